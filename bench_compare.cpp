@@ -0,0 +1,322 @@
+// Compares two result files written by "bench --json".
+//
+// Results are matched by (impl, function, variant, bits). For every pair
+// the change of the median ns/op is reported together with the p-value of
+// a two-sided Mann-Whitney U test over the samples of both runs. A result
+// counts as a regression if it is slower by more than --threshold percent
+// and the difference is significant (p < --alpha).
+//
+// Both sides can be given as a comma-separated list of files (e.g. one
+// per round of bench_regress.sh), their samples are merged.
+//
+// build: make bench_compare
+// usage: ./bench_compare [--threshold PCT] [--alpha P] [--all]
+//                        baseline.json[,...] candidate.json[,...]
+//
+// exit status: 0 = no regressions, 1 = usage/input error, 2 = regressions
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// minimal JSON reader (enough for the files bench writes)
+struct Json {
+  enum Type { NIL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NIL;
+  bool boolean = false;
+  double number = 0;
+  std::string str;
+  std::vector<Json> items;
+  std::map<std::string, Json> fields;
+
+  const Json* get(const std::string &key) const {
+    auto it = fields.find(key);
+    return it == fields.end() ? nullptr : &it->second;
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string &text) : s_(text) {}
+
+  bool parse(Json *out) {
+    if (!value(out)) return false;
+    skip_ws();
+    return pos_ == s_.size();
+  }
+
+ private:
+  void skip_ws() {
+    while (pos_ < s_.size() && strchr(" \t\r\n", s_[pos_])) pos_++;
+  }
+
+  bool literal(const char *lit) {
+    size_t n = strlen(lit);
+    if (s_.compare(pos_, n, lit) != 0) return false;
+    pos_ += n;
+    return true;
+  }
+
+  bool string(std::string *out) {
+    if (s_[pos_] != '"') return false;
+    pos_++;
+    while (pos_ < s_.size() && s_[pos_] != '"') {
+      char c = s_[pos_++];
+      if (c == '\\') {
+        if (pos_ >= s_.size()) return false;
+        c = s_[pos_++];
+        if (c == 'n') c = '\n';
+        else if (c == 't') c = '\t';
+        else if (c == 'u') return false;  // not written by bench
+      }
+      out->push_back(c);
+    }
+    if (pos_ >= s_.size()) return false;
+    pos_++;
+    return true;
+  }
+
+  bool value(Json *out) {
+    skip_ws();
+    if (pos_ >= s_.size()) return false;
+
+    char c = s_[pos_];
+    if (c == '{') {
+      out->type = Json::OBJECT;
+      pos_++;
+      skip_ws();
+      if (s_[pos_] == '}') return ++pos_;
+      for (;;) {
+        std::string key;
+        skip_ws();
+        if (!string(&key)) return false;
+        skip_ws();
+        if (s_[pos_++] != ':') return false;
+        if (!value(&out->fields[key])) return false;
+        skip_ws();
+        if (s_[pos_] == ',') { pos_++; continue; }
+        if (s_[pos_] == '}') return ++pos_;
+        return false;
+      }
+    }
+    if (c == '[') {
+      out->type = Json::ARRAY;
+      pos_++;
+      skip_ws();
+      if (s_[pos_] == ']') return ++pos_;
+      for (;;) {
+        out->items.emplace_back();
+        if (!value(&out->items.back())) return false;
+        skip_ws();
+        if (s_[pos_] == ',') { pos_++; continue; }
+        if (s_[pos_] == ']') return ++pos_;
+        return false;
+      }
+    }
+    if (c == '"') {
+      out->type = Json::STRING;
+      return string(&out->str);
+    }
+    if (literal("true")) { out->type = Json::BOOL; out->boolean = true; return true; }
+    if (literal("false")) { out->type = Json::BOOL; return true; }
+    if (literal("null")) return true;
+
+    char *end;
+    out->type = Json::NUMBER;
+    out->number = strtod(s_.c_str() + pos_, &end);
+    if (end == s_.c_str() + pos_) return false;
+    pos_ = end - s_.c_str();
+    return true;
+  }
+
+  const std::string &s_;
+  size_t pos_ = 0;
+};
+
+struct Run {
+  std::string library;
+  // (impl, function, variant, bits) -> ns/op samples
+  std::map<std::tuple<std::string, std::string, std::string, size_t>,
+           std::vector<double>> samples;
+};
+
+bool load(const char *path, Run *run) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  std::string text;
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+  fclose(f);
+
+  Json root;
+  if (!JsonParser(text).parse(&root) || root.type != Json::OBJECT) {
+    fprintf(stderr, "%s: not a bench result file\n", path);
+    return false;
+  }
+
+  const Json *lib = root.get("library");
+  run->library = lib ? lib->str : "?";
+
+  const Json *results = root.get("results");
+  if (!results || results->type != Json::ARRAY) {
+    fprintf(stderr, "%s: no results\n", path);
+    return false;
+  }
+  for (const Json &r : results->items) {
+    const Json *impl = r.get("impl"), *fn = r.get("function");
+    const Json *variant = r.get("variant"), *bits = r.get("bits");
+    const Json *ns = r.get("ns_per_op");
+    if (!impl || !fn || !variant || !bits || !ns) continue;
+
+    auto &v = run->samples[std::make_tuple(impl->str, fn->str, variant->str,
+                                           static_cast<size_t>(bits->number))];
+    for (const Json &x : ns->items) v.push_back(x.number);
+  }
+  return true;
+}
+
+// load a comma-separated list of files into one run
+bool load_all(const std::string &paths, Run *run) {
+  size_t start = 0;
+  for (;;) {
+    size_t end = paths.find(',', start);
+    std::string path = paths.substr(start, end - start);
+    if (!load(path.c_str(), run)) return false;
+    if (end == std::string::npos) return true;
+    start = end + 1;
+  }
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// two-sided p-value of the Mann-Whitney U test
+// (normal approximation with tie and continuity correction)
+double mann_whitney_p(const std::vector<double> &a,
+                      const std::vector<double> &b) {
+  size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+  if (!n1 || !n2) return 1;
+
+  std::vector<std::pair<double, int>> all;
+  for (double x : a) all.push_back({x, 0});
+  for (double x : b) all.push_back({x, 1});
+  std::sort(all.begin(), all.end());
+
+  // rank sum of a (average ranks for ties)
+  double rank_sum = 0, tie_term = 0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && all[j].first == all[i].first) j++;
+    double t = j - i;
+    double avg_rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++) {
+      if (all[k].second == 0) rank_sum += avg_rank;
+    }
+    tie_term += t * t * t - t;
+    i = j;
+  }
+
+  double u = rank_sum - n1 * (n1 + 1) / 2.0;
+  double mu = n1 * n2 / 2.0;
+  double var = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1.0)));
+  if (var <= 0) return 1;
+
+  double z = std::max(0.0, std::fabs(u - mu) - 0.5) / std::sqrt(var);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [--threshold PCT] [--alpha P] [--all] "
+                  "baseline.json[,...] candidate.json[,...]\n", prog);
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  double threshold = 5;  // percent
+  double alpha = 0.05;
+  bool all = false;
+  std::vector<const char*> files;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--alpha") && i + 1 < argc) {
+      alpha = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--all")) {
+      all = true;
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.size() != 2) usage(argv[0]);
+
+  Run base, cand;
+  if (!load_all(files[0], &base) || !load_all(files[1], &cand)) return 1;
+
+  printf("baseline:  %s (%s)\ncandidate: %s (%s)\n"
+         "threshold: %.1f%%, alpha: %g\n\n", files[0], base.library.c_str(),
+         files[1], cand.library.c_str(), threshold, alpha);
+  printf("%-9s %-28s %-12s %12s %12s %12s %8s %9s  %s\n", "impl", "function",
+         "variant", "bits", "base ns/op", "cand ns/op", "change", "p", "");
+
+  // (results only one run has, e.g. functions the other tree doesn't
+  // have yet, are counted but not compared)
+  size_t n_regressions = 0, n_improvements = 0, n_compared = 0;
+  size_t n_unmatched = 0;
+  for (const auto &entry : cand.samples) {
+    n_unmatched += !base.samples.count(entry.first);
+  }
+  for (const auto &entry : base.samples) {
+    auto it = cand.samples.find(entry.first);
+    if (it == cand.samples.end()) {
+      n_unmatched++;
+      continue;
+    }
+    n_compared++;
+
+    double m_base = median(entry.second);
+    double m_cand = median(it->second);
+    double change = 100 * (m_cand - m_base) / m_base;
+    double p = mann_whitney_p(entry.second, it->second);
+
+    const char *verdict = "";
+    if (p < alpha && change > threshold) {
+      verdict = "REGRESSION";
+      n_regressions++;
+    } else if (p < alpha && change < -threshold) {
+      verdict = "improvement";
+      n_improvements++;
+    }
+    if (!all && !*verdict) continue;
+
+    printf("%-9s %-28s %-12s %12zu %12.2f %12.2f %+7.1f%% %9.4f  %s\n",
+           std::get<0>(entry.first).c_str(), std::get<1>(entry.first).c_str(),
+           std::get<2>(entry.first).c_str(), std::get<3>(entry.first),
+           m_base, m_cand, change, p, verdict);
+  }
+
+  printf("\n%zu results compared, %zu regressions, %zu improvements, "
+         "%zu results of only one run not compared\n", n_compared,
+         n_regressions, n_improvements, n_unmatched);
+
+  return n_regressions ? 2 : 0;
+}
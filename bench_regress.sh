@@ -0,0 +1,65 @@
+#!/bin/sh
+# Benchmarks two checkouts of this repo and reports significant slowdowns
+# of the candidate against the baseline.
+#
+# usage: ./bench_regress.sh BASELINE_DIR CANDIDATE_DIR [bench options]
+#
+# bench is built in each directory from that tree's own bitarray_bench.cpp
+# and runs against that tree's libbitarray.so (make bench builds both), so
+# the two sides may differ in their API and in the layout of bitarray.
+# Only the results both runs have (same impl, function, variant and size)
+# are compared; functions that only one tree has are reported as not
+# compared. Both trees need a bench with --json (this script's version of
+# the repo or later). The runs are pinned to one cpu (BENCH_CPU, default
+# 0) and alternate between the two trees (BENCH_ROUNDS rounds, default 2)
+# so slow drifts of the machine affect both sides equally. The results of
+# round i are written to baseline.i.json and candidate.i.json (in
+# BENCH_OUT, default .) and the samples of all rounds are compared by
+# bench_compare; the exit status is the one of bench_compare (2 if there
+# are regressions). Extra options are passed to bench, e.g.
+#
+#   ./bench_regress.sh ../bitarray-v1 . --filter count,and_bits --max-log2 24
+
+set -e
+
+if [ $# -lt 2 ]; then
+  sed -n '2,/^$/s/^# \{0,1\}//p' "$0"
+  exit 1
+fi
+
+here=$(cd "$(dirname "$0")" && pwd)
+base=$(cd "$1" && pwd)
+cand=$(cd "$2" && pwd)
+shift 2
+
+for dir in "$base" "$cand"; do
+  if [ ! -f "$dir/bitarray_bench.cpp" ]; then
+    echo "$dir/bitarray_bench.cpp not found (no benchmark in that tree)" >&2
+    exit 1
+  fi
+  echo "building $dir/bench"
+  make -s -C "$dir" bench
+done
+
+cpu=${BENCH_CPU:-0}
+rounds=${BENCH_ROUNDS:-2}
+out=$(cd "${BENCH_OUT:-.}" && pwd)
+
+make -s -C "$here" bench_compare
+
+base_files=""
+cand_files=""
+i=1
+while [ "$i" -le "$rounds" ]; do
+  echo "round $i/$rounds: baseline ($base)"
+  LD_LIBRARY_PATH="$base" "$base/bench" --no-baselines --reps 10 --cpu "$cpu" \
+    --json "$out/baseline.$i.json" "$@" > /dev/null
+  echo "round $i/$rounds: candidate ($cand)"
+  LD_LIBRARY_PATH="$cand" "$cand/bench" --no-baselines --reps 10 --cpu "$cpu" \
+    --json "$out/candidate.$i.json" "$@" > /dev/null
+  base_files="$base_files${base_files:+,}$out/baseline.$i.json"
+  cand_files="$cand_files${cand_files:+,}$out/candidate.$i.json"
+  i=$((i + 1))
+done
+
+"$here/bench_compare" "$base_files" "$cand_files"
@@ -0,0 +1,2349 @@
+// Benchmark program for the bitarray library.
+//
+// Every public function of libbitarray.h is timed over a sweep of sizes
+// (64 bits up to 2^max_log2 bits), bit densities and range alignments.
+// Results are reported as ns/op and GB/s; if the kernel allows it,
+// cycles and cache misses per op are read through perf_event_open.
+// std::bitset and std::vector<bool> are timed on the same operations
+// as baselines.
+//
+// build: make bench
+// Each measurement is repeated (--reps) after warmup runs (--warmup) and
+// the median is reported; with --json all samples are written to a file
+// that bench_compare can compare against the results of another build
+// (see bench_regress.sh).
+//
+// usage: ./bench [--min-log2 N] [--max-log2 N] [--step N] [--min-time S]
+//                [--filter SUBSTR[,SUBSTR...]] [--no-baselines] [--no-perf]
+//                [--reps N] [--warmup N] [--cpu N] [--json FILE]
+
+#include <algorithm>
+#include <bitset>
+#include <queue>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libbitarray.h"
+#include "bsi.h"
+#include "bloom.h"
+#include "bitmap_index.h"
+#include "bitmatrix.h"
+#include "hamming.h"
+#include "paged_bitarray.h"
+#include "cow_bitarray.h"
+#include "bitarray_map.h"
+#include "shm_bitarray.h"
+#include "id_allocator.h"
+#include "ring_bitarray.h"
+#include "elias_fano.h"
+
+namespace {
+
+struct Options {
+  unsigned min_log2 = 6;
+  unsigned max_log2 = 30;
+  unsigned step = 2;
+  double min_time = 0.05;  // seconds per measurement
+  std::string filter;
+  bool baselines = true;
+  bool perf = true;
+  unsigned reps = 5;    // kept samples per measurement
+  unsigned warmup = 1;  // discarded samples per measurement
+  int cpu = -1;         // pin the benchmark to this cpu
+  std::string json;     // write results to this file
+};
+
+Options opts;
+
+// keeps the compiler from optimizing benchmarked calls away
+volatile uint64_t sink;
+
+// xorshift64* (fast enough to fill multi-GB arrays)
+struct Rng {
+  uint64_t s;
+  explicit Rng(uint64_t seed) : s(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+  uint64_t next() {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1DULL;
+  }
+};
+
+// hardware counters through perf_event_open;
+// silently disabled if the kernel doesn't allow it
+class PerfCounters {
+ public:
+  PerfCounters() {
+    if (!opts.perf) return;
+    leader_ = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader_ < 0) return;
+    misses_ = open_counter(PERF_COUNT_HW_CACHE_MISSES, leader_);
+    if (misses_ < 0) {
+      close(leader_);
+      leader_ = -1;
+    }
+  }
+
+  ~PerfCounters() {
+    if (misses_ >= 0) close(misses_);
+    if (leader_ >= 0) close(leader_);
+  }
+
+  bool available() const { return leader_ >= 0; }
+
+  void start() {
+    if (!available()) return;
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // returns false if the counters couldn't be read
+  bool stop(uint64_t *cycles, uint64_t *misses) {
+    if (!available()) return false;
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // layout for PERF_FORMAT_GROUP: nr, values[nr]
+    uint64_t buf[3];
+    if (read(leader_, buf, sizeof(buf)) != sizeof(buf)) return false;
+    *cycles = buf[1];
+    *misses = buf[2];
+    return true;
+  }
+
+ private:
+  static int open_counter(uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+  }
+
+  int leader_ = -1;
+  int misses_ = -1;
+};
+
+PerfCounters *perf;
+
+double now_sec() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// result of one measurement (one sample per repetition)
+struct Result {
+  std::string impl, name, variant;
+  size_t n_bits;
+  size_t iters;             // calls per sample
+  double bytes_per_op;
+  std::vector<double> ns;   // ns/op of every sample
+  std::vector<double> cycles, misses;  // per op (empty without perf)
+};
+
+std::vector<Result> results;
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// print one result line (medians of the samples) and keep the
+// result for the JSON output
+void record(Result r) {
+  double ns_per_op = median(r.ns);
+  double gbps = r.bytes_per_op / ns_per_op;  // bytes/ns == GB/s
+
+  // spread of the samples relative to the median
+  auto minmax = std::minmax_element(r.ns.begin(), r.ns.end());
+  double spread = 100 * (*minmax.second - *minmax.first) / ns_per_op;
+
+  printf("%-9s %-28s %-12s %12zu %14.2f %9.2f %7.1f", r.impl.c_str(),
+         r.name.c_str(), r.variant.c_str(), r.n_bits, ns_per_op, gbps,
+         spread);
+  if (!r.cycles.empty()) {
+    printf(" %12.1f %11.2f\n", median(r.cycles), median(r.misses));
+  } else {
+    printf(" %12s %11s\n", "-", "-");
+  }
+  fflush(stdout);
+
+  results.push_back(std::move(r));
+}
+
+// time op (one call == one operation): calibrate the number of calls so
+// one sample takes about opts.min_time seconds, run opts.warmup samples
+// that are thrown away and opts.reps samples that are kept;
+// bytes_per_op is the amount of bitarray memory one call touches
+Result run_measurement(const char *impl, const std::string &name,
+                       const std::string &variant, size_t n_bits,
+                       double bytes_per_op, const std::function<void()> &op) {
+  // calibrate the number of iterations (also warms caches/TLB)
+  size_t iters = 1;
+  for (;;) {
+    double t0 = now_sec();
+    for (size_t i = 0; i < iters; i++) op();
+    double elapsed = now_sec() - t0;
+    if (elapsed >= opts.min_time / 4) {
+      double scale = opts.min_time / (elapsed > 0 ? elapsed : 1e-9);
+      iters = std::max<size_t>(1, static_cast<size_t>(iters * scale));
+      break;
+    }
+    iters *= 4;
+  }
+
+  Result r{impl, name, variant, n_bits, iters, bytes_per_op, {}, {}, {}};
+  for (unsigned rep = 0; rep < opts.warmup + opts.reps; rep++) {
+    uint64_t cycles = 0, misses = 0;
+    perf->start();
+    double t0 = now_sec();
+    for (size_t i = 0; i < iters; i++) op();
+    double elapsed = now_sec() - t0;
+    bool have_perf = perf->stop(&cycles, &misses);
+
+    if (rep < opts.warmup) continue;
+    r.ns.push_back(elapsed * 1e9 / iters);
+    if (have_perf) {
+      r.cycles.push_back(static_cast<double>(cycles) / iters);
+      r.misses.push_back(static_cast<double>(misses) / iters);
+    }
+  }
+
+  return r;
+}
+
+void measure(const char *impl, const std::string &name,
+             const std::string &variant, size_t n_bits,
+             double bytes_per_op, const std::function<void()> &op) {
+  record(run_measurement(impl, name, variant, n_bits, bytes_per_op, op));
+}
+
+// --filter takes a comma-separated list of substrings
+bool selected(const std::string &name) {
+  if (opts.filter.empty()) return true;
+
+  size_t start = 0;
+  for (;;) {
+    size_t end = opts.filter.find(',', start);
+    std::string part = opts.filter.substr(start, end - start);
+    if (!part.empty() && name.find(part) != std::string::npos) return true;
+    if (end == std::string::npos) return false;
+    start = end + 1;
+  }
+}
+
+size_t array_bytes(size_t n_bits) {
+  return __bitarray_size(n_bits) * TYPE_SIZE;
+}
+
+// fill words with bits of the given density
+// (0: ~1/64, 1: ~1/2, 2: ~63/64)
+void fill_density(ARRAY_TYPE *words, size_t n_words, size_t n_bits,
+                  int density, uint64_t seed) {
+  Rng rng(seed);
+  for (size_t i = 0; i < n_words; i++) {
+    uint64_t w = rng.next();
+    if (density == 0) {
+      for (int k = 0; k < 5; k++) w &= rng.next();
+    } else if (density == 2) {
+      for (int k = 0; k < 5; k++) w |= rng.next();
+    }
+    words[i] = w;
+  }
+
+  // keep the bits after n_bits cleared
+  size_t used = n_bits / BITS_PER_EL;
+  if (used < n_words) {
+    words[used] &= (MASK_1 << (n_bits % BITS_PER_EL)) - 1;
+    for (size_t i = used + 1; i < n_words; i++) words[i] = 0;
+  }
+}
+
+const char *density_name(int density) {
+  static const char *names[] = {"sparse", "half", "dense"};
+  return names[density];
+}
+
+struct BitarrayDeleter {
+  void operator()(bitarray *b) const { if (b) delete_bitarray(b); }
+};
+using BitarrayPtr = std::unique_ptr<bitarray, BitarrayDeleter>;
+
+BitarrayPtr random_bitarray(size_t n_bits, int density, uint64_t seed) {
+  BitarrayPtr b(create_bitarray(n_bits));
+  fill_density(b->array, b->_array_size, n_bits, density, seed);
+  return b;
+}
+
+// range [from, to) used for the "range" variants
+struct Range {
+  const char *name;
+  size_t from, to;
+};
+
+std::vector<Range> ranges_for(size_t n_bits) {
+  std::vector<Range> r;
+  r.push_back({"aligned", 0, n_bits & ~(BITS_PER_EL - 1)});
+  if (n_bits > 2 * BITS_PER_EL) {
+    r.push_back({"unaligned", 3, n_bits - 5});
+  }
+  // a short range crossing one word boundary
+  if (n_bits >= 2 * BITS_PER_EL) {
+    r.push_back({"short", BITS_PER_EL - 9, BITS_PER_EL + 8});
+  }
+  return r;
+}
+
+// random positions (power-of-two sized table, indexed with a mask)
+std::vector<size_t> random_positions(size_t n_bits, size_t count,
+                                     uint64_t seed) {
+  Rng rng(seed);
+  std::vector<size_t> pos(count);
+  for (auto &p : pos) p = rng.next() % n_bits;
+  return pos;
+}
+
+constexpr size_t POS_COUNT = 1 << 12;
+
+// std::vector<bool> gets filled/compared element by element,
+// which takes too long for the largest sizes of the sweep
+constexpr unsigned BASELINE_MAX_LOG2 = 28;
+
+// a benchmark case is run once per size of the sweep;
+// sizes above max_log2 are skipped (for functions that are
+// too slow to be measured on huge arrays)
+struct Case {
+  const char *name;
+  unsigned max_log2;
+  std::function<void(const char *name, size_t n_bits)> run;
+};
+
+// single-bit access at random positions
+template <typename F>
+void single_bit_case(const char *name, size_t n_bits, F f) {
+  BitarrayPtr b = random_bitarray(n_bits, 1, 1);
+  std::vector<size_t> pos = random_positions(n_bits, POS_COUNT, 2);
+  size_t i = 0;
+  measure("bitarray", name, "random", n_bits, sizeof(ARRAY_TYPE), [&] {
+    f(b.get(), pos[i++ & (POS_COUNT - 1)]);
+  });
+}
+
+// batches of random positions: POS_COUNT positions and one position per
+// 64 bits (up to 2^24 positions); the baseline makes one single-bit call
+// per position
+template <typename F, typename G>
+void batch_case(const char *name, size_t n_bits, F batch, G single) {
+  BitarrayPtr b = random_bitarray(n_bits, 1, 1);
+  size_t counts[] = {POS_COUNT, std::min<size_t>(n_bits / 64, 1 << 24)};
+  for (size_t count : counts) {
+    if (count < POS_COUNT || (count == POS_COUNT && count != counts[0])) {
+      continue;
+    }
+    std::vector<size_t> pos = random_positions(n_bits, count, 2);
+    const char *variant = count == POS_COUNT ? "4096" : "n/64";
+    double bytes = count * sizeof(ARRAY_TYPE);
+    measure("bitarray", name, variant, n_bits, bytes, [&] {
+      batch(b.get(), pos.data(), count);
+    });
+    if (!opts.baselines) continue;
+    measure("naive", name, variant, n_bits, bytes, [&] {
+      for (size_t p : pos) single(b.get(), p);
+    });
+  }
+}
+
+template <typename F>
+void range_case(const char *name, size_t n_bits, F f) {
+  BitarrayPtr b = random_bitarray(n_bits, 1, 1);
+  for (const Range &r : ranges_for(n_bits)) {
+    if (r.to <= r.from) continue;
+    double bytes = (r.to - r.from) / 8.0;
+    measure("bitarray", name, r.name, n_bits, bytes, [&] {
+      f(b.get(), r.from, r.to);
+    });
+  }
+}
+
+template <typename F>
+void whole_case(const char *name, size_t n_bits, F f) {
+  BitarrayPtr b = random_bitarray(n_bits, 1, 1);
+  measure("bitarray", name, "-", n_bits, array_bytes(n_bits), [&] {
+    f(b.get());
+  });
+}
+
+template <typename F>
+void density_case(const char *name, size_t n_bits, F f) {
+  for (int d = 0; d < 3; d++) {
+    BitarrayPtr b = random_bitarray(n_bits, d, 1);
+    measure("bitarray", name, density_name(d), n_bits, array_bytes(n_bits),
+            [&] { f(b.get()); });
+  }
+}
+
+template <typename F>
+void binary_case(const char *name, size_t n_bits, F f) {
+  BitarrayPtr l = random_bitarray(n_bits, 1, 1);
+  BitarrayPtr r = random_bitarray(n_bits, 1, 2);
+  measure("bitarray", name, "-", n_bits, 2.0 * array_bytes(n_bits), [&] {
+    f(l.get(), r.get());
+  });
+}
+
+template <typename F>
+void shift_case(const char *name, size_t n_bits, F f) {
+  BitarrayPtr b = random_bitarray(n_bits, 1, 1);
+  const size_t shifts[] = {1, BITS_PER_EL, n_bits / 3};
+  const char *names[] = {"by1", "by64", "byn/3"};
+  for (int k = 0; k < 3; k++) {
+    size_t n = shifts[k];
+    if (!n || n >= n_bits) continue;
+    measure("bitarray", name, names[k], n_bits, array_bytes(n_bits), [&] {
+      f(b.get(), n);
+    });
+  }
+}
+
+// data structures built on bitarrays; their baselines are registered as
+// impl "scan" (a plain scan over the same data) or "naive" (the same
+// structure on top of the single-bit functions)
+
+using BsiPtr = std::unique_ptr<bsi, void (*)(bsi*)>;
+
+// random 32 bit column plus its index
+struct BsiColumn {
+  std::vector<uint64_t> values;
+  BsiPtr index{nullptr, delete_bsi};
+
+  explicit BsiColumn(size_t n_rows) : values(n_rows) {
+    Rng rng(5);
+    for (auto &v : values) v = rng.next() >> 32;
+    index.reset(create_bsi(values.data(), n_rows));
+  }
+};
+
+void add_bsi_cases(std::vector<Case> &c) {
+  // ~1% and ~50% of the rows match
+  c.push_back({"bsi_between", 24, [](const char *name, size_t n) {
+    BsiColumn col(n);
+    const uint64_t bounds[][2] = {{1ULL << 31, (1ULL << 31) + (1ULL << 25)},
+                                  {1ULL << 30, 3ULL << 30}};
+    const char *names[] = {"1%", "50%"};
+    for (int k = 0; k < 2; k++) {
+      uint64_t lo = bounds[k][0], hi = bounds[k][1];
+      measure("bitarray", name, names[k], n, 32 * array_bytes(n), [&] {
+        delete_bitarray(bsi_between(col.index.get(), lo, hi));
+      });
+      if (!opts.baselines) continue;
+      measure("scan", name, names[k], n, 8.0 * n, [&] {
+        bitarray *res = create_bitarray(n);
+        const uint64_t *v = col.values.data();
+        for (size_t w = 0; w * BITS_PER_EL < n; w++) {
+          ARRAY_TYPE word = 0;
+          size_t end = std::min(n - w * BITS_PER_EL, BITS_PER_EL);
+          for (size_t i = 0; i < end; i++) {
+            // lo <= x <= hi without branches
+            uint64_t x = v[w * BITS_PER_EL + i] - lo;
+            word |= (ARRAY_TYPE) (x <= hi - lo) << i;
+          }
+          res->array[w] = word;
+        }
+        delete_bitarray(res);
+      });
+    }
+  }});
+  c.push_back({"bsi_sum", 24, [](const char *name, size_t n) {
+    BsiColumn col(n);
+    BitarrayPtr filter = random_bitarray(n, 1, 6);
+    measure("bitarray", name, "filtered", n, 33 * array_bytes(n), [&] {
+      sink += bsi_sum(col.index.get(), filter.get());
+    });
+    measure("bitarray", name, "all", n, 32 * array_bytes(n), [&] {
+      sink += bsi_sum(col.index.get(), nullptr);
+    });
+    if (!opts.baselines) return;
+    measure("scan", name, "filtered", n, 8.0 * n + array_bytes(n), [&] {
+      const uint64_t *v = col.values.data();
+      const ARRAY_TYPE *f = filter->array;
+      uint64_t sum = 0;
+      for (size_t i = 0; i < n; i++) {
+        sum += v[i] & -((f[i / BITS_PER_EL] >> (i % BITS_PER_EL)) & 1);
+      }
+      sink += sum;
+    });
+    measure("scan", name, "all", n, 8.0 * n, [&] {
+      uint64_t sum = 0;
+      for (size_t i = 0; i < n; i++) sum += col.values[i];
+      sink += sum;
+    });
+  }});
+  c.push_back({"bsi_top_k", 24, [](const char *name, size_t n) {
+    BsiColumn col(n);
+    BitarrayPtr filter = random_bitarray(n, 1, 6);
+    const size_t k = 100;
+    measure("bitarray", name, "k=100", n, 33 * array_bytes(n), [&] {
+      delete_bitarray(bsi_top_k(col.index.get(), filter.get(), k));
+    });
+    if (!opts.baselines) return;
+    // min-heap of the k largest (value, row) pairs
+    measure("scan", name, "k=100", n, 8.0 * n + array_bytes(n), [&] {
+      std::priority_queue<std::pair<uint64_t, size_t>,
+                          std::vector<std::pair<uint64_t, size_t>>,
+                          std::greater<std::pair<uint64_t, size_t>>> heap;
+      for (size_t i = 0; i < n; i++) {
+        if (!((filter->array[i / BITS_PER_EL] >> (i % BITS_PER_EL)) & 1)) {
+          continue;
+        }
+        if (heap.size() < k) {
+          heap.push({col.values[i], i});
+        } else if (col.values[i] > heap.top().first) {
+          heap.pop();
+          heap.push({col.values[i], i});
+        }
+      }
+      bitarray *res = create_bitarray(n);
+      for (; !heap.empty(); heap.pop()) set_bit(res, heap.top().second);
+      delete_bitarray(res);
+    });
+  }});
+}
+
+// filters of n bits with n / 10 keys inserted (k = 7 is optimal for 10
+// bits per key); one op probes a batch of POS_COUNT keys, the variant
+// names the layout and the false-positive rate measured on the keys of
+// the batch (none of which were inserted)
+void add_bloom_cases(std::vector<Case> &c) {
+  auto run = [](const char *name, size_t n, bool insert) {
+    const uint8_t k = 7;
+    std::vector<uint64_t> batch(POS_COUNT);
+    Rng rng(8);
+    for (auto &key : batch) key = rng.next();
+    BitarrayPtr out(create_bitarray(POS_COUNT));
+
+    for (int blocked = 0; blocked < 2; blocked++) {
+      bloom_filter *filter = create_bloom_filter(n, k, blocked);
+      std::vector<uint64_t> keys(n / 10);
+      Rng key_rng(7);
+      for (auto &key : keys) key = key_rng.next();
+      bloom_insert_many(filter, keys.data(), keys.size());
+
+      bloom_contains_many(filter, batch.data(), POS_COUNT, out.get());
+      char variant[64];
+      snprintf(variant, sizeof(variant), "%s/fpr=%.2f%%",
+               blocked ? "blocked" : "plain",
+               100.0 * count_bits(out.get()) / POS_COUNT);
+
+      if (insert) {
+        measure("bitarray", name, variant, n, 8.0 * POS_COUNT, [&] {
+          bloom_insert_many(filter, batch.data(), POS_COUNT);
+        });
+      } else {
+        measure("bitarray", name, variant, n, 8.0 * POS_COUNT, [&] {
+          bloom_contains_many(filter, batch.data(), POS_COUNT, out.get());
+        });
+        // the same probes one key at a time (no batching/prefetching)
+        measure("bitarray", "bloom_contains", variant, n, 8.0 * POS_COUNT,
+                [&] {
+          for (uint64_t key : batch) sink += bloom_contains(filter, key);
+        });
+      }
+      delete_bloom_filter(filter);
+    }
+
+    if (!opts.baselines) return;
+    // plain layout on top of get_bit/set_bit (k calls per key)
+    BitarrayPtr bits(create_bitarray(n));
+    auto probe = [n](uint64_t key, uint8_t i) {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ULL;
+      key ^= key >> 33;
+      uint64_t step = ((key >> 32) | (key << 32)) | 1;
+      return static_cast<size_t>(
+        (static_cast<unsigned __int128>(key + i * step) * n) >> 64);
+    };
+    Rng key_rng(7);
+    for (size_t j = 0; j < n / 10; j++) {
+      uint64_t key = key_rng.next();
+      for (uint8_t i = 0; i < k; i++) set_bit(bits.get(), probe(key, i));
+    }
+    if (insert) {
+      measure("naive", name, "plain", n, 8.0 * POS_COUNT, [&] {
+        for (uint64_t key : batch) {
+          for (uint8_t i = 0; i < k; i++) set_bit(bits.get(), probe(key, i));
+        }
+      });
+    } else {
+      measure("naive", name, "plain", n, 8.0 * POS_COUNT, [&] {
+        for (uint64_t key : batch) {
+          bool found = true;
+          for (uint8_t i = 0; i < k && found; i++) {
+            found = get_bit(bits.get(), probe(key, i));
+          }
+          sink += found;
+        }
+      });
+    }
+  };
+
+  c.push_back({"bloom_insert_many", 28, [run](const char *name, size_t n) {
+    if (n >= 1 << 10) run(name, n, true);
+  }});
+  c.push_back({"bloom_contains_many", 28, [run](const char *name, size_t n) {
+    if (n >= 1 << 10) run(name, n, false);
+  }});
+}
+
+// index over n documents with 32 keys "t0" to "t31" of Zipf-like
+// frequencies (key t is in ~1/2^(1 + t/2) of the documents); the variant
+// names the query, one op evaluates it
+void add_bitmap_index_cases(std::vector<Case> &c) {
+  static const struct {
+    const char *variant, *query;
+    size_t n_keys;
+  } queries[] = {
+    {"and", "t0 AND t1 AND t30", 3},
+    {"and_not", "(t0 OR t1) AND t20 AND NOT t2", 4},
+    {"or", "t2 OR t4 OR t8 OR t16", 4},
+  };
+
+  c.push_back({"bitmap_index_query", 24, [](const char *name, size_t n) {
+    bitmap_index *index = create_bitmap_index(n);
+    BitarrayPtr bits(create_bitarray(n));
+    Rng rng(9);
+    for (int t = 0; t < 32; t++) {
+      for (size_t i = 0; i < bits->_array_size; i++) {
+        uint64_t w = rng.next();
+        for (int k = 0; k < t / 2; k++) w &= rng.next();
+        bits->array[i] = w;
+      }
+      size_t used = n / BITS_PER_EL;
+      bits->array[used] &= (MASK_1 << (n % BITS_PER_EL)) - 1;
+      char key[8];
+      snprintf(key, sizeof(key), "t%d", t);
+      bitmap_index_put(index, key, bits.get());
+    }
+
+    for (const auto &q : queries) {
+      bitmap_query *query = parse_bitmap_query(q.query);
+      measure("bitarray", name, q.variant, n, q.n_keys * array_bytes(n),
+              [&] {
+        delete_bitarray(bitmap_index_query(index, query));
+      });
+      if (opts.baselines) {
+        // one new bitarray per operator, evaluated in the written order
+        std::function<bitarray*(bitmap_query*)> eval =
+            [&](bitmap_query *node) -> bitarray* {
+          if (node->op == BITMAP_QUERY_KEY) {
+            return copy_bitarray(bitmap_index_get(index, node->key));
+          }
+          bitarray *res = eval(node->children[0]);
+          if (node->op == BITMAP_QUERY_NOT) {
+            bitarray *tmp = not_bits(res);
+            delete_bitarray(res);
+            return tmp;
+          }
+          for (size_t i = 1; i < node->n_children; i++) {
+            bitarray *child = eval(node->children[i]);
+            bitarray *tmp = node->op == BITMAP_QUERY_AND
+                            ? and_bits(res, child) : or_bits(res, child);
+            delete_bitarray(child);
+            delete_bitarray(res);
+            res = tmp;
+          }
+          return res;
+        };
+        measure("naive", name, q.variant, n, q.n_keys * array_bytes(n), [&] {
+          delete_bitarray(eval(query));
+        });
+      }
+      delete_bitmap_query(query);
+    }
+    delete_bitmap_index(index);
+  }});
+}
+
+// square matrices of n bits (only even log2(n), 64x64 and up); the
+// baselines work on an array of bitarray rows, bit by bit (get_bit/
+// set_bit) or row by row (xor_bits_inplace/or_bits_inplace)
+struct BitmatrixDeleter {
+  void operator()(bitmatrix *m) const { if (m) delete_bitmatrix(m); }
+};
+using BitmatrixPtr = std::unique_ptr<bitmatrix, BitmatrixDeleter>;
+
+struct MatrixCase {
+  size_t side;
+  BitmatrixPtr m;
+  std::vector<BitarrayPtr> rows;
+  std::vector<bitarray*> row_ptrs;
+
+  MatrixCase(size_t n, uint64_t seed) : side(1) {
+    while (side * side < n) side *= 2;
+    m.reset(create_bitmatrix(side, side));
+    for (size_t i = 0; i < side; i++) {
+      bitarray row = bitmatrix_row(m.get(), i);
+      fill_density(row.array, row._array_size, side, 1, seed + i);
+    }
+  }
+
+  // the rows as bitarrays (for the baselines)
+  void make_rows() {
+    for (size_t i = 0; i < side; i++) {
+      bitarray row = bitmatrix_row(m.get(), i);
+      rows.emplace_back(create_bitarray(side));
+      copy_all_bits(&row, rows.back().get());
+      row_ptrs.push_back(rows.back().get());
+    }
+  }
+};
+
+bool matrix_size(size_t n) {
+  unsigned log2 = 63 - __builtin_clzll(n);
+  return log2 >= 12 && log2 % 2 == 0;
+}
+
+void add_bitmatrix_cases(std::vector<Case> &c) {
+  c.push_back({"bitmatrix_transpose", 32, [](const char *name, size_t n) {
+    if (!matrix_size(n)) return;
+    MatrixCase mc(n, 10);
+    measure("bitarray", name, "square", n, 2 * array_bytes(n), [&] {
+      delete_bitmatrix(bitmatrix_transpose(mc.m.get()));
+    });
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) return;
+    mc.make_rows();
+    measure("naive", name, "square", n, 2 * array_bytes(n), [&] {
+      std::vector<BitarrayPtr> t;
+      for (size_t j = 0; j < mc.side; j++) {
+        t.emplace_back(create_bitarray(mc.side));
+      }
+      for (size_t i = 0; i < mc.side; i++) {
+        for (size_t j = 0; j < mc.side; j++) {
+          if (get_bit(mc.row_ptrs[i], j)) set_bit(t[j].get(), i);
+        }
+      }
+    });
+  }});
+
+  c.push_back({"bitmatrix_col_counts", 32, [](const char *name, size_t n) {
+    if (!matrix_size(n)) return;
+    MatrixCase mc(n, 10);
+    std::vector<size_t> counts(mc.side);
+    measure("bitarray", name, "square", n, array_bytes(n), [&] {
+      bitmatrix_col_counts(mc.m.get(), counts.data());
+    });
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) return;
+    mc.make_rows();
+    measure("naive", name, "square", n, array_bytes(n), [&] {
+      for (size_t j = 0; j < mc.side; j++) {
+        size_t count = 0;
+        for (size_t i = 0; i < mc.side; i++) {
+          count += get_bit(mc.row_ptrs[i], j);
+        }
+        counts[j] = count;
+      }
+    });
+  }});
+
+  // elimination of a square matrix: random (full rank, dense) and
+  // structured (3 bits per row, rank deficient), with 1 and 4 threads;
+  // the baseline eliminates bitarray rows with get_bit pivot searches and
+  // xor_bits_inplace
+  c.push_back({"bitmatrix_rank", 28, [](const char *name, size_t n) {
+    if (!matrix_size(n)) return;
+    for (int structured = 0; structured < 2; structured++) {
+      MatrixCase mc(n, 10);
+      if (structured) {
+        memset(mc.m->array, 0, mc.side * mc.m->_row_words * TYPE_SIZE);
+        for (size_t i = 0; i < mc.side; i++) {
+          bitmatrix_set(mc.m.get(), i, i);
+          bitmatrix_set(mc.m.get(), i, (i * 5 + 1) % mc.side);
+          bitmatrix_set(mc.m.get(), i, (i * 11 + 3) % mc.side);
+        }
+      }
+      const char *kind = structured ? "structured" : "random";
+      for (unsigned threads : {1, 4}) {
+        char variant[64];
+        snprintf(variant, sizeof(variant), "%s/t=%u", kind, threads);
+        measure("bitarray", name, variant, n, array_bytes(n), [&] {
+          sink += bitmatrix_rank(mc.m.get(), threads);
+        });
+      }
+      if (!opts.baselines || n > (size_t) 1 << 24) continue;
+      mc.make_rows();
+      measure("naive", name, kind, n, array_bytes(n), [&] {
+        std::vector<BitarrayPtr> rows;
+        for (bitarray *row : mc.row_ptrs) rows.emplace_back(copy_bitarray(row));
+        size_t r = 0;
+        for (size_t col = 0; col < mc.side && r < mc.side; col++) {
+          size_t p = r;
+          while (p < mc.side && !get_bit(rows[p].get(), col)) p++;
+          if (p == mc.side) continue;
+          std::swap(rows[p], rows[r]);
+          for (size_t i = 0; i < mc.side; i++) {
+            if (i != r && get_bit(rows[i].get(), col)) {
+              xor_bits_inplace(rows[i].get(), rows[r].get());
+            }
+          }
+          r++;
+        }
+        sink += r;
+      });
+    }
+  }});
+
+  // the product of two matrices of n bits each
+  for (bool gf2 : {true, false}) {
+    const char *fn = gf2 ? "bitmatrix_mul_gf2" : "bitmatrix_mul_bool";
+    c.push_back({fn, 28, [gf2](const char *name, size_t n) {
+      if (!matrix_size(n)) return;
+      MatrixCase a(n, 10), b(n, 20);
+      measure("bitarray", name, "square", n, 3 * array_bytes(n), [&] {
+        delete_bitmatrix(gf2 ? bitmatrix_mul_gf2(a.m.get(), b.m.get())
+                             : bitmatrix_mul_bool(a.m.get(), b.m.get()));
+      });
+      if (!opts.baselines || n > (size_t) 1 << 24) return;
+      a.make_rows();
+      b.make_rows();
+      // row i of the product combines the rows k of b with a[i][k] set
+      measure("naive", name, "square", n, 3 * array_bytes(n), [&] {
+        for (size_t i = 0; i < a.side; i++) {
+          BitarrayPtr row(create_bitarray(b.side));
+          for (size_t k = 0; k < a.side; k++) {
+            if (!get_bit(a.row_ptrs[i], k)) continue;
+            if (gf2) {
+              xor_bits_inplace(row.get(), b.row_ptrs[k]);
+            } else {
+              or_bits_inplace(row.get(), b.row_ptrs[k]);
+            }
+          }
+        }
+      });
+    }});
+  }
+}
+
+// k = 10 nearest neighbors among n bits of codes of 256 and 1024 bits,
+// clustered around 64 centers (5% of the bits flipped); the query is a
+// center with 5% of its bits flipped as well. the baseline scores every
+// code with xor_bits and count_bits
+void add_hamming_cases(std::vector<Case> &c) {
+  c.push_back({"hamming_index_knn", 32, [](const char *name, size_t n) {
+    const size_t k = 10;
+    for (size_t code_bits : {256, 1024}) {
+      size_t n_codes = n / code_bits;
+      if (n_codes < 64) continue;
+      Rng rng(code_bits);
+      std::vector<BitarrayPtr> centers;
+      for (size_t i = 0; i < 64; i++) {
+        centers.push_back(random_bitarray(code_bits, 1, rng.next()));
+      }
+      auto near = [&](bitarray *center) {
+        bitarray *code = copy_bitarray(center);
+        for (size_t j = 0; j < code_bits; j++) {
+          if (rng.next() % 20 == 0) flip_bit(code, j);
+        }
+        return BitarrayPtr(code);
+      };
+      std::unique_ptr<hamming_index, void (*)(hamming_index*)> index(
+        create_hamming_index(code_bits), delete_hamming_index);
+      for (size_t i = 0; i < n_codes; i++) {
+        hamming_index_add(index.get(), near(centers[i % 64].get()).get());
+      }
+      hamming_index_build_mih(index.get());
+      BitarrayPtr query = near(centers[0].get());
+      size_t ids[k];
+      uint32_t dists[k];
+      double bytes = n / 8.0;
+
+      char variant[64];
+      for (unsigned threads : {1, 4}) {
+        snprintf(variant, sizeof(variant), "%zu/scan/t=%u", code_bits,
+                 threads);
+        measure("bitarray", name, variant, n, bytes, [&] {
+          sink += hamming_index_knn(index.get(), query.get(), k, ids, dists,
+                                    threads);
+        });
+      }
+      snprintf(variant, sizeof(variant), "%zu/mih", code_bits);
+      measure("bitarray", name, variant, n, bytes, [&] {
+        sink += hamming_index_knn_mih(index.get(), query.get(), k, ids, dists);
+      });
+
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      snprintf(variant, sizeof(variant), "%zu", code_bits);
+      measure("naive", name, variant, n, bytes, [&] {
+        std::priority_queue<std::pair<size_t, size_t>> heap;
+        for (size_t i = 0; i < n_codes; i++) {
+          bitarray code = hamming_index_code(index.get(), i);
+          BitarrayPtr x(xor_bits(query.get(), &code));
+          heap.emplace(count_bits(x.get()), i);
+          if (heap.size() > k) heap.pop();
+        }
+        sink += heap.top().first;
+      });
+    }
+  }});
+}
+
+// file-backed bitarrays (64 KiB pages, temporary files) with a cache for
+// all pages and for a quarter of them: whole-array count, xor of two
+// arrays and random set_bit; the baseline sets bits with a pread/pwrite of
+// the element per access (no cache)
+struct PagedCase {
+  char path[2][32] = {"/tmp/bitarray_bench_XXXXXX",
+                      "/tmp/bitarray_bench_XXXXXX"};
+  paged_bitarray *p[2] = {nullptr, nullptr};
+
+  PagedCase(size_t n, size_t cache_bytes) {
+    for (int i = 0; i < 2; i++) {
+      close(mkstemp(path[i]));
+      p[i] = open_paged_bitarray(path[i], n, 1 << 16, cache_bytes);
+      BitarrayPtr b = random_bitarray(std::min<size_t>(n, 1 << 20), 1, i);
+      for (size_t from = 0; from < n; from += b->size) {
+        size_t len = std::min(b->size, n - from);
+        bitarray part = {len, b->_array_size, b->array, true, NULL};
+        paged_copy_from_bitarray(p[i], from, &part);
+      }
+      paged_flush(p[i]);
+    }
+  }
+
+  ~PagedCase() {
+    for (int i = 0; i < 2; i++) {
+      close_paged_bitarray(p[i]);
+      unlink(path[i]);
+    }
+  }
+};
+
+void add_paged_cases(std::vector<Case> &c) {
+  auto run = [](const char *name, size_t n, int kind) {
+    size_t bytes = array_bytes(n);
+    if (bytes < ((size_t) 1 << 18)) return;
+    for (size_t share : {1, 4}) {
+      PagedCase pc(n, bytes / share);
+      char variant[64];
+      snprintf(variant, sizeof(variant), "cache=1/%zu", share);
+      if (kind == 0) {
+        measure("bitarray", name, variant, n, bytes, [&] {
+          sink += paged_count_bits(pc.p[0]);
+        });
+      } else if (kind == 1) {
+        measure("bitarray", name, variant, n, 2 * bytes, [&] {
+          paged_xor_bits_inplace(pc.p[0], pc.p[1]);
+        });
+      } else {
+        std::vector<size_t> pos = random_positions(n, POS_COUNT, 2);
+        measure("bitarray", name, variant, n, POS_COUNT * TYPE_SIZE, [&] {
+          for (size_t i : pos) paged_set_bit(pc.p[0], i);
+        });
+      }
+    }
+
+    if (kind != 2 || !opts.baselines) return;
+    PagedCase pc(n, 0);
+    int fd = open(pc.path[0], O_RDWR);
+    std::vector<size_t> pos = random_positions(n, POS_COUNT, 2);
+    measure("naive", name, "pread/pwrite", n, POS_COUNT * TYPE_SIZE, [&] {
+      for (size_t i : pos) {
+        ARRAY_TYPE word;
+        off_t at = (off_t) (i / BITS_PER_EL * TYPE_SIZE);
+        sink += pread(fd, &word, TYPE_SIZE, at);
+        word |= (ARRAY_TYPE) 1 << (i % BITS_PER_EL);
+        sink += pwrite(fd, &word, TYPE_SIZE, at);
+      }
+    });
+    close(fd);
+  };
+
+  c.push_back({"paged_count_bits", 32, [run](const char *name, size_t n) {
+    run(name, n, 0);
+  }});
+  c.push_back({"paged_xor_bits_inplace", 32,
+               [run](const char *name, size_t n) { run(name, n, 1); }});
+  c.push_back({"paged_set_bit", 32, [run](const char *name, size_t n) {
+    run(name, n, 2);
+  }});
+}
+
+// sparse arrays (one set bit per 2^10 and per 2^16 bits at random
+// positions): visiting every set bit, counting and and-ing two arrays
+// through the summary; the baselines scan all elements of plain bitarrays
+void add_summary_cases(std::vector<Case> &c) {
+  auto sparse = [](size_t n, unsigned log2_gap, uint64_t seed) {
+    BitarrayPtr s(create_bitarray(n));
+    attach_summary(s.get());
+    for (size_t i : random_positions(n, (n >> log2_gap) + 1, seed)) {
+      set_bit(s.get(), i);
+    }
+    return s;
+  };
+  auto run = [sparse](const char *name, size_t n, int kind) {
+    for (unsigned log2_gap : {10, 16}) {
+      if (n >> log2_gap < 4) continue;
+      BitarrayPtr a = sparse(n, log2_gap, 1);
+      BitarrayPtr b = sparse(n, log2_gap, 2);
+      char variant[64];
+      snprintf(variant, sizeof(variant), "1/2^%u", log2_gap);
+
+      if (kind == 0) {
+        measure("bitarray", name, variant, n, array_bytes(n), [&] {
+          for (size_t i = find_set_run(a.get(), 1, 0); i != SIZE_MAX;
+               i = i + 1 < n ? find_set_run(a.get(), 1, i + 1) : SIZE_MAX) {
+            sink += i;
+          }
+        });
+      } else if (kind == 1) {
+        measure("bitarray", name, variant, n, array_bytes(n), [&] {
+          sink += count_bits(a.get());
+        });
+      } else {
+        // and-ing a copy keeps the arrays of all repetitions the same
+        BitarrayPtr a2(copy_bitarray(a.get()));
+        attach_summary(a2.get());
+        measure("bitarray", name, variant, n, 2 * array_bytes(n), [&] {
+          and_bits_inplace(a2.get(), b.get());
+          or_bits_inplace(a2.get(), a.get());
+        });
+      }
+
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      // (the baselines use copies without the summary)
+      BitarrayPtr plain(copy_bitarray(a.get()));
+      BitarrayPtr plain_b(copy_bitarray(b.get()));
+      bitarray *bits = plain.get();
+      size_t n_words = (n + BITS_PER_EL - 1) / BITS_PER_EL;
+      if (kind == 0) {
+        measure("scan", name, variant, n, array_bytes(n), [&] {
+          for (size_t w = 0; w < n_words; w++) {
+            for (ARRAY_TYPE el = bits->array[w]; el; el &= el - 1) {
+              sink += w * BITS_PER_EL + __builtin_ctzll(el);
+            }
+          }
+        });
+      } else if (kind == 1) {
+        measure("scan", name, variant, n, array_bytes(n), [&] {
+          sink += count_bits(bits);
+        });
+      } else {
+        BitarrayPtr a2(copy_bitarray(bits));
+        measure("scan", name, variant, n, 2 * array_bytes(n), [&] {
+          and_bits_inplace(a2.get(), plain_b.get());
+          or_bits_inplace(a2.get(), bits);
+        });
+      }
+    }
+  };
+
+  c.push_back({"summary_find_set_run", 34, [run](const char *name,
+                                                size_t n) {
+    run(name, n, 0);
+  }});
+  c.push_back({"summary_count_bits", 34, [run](const char *name, size_t n) {
+    run(name, n, 1);
+  }});
+  c.push_back({"summary_and_bits_inplace", 34,
+               [run](const char *name, size_t n) { run(name, n, 2); }});
+}
+
+// snapshot of a copy-on-write bitarray (4 KiB blocks), alone and followed
+// by 64 random writes to the original (which clone the blocks they touch);
+// the baseline copies a plain bitarray with copy_bitarray
+void add_cow_cases(std::vector<Case> &c) {
+  c.push_back({"cow_snapshot", 34, [](const char *name, size_t n) {
+    const size_t block_bytes = 4096;
+    BitarrayPtr b = random_bitarray(n, 1, 1);
+    std::unique_ptr<cow_bitarray, void (*)(cow_bitarray*)> cow(
+      create_cow_bitarray_from_bitarray(b.get(), block_bytes),
+      delete_cow_bitarray);
+    std::vector<size_t> pos = random_positions(n, 64, 2);
+
+    measure("bitarray", name, "snapshot", n, array_bytes(n), [&] {
+      delete_cow_bitarray(cow_snapshot(cow.get()));
+    });
+    measure("bitarray", name, "64 writes", n, array_bytes(n), [&] {
+      cow_bitarray *snapshot = cow_snapshot(cow.get());
+      for (size_t i : pos) cow_flip_bit(cow.get(), i);
+      delete_cow_bitarray(snapshot);
+    });
+
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) return;
+    measure("naive", name, "64 writes", n, array_bytes(n), [&] {
+      bitarray *snapshot = copy_bitarray(b.get());
+      for (size_t i : pos) flip_bit(b.get(), i);
+      delete_bitarray(snapshot);
+    });
+  }});
+}
+
+// bitarrays with attached counts (4 KiB blocks): tracking the cardinality
+// (64 rounds of 4 random flips and a count), the overhead on random flips
+// and and-ing with a recount; the baselines rescan plain bitarrays with
+// count_bits
+void add_counted_cases(std::vector<Case> &c) {
+  auto run = [](const char *name, size_t n, int kind) {
+    BitarrayPtr b = random_bitarray(n, 1, 1);
+    BitarrayPtr other = random_bitarray(n, 1, 2);
+    BitarrayPtr cnt(copy_bitarray(b.get()));
+    attach_count(cnt.get(), 4096);
+    std::vector<size_t> pos = random_positions(n, POS_COUNT, 3);
+    const size_t rounds = 64;
+
+    if (kind == 0) {
+      measure("bitarray", name, "4 flips+count", n, rounds * array_bytes(n),
+              [&] {
+        for (size_t r = 0; r < rounds; r++) {
+          for (size_t j = 0; j < 4; j++) {
+            flip_bit(cnt.get(), pos[4 * r + j]);
+          }
+          sink += count_bits(cnt.get());
+        }
+      });
+    } else if (kind == 1) {
+      measure("bitarray", name, "random", n, POS_COUNT * TYPE_SIZE, [&] {
+        for (size_t i : pos) flip_bit(cnt.get(), i);
+      });
+    } else {
+      measure("bitarray", name, "and+count", n, 2 * array_bytes(n), [&] {
+        and_bits_inplace(cnt.get(), other.get());
+        or_bits_inplace(cnt.get(), b.get());
+        sink += count_bits(cnt.get());
+      });
+    }
+
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) return;
+    BitarrayPtr plain(copy_bitarray(b.get()));
+    if (kind == 0) {
+      measure("scan", name, "4 flips+count", n, rounds * array_bytes(n), [&] {
+        for (size_t r = 0; r < rounds; r++) {
+          for (size_t j = 0; j < 4; j++) flip_bit(plain.get(), pos[4 * r + j]);
+          sink += count_bits(plain.get());
+        }
+      });
+    } else if (kind == 1) {
+      measure("scan", name, "random", n, POS_COUNT * TYPE_SIZE, [&] {
+        for (size_t i : pos) flip_bit(plain.get(), i);
+      });
+    } else {
+      measure("scan", name, "and+count", n, 2 * array_bytes(n), [&] {
+        and_bits_inplace(plain.get(), other.get());
+        or_bits_inplace(plain.get(), b.get());
+        sink += count_bits(plain.get());
+      });
+    }
+  };
+
+  c.push_back({"counted_count_bits", 34, [run](const char *name, size_t n) {
+    run(name, n, 0);
+  }});
+  c.push_back({"counted_flip_bit", 34, [run](const char *name, size_t n) {
+    run(name, n, 1);
+  }});
+  c.push_back({"counted_and_bits_inplace", 34,
+               [run](const char *name, size_t n) { run(name, n, 2); }});
+}
+
+// allocation map with fragmented free space: used extents of 1 to 96
+// bits alternate with free holes of 1 to 16 bits
+BitarrayPtr fragmented_map(size_t n_bits, uint64_t seed) {
+  BitarrayPtr b(create_bitarray(n_bits));
+  Rng rng(seed);
+  for (size_t i = 0; i < n_bits;) {
+    size_t used = std::min<size_t>(1 + rng.next() % 96, n_bits - i);
+    set_bit_range(b.get(), i, i + used);
+    i += used + 1 + rng.next() % 16;
+  }
+  return b;
+}
+
+// first run of k unset bits at or after start, bit by bit
+size_t naive_find_clear_run(bitarray *b, size_t k, size_t start) {
+  size_t run = 0;
+  for (size_t i = start; i < b->size; i++) {
+    run = get_bit(b, i) ? 0 : run + 1;
+    if (run == k) return i + 1 - k;
+  }
+  return SIZE_MAX;
+}
+
+// searching fragmented allocation maps: finding every fitting hole of k
+// bits from the start to the end (a hole of k = 64 or more is never there,
+// so that variant scans the whole map once per search) and the longest
+// hole
+void add_run_cases(std::vector<Case> &c) {
+  c.push_back({"find_clear_run", 34, [](const char *name, size_t n) {
+    BitarrayPtr b = fragmented_map(n, 1);
+    for (size_t k : {4, 12, 64}) {
+      std::string variant = "k=" + std::to_string(k);
+      measure("bitarray", name, variant, n, array_bytes(n), [&] {
+        for (size_t p = find_clear_run(b.get(), k, 0); p != SIZE_MAX;
+             p = find_clear_run(b.get(), k, p + k)) {
+          sink += p;
+        }
+      });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, variant, n, array_bytes(n), [&] {
+        for (size_t p = naive_find_clear_run(b.get(), k, 0); p != SIZE_MAX;
+             p = naive_find_clear_run(b.get(), k, p + k)) {
+          sink += p;
+        }
+      });
+    }
+  }});
+  c.push_back({"longest_clear_run", 34, [](const char *name, size_t n) {
+    BitarrayPtr b = fragmented_map(n, 1);
+    measure("bitarray", name, "fragmented", n, array_bytes(n), [&] {
+      size_t pos;
+      sink += longest_clear_run(b.get(), 0, n, &pos) + pos;
+    });
+  }});
+}
+
+// runs of set bits in random arrays (sparse: mostly single bits, dense:
+// runs of about 64 bits), alternating bits (a run every other bit) and
+// extents of 1 to 96 bits (fragmented_map); the baseline walks get_bit
+void add_interval_cases(std::vector<Case> &c) {
+  auto pattern = [](size_t n, int kind) {
+    if (kind < 3) return random_bitarray(n, kind == 0 ? 0 : 2, 1);
+    if (kind == 3) {
+      BitarrayPtr b(create_bitarray(n));
+      for (size_t i = 0; i < b->_array_size; i++) {
+        b->array[i] = 0x5555555555555555ULL;
+      }
+      return b;
+    }
+    return fragmented_map(n, 1);
+  };
+  static const char *names[] = {"sparse", "", "dense", "alternating",
+                                "extents"};
+  static const int kinds[] = {0, 2, 3, 4};
+
+  c.push_back({"next_set_run", 30, [=](const char *name, size_t n) {
+    for (int kind : kinds) {
+      BitarrayPtr b = pattern(n, kind);
+      measure("bitarray", name, names[kind], n, array_bytes(n), [&] {
+        size_t end;
+        for (size_t s = next_set_run(b.get(), 0, &end); s < n;
+             s = next_set_run(b.get(), end, &end)) {
+          sink += end - s;
+        }
+      });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, names[kind], n, array_bytes(n), [&] {
+        for (size_t i = 0; i < n;) {
+          if (!get_bit(b.get(), i)) {
+            i++;
+            continue;
+          }
+          size_t s = i;
+          while (i < n && get_bit(b.get(), i)) i++;
+          sink += i - s;
+        }
+      });
+    }
+  }});
+  c.push_back({"convert_bitarray_to_intervals", 30,
+               [=](const char *name, size_t n) {
+    for (int kind : kinds) {
+      BitarrayPtr b = pattern(n, kind);
+      std::vector<bitarray_interval> iv(
+        convert_bitarray_to_intervals(b.get(), NULL, 0));
+      measure("bitarray", name, names[kind], n, array_bytes(n), [&] {
+        sink += convert_bitarray_to_intervals(b.get(), iv.data(), iv.size());
+      });
+    }
+  }});
+  c.push_back({"create_bitarray_from_intervals", 30,
+               [=](const char *name, size_t n) {
+    for (int kind : kinds) {
+      BitarrayPtr b = pattern(n, kind);
+      std::vector<bitarray_interval> iv(
+        convert_bitarray_to_intervals(b.get(), NULL, 0));
+      convert_bitarray_to_intervals(b.get(), iv.data(), iv.size());
+      measure("bitarray", name, names[kind], n, array_bytes(n), [&] {
+        delete_bitarray(create_bitarray_from_intervals(n, iv.data(),
+                                                       iv.size()));
+      });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, names[kind], n, array_bytes(n), [&] {
+        bitarray *r = create_bitarray(n);
+        for (const bitarray_interval &v : iv) {
+          for (size_t i = v.start; i < v.end; i++) set_bit(r, i);
+        }
+        delete_bitarray(r);
+      });
+    }
+  }});
+}
+
+// bitarray maps: deduplicating n / 256 random 256 bit signatures (half
+// of them duplicates) and looking all of them up again; the baseline
+// keeps the signatures as strings in a std::unordered_set
+void add_map_cases(std::vector<Case> &c) {
+  auto run = [](const char *name, size_t n, bool lookup) {
+    const size_t sig_bits = 256;
+    size_t n_sigs = n / sig_bits;
+    if (n_sigs < 2) return;
+    BitarrayPtr sigs = random_bitarray(n, 1, 1);
+    // (views of the first half of the signatures, each twice)
+    std::vector<bitarray> keys;
+    for (size_t i = 0; i < n_sigs; i++) {
+      size_t j = i < n_sigs / 2 ? i : i - n_sigs / 2;
+      keys.push_back({sig_bits, sig_bits / BITS_PER_EL,
+                      sigs->array + j * (sig_bits / BITS_PER_EL), true,
+                      NULL});
+    }
+    std::unique_ptr<bitarray_map, void (*)(bitarray_map*)> m(
+      create_bitarray_map(n_sigs / 2), delete_bitarray_map);
+    for (bitarray &k : keys) bitarray_map_add(m.get(), &k, 0);
+
+    if (lookup) {
+      measure("bitarray", name, "256 bits", n, array_bytes(n), [&] {
+        for (bitarray &k : keys) sink += bitarray_map_get(m.get(), &k, NULL);
+      });
+      // (in insertion order above, in random order here)
+      std::vector<bitarray> shuffled = keys;
+      Rng rng(2);
+      for (size_t i = shuffled.size() - 1; i > 0; i--) {
+        std::swap(shuffled[i], shuffled[rng.next() % (i + 1)]);
+      }
+      measure("bitarray", name, "random order", n, array_bytes(n), [&] {
+        for (bitarray &k : shuffled) {
+          sink += bitarray_map_get(m.get(), &k, NULL);
+        }
+      });
+    } else {
+      measure("bitarray", name, "256 bits", n, array_bytes(n), [&] {
+        std::unique_ptr<bitarray_map, void (*)(bitarray_map*)> d(
+          create_bitarray_map(0), delete_bitarray_map);
+        for (bitarray &k : keys) sink += bitarray_map_add(d.get(), &k, 0);
+      });
+    }
+
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) return;
+    auto key_string = [](bitarray &k) {
+      return std::string((const char*) k.array, sig_bits / 8);
+    };
+    std::unordered_set<std::string> set;
+    for (bitarray &k : keys) set.insert(key_string(k));
+    if (lookup) {
+      measure("unordered_set", name, "256 bits", n, array_bytes(n), [&] {
+        for (bitarray &k : keys) sink += set.count(key_string(k));
+      });
+    } else {
+      measure("unordered_set", name, "256 bits", n, array_bytes(n), [&] {
+        std::unordered_set<std::string> d;
+        for (bitarray &k : keys) sink += d.insert(key_string(k)).second;
+      });
+    }
+  };
+
+  c.push_back({"bitarray_map_add", 30, [run](const char *name, size_t n) {
+    run(name, n, false);
+  }});
+  c.push_back({"bitarray_map_get", 30, [run](const char *name, size_t n) {
+    run(name, n, true);
+  }});
+}
+
+// memory (KiB) only this process maps
+size_t private_kib() {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (!f) return 0;
+  char line[256];
+  size_t kib = 0, v;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "Private_Clean: %zu", &v) == 1 ||
+        sscanf(line, "Private_Dirty: %zu", &v) == 1) {
+      kib += v;
+    }
+  }
+  fclose(f);
+  return kib;
+}
+
+constexpr unsigned SHM_WORKERS = 64;
+
+// start SHM_WORKERS forked workers that each get the same n bit array
+// ready and count its bits, and wait for them: either the parent fills a
+// shared memory region once and the workers attach to it read-only, or
+// every worker builds a private copy; returns the private memory per
+// worker (KiB) if report is true
+double run_workers(size_t n, bool shared, bool report) {
+  char name[64];
+  snprintf(name, sizeof(name), "/bitarray_bench_%d", (int) getpid());
+  shm_bitarray *s = nullptr;
+  if (shared) {
+    s = create_shm_bitarray(name, n);
+    if (!s) {
+      perror("create_shm_bitarray");
+      exit(1);
+    }
+    fill_density(s->bits.array, s->bits._array_size, n, 1, 1);
+  }
+  int fds[2];
+  if (report && pipe(fds)) {
+    perror("pipe");
+    exit(1);
+  }
+
+  std::vector<pid_t> pids;
+  for (unsigned w = 0; w < SHM_WORKERS; w++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      size_t before = report ? private_kib() : 0;
+      BitarrayPtr copy(nullptr);
+      if (shared) {
+        shm_bitarray *a = attach_shm_bitarray(name, false);
+        if (!a) _exit(1);
+        sink += count_bits(&a->bits);
+      } else {
+        copy = random_bitarray(n, 1, 1);
+        sink += count_bits(copy.get());
+      }
+      // (measured while the worker still holds its array)
+      if (report) {
+        uint64_t kib = private_kib() - before;
+        if (write(fds[1], &kib, sizeof(kib)) != sizeof(kib)) _exit(1);
+      }
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+
+  for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+  uint64_t total = 0;
+  if (report) {
+    for (unsigned w = 0; w < SHM_WORKERS; w++) {
+      uint64_t kib = 0;
+      if (read(fds[0], &kib, sizeof(kib)) == sizeof(kib)) total += kib;
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+  if (shared) {
+    detach_shm_bitarray(s);
+    unlink_shm_bitarray(name);
+  }
+  return static_cast<double>(total) / SHM_WORKERS;
+}
+
+// pre-fork workers sharing one read-mostly bitarray: startup time of
+// SHM_WORKERS workers (fill once + attach vs. a private copy each) and
+// their private memory, printed as a comment line after the timings
+void add_shm_cases(std::vector<Case> &c) {
+  c.push_back({"shm_workers", 28, [](const char *name, size_t n) {
+    std::string variant = std::to_string(SHM_WORKERS) + " workers";
+    measure("shm", name, variant, n, array_bytes(n), [&] {
+      run_workers(n, true, false);
+    });
+    double shared_kib = run_workers(n, true, true);
+    if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) {
+      printf("# %s %zu: %.0f KiB private per worker with shm, "
+             "%.0f KiB shared\n", name, n, shared_kib,
+             array_bytes(n) / 1024.0);
+      return;
+    }
+    measure("private", name, variant, n, SHM_WORKERS * array_bytes(n), [&] {
+      run_workers(n, false, false);
+    });
+    double private_kib = run_workers(n, false, true);
+    printf("# %s %zu: %.0f KiB private per worker with shm (plus %.0f KiB "
+           "shared), %.0f KiB with private copies\n", name, n, shared_kib,
+           array_bytes(n) / 1024.0, private_kib);
+  }});
+}
+
+// IDs every thread of the id_alloc case holds at once and alloc/free
+// pairs it runs per measured call
+constexpr size_t ID_HELD = 64;
+constexpr size_t ID_OPS = 1 << 14;
+
+// run threads threads that each free their oldest of ID_HELD IDs and
+// allocate a new one ID_OPS times (alloc/free are the allocator's)
+template <typename Alloc, typename Free>
+void run_id_threads(unsigned threads, Alloc alloc, Free free_fn) {
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back([&] {
+      size_t held[ID_HELD];
+      for (size_t &id : held) id = alloc();
+      for (size_t i = 0; i < ID_OPS; i++) {
+        free_fn(held[i % ID_HELD]);
+        held[i % ID_HELD] = alloc();
+      }
+      for (size_t id : held) free_fn(id);
+    });
+  }
+  for (std::thread &t : pool) t.join();
+}
+
+// concurrent ID allocation/free from 1 to 64 threads (ns per alloc/free
+// pair over all threads); the baseline guards a bitarray with one mutex.
+// the throughput is printed as a comment line after the timings
+void add_id_cases(std::vector<Case> &c) {
+  c.push_back({"id_alloc", 24, [](const char *name, size_t n) {
+    for (unsigned threads : {1, 2, 4, 8, 16, 32, 64}) {
+      if (4 * threads * ID_HELD > n) break;
+      std::string variant = std::to_string(threads) + " threads";
+      double pairs = static_cast<double>(threads) * ID_OPS;
+
+      id_allocator *a = create_id_allocator(n);
+      Result r = run_measurement("bitarray", name, variant, n, 0, [&] {
+        run_id_threads(threads, [&] { return alloc_id(a); },
+                       [&](size_t id) { free_id(a, id); });
+      });
+      delete_id_allocator(a);
+      for (double &ns : r.ns) ns /= pairs;
+      double ns_per_pair = median(r.ns);
+      record(std::move(r));
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) {
+        printf("# %s %zu, %u threads: %.1f M alloc/free pairs/s\n", name,
+               n, threads, 1e3 / ns_per_pair);
+        continue;
+      }
+
+      BitarrayPtr b(create_bitarray(n));
+      std::mutex lock;
+      Result base = run_measurement("mutex", name, variant, n, 0, [&] {
+        run_id_threads(threads,
+                       [&] {
+                         std::lock_guard<std::mutex> guard(lock);
+                         size_t id = find_clear_run(b.get(), 1, 0);
+                         set_bit(b.get(), id);
+                         return id;
+                       },
+                       [&](size_t id) {
+                         std::lock_guard<std::mutex> guard(lock);
+                         clear_bit(b.get(), id);
+                       });
+      });
+      for (double &ns : base.ns) ns /= pairs;
+      double base_ns_per_pair = median(base.ns);
+      record(std::move(base));
+      printf("# %s %zu, %u threads: %.1f M alloc/free pairs/s "
+             "(%.1f M with a mutex)\n", name, n, threads, 1e3 / ns_per_pair,
+             1e3 / base_ns_per_pair);
+    }
+  }});
+}
+
+// sliding windows, pushed once per op: a ring of n bits (push, then count
+// the window or its newer half) and a ring_set of n windows of 64 or 1024
+// bits (one tick for all windows); the baselines shift a bitarray per
+// window by one and recount it
+void add_ring_cases(std::vector<Case> &c) {
+  c.push_back({"ring_push", 64, [](const char *name, size_t n) {
+    BitarrayPtr pattern = random_bitarray(POS_COUNT, 1, 1);
+    ring_bitarray *r = create_ring_bitarray(n);
+    size_t i = 0;
+    measure("bitarray", name, "count", n, TYPE_SIZE, [&] {
+      ring_push_bit(r, get_bit(pattern.get(), i++ % POS_COUNT));
+      sink += r->count;
+    });
+    measure("bitarray", name, "last n/2", n, array_bytes(n) / 4, [&] {
+      ring_push_bit(r, get_bit(pattern.get(), i++ % POS_COUNT));
+      sink += ring_count_last(r, n / 2);
+    });
+    delete_ring_bitarray(r);
+    if (!opts.baselines || n > (size_t) 1 << 20) return;
+
+    BitarrayPtr b(create_bitarray(n));
+    measure("shift", name, "count", n, 3 * array_bytes(n), [&] {
+      right_shift_bits_inplace(b.get(), 1);
+      if (get_bit(pattern.get(), i++ % POS_COUNT)) set_bit(b.get(), 0);
+      sink += count_bits(b.get());
+    });
+    measure("shift", name, "last n/2", n, 2.5 * array_bytes(n), [&] {
+      right_shift_bits_inplace(b.get(), 1);
+      if (get_bit(pattern.get(), i++ % POS_COUNT)) set_bit(b.get(), 0);
+      sink += count_bit_range(b.get(), 0, n / 2);
+    });
+  }});
+
+  c.push_back({"ring_set_push", 26, [](const char *name, size_t n) {
+    for (size_t window : {64, 1024}) {
+      // (8 different ticks of events, half of the windows get a bit)
+      std::vector<BitarrayPtr> ticks;
+      for (uint64_t seed = 1; seed <= 8; seed++) {
+        ticks.push_back(random_bitarray(n, 1, seed));
+      }
+      std::string variant = "w=" + std::to_string(window);
+      ring_set *rs = create_ring_set(n, window);
+      size_t t = 0;
+      // (a row of elements and the counts, read and written)
+      double bytes = 2.0 * n * (TYPE_SIZE + sizeof(uint32_t));
+      measure("bitarray", name, variant, n, bytes, [&] {
+        ring_set_push(rs, ticks[t++ % ticks.size()].get());
+      });
+      delete_ring_set(rs);
+      if (!opts.baselines || n > (size_t) 1 << 20) continue;
+
+      std::vector<BitarrayPtr> windows;
+      std::vector<uint32_t> counts(n);
+      for (size_t k = 0; k < n; k++) {
+        windows.push_back(BitarrayPtr(create_bitarray(window)));
+      }
+      measure("shift", name, variant, n, 3.0 * n * array_bytes(window), [&] {
+        bitarray *events = ticks[t++ % ticks.size()].get();
+        for (size_t k = 0; k < n; k++) {
+          bitarray *w = windows[k].get();
+          right_shift_bits_inplace(w, 1);
+          if (get_bit(events, k)) set_bit(w, 0);
+          counts[k] = count_bits(w);
+        }
+        sink += counts[n - 1];
+      });
+    }
+  }});
+}
+
+// Elias-Fano encoded set bits of n bits with density 1/64 (random bits)
+// and 1/4096 (random positions): access and next_geq at random
+// positions, decoding all values (ns per value) and the intersection with
+// a dense bitarray of density 1/2, against a plain uint64_t array
+// (std::lower_bound for next_geq); the size per value is printed as a
+// comment line after the timings
+void add_elias_fano_cases(std::vector<Case> &c) {
+  c.push_back({"elias_fano", 28, [](const char *name, size_t n) {
+    if (n < 1 << 16) return;
+    for (int sparse = 0; sparse < 2; sparse++) {
+      BitarrayPtr b = random_bitarray(n, 0, 1);
+      if (sparse) {
+        clear_all_bits(b.get());
+        for (size_t p : random_positions(n, n / 4096, 1)) set_bit(b.get(), p);
+      }
+      std::string variant = sparse ? "1/4096" : "1/64";
+      elias_fano *ef = create_elias_fano_from_bitarray(b.get());
+      size_t count = ef->n;
+      std::vector<uint64_t> values(count);
+      ef_decode(ef, 0, count, values.data());
+      BitarrayPtr dense = random_bitarray(n, 1, 2);
+      std::vector<uint64_t> out(count);
+
+      Rng rng(3);
+      std::vector<size_t> idx(POS_COUNT);
+      std::vector<uint64_t> xs(POS_COUNT);
+      for (size_t i = 0; i < POS_COUNT; i++) {
+        idx[i] = rng.next() % count;
+        xs[i] = rng.next() % n;
+      }
+      size_t i = 0;
+      double ef_per_value = 8.0 * ef_bytes(ef) / count;
+
+      measure("bitarray", name, variant + " access", n, ef_per_value / 8,
+              [&] { sink += ef_access(ef, idx[i++ % POS_COUNT]); });
+      measure("bitarray", name, variant + " geq", n, ef_per_value / 8, [&] {
+        sink += ef_next_geq(ef, xs[i++ % POS_COUNT], nullptr);
+      });
+      Result r = run_measurement("bitarray", name, variant + " decode", n,
+                                 ef_bytes(ef), [&] {
+        sink += ef_decode(ef, 0, count, out.data());
+      });
+      for (double &ns : r.ns) ns /= count;
+      r.bytes_per_op /= count;
+      double decode_ns = median(r.ns);
+      record(std::move(r));
+      measure("bitarray", name, variant + " and", n,
+              ef_bytes(ef) + array_bytes(n), [&] {
+        sink += ef_intersect_bitarray(ef, dense.get(), out.data());
+      });
+      printf("# %s %zu %s: %.2f bits per value (dense bitarray: %.1f), "
+             "decode %.0f M values/s\n", name, n, variant.c_str(),
+             ef_per_value, static_cast<double>(n) / count, 1e3 / decode_ns);
+      delete_elias_fano(ef);
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+
+      measure("array", name, variant + " access", n, TYPE_SIZE,
+              [&] { sink += values[idx[i++ % POS_COUNT]]; });
+      measure("array", name, variant + " geq", n, TYPE_SIZE, [&] {
+        sink += std::lower_bound(values.begin(), values.end(),
+                                 xs[i++ % POS_COUNT]) - values.begin();
+      });
+      Result base = run_measurement("array", name, variant + " decode", n,
+                                    count * sizeof(uint64_t), [&] {
+        memcpy(out.data(), values.data(), count * sizeof(uint64_t));
+        sink += out[count - 1];
+      });
+      for (double &ns : base.ns) ns /= count;
+      base.bytes_per_op /= count;
+      record(std::move(base));
+      measure("array", name, variant + " and", n,
+              count * sizeof(uint64_t) + array_bytes(n), [&] {
+        size_t found = 0;
+        for (uint64_t v : values) {
+          out[found] = v;
+          found += get_bit(dense.get(), v);
+        }
+        sink += found;
+      });
+    }
+  }});
+}
+
+std::vector<Case> bitarray_cases() {
+  std::vector<Case> c;
+
+  c.push_back({"get_bit", 64, [](const char *name, size_t n) {
+    single_bit_case(name, n, [](bitarray *b, size_t i) {
+      sink += get_bit(b, i);
+    });
+  }});
+  c.push_back({"set_bit", 64, [](const char *name, size_t n) {
+    single_bit_case(name, n, [](bitarray *b, size_t i) { set_bit(b, i); });
+  }});
+  c.push_back({"flip_bit", 64, [](const char *name, size_t n) {
+    single_bit_case(name, n, [](bitarray *b, size_t i) { flip_bit(b, i); });
+  }});
+  c.push_back({"clear_bit", 64, [](const char *name, size_t n) {
+    single_bit_case(name, n, [](bitarray *b, size_t i) { clear_bit(b, i); });
+  }});
+
+  c.push_back({"set_bits", 34, [](const char *name, size_t n) {
+    batch_case(name, n, set_bits, set_bit);
+  }});
+  c.push_back({"clear_bits", 34, [](const char *name, size_t n) {
+    batch_case(name, n, clear_bits, clear_bit);
+  }});
+  c.push_back({"get_bits", 34, [](const char *name, size_t n) {
+    BitarrayPtr out(create_bitarray(std::max<size_t>(n / 64, POS_COUNT)));
+    batch_case(name, n,
+               [&](bitarray *b, const size_t *idx, size_t count) {
+                 get_bits(b, idx, count, out.get());
+               },
+               [&](bitarray *b, size_t i) { sink += get_bit(b, i); });
+  }});
+
+  c.push_back({"set_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      set_bit_range(b, f, t);
+    });
+  }});
+  c.push_back({"flip_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      flip_bit_range(b, f, t);
+    });
+  }});
+  c.push_back({"clear_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      clear_bit_range(b, f, t);
+    });
+  }});
+  c.push_back({"count_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      sink += count_bit_range(b, f, t);
+    });
+  }});
+  c.push_back({"test_any_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      sink += test_any_bit_range(b, f, t);
+    });
+  }});
+  c.push_back({"test_all_bit_range", 64, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t f, size_t t) {
+      sink += test_all_bit_range(b, f, t);
+    });
+  }});
+
+  c.push_back({"set_all_bits", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { set_all_bits(b); });
+  }});
+  c.push_back({"flip_all_bits", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { flip_all_bits(b); });
+  }});
+  c.push_back({"clear_all_bits", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { clear_all_bits(b); });
+  }});
+  c.push_back({"not_bits_inplace", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { not_bits_inplace(b); });
+  }});
+  c.push_back({"count_bits", 64, [](const char *name, size_t n) {
+    density_case(name, n, [](bitarray *b) { sink += count_bits(b); });
+  }});
+
+  c.push_back({"and_bits_inplace", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      and_bits_inplace(l, r);
+    });
+  }});
+  c.push_back({"or_bits_inplace", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      or_bits_inplace(l, r);
+    });
+  }});
+  c.push_back({"xor_bits_inplace", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      xor_bits_inplace(l, r);
+    });
+  }});
+  c.push_back({"and_bits", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      delete_bitarray(and_bits(l, r));
+    });
+  }});
+  c.push_back({"or_bits", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      delete_bitarray(or_bits(l, r));
+    });
+  }});
+  c.push_back({"xor_bits", 64, [](const char *name, size_t n) {
+    binary_case(name, n, [](bitarray *l, bitarray *r) {
+      delete_bitarray(xor_bits(l, r));
+    });
+  }});
+  c.push_back({"not_bits", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { delete_bitarray(not_bits(b)); });
+  }});
+  c.push_back({"hash_bits", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { sink += hash_bits(b, 0); });
+  }});
+  c.push_back({"equal_bits", 64, [](const char *name, size_t n) {
+    BitarrayPtr l = random_bitarray(n, 1, 1);
+    BitarrayPtr r = random_bitarray(n, 1, 1);
+    measure("bitarray", name, "equal", n, 2.0 * array_bytes(n), [&] {
+      sink += equal_bits(l.get(), r.get());
+    });
+  }});
+
+  // the in-place shifts move the bits within the array, the copying
+  // ones go through append_bit_range (plus an allocation)
+  c.push_back({"right_shift_bits_inplace", 24, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) {
+      right_shift_bits_inplace(b, k);
+    });
+  }});
+  c.push_back({"left_shift_bits_inplace", 24, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) {
+      left_shift_bits_inplace(b, k);
+    });
+  }});
+  c.push_back({"right_shift_bits", 24, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) {
+      delete_bitarray(right_shift_bits(b, k));
+    });
+  }});
+  c.push_back({"left_shift_bits", 24, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) {
+      delete_bitarray(left_shift_bits(b, k));
+    });
+  }});
+  c.push_back({"rotate_left", 32, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) { rotate_left(b, k); });
+  }});
+  c.push_back({"rotate_right", 32, [](const char *name, size_t n) {
+    shift_case(name, n, [](bitarray *b, size_t k) { rotate_right(b, k); });
+  }});
+  c.push_back({"reverse_bits", 32, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) { reverse_bits(b); });
+  }});
+  c.push_back({"reverse_bit_range", 32, [](const char *name, size_t n) {
+    range_case(name, n, [](bitarray *b, size_t from, size_t to) {
+      reverse_bit_range(b, from, to);
+    });
+  }});
+
+  // extract/deposit under masks of every density; the baselines make one
+  // get_bit call per mask bit
+  c.push_back({"extract_bits", 32, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(n));
+    for (int d = 0; d < 3; d++) {
+      BitarrayPtr mask = random_bitarray(n, d, 2);
+      measure("bitarray", name, density_name(d), n, 2.0 * array_bytes(n),
+              [&] { extract_bits(dest.get(), src.get(), mask.get()); });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, density_name(d), n, 2.0 * array_bytes(n), [&] {
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (!get_bit(mask.get(), i)) continue;
+          if (get_bit(src.get(), i)) {
+            set_bit(dest.get(), k);
+          } else {
+            clear_bit(dest.get(), k);
+          }
+          k++;
+        }
+      });
+    }
+  }});
+  c.push_back({"deposit_bits", 32, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(n));
+    for (int d = 0; d < 3; d++) {
+      BitarrayPtr mask = random_bitarray(n, d, 2);
+      measure("bitarray", name, density_name(d), n, 2.0 * array_bytes(n),
+              [&] { deposit_bits(dest.get(), src.get(), mask.get()); });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, density_name(d), n, 2.0 * array_bytes(n), [&] {
+        clear_all_bits(dest.get());
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (get_bit(mask.get(), i) && get_bit(src.get(), k++)) {
+            set_bit(dest.get(), i);
+          }
+        }
+      });
+    }
+  }});
+
+  // wrapping a byte buffer: in place for LSB-first (nothing to convert),
+  // byte bit reversal for MSB-first; the baseline builds the bitarray bit
+  // by bit
+  c.push_back({"wrap_bitarray_bytes", 32, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    size_t n_bytes = array_bytes(n);
+    std::vector<uint64_t> buf(n_bytes / sizeof(uint64_t) + 1);
+    uint8_t *bytes = (uint8_t*) buf.data();
+    const bitarray_bit_order orders[] = {BITARRAY_LSB_FIRST,
+                                         BITARRAY_MSB_FIRST};
+    const char *names[] = {"lsb", "msb"};
+    for (int o = 0; o < 2; o++) {
+      copy_bitarray_to_bytes(src.get(), bytes, orders[o]);
+      measure("bitarray", name, names[o], n, n_bytes, [&] {
+        // (converting back and forth keeps the buffer in its order)
+        bitarray *b = wrap_bitarray_bytes(bytes, n_bytes, n, orders[o],
+                                          false);
+        sink += b->array[0];
+        copy_bitarray_to_bytes(b, bytes, orders[o]);
+        delete_bitarray(b);
+      });
+      if (!opts.baselines || n > (size_t) 1 << BASELINE_MAX_LOG2) continue;
+      measure("naive", name, names[o], n, n_bytes, [&] {
+        BitarrayPtr b(create_bitarray(n));
+        for (size_t i = 0; i < n; i++) {
+          int shift = orders[o] == BITARRAY_MSB_FIRST ? 7 - i % 8 : i % 8;
+          if ((bytes[i / 8] >> shift) & 1) set_bit(b.get(), i);
+        }
+        sink += b->array[0];
+      });
+    }
+  }});
+
+  c.push_back({"copy_all_bits", 64, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(n));
+    measure("bitarray", name, "-", n, 2.0 * array_bytes(n), [&] {
+      copy_all_bits(src.get(), dest.get());
+    });
+  }});
+  c.push_back({"copy_bit_range", 64, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(n));
+    for (const Range &r : ranges_for(n)) {
+      if (r.to <= r.from) continue;
+      measure("bitarray", name, r.name, n, (r.to - r.from) / 4.0, [&] {
+        copy_bit_range(src.get(), dest.get(), r.from, r.to);
+      });
+    }
+  }});
+  // dest has enough capacity, so only the append itself is measured
+  c.push_back({"append_bit_range", 24, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(2 * n));
+    for (const Range &r : ranges_for(n)) {
+      if (r.to <= r.from) continue;
+      measure("bitarray", name, r.name, n, (r.to - r.from) / 4.0, [&] {
+        dest->size = 0;
+        append_bit_range(src.get(), dest.get(), r.from, r.to);
+      });
+    }
+  }});
+  c.push_back({"append_all_bits", 24, [](const char *name, size_t n) {
+    BitarrayPtr src = random_bitarray(n, 1, 1);
+    BitarrayPtr dest(create_bitarray(2 * n));
+    measure("bitarray", name, "-", n, 2.0 * array_bytes(n), [&] {
+      dest->size = 0;
+      append_all_bits(src.get(), dest.get());
+    });
+  }});
+
+  c.push_back({"copy_bitarray", 64, [](const char *name, size_t n) {
+    whole_case(name, n, [](bitarray *b) {
+      delete_bitarray(copy_bitarray(b));
+    });
+  }});
+  c.push_back({"create_bitarray+delete", 64, [](const char *name, size_t n) {
+    measure("bitarray", name, "-", n, array_bytes(n), [n] {
+      delete_bitarray(create_bitarray(n));
+    });
+  }});
+  c.push_back({"create_set_bitarray+delete", 64,
+               [](const char *name, size_t n) {
+    measure("bitarray", name, "-", n, array_bytes(n), [n] {
+      delete_bitarray(create_set_bitarray(n));
+    });
+  }});
+  c.push_back({"create_bitarray_from_str", 26, [](const char *name, size_t n) {
+    std::string s(n, '0');
+    Rng rng(3);
+    for (auto &ch : s) ch = (rng.next() & 1) ? '1' : '0';
+    measure("bitarray", name, "-", n, n, [&] {
+      delete_bitarray(create_bitarray_from_str(s.c_str(), n));
+    });
+  }});
+  c.push_back({"create_str_from_bitarray", 26, [](const char *name, size_t n) {
+    BitarrayPtr b = random_bitarray(n, 1, 1);
+    measure("bitarray", name, "-", n, n, [&] {
+      free(create_str_from_bitarray(b.get()));
+    });
+  }});
+  c.push_back({"print_bitarray", 20, [](const char *name, size_t n) {
+    BitarrayPtr b = random_bitarray(n, 1, 1);
+
+    // send the output to /dev/null while measuring
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (saved < 0 || devnull < 0) return;
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    Result r = run_measurement("bitarray", name, "-", n, n, [&] {
+      print_bitarray(b.get());
+      fflush(stdout);
+    });
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    record(std::move(r));
+  }});
+
+  // these only exist for bitarrays of (up to) one element
+  c.push_back({"create_bitarray_from_num", 6, [](const char *name, size_t n) {
+    Rng rng(4);
+    measure("bitarray", name, "-", n, TYPE_SIZE, [&] {
+      delete_bitarray(create_bitarray_from_num(rng.next()));
+    });
+  }});
+  c.push_back({"convert_bitarray_to_num", 6, [](const char *name, size_t n) {
+    BitarrayPtr b = random_bitarray(n, 1, 1);
+    measure("bitarray", name, "-", n, TYPE_SIZE, [&] {
+      sink += convert_bitarray_to_num(b.get());
+    });
+  }});
+
+  add_bsi_cases(c);
+  add_bloom_cases(c);
+  add_bitmap_index_cases(c);
+  add_bitmatrix_cases(c);
+  add_hamming_cases(c);
+  add_paged_cases(c);
+  add_summary_cases(c);
+  add_cow_cases(c);
+  add_counted_cases(c);
+  add_run_cases(c);
+  add_interval_cases(c);
+  add_map_cases(c);
+  add_shm_cases(c);
+  add_id_cases(c);
+  add_ring_cases(c);
+  add_elias_fano_cases(c);
+
+  return c;
+}
+
+// baselines
+
+// std::vector<bool>: every size of the sweep
+void vector_bool_baselines(size_t n_bits) {
+  std::vector<bool> v(n_bits), w(n_bits);
+  Rng rng(1);
+  for (size_t i = 0; i < n_bits; i++) v[i] = rng.next() & 1;
+  for (size_t i = 0; i < n_bits; i++) w[i] = rng.next() & 1;
+  std::vector<size_t> pos = random_positions(n_bits, POS_COUNT, 2);
+  double bytes = array_bytes(n_bits);
+  size_t i = 0;
+
+  auto run = [&](const char *name, const char *variant, double b,
+                 const std::function<void()> &op) {
+    if (selected(name)) measure("vec<bool>", name, variant, n_bits, b, op);
+  };
+
+  run("get_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    sink += v[pos[i++ & (POS_COUNT - 1)]];
+  });
+  run("set_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    v[pos[i++ & (POS_COUNT - 1)]] = true;
+  });
+  run("flip_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    v[pos[i++ & (POS_COUNT - 1)]].flip();
+  });
+  for (const Range &r : ranges_for(n_bits)) {
+    if (r.to <= r.from) continue;
+    double rb = (r.to - r.from) / 8.0;
+    run("set_bit_range", r.name, rb, [&] {
+      std::fill(v.begin() + r.from, v.begin() + r.to, true);
+    });
+    run("count_bit_range", r.name, rb, [&] {
+      sink += std::count(v.begin() + r.from, v.begin() + r.to, true);
+    });
+  }
+  run("flip_all_bits", "-", bytes, [&] { v.flip(); });
+  run("count_bits", "half", bytes, [&] {
+    sink += std::count(v.begin(), v.end(), true);
+  });
+  run("and_bits_inplace", "-", 2 * bytes, [&] {
+    for (size_t k = 0; k < n_bits; k++) v[k] = v[k] && w[k];
+  });
+  run("equal_bits", "equal", 2 * bytes, [&] { sink += (v == w); });
+  run("copy_all_bits", "-", 2 * bytes, [&] { w = v; });
+  const size_t shifts[] = {1, BITS_PER_EL, n_bits / 3};
+  const char *names[] = {"by1", "by64", "byn/3"};
+  for (int k = 0; k < 3; k++) {
+    size_t n = shifts[k];
+    if (!n || n >= n_bits) continue;
+    run("rotate_left", names[k], bytes, [&] {
+      std::rotate(v.begin(), v.begin() + (n_bits - n), v.end());
+    });
+  }
+  run("reverse_bits", "-", bytes, [&] { std::reverse(v.begin(), v.end()); });
+}
+
+// std::bitset: only the sizes it was instantiated for
+template <size_t N>
+void bitset_baselines() {
+  auto v = std::make_unique<std::bitset<N>>();
+  auto w = std::make_unique<std::bitset<N>>();
+  Rng rng(1);
+  for (size_t i = 0; i < N; i++) (*v)[i] = rng.next() & 1;
+  for (size_t i = 0; i < N; i++) (*w)[i] = rng.next() & 1;
+  std::vector<size_t> pos = random_positions(N, POS_COUNT, 2);
+  double bytes = array_bytes(N);
+  size_t i = 0;
+
+  auto run = [&](const char *name, const char *variant, double b,
+                 const std::function<void()> &op) {
+    if (selected(name)) measure("bitset", name, variant, N, b, op);
+  };
+
+  run("get_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    sink += v->test(pos[i++ & (POS_COUNT - 1)]);
+  });
+  run("set_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    v->set(pos[i++ & (POS_COUNT - 1)]);
+  });
+  run("flip_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    v->flip(pos[i++ & (POS_COUNT - 1)]);
+  });
+  run("clear_bit", "random", sizeof(ARRAY_TYPE), [&] {
+    v->reset(pos[i++ & (POS_COUNT - 1)]);
+  });
+  run("set_all_bits", "-", bytes, [&] { v->set(); });
+  run("flip_all_bits", "-", bytes, [&] { v->flip(); });
+  run("clear_all_bits", "-", bytes, [&] { v->reset(); });
+  run("count_bits", "half", bytes, [&] {
+    *v ^= *w;
+    sink += v->count();
+  });
+  run("and_bits_inplace", "-", 2 * bytes, [&] { *v &= *w; });
+  run("or_bits_inplace", "-", 2 * bytes, [&] { *v |= *w; });
+  run("xor_bits_inplace", "-", 2 * bytes, [&] { *v ^= *w; });
+  run("equal_bits", "equal", 2 * bytes, [&] { sink += (*v == *w); });
+  run("copy_all_bits", "-", 2 * bytes, [&] { *w = *v; });
+  const size_t shifts[] = {1, BITS_PER_EL, N / 3};
+  const char *names[] = {"by1", "by64", "byn/3"};
+  for (int k = 0; k < 3; k++) {
+    size_t n = shifts[k];
+    if (!n || n >= N) continue;
+    run("right_shift_bits_inplace", names[k], bytes, [&] { *v >>= n; });
+    run("left_shift_bits_inplace", names[k], bytes, [&] { *v <<= n; });
+    run("rotate_left", names[k], bytes, [&] {
+      *v = (*v << n) | (*v >> (N - n));
+    });
+  }
+}
+
+void bitset_baselines(size_t n_bits) {
+  switch (n_bits) {
+    case 1 << 6: bitset_baselines<1 << 6>(); break;
+    case 1 << 12: bitset_baselines<1 << 12>(); break;
+    case 1 << 16: bitset_baselines<1 << 16>(); break;
+    case 1 << 20: bitset_baselines<1 << 20>(); break;
+    case 1 << 24: bitset_baselines<1 << 24>(); break;
+    default: break;
+  }
+}
+
+// path of the libbitarray that was loaded (tells builds apart in the JSON)
+std::string library_path() {
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(&create_bitarray), &info) &&
+      info.dli_fname) {
+    return info.dli_fname;
+  }
+  return "unknown";
+}
+
+void pin_cpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set)) {
+    perror("sched_setaffinity");
+    exit(1);
+  }
+}
+
+void json_string(FILE *f, const std::string &str) {
+  fputc('"', f);
+  for (char c : str) {
+    if (c == '"' || c == '\\') fputc('\\', f);
+    fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+void json_array(FILE *f, const std::vector<double> &v) {
+  fputc('[', f);
+  for (size_t i = 0; i < v.size(); i++) {
+    fprintf(f, "%s%.6g", i ? ", " : "", v[i]);
+  }
+  fputc(']', f);
+}
+
+void write_json(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    exit(1);
+  }
+
+  fprintf(f, "{\n  \"version\": 1,\n  \"library\": ");
+  json_string(f, library_path());
+  fprintf(f, ",\n  \"cpu\": %d,\n  \"reps\": %u,\n  \"warmup\": %u,\n"
+             "  \"min_time\": %g,\n  \"results\": [",
+          opts.cpu, opts.reps, opts.warmup, opts.min_time);
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(f, "%s\n    {\"impl\": ", i ? "," : "");
+    json_string(f, r.impl);
+    fprintf(f, ", \"function\": ");
+    json_string(f, r.name);
+    fprintf(f, ", \"variant\": ");
+    json_string(f, r.variant);
+    fprintf(f, ", \"bits\": %zu, \"iters\": %zu, \"bytes_per_op\": %.6g, "
+               "\"ns_per_op\": ", r.n_bits, r.iters, r.bytes_per_op);
+    json_array(f, r.ns);
+    if (!r.cycles.empty()) {
+      fprintf(f, ", \"cycles_per_op\": ");
+      json_array(f, r.cycles);
+      fprintf(f, ", \"misses_per_op\": ");
+      json_array(f, r.misses);
+    }
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--min-log2 N] [--max-log2 N] [--step N] "
+          "[--min-time S]\n"
+          "          [--filter SUBSTR[,SUBSTR...]] [--no-baselines] "
+          "[--no-perf]\n"
+          "          [--reps N] [--warmup N] [--cpu N] [--json FILE]\n",
+          prog);
+  exit(1);
+}
+
+void parse_args(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if (a == "--min-log2" && has_val) {
+      opts.min_log2 = atoi(argv[++i]);
+    } else if (a == "--max-log2" && has_val) {
+      opts.max_log2 = atoi(argv[++i]);
+    } else if (a == "--step" && has_val) {
+      opts.step = std::max(1, atoi(argv[++i]));
+    } else if (a == "--min-time" && has_val) {
+      opts.min_time = atof(argv[++i]);
+    } else if (a == "--filter" && has_val) {
+      opts.filter = argv[++i];
+    } else if (a == "--no-baselines") {
+      opts.baselines = false;
+    } else if (a == "--no-perf") {
+      opts.perf = false;
+    } else if (a == "--reps" && has_val) {
+      opts.reps = std::max(1, atoi(argv[++i]));
+    } else if (a == "--warmup" && has_val) {
+      opts.warmup = std::max(0, atoi(argv[++i]));
+    } else if (a == "--cpu" && has_val) {
+      opts.cpu = atoi(argv[++i]);
+    } else if (a == "--json" && has_val) {
+      opts.json = argv[++i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (opts.min_log2 < 6 || opts.max_log2 > 40 ||
+      opts.min_log2 > opts.max_log2) {
+    fprintf(stderr, "sizes must satisfy 6 <= min-log2 <= max-log2 <= 40\n");
+    exit(1);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  parse_args(argc, argv);
+  if (opts.cpu >= 0) pin_cpu(opts.cpu);
+
+  PerfCounters counters;
+  perf = &counters;
+  if (opts.perf && !counters.available()) {
+    fprintf(stderr, "perf_event_open not available, "
+                    "hardware counters disabled\n");
+  }
+
+  printf("%-9s %-28s %-12s %12s %14s %9s %7s %12s %11s\n", "impl",
+         "function", "variant", "bits", "ns/op", "GB/s", "spread%",
+         "cycles/op", "misses/op");
+
+  std::vector<Case> cases = bitarray_cases();
+  for (unsigned lg = opts.min_log2; lg <= opts.max_log2; lg += opts.step) {
+    size_t n_bits = static_cast<size_t>(1) << lg;
+    for (const Case &c : cases) {
+      if (lg > c.max_log2 || !selected(c.name)) continue;
+      c.run(c.name, n_bits);
+    }
+
+    if (opts.baselines) {
+      bitset_baselines(n_bits);
+      if (lg <= BASELINE_MAX_LOG2) vector_bool_baselines(n_bits);
+    }
+  }
+
+  if (!opts.json.empty()) write_json(opts.json);
+
+  return 0;
+}
@@ -0,0 +1,213 @@
+#include "bitarray_map.h"
+
+// hash of key as stored in the map (0 marks empty slots)
+static inline uint64_t __map_hash(bitarray *key) {
+  uint64_t h = hash_bits(key, 0);
+  return h ? h : 1;
+}
+
+static inline size_t __map_key_els(size_t key_bits) {
+  return (key_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+}
+
+// elements of the key in slot s
+static inline ARRAY_TYPE* __map_key_array(bitarray_map *m,
+                                          bitarray_map_slot *s) {
+  return s->key_bits <= __MAP_INLINE_BITS ? s->_inline
+                                          : m->_arena + s->_key;
+}
+
+// slot that holds key (with hash h) or the empty slot where the probe
+// sequence of h ends
+static inline size_t __map_find(bitarray_map *m, bitarray *key,
+                                uint64_t h) {
+  size_t mask = m->capacity - 1;
+  for (size_t i = h & mask; ; i = (i + 1) & mask) {
+    bitarray_map_slot *s = &m->slots[i];
+    if (!s->hash) return i;
+    if (s->hash == h && s->key_bits == key->size) {
+      bitarray stored = {s->key_bits, __map_key_els(s->key_bits),
+                         __map_key_array(m, s), true, NULL};
+      if (equal_bits(&stored, key)) return i;
+    }
+  }
+}
+
+static void __map_alloc(bitarray_map *m, size_t capacity) {
+  m->capacity = capacity;
+  // (one cache line per slot)
+  m->slots = (bitarray_map_slot*) aligned_alloc(
+    64, capacity * sizeof(bitarray_map_slot));
+  assert(m->slots);
+  for (size_t i = 0; i < capacity; i++) m->slots[i].hash = 0;
+}
+
+// move the long keys into a new arena with room for at least extra more
+// elements, leaving out the elements of removed keys
+static void __map_compact(bitarray_map *m, size_t extra) {
+  size_t live = m->_arena_used - m->_arena_free;
+  size_t capacity = 2 * (live + extra);
+  if (capacity < 64) capacity = 64;
+  ARRAY_TYPE *arena = (ARRAY_TYPE*) malloc(capacity * TYPE_SIZE);
+  assert(arena);
+
+  size_t used = 0;
+  for (size_t i = 0; i < m->capacity; i++) {
+    bitarray_map_slot *s = &m->slots[i];
+    if (!s->hash || s->key_bits <= __MAP_INLINE_BITS) continue;
+    size_t n_els = __map_key_els(s->key_bits);
+    memcpy(arena + used, m->_arena + s->_key, n_els * TYPE_SIZE);
+    s->_key = used;
+    used += n_els;
+  }
+
+  free(m->_arena);
+  m->_arena = arena;
+  m->_arena_used = used;
+  m->_arena_free = 0;
+  m->_arena_capacity = capacity;
+}
+
+// double the capacity, placing the entries by their cached hashes
+static void __map_grow(bitarray_map *m) {
+  bitarray_map_slot *slots = m->slots;
+  size_t old_capacity = m->capacity;
+
+  __map_alloc(m, 2 * old_capacity);
+  size_t mask = m->capacity - 1;
+  for (size_t j = 0; j < old_capacity; j++) {
+    if (!slots[j].hash) continue;
+    size_t i = slots[j].hash & mask;
+    while (m->slots[i].hash) i = (i + 1) & mask;
+    m->slots[i] = slots[j];
+  }
+  free(slots);
+
+  if (m->_arena_free) __map_compact(m, 0);
+}
+
+// store a copy of key in slot s (the bits after its size cleared)
+static void __map_store_key(bitarray_map *m, bitarray_map_slot *s,
+                            bitarray *key) {
+  size_t n_els = __map_key_els(key->size);
+  s->key_bits = key->size;
+  if (key->size > __MAP_INLINE_BITS) {
+    if (m->_arena_used + n_els > m->_arena_capacity) {
+      __map_compact(m, n_els);
+    }
+    s->_key = m->_arena_used;
+    m->_arena_used += n_els;
+  }
+
+  ARRAY_TYPE *dst = __map_key_array(m, s);
+  if (n_els) memcpy(dst, key->array, n_els * TYPE_SIZE);
+  if (key->size % BITS_PER_EL) {
+    dst[n_els - 1] &= (MASK_1 << (key->size % BITS_PER_EL)) - 1;
+  }
+}
+
+// insert key with value if it's new, else replace its value if replace
+static bool __map_insert(bitarray_map *m, bitarray *key, uint64_t value,
+                         bool replace) {
+  assert(m && key);
+
+  uint64_t h = __map_hash(key);
+  size_t i = __map_find(m, key, h);
+  if (m->slots[i].hash) {
+    if (replace) m->slots[i].value = value;
+    return false;
+  }
+
+  // (max. load factor 3/4)
+  if (4 * (m->size + 1) > 3 * m->capacity) {
+    __map_grow(m);
+    i = __map_find(m, key, h);
+  }
+  bitarray_map_slot *s = &m->slots[i];
+  __map_store_key(m, s, key);
+  s->value = value;
+  s->hash = h;
+  m->size++;
+  return true;
+}
+
+bitarray_map* create_bitarray_map(size_t n_keys) {
+  bitarray_map *m = (bitarray_map*) malloc(sizeof(bitarray_map));
+  assert(m);
+
+  size_t capacity = 16;
+  while (3 * capacity < 4 * n_keys) capacity *= 2;
+  __map_alloc(m, capacity);
+  m->size = 0;
+  m->_arena = NULL;
+  m->_arena_used = 0;
+  m->_arena_free = 0;
+  m->_arena_capacity = 0;
+  return m;
+}
+
+void delete_bitarray_map(bitarray_map *m) {
+  assert(m);
+
+  free(m->slots);
+  free(m->_arena);
+  free(m);
+}
+
+bool bitarray_map_add(bitarray_map *m, bitarray *key, uint64_t value) {
+  return __map_insert(m, key, value, false);
+}
+
+bool bitarray_map_put(bitarray_map *m, bitarray *key, uint64_t value) {
+  return __map_insert(m, key, value, true);
+}
+
+bool bitarray_map_get(bitarray_map *m, bitarray *key, uint64_t *value) {
+  assert(m && key);
+
+  size_t i = __map_find(m, key, __map_hash(key));
+  if (!m->slots[i].hash) return false;
+  if (value) *value = m->slots[i].value;
+  return true;
+}
+
+bool bitarray_map_remove(bitarray_map *m, bitarray *key) {
+  assert(m && key);
+
+  size_t mask = m->capacity - 1;
+  size_t hole = __map_find(m, key, __map_hash(key));
+  if (!m->slots[hole].hash) return false;
+  if (m->slots[hole].key_bits > __MAP_INLINE_BITS) {
+    m->_arena_free += __map_key_els(m->slots[hole].key_bits);
+  }
+  m->slots[hole].hash = 0;
+  m->size--;
+
+  // move entries after the hole back that can't be found anymore
+  for (size_t i = (hole + 1) & mask; m->slots[i].hash; i = (i + 1) & mask) {
+    size_t home = m->slots[i].hash & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      m->slots[hole] = m->slots[i];
+      m->slots[i].hash = 0;
+      hole = i;
+    }
+  }
+  return true;
+}
+
+size_t bitarray_map_next(bitarray_map *m, size_t slot) {
+  assert(m);
+
+  while (slot < m->capacity && !m->slots[slot].hash) slot++;
+  return slot;
+}
+
+bitarray bitarray_map_key(bitarray_map *m, size_t slot) {
+  assert(m);
+  assert(slot < m->capacity && m->slots[slot].hash);
+
+  bitarray_map_slot *s = &m->slots[slot];
+  bitarray key = {s->key_bits, __map_key_els(s->key_bits),
+                  __map_key_array(m, s), true, NULL};
+  return key;
+}
@@ -0,0 +1,83 @@
+#ifndef BITARRAY_MAP_H_
+#define BITARRAY_MAP_H_
+
+// hash map (or set, ignoring the values) keyed by bitarrays, e.g. to
+// deduplicate signatures
+//
+// open addressing with linear probing over 64 byte slots that hold a
+// key's hash (hash_bits), size, value and, for keys of up to
+// __MAP_INLINE_BITS bits, its elements, so a lookup of such a key reads
+// one cache line per probed slot (usually one). longer keys are stored in
+// an arena the slot points into (a second cache miss). a key's bits are
+// only compared if its full 64 bit hash matches. growing reuses the
+// cached hashes instead of rehashing the keys (and compacts the arena);
+// removal shifts the following entries back (no tombstones).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// key bits stored in the slot itself
+#define __MAP_INLINE_BITS 256
+
+typedef struct {
+  uint64_t hash;         // hash of the key (0: empty slot)
+  uint64_t value;
+  size_t key_bits;       // size of the key
+  size_t _key;           // offset of the key's elements in _arena (keys
+                         // longer than __MAP_INLINE_BITS bits)
+  ARRAY_TYPE _inline[__MAP_INLINE_BITS / BITS_PER_EL];  // shorter keys
+} bitarray_map_slot;
+
+typedef struct {
+  size_t size;              // number of keys
+  size_t capacity;          // number of slots (a power of 2)
+  bitarray_map_slot *slots;
+  ARRAY_TYPE *_arena;       // elements of the long keys
+  size_t _arena_used;       // elements in use (including removed keys')
+  size_t _arena_free;       // elements of removed keys
+  size_t _arena_capacity;
+} bitarray_map;
+
+// create empty map with room for n_keys keys before it grows
+bitarray_map* create_bitarray_map(size_t n_keys);
+
+// delete map and free allocated memory
+void delete_bitarray_map(bitarray_map *m);
+
+// insert a copy of key with value unless the map holds key already;
+// returns true if it was inserted (set semantics: an existing key keeps
+// its value)
+bool bitarray_map_add(bitarray_map *m, bitarray *key, uint64_t value);
+
+// set the value of key (inserting a copy of key if it's new); returns
+// true if it was inserted
+bool bitarray_map_put(bitarray_map *m, bitarray *key, uint64_t value);
+
+// look key up; returns true and stores its value in *value (if value
+// isn't NULL) if the map holds it
+bool bitarray_map_get(bitarray_map *m, bitarray *key, uint64_t *value);
+
+// remove key; returns true if the map held it
+bool bitarray_map_remove(bitarray_map *m, bitarray *key);
+
+// first occupied slot at or after slot (capacity if there is none), to
+// iterate over the keys (bitarray_map_key) and m->slots[i].value:
+// for (size_t i = bitarray_map_next(m, 0); i < m->capacity;
+//      i = bitarray_map_next(m, i + 1))
+size_t bitarray_map_next(bitarray_map *m, size_t slot);
+
+// view of the key in occupied slot (valid until the map is modified)
+bitarray bitarray_map_key(bitarray_map *m, size_t slot);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // BITARRAY_MAP_H_
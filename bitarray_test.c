@@ -1,4 +1,20 @@
 #include "bitarray.h"
+#include "bsi.h"
+#include "bloom.h"
+#include "bitmap_index.h"
+#include "bitmatrix.h"
+#include "hamming.h"
+#include "paged_bitarray.h"
+#include "cow_bitarray.h"
+#include "bitarray_map.h"
+#include "shm_bitarray.h"
+#include "id_allocator.h"
+#include "ring_bitarray.h"
+#include "elias_fano.h"
+
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 static bool COUNT_EQUAL(bitarray *b, size_t from, size_t to, size_t ans) {
   if (from == 0 && to == b->size) {
@@ -8,6 +24,34 @@ static bool COUNT_EQUAL(bitarray *b, size_t from, size_t to, size_t ans) {
   }
 }
 
+static int CMP_UINT64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+// allocates IDs and frees every second one, marking the IDs it keeps in
+// owned (a shared, non-atomic array: a duplicate ID shows up as a count > 1)
+typedef struct {
+  id_allocator *a;
+  uint8_t *owned;
+  size_t n;
+} ID_WORKER_ARGS;
+
+static void* ID_WORKER(void *p) {
+  ID_WORKER_ARGS *args = (ID_WORKER_ARGS*) p;
+  for (size_t i = 0; i < args->n; i++) {
+    size_t id = alloc_id(args->a);
+    if (id == SIZE_MAX) return p;
+    if (i % 2) {
+      free_id(args->a, id);
+    } else {
+      __atomic_fetch_add(&args->owned[id], 1, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+}
+
 static bool BITS_EQUAL(bitarray *b1, bitarray *b2, bool cmp_str) {
   bool ans;
   if (cmp_str) {
@@ -385,6 +429,1263 @@ int execute_tests() {
   delete_bitarray(ref);
   delete_bitarray(res);
 
+  // rotate and reverse
+  b =   create_bitarray_from_str("0100101010010001010011101", 25);
+  ref = create_bitarray_from_str("1001000101001110101001010", 25);
+  rotate_left(b, 8);
+  ans = !BITS_EQUAL(b, ref, false);
+  rotate_right(b, 8 + 2 * 25);
+  delete_bitarray(ref);
+  ref = create_bitarray_from_str("0100101010010001010011101", 25);
+  ans |= !BITS_EQUAL(b, ref, false);
+  reverse_bits(b);
+  delete_bitarray(ref);
+  ref = create_bitarray_from_str("1011100101000100101010010", 25);
+  ans |= !BITS_EQUAL(b, ref, false);
+  total_tests++;
+  if (ans) printf("Test %d (rotate/reverse_bits) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+  delete_bitarray(ref);
+
+  // rotate and reverse ranges (against bit by bit results)
+  ans = false;
+  srand(41);
+  for (int t = 0; t < 300; t++) {
+    size_t n = 1 + rand() % 2000;
+    size_t from = rand() % n;
+    size_t to = from + rand() % (n - from + 1);
+    size_t k = rand() % 3000;
+    int op = t % 3;
+    b = create_bitarray(n);
+    for (size_t i = 0; i < n; i++) {
+      if (rand() % 2) set_bit(b, i);
+    }
+    ref = copy_bitarray(b);
+    size_t len = to - from;
+    for (size_t i = 0; i < len; i++) {
+      size_t j = op == 0 ? (i + len - k % len) % len
+               : op == 1 ? (i + k) % len : len - 1 - i;
+      if (get_bit(b, from + j)) {
+        set_bit(ref, from + i);
+      } else {
+        clear_bit(ref, from + i);
+      }
+    }
+    if (op == 0) rotate_left_bit_range(b, from, to, k);
+    if (op == 1) rotate_right_bit_range(b, from, to, k);
+    if (op == 2) reverse_bit_range(b, from, to);
+    ans |= !BITS_EQUAL(b, ref, false);
+    delete_bitarray(b);
+    delete_bitarray(ref);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (rotate/reverse_bit_range) failed.\n", total_tests);
+  fail_c += ans;
+
+  // extract/deposit (against bit by bit results)
+  ans = false;
+  srand(42);
+  b2 = create_bitarray(1);
+  for (int t = 0; t < 200; t++) {
+    size_t n = 1 + rand() % 3000;
+    int density = rand() % 4;
+    b = create_bitarray(n);
+    bitarray *mask = create_bitarray(n);
+    for (size_t i = 0; i < n; i++) {
+      if (rand() % 2) set_bit(b, i);
+      if (density == 3 ? rand() % 8 != 0 : rand() % 4 < density) {
+        set_bit(mask, i);
+      }
+    }
+    set_bit(mask, rand() % n);
+    // (b2 is reused, so it grows and shrinks)
+    extract_bits(b2, b, mask);
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (get_bit(mask, i)) ans |= get_bit(b2, k++) != get_bit(b, i);
+    }
+    ans |= b2->size != k;
+
+    res = create_set_bitarray(n);
+    deposit_bits(res, b2, mask);
+    ref = copy_bitarray(b);
+    and_bits_inplace(ref, mask);
+    ans |= !BITS_EQUAL(res, ref, false);
+
+    // in-place
+    extract_bits(b, b, mask);
+    ans |= !BITS_EQUAL(b, b2, false);
+    delete_bitarray(ref);
+    delete_bitarray(res);
+    delete_bitarray(mask);
+    delete_bitarray(b);
+  }
+  delete_bitarray(b2);
+  total_tests++;
+  if (ans) printf("Test %d (extract/deposit_bits) failed.\n", total_tests);
+  fail_c += ans;
+
+  // wrap external buffers
+  ARRAY_TYPE words[4] = {0, 0, 0, ARRAY_TYPE_MAX};
+  b = wrap_bitarray(words, 200, false);
+  set_bit(b, 3);
+  set_bit_range(b, 130, 140);
+  ans = !(b->array == words && words[0] == 8 && count_bits(b) == 19 &&
+          words[3] == (MASK_1 << 8) - 1);
+  b2 = create_bitarray(200);
+  or_bits_inplace(b2, b);
+  ans |= !BITS_EQUAL(b, b2, false);
+  append_all_bits(b2, b);  // moves the bits to an owned array
+  ans |= b->array == words || b->size != 400 || count_bits(b) != 38 ||
+         words[0] != 8;
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // (exactly sized owned array, binary ops with a larger array)
+  ARRAY_TYPE *owned = (ARRAY_TYPE*) malloc(2 * TYPE_SIZE);
+  owned[0] = 5;
+  owned[1] = ARRAY_TYPE_MAX;
+  b = wrap_bitarray(owned, 2 * BITS_PER_EL, true);
+  b2 = create_set_bitarray(2 * BITS_PER_EL);
+  and_bits_inplace(b2, b);
+  xor_bits_inplace(b, b2);
+  res = copy_bitarray(b2);
+  ans |= count_bits(b2) != 2 + BITS_PER_EL || count_bits(b) != 0 ||
+         !BITS_EQUAL(res, b2, false);
+  delete_bitarray(res);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // bytes in MSB-first (in place) and LSB-first order (unaligned, copied)
+  uint64_t storage[6];
+  uint8_t *bytes = (uint8_t*) storage;
+  srand(43);
+  for (size_t i = 0; i < sizeof(storage); i++) bytes[i] = rand();
+  uint8_t msb[sizeof(storage)];
+  memcpy(msb, bytes, sizeof(storage));
+  b = wrap_bitarray_bytes(bytes, sizeof(storage), 300, BITARRAY_MSB_FIRST,
+                          false);
+  ans |= b->array != (ARRAY_TYPE*) bytes;
+  for (size_t i = 0; i < 300; i++) {
+    ans |= get_bit(b, i) != ((msb[i / 8] >> (7 - i % 8)) & 1);
+  }
+  b2 = wrap_bitarray_bytes(msb + 1, 40, 300, BITARRAY_LSB_FIRST, false);
+  ans |= b2->array == (ARRAY_TYPE*) (msb + 1);
+  for (size_t i = 0; i < 300; i++) {
+    ans |= get_bit(b2, i) != ((msb[1 + i / 8] >> (i % 8)) & 1);
+  }
+  uint8_t exported[38];
+  copy_bitarray_to_bytes(b, exported, BITARRAY_MSB_FIRST);
+  ans |= memcmp(exported, msb, 37) ||
+         exported[37] != (msb[37] & 0xf0);
+  copy_bitarray_to_bytes(b2, exported, BITARRAY_LSB_FIRST);
+  ans |= memcmp(exported, msb + 1, 37) ||
+         exported[37] != (msb[38] & 0x0f);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+  total_tests++;
+  if (ans) printf("Test %d (wrap_bitarray/_bytes) failed.\n", total_tests);
+  fail_c += ans;
+
+  // test any/all bits in range
+  b = create_bitarray(300);
+  set_bit_range(b, 70, 250);
+  ans = !(test_all_bit_range(b, 70, 250) && !test_all_bit_range(b, 69, 250) &&
+          !test_all_bit_range(b, 70, 251) && test_all_bit_range(b, 5, 5) &&
+          test_any_bit_range(b, 0, 71) && !test_any_bit_range(b, 0, 70) &&
+          !test_any_bit_range(b, 250, 300) && test_any_bit_range(b, 249, 300));
+  total_tests++;
+  if (ans) printf("Test %d (test_any/all_bit_range) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  // runs of unset/set bits (an allocation map with holes)
+  b = create_bitarray(2000);
+  set_bit_range(b, 0, 1000);
+  clear_bit_range(b, 100, 104);
+  clear_bit_range(b, 300, 311);
+  clear_bit_range(b, 600, 700);
+  size_t run_pos, run_pos2, run_pos3;
+  ans = find_clear_run(b, 4, 0) != 100 || find_clear_run(b, 5, 0) != 300 ||
+        find_clear_run(b, 12, 0) != 600 || find_clear_run(b, 101, 0) != 1000 ||
+        find_clear_run(b, 50, 650) != 650 ||
+        find_clear_run(b, 1000, 1000) != 1000 ||
+        find_clear_run(b, 1001, 0) != SIZE_MAX ||
+        find_clear_run(b, 1001, 999) != SIZE_MAX ||
+        find_set_run(b, 100, 0) != 0 || find_set_run(b, 200, 150) != 311 ||
+        find_set_run(b, 300, 0) != 700 || find_set_run(b, 301, 0) != SIZE_MAX;
+  ans |= longest_clear_run(b, 0, 2000, &run_pos) != 1000 ||
+         run_pos != 1000 ||
+         longest_clear_run(b, 0, 1000, &run_pos2) != 100 ||
+         run_pos2 != 600 ||
+         longest_set_run(b, 0, 2000, &run_pos3) != 300 || run_pos3 != 700 ||
+         longest_set_run(b, 50, 60, &run_pos) != 10 || run_pos != 50 ||
+         longest_clear_run(b, 50, 60, &run_pos) != 0 || run_pos != SIZE_MAX;
+  total_tests++;
+  if (ans) printf("Test %d (find/longest_clear/set_run) failed.\n",
+                  total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  // runs of set bits as intervals and back
+  bitarray_interval ivs[4] = {{3, 5}, {60, 200}, {300, 301}, {399, 400}};
+  b = create_bitarray_from_intervals(400, ivs, 4);
+  bitarray_interval out_ivs[4];
+  size_t run_end;
+  ans = count_bits(b) != 2 + 140 + 1 + 1 ||
+        convert_bitarray_to_intervals(b, out_ivs, 4) != 4 ||
+        memcmp(out_ivs, ivs, sizeof(ivs)) ||
+        convert_bitarray_to_intervals(b, out_ivs, 1) != 4 ||
+        convert_bitarray_to_intervals(b, NULL, 0) != 4 ||
+        next_set_run(b, 100, &run_end) != 100 || run_end != 200 ||
+        next_set_run(b, 200, &run_end) != 300 || run_end != 301 ||
+        next_set_run(b, 399, &run_end) != 399 || run_end != 400 ||
+        next_set_run(b, 400, &run_end) != 400;
+  size_t n_runs = 0, run_bits = 0;
+  for (size_t start = next_set_run(b, 0, &run_end); start < b->size;
+       start = next_set_run(b, run_end, &run_end)) {
+    n_runs++;
+    run_bits += run_end - start;
+  }
+  ans |= n_runs != 4 || run_bits != count_bits(b);
+  total_tests++;
+  if (ans) printf("Test %d (next_set_run/intervals) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  // range ops inside a single element
+  b = create_bitarray(64);
+  set_bit_range(b, 3, 9);
+  flip_bit_range(b, 5, 7);
+  clear_bit_range(b, 8, 9);
+  ans = !(COUNT_EQUAL(b, 0, 64, 3) && get_bit(b, 3) && get_bit(b, 4) &&
+          get_bit(b, 7) && !get_bit(b, 5) && !get_bit(b, 8));
+  total_tests++;
+  if (ans) printf("Test %d (short bit ranges) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  // copy unaligned range (from > 0) into a larger bitarray
+  b = create_bitarray(500);
+  for (size_t i = 0; i < 500; i += 3) set_bit(b, i);
+  b2 = create_set_bitarray(400);
+  copy_bit_range(b, b2, 37, 337);
+  ans = b2->size != 300 || count_bits(b2) != 100;
+  for (size_t i = 0; i < 300; i++) ans |= get_bit(b2, i) != get_bit(b, i + 37);
+  total_tests++;
+  if (ans) printf("Test %d (copy_bit_range unaligned) failed.\n", total_tests);
+  fail_c += ans;
+
+  // append to itself, growing the array several times
+  copy_bit_range(b, b2, 0, 10);
+  for (int k = 0; k < 6; k++) append_bit_range(b2, b2, 3, 10);
+  append_bit_range(b, b2, 1, 450);
+  ans = b2->size != 10 + 6 * 7 + 449;
+  for (size_t i = 0; i < 52; i++) {
+    ans |= get_bit(b2, i) != get_bit(b, i < 10 ? i : 3 + (i - 10) % 7);
+  }
+  for (size_t i = 0; i < 449; i++) {
+    ans |= get_bit(b2, 52 + i) != get_bit(b, i + 1);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (append_bit_range growth) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // batch functions match the single-bit functions
+  size_t positions[200];
+  for (size_t i = 0; i < 200; i++) positions[i] = (i * 7919) % 1000;
+  b = create_bitarray(1000);
+  b2 = create_bitarray(1000);
+  set_bits(b, positions, 200);
+  for (size_t i = 0; i < 200; i++) set_bit(b2, positions[i]);
+  clear_bits(b, positions + 150, 50);
+  for (size_t i = 150; i < 200; i++) clear_bit(b2, positions[i]);
+  bitarray *got = create_set_bitarray(300);
+  get_bits(b, positions + 100, 100, got);
+  ans = !equal_bits(b, b2) || count_bits(b) != 150 ||
+        count_bit_range(got, 100, 300) != 200;
+  for (size_t i = 0; i < 100; i++) {
+    ans |= get_bit(got, i) != get_bit(b, positions[100 + i]);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (set_bits/clear_bits/get_bits) failed.\n",
+                  total_tests);
+  fail_c += ans;
+  delete_bitarray(got);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // bit-sliced index (compared against a scan of the values)
+  uint64_t values[300];
+  uint64_t seed = 12345;
+  for (size_t i = 0; i < 300; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    values[i] = (seed >> 33) % 1000;
+  }
+  bsi *index = create_bsi(values, 300);
+  ans = index->n_slices != 10;
+  for (size_t i = 0; i < 300; i++) ans |= bsi_get_value(index, i) != values[i];
+  total_tests++;
+  if (ans) printf("Test %d (create_bsi) failed.\n", total_tests);
+  fail_c += ans;
+
+  const uint64_t bounds[] = {0, 1, 333, values[7], 999, 1023, 5000};
+  ans = false;
+  for (int i = 0; i < 7; i++) {
+    uint64_t x = bounds[i], y = bounds[(i + 3) % 7];
+    bitarray *r[] = {bsi_lt(index, x), bsi_le(index, x), bsi_eq(index, x),
+                     bsi_gt(index, x), bsi_ge(index, x),
+                     bsi_between(index, x, y)};
+    for (size_t row = 0; row < 300; row++) {
+      uint64_t v = values[row];
+      ans |= get_bit(r[0], row) != (v < x) || get_bit(r[1], row) != (v <= x) ||
+             get_bit(r[2], row) != (v == x) || get_bit(r[3], row) != (v > x) ||
+             get_bit(r[4], row) != (v >= x) ||
+             get_bit(r[5], row) != (x <= v && v <= y);
+    }
+    for (int k = 0; k < 6; k++) {
+      ans |= count_bits(r[k]) != count_bit_range(r[k], 0, 300);
+      delete_bitarray(r[k]);
+    }
+  }
+  total_tests++;
+  if (ans) printf("Test %d (bsi comparisons) failed.\n", total_tests);
+  fail_c += ans;
+
+  b = bsi_ge(index, 500);
+  uint64_t sum = 0, filtered_sum = 0;
+  for (size_t i = 0; i < 300; i++) {
+    sum += values[i];
+    if (values[i] >= 500) filtered_sum += values[i];
+  }
+  ans = bsi_sum(index, NULL) != sum || bsi_sum(index, b) != filtered_sum;
+  total_tests++;
+  if (ans) printf("Test %d (bsi_sum) failed.\n", total_tests);
+  fail_c += ans;
+
+  // top 10 of the rows >= 500: nothing outside of them may be larger
+  res = bsi_top_k(index, b, 10);
+  uint64_t min_top = UINT64_MAX, max_rest = 0;
+  for (size_t i = 0; i < 300; i++) {
+    if (get_bit(res, i)) {
+      min_top = values[i] < min_top ? values[i] : min_top;
+    } else if (get_bit(b, i)) {
+      max_rest = values[i] > max_rest ? values[i] : max_rest;
+    }
+  }
+  ans = count_bits(res) != 10 || max_rest > min_top;
+  delete_bitarray(res);
+  res = bsi_top_k(index, NULL, 1000);
+  ans |= count_bits(res) != 300;
+  delete_bitarray(res);
+  total_tests++;
+  if (ans) printf("Test %d (bsi_top_k) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  // ties: of four equal values only the first two rows are taken
+  bsi_set_value(index, 299, 1 << 20);
+  for (size_t i = 10; i < 14; i++) bsi_set_value(index, i, 5000);
+  res = bsi_top_k(index, NULL, 3);
+  ans = index->n_slices != 21 || bsi_get_value(index, 299) != 1 << 20 ||
+        count_bits(res) != 3 || !get_bit(res, 299) || !get_bit(res, 10) ||
+        !get_bit(res, 11) || bsi_sum(index, res) != (1 << 20) + 10000;
+  total_tests++;
+  if (ans) printf("Test %d (bsi_set_value) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(res);
+  delete_bsi(index);
+
+  // bloom filters: no false negatives, false-positive rate near the target
+  uint64_t keys[2000];
+  for (size_t i = 0; i < 2000; i++) keys[i] = i * 0x9E3779B97F4A7C15ULL;
+  for (int blocked = 0; blocked < 2; blocked++) {
+    bloom_filter *filter = create_bloom_filter_for(1000, 0.01, blocked);
+    bloom_insert_many(filter, keys, 999);
+    bloom_insert(filter, keys[999]);
+    res = create_set_bitarray(2000);
+    bloom_contains_many(filter, keys, 2000, res);
+    size_t false_positives = count_bit_range(res, 1000, 2000);
+    ans = filter->k != 7 || (blocked && filter->bits->size % 512) ||
+          count_bit_range(res, 0, 1000) != 1000 || false_positives > 40;
+    for (size_t i = 0; i < 2000; i++) {
+      ans |= bloom_contains(filter, keys[i]) != get_bit(res, i);
+    }
+    total_tests++;
+    if (ans) printf("Test %d (bloom filter, %s) failed.\n", total_tests,
+                    blocked ? "blocked" : "plain");
+    fail_c += ans;
+    delete_bitarray(res);
+    delete_bloom_filter(filter);
+  }
+
+  // bitmap index: planned block-wise queries match the bitwise operations
+  bitmap_index *bindex = create_bitmap_index(1000);
+  for (size_t i = 0; i < 1000; i++) {
+    if (i % 2 == 0) bitmap_index_add(bindex, "even", i);
+    if (i % 3 == 0) bitmap_index_add(bindex, "by-3", i);
+    if (i % 7 == 0) bitmap_index_add(bindex, "by.7", i);
+    if (i >= 990) bitmap_index_add(bindex, "top", i);
+  }
+  for (size_t i = 0; i < 40; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "k%zu", i);
+    bitmap_index_add(bindex, key, i);
+  }
+  bitmap_index_add(bindex, "top", 995);
+  bitmap_index_remove(bindex, "top", 991);
+  bitarray *even = bitmap_index_get(bindex, "even");
+  bitarray *by3 = bitmap_index_get(bindex, "by-3");
+  bitarray *by7 = bitmap_index_get(bindex, "by.7");
+  bitarray *top = bitmap_index_get(bindex, "top");
+  ans = bindex->n_keys != 44 || bitmap_index_get(bindex, "odd") ||
+        bitmap_index_cardinality(bindex, "top") != 9 ||
+        bitmap_index_cardinality(bindex, "even") != 500 ||
+        bitmap_index_cardinality(bindex, "k39") != 1;
+  // (even AND NOT by-3) OR (by.7 AND NOT (top OR even))
+  bitarray *tmp = not_bits(by3);
+  b = and_bits(even, tmp);
+  delete_bitarray(tmp);
+  tmp = or_bits(top, even);
+  not_bits_inplace(tmp);
+  and_bits_inplace(tmp, by7);
+  or_bits_inplace(b, tmp);
+  delete_bitarray(tmp);
+  bitmap_query *query = parse_bitmap_query(
+    "even AND NOT \"by-3\" OR (by.7 AND NOT (top OR even))");
+  res = query ? bitmap_index_query(bindex, query) : NULL;
+  ans |= !res || !equal_bits(res, b);
+  delete_bitarray(b);
+  delete_bitarray(res);
+  delete_bitmap_query(query);
+  // NOT NOT, missing keys and an empty intersection
+  query = parse_bitmap_query("NOT NOT top AND NOT missing");
+  res = query ? bitmap_index_query(bindex, query) : NULL;
+  ans |= !res || !equal_bits(res, top);
+  delete_bitarray(res);
+  delete_bitmap_query(query);
+  query = parse_bitmap_query("(k1 AND k2) OR missing");
+  res = query ? bitmap_index_query(bindex, query) : NULL;
+  ans |= !res || count_bits(res);
+  delete_bitarray(res);
+  delete_bitmap_query(query);
+  query = parse_bitmap_query("NOT (k1 AND missing)");
+  res = query ? bitmap_index_query(bindex, query) : NULL;
+  ans |= !res || count_bits(res) != 1000;
+  delete_bitarray(res);
+  delete_bitmap_query(query);
+  // syntax errors
+  const char *invalid[] = {"", "a AND", "(a OR b", "a b", "AND", "\"a"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    query = parse_bitmap_query(invalid[i]);
+    ans |= query != NULL;
+    delete_bitmap_query(query);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (bitmap index) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitmap_index(bindex);
+
+  // bit matrices: transpose, products and counts match bit-by-bit loops
+  bitarray *rows[70];
+  for (size_t i = 0; i < 70; i++) {
+    rows[i] = create_bitarray(150);
+    for (size_t j = 0; j < 150; j++) {
+      if ((i * 31 + j * 17) % 7 < 2 || i == j) set_bit(rows[i], j);
+    }
+  }
+  bitmatrix *ma = create_bitmatrix_from_rows(rows, 70);
+  bitmatrix *mb = create_bitmatrix(150, 90);
+  for (size_t i = 0; i < 150; i++) {
+    for (size_t j = 0; j < 90; j++) {
+      if ((i * 13 + j * 5) % 11 < 3) bitmatrix_set(mb, i, j);
+    }
+  }
+  bitmatrix_clear(mb, 0, 0);
+  bitmatrix *mt = bitmatrix_transpose(ma);
+  bitmatrix *gf2 = bitmatrix_mul_gf2(ma, mb);
+  bitmatrix *boolean = bitmatrix_mul_bool(ma, mb);
+  size_t row_counts[70], col_counts[150];
+  bitmatrix_row_counts(ma, row_counts);
+  bitmatrix_col_counts(ma, col_counts);
+  ans = mt->n_rows != 150 || mt->n_cols != 70 || gf2->n_rows != 70 ||
+        gf2->n_cols != 90 || bitmatrix_get(mb, 0, 0);
+  for (size_t i = 0; i < 70; i++) {
+    bitarray row = bitmatrix_row(ma, i);
+    ans |= !equal_bits(&row, rows[i]) || row_counts[i] != count_bits(rows[i]);
+    for (size_t j = 0; j < 150; j++) {
+      ans |= bitmatrix_get(mt, j, i) != get_bit(rows[i], j);
+    }
+    for (size_t j = 0; j < 90; j++) {
+      bool x = false, y = false;
+      for (size_t k = 0; k < 150; k++) {
+        bool p = get_bit(rows[i], k) && bitmatrix_get(mb, k, j);
+        x ^= p;
+        y |= p;
+      }
+      ans |= bitmatrix_get(gf2, i, j) != x || bitmatrix_get(boolean, i, j) != y;
+    }
+  }
+  for (size_t j = 0; j < 150; j++) {
+    bitarray col = bitmatrix_row(mt, j);
+    ans |= col_counts[j] != count_bits(&col);
+  }
+  // 8x8 blocks (the first 8 with the SIMD path, the other 3 without)
+  uint64_t blocks[11], blocks_t[11];
+  for (size_t b = 0; b < 11; b++) {
+    blocks[b] = 0x9E3779B97F4A7C15ULL * (b + 1);
+    blocks_t[b] = blocks[b];
+  }
+  bitmatrix_transpose_8x8(blocks_t, 11);
+  for (size_t b = 0; b < 11; b++) {
+    for (size_t i = 0; i < 8; i++) {
+      for (size_t j = 0; j < 8; j++) {
+        ans |= ((blocks_t[b] >> (8 * i + j)) & 1) !=
+               ((blocks[b] >> (8 * j + i)) & 1);
+      }
+    }
+  }
+  total_tests++;
+  if (ans) printf("Test %d (bitmatrix) failed.\n", total_tests);
+  fail_c += ans;
+  for (size_t i = 0; i < 70; i++) delete_bitarray(rows[i]);
+  delete_bitmatrix(ma);
+  delete_bitmatrix(mb);
+  delete_bitmatrix(mt);
+  delete_bitmatrix(gf2);
+  delete_bitmatrix(boolean);
+
+  // GF(2) elimination: 90 x 140 matrix of rank 80 (rows 80 to 89 are
+  // sums of other rows), a * solve(a * x) == a * x, a * nullspace == 0
+  bitmatrix *ga = create_bitmatrix(90, 140);
+  uint64_t state = 88172645463325252ULL;
+  for (size_t i = 0; i < 80; i++) {
+    for (size_t j = 0; j < 140; j++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      if (state & 1) bitmatrix_set(ga, i, j);
+    }
+    bitmatrix_set(ga, i, i);
+    for (size_t j = 0; j < i; j++) bitmatrix_clear(ga, i, j);
+  }
+  for (size_t i = 80; i < 90; i++) {
+    for (size_t j = 0; j < 140; j++) {
+      if (bitmatrix_get(ga, i - 80, j) != bitmatrix_get(ga, 2 * i - 150, j)) {
+        bitmatrix_set(ga, i, j);
+      }
+    }
+  }
+  bitmatrix *gx = create_bitmatrix(140, 1);
+  for (size_t j = 0; j < 140; j += 3) bitmatrix_set(gx, j, 0);
+  bitmatrix *gb = bitmatrix_mul_gf2(ga, gx);
+  bitmatrix *gbt = bitmatrix_transpose(gb);
+  bitarray col = bitmatrix_row(gbt, 0);
+  bitarray *x = bitmatrix_solve(ga, &col, 2);
+  bitmatrix *ns = bitmatrix_nullspace(ga, 1);
+  ans = bitmatrix_rank(ga, 1) != 80 || !x || !ns || ns->n_rows != 60;
+  if (x && ns) {
+    bitmatrix *xm = create_bitmatrix_from_rows(&x, 1);
+    bitmatrix *xt = bitmatrix_transpose(xm);
+    bitmatrix *ax = bitmatrix_mul_gf2(ga, xt);
+    bitmatrix *nt = bitmatrix_transpose(ns);
+    bitmatrix *an = bitmatrix_mul_gf2(ga, nt);
+    ans |= memcmp(ax->array, gb->array, 90 * gb->_row_words * TYPE_SIZE) ||
+           bitmatrix_rank(ns, 1) != 60;
+    for (size_t i = 0; i < 90; i++) {
+      bitarray row = bitmatrix_row(an, i);
+      ans |= count_bits(&row) != 0;
+    }
+    delete_bitmatrix(xm);
+    delete_bitmatrix(xt);
+    delete_bitmatrix(ax);
+    delete_bitmatrix(nt);
+    delete_bitmatrix(an);
+  }
+  // inconsistent: row 80 is the sum of rows 0 and 10, its b isn't
+  flip_bit(&col, 80);
+  bitarray *none = bitmatrix_solve(ga, &col, 1);
+  ans |= none != NULL;
+  total_tests++;
+  if (ans) printf("Test %d (bitmatrix GF(2) solver) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(x);
+  delete_bitmatrix(ns);
+  delete_bitmatrix(ga);
+  delete_bitmatrix(gx);
+  delete_bitmatrix(gb);
+  delete_bitmatrix(gbt);
+
+  // Hamming search: 9000 codes of 200 bits around 30 centers, queries near
+  // centers (multi-index hashing) and far from all codes (fallback scan)
+  hamming_index *hi = create_hamming_index(200);
+  bitarray *code = create_bitarray(200);
+  uint64_t hstate = 88172645463325252ULL;
+  for (size_t i = 0; i < 9000; i++) {
+    for (size_t j = 0; j < 200; j++) {
+      hstate ^= hstate << 13;
+      hstate ^= hstate >> 7;
+      hstate ^= hstate << 17;
+      bool center_bit = ((i % 30) * 7 + j * (i % 30 + 3)) % 5 < 2;
+      if (center_bit ^ (hstate % 16 == 0)) {
+        set_bit(code, j);
+      } else {
+        clear_bit(code, j);
+      }
+    }
+    ans |= hamming_index_add(hi, code) != i;
+  }
+  uint32_t *hdist = (uint32_t*) malloc(9000 * sizeof(uint32_t));
+  uint64_t *hkeys = (uint64_t*) malloc(9000 * sizeof(uint64_t));
+  size_t hids[3][25];
+  uint32_t hdists[3][25];
+  for (size_t q = 0; q < 4; q++) {
+    for (size_t j = 0; j < 200; j++) {
+      bool center_bit = ((q * 11) * 7 + j * (q * 11 + 3)) % 5 < 2;
+      if (q < 3 ? center_bit : j % 2) {
+        set_bit(code, j);
+      } else {
+        clear_bit(code, j);
+      }
+    }
+    if (q < 3) flip_bit(code, q * 50);
+    hamming_index_distances(hi, code, hdist);
+    // brute force: sorted (distance, id)
+    for (size_t i = 0; i < 9000; i++) {
+      bitarray c = hamming_index_code(hi, i);
+      bitarray *x = xor_bits(code, &c);
+      ans |= hdist[i] != count_bits(x);
+      delete_bitarray(x);
+      hkeys[i] = (uint64_t) hdist[i] << 32 | i;
+    }
+    qsort(hkeys, 9000, sizeof(uint64_t), CMP_UINT64);
+    ans |= hamming_index_knn(hi, code, 25, hids[0], hdists[0], 1) != 25 ||
+           hamming_index_knn(hi, code, 25, hids[1], hdists[1], 2) != 25 ||
+           hamming_index_knn_mih(hi, code, 25, hids[2], hdists[2]) != 25;
+    for (size_t r = 0; r < 3; r++) {
+      for (size_t i = 0; i < 25; i++) {
+        ans |= hids[r][i] != (hkeys[i] & UINT32_MAX) ||
+               hdists[r][i] != hkeys[i] >> 32;
+      }
+    }
+  }
+  // k larger than the collection
+  hamming_index *hs = create_hamming_index(200);
+  hamming_index_add(hs, code);
+  hamming_index_add(hs, code);
+  ans |= hamming_index_knn_mih(hs, code, 25, hids[0], hdists[0]) != 2 ||
+         hids[0][1] != 1 || hdists[0][1] != 0;
+  total_tests++;
+  if (ans) printf("Test %d (hamming_index_knn) failed.\n", total_tests);
+  fail_c += ans;
+  delete_hamming_index(hi);
+  delete_hamming_index(hs);
+  delete_bitarray(code);
+  free(hdist);
+  free(hkeys);
+
+  // paged bitarray: 100003 bits in pages of 4096 bits with room for 3 pages,
+  // checked against a bitarray with the same operations
+  char paged_path[] = "/tmp/bitarray_test_XXXXXX";
+  char paged_path2[] = "/tmp/bitarray_test_XXXXXX";
+  close(mkstemp(paged_path));
+  close(mkstemp(paged_path2));
+  paged_bitarray *pa = open_paged_bitarray(paged_path, 100003, 512, 1536);
+  paged_bitarray *pb = open_paged_bitarray(paged_path2, 100003, 512, 1536);
+  b = create_bitarray(100003);
+  b2 = create_bitarray(100003);
+  ans = !pa || !pb || pa->n_pages != 25;
+  if (pa && pb) {
+    for (size_t i = 0; i < 100003; i += 7) {
+      paged_set_bit(pa, i);
+      set_bit(b, i);
+      paged_set_bit(pb, (i * 13) % 100003);
+      set_bit(b2, (i * 13) % 100003);
+    }
+    paged_clear_bit(pa, 14);
+    clear_bit(b, 14);
+    paged_flip_bit(pa, 99999);
+    flip_bit(b, 99999);
+    paged_set_bit_range(pa, 5000, 20000);
+    set_bit_range(b, 5000, 20000);
+    paged_clear_bit_range(pa, 8192, 12288);
+    clear_bit_range(b, 8192, 12288);
+    paged_flip_bit_range(pa, 30001, 99000);
+    flip_bit_range(b, 30001, 99000);
+    paged_xor_bits_inplace(pa, pb);
+    xor_bits_inplace(b, b2);
+    paged_or_bits_inplace(pb, pa);
+    or_bits_inplace(b2, b);
+    paged_and_bits_inplace(pa, pb);
+    and_bits_inplace(b, b2);
+    ans |= paged_count_bits(pa) != count_bits(b) ||
+           paged_count_bit_range(pa, 777, 77777) !=
+             count_bit_range(b, 777, 77777) ||
+           paged_get_bit(pa, 99999) != get_bit(b, 99999) ||
+           pa->n_writes == 0;
+
+    // copy out, copy a range back in, reopen
+    bitarray *part = create_bitarray(3001);
+    copy_bit_range(b, part, 4000, 7001);
+    flip_all_bits(part);
+    paged_copy_from_bitarray(pa, 4000, part);
+    flip_bit_range(b, 4000, 7001);
+    close_paged_bitarray(pa);
+    pa = open_paged_bitarray(paged_path, 100003, 512, 1 << 20);
+    bitarray *out = create_bitarray(100003);
+    paged_copy_to_bitarray(pa, 0, out);
+    ans |= !equal_bits(out, b) || pa->n_reads != 25;
+    delete_bitarray(part);
+    delete_bitarray(out);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (paged_bitarray) failed.\n", total_tests);
+  fail_c += ans;
+  if (pa) close_paged_bitarray(pa);
+  if (pb) close_paged_bitarray(pb);
+  unlink(paged_path);
+  unlink(paged_path2);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // attached summary: 3 levels over 300000 bits, checked against a
+  // bitarray without one
+  bitarray *sa = create_bitarray(300000);
+  bitarray *sb = create_bitarray(300000);
+  attach_summary(sa);
+  attach_summary(sb);
+  b = create_bitarray(300000);
+  for (size_t i = 17; i < 300000; i += 65537) {
+    set_bit(sa, i);
+    set_bit(sb, i + 3);
+    set_bit(b, i);
+  }
+  set_bit_range(sa, 200000, 200100);
+  set_bit_range(b, 200000, 200100);
+  clear_bit_range(sa, 200050, 299999);
+  clear_bit_range(b, 200050, 299999);
+  flip_bit(sa, 299999);
+  flip_bit(b, 299999);
+  ans = find_set_run(sa, 1, 18) != 65554 ||
+        find_set_run(sa, 1, 200050) != 299999 ||
+        count_bits(sa) != count_bits(b) ||
+        count_bit_range(sa, 100, 200010) != count_bit_range(b, 100, 200010);
+  clear_bit(sa, 299999);
+  ans |= find_set_run(sa, 1, 200050) != SIZE_MAX;
+  or_bits_inplace(sb, sa);
+  and_bits_inplace(sa, sb);
+  xor_bits_inplace(sb, sa);
+  ans |= count_bits(sa) != count_bits(b) - 1 || count_bits(sb) != 5 ||
+         find_set_run(sb, 1, 0) != 20;
+  bitarray *sc = copy_bitarray(b);
+  attach_summary(sc);
+  ans |= find_set_run(sc, 1, 200099) != 299999;
+  total_tests++;
+  if (ans) printf("Test %d (summary) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(sa);
+  delete_bitarray(sb);
+  delete_bitarray(sc);
+  delete_bitarray(b);
+
+  // attached summary and counts: a bitarray with a summary and counts, one
+  // with counts only and a copy without either go through the same
+  // modifications and must agree on every search and count
+  b = create_bitarray(20000);
+  b2 = create_bitarray(20000);
+  bitarray *b3 = create_bitarray(20000);
+  bitarray *operand = create_bitarray(20000);
+  attach_summary(b);
+  attach_count(b, 128);
+  attach_count(b3, 64);
+  bitarray *versions[3] = {b, b2, b3};
+  ans = false;
+  size_t end1, end2;
+  uint64_t sum_seed = 7;
+  for (int round = 0; round < 600 && !ans; round++) {
+    sum_seed = sum_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    size_t x = (sum_seed >> 33) % 20000, y = (sum_seed >> 17) % 20000;
+    size_t from = x < y ? x : y, to = x < y ? y : x;
+    size_t short_to = from + (to - from) % 300;
+    size_t idx[3] = {x, y, (x + y) / 2};
+    if (round % 16 == 8) {
+      clear_all_bits(operand);
+      set_bit_range(operand, from, short_to);
+    } else if (round % 16 == 9) {
+      set_all_bits(operand);
+      clear_bit_range(operand, from, to);
+    } else if (round % 16 == 10) {
+      clear_all_bits(operand);
+      set_bit(operand, x);
+      set_bit_range(operand, from, short_to);
+    }
+    for (int v = 0; v < 3; v++) {
+      bitarray *t = versions[v];
+      switch (round % 16) {
+        case 0: set_bit(t, x); break;
+        case 1: clear_bit(t, x); break;
+        case 2: flip_bit(t, y); break;
+        case 3: set_bit_range(t, from, short_to); break;
+        case 4: clear_bit_range(t, from, to); break;
+        case 5: flip_bit_range(t, from, round % 32 ? short_to : to); break;
+        case 6: set_bits(t, idx, 3); break;
+        case 7: clear_bits(t, idx, 2); break;
+        case 8: or_bits_inplace(t, operand); break;
+        case 9: and_bits_inplace(t, operand); break;
+        case 10: xor_bits_inplace(t, operand); break;
+        case 11: rotate_left_bit_range(t, from, to, x); break;
+        case 12: reverse_bit_range(t, from, to); break;
+        case 13:
+          right_shift_bits_inplace(t, x % 100);
+          left_shift_bits_inplace(t, y % 100);
+          break;
+        case 14: if (round % 64 == 14) flip_all_bits(t); break;
+        case 15: if (round % 128 == 15) clear_all_bits(t); break;
+      }
+    }
+    size_t pos = (sum_seed >> 5) % 20000, k = 1 + x % 40;
+    ans |= !BITS_EQUAL(b, b2, false) || count_bits(b) != count_bits(b2) ||
+           next_set_run(b, pos, &end1) != next_set_run(b2, pos, &end2) ||
+           end1 != end2 ||
+           find_set_run(b, k, pos) != find_set_run(b2, k, pos) ||
+           count_bit_range(b, from, to) != count_bit_range(b2, from, to) ||
+           test_any_bit_range(b, from, short_to) !=
+             test_any_bit_range(b2, from, short_to) ||
+           count_bits(b3) != count_bits(b2) ||
+           count_bit_range(b3, from, to) != count_bit_range(b2, from, to) ||
+           count_bit_range(b3, from, short_to) !=
+             count_bit_range(b2, from, short_to);
+  }
+  // size changes, attached structures on the right operand, and detaching
+  set_bit_range(operand, 0, 20000);
+  append_bit_range(operand, b, 100, 9000);
+  append_bit_range(operand, b2, 100, 9000);
+  append_bit_range(operand, b3, 100, 9000);
+  ans |= !BITS_EQUAL(b, b2, false) || count_bits(b) != count_bits(b2) ||
+         count_bits(b3) != count_bits(b2) ||
+         find_set_run(b, 5000, 0) != find_set_run(b2, 5000, 0);
+  copy_bit_range(b2, b, 300, 28000);
+  copy_bit_range(b2, b3, 300, 28000);
+  copy_bit_range(b2, b2, 300, 28000);
+  xor_bits_inplace(b2, b);
+  xor_bits_inplace(b3, b);
+  ans |= count_bits(b2) != 0 || count_bits(b) == 0 || count_bits(b3) != 0;
+  b3->array[0] = 3;
+  refresh_bitarray(b3);
+  ans |= count_bits(b3) != 2;
+  detach_summary(b);
+  ans |= count_bits(b) != count_bit_range(b, 0, b->size);
+  detach_count(b);
+  clear_all_bits(b);
+  ans |= count_bits(b) != 0 || next_set_run(b, 0, &end1) != b->size;
+  total_tests++;
+  if (ans) printf("Test %d (attached summary and counts) failed.\n",
+                  total_tests);
+  fail_c += ans;
+  delete_bitarray(operand);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+  delete_bitarray(b3);
+
+  // copy-on-write bitarray: a snapshot keeps its bits while the original is
+  // modified, and only the touched blocks stop being shared
+  b = create_bitarray(10000);
+  set_bit_range(b, 100, 3000);
+  cow_bitarray *ca = create_cow_bitarray_from_bitarray(b, 128);
+  cow_bitarray *cs = cow_snapshot(ca);
+  cow_set_bit(ca, 5000);
+  cow_clear_bit_range(ca, 0, 2048);
+  cow_flip_bit_range(ca, 9000, 10000);
+  size_t shared = 0;
+  for (size_t i = 0; i < ca->n_blocks; i++) {
+    shared += ca->_blocks[i] == cs->_blocks[i];
+  }
+  bitarray *out = create_bitarray(10000);
+  cow_copy_to_bitarray(cs, out);
+  ans = ca->n_blocks != 10 || shared != 5 || !equal_bits(out, b) ||
+        cow_count_bits(ca) != 952 + 1 + 1000 ||
+        cow_count_bit_range(cs, 50, 150) != 50 || !cow_get_bit(ca, 5000) ||
+        cow_get_bit(cs, 5000) || cow_equal_bits(ca, cs);
+  cow_xor_bits_inplace(cs, ca);
+  cow_xor_bits_inplace(cs, ca);
+  cow_and_bits_inplace(ca, ca);
+  cow_copy_to_bitarray(cs, out);
+  ans |= !equal_bits(out, b);
+  cow_bitarray *cz = create_cow_bitarray(10000, 128);
+  cow_or_bits_inplace(cz, cs);
+  ans |= !cow_equal_bits(cz, cs);
+  total_tests++;
+  if (ans) printf("Test %d (cow_bitarray) failed.\n", total_tests);
+  fail_c += ans;
+  delete_cow_bitarray(ca);
+  delete_cow_bitarray(cs);
+  delete_cow_bitarray(cz);
+  delete_bitarray(out);
+  delete_bitarray(b);
+
+  // attached counts of 512 bit blocks checked against a plain bitarray
+  bitarray *cn = create_bitarray(5000);
+  attach_count(cn, 64);
+  b = create_bitarray(5000);
+  b2 = create_bitarray(5000);
+  set_bit_range(b2, 1000, 4000);
+  for (size_t i = 0; i < 5000; i += 3) {
+    set_bit(cn, i);
+    set_bit(cn, i);
+    set_bit(b, i);
+  }
+  clear_bit(cn, 3);
+  clear_bit(b, 3);
+  flip_bit(cn, 4);
+  flip_bit(b, 4);
+  set_bit_range(cn, 100, 700);
+  set_bit_range(b, 100, 700);
+  clear_bit_range(cn, 1024, 2048);
+  clear_bit_range(b, 1024, 2048);
+  flip_bit_range(cn, 2500, 4999);
+  flip_bit_range(b, 2500, 4999);
+  ans = count_bits(cn) != count_bits(b) ||
+        count_bit_range(cn, 10, 4000) != count_bit_range(b, 10, 4000) ||
+        count_bit_range(cn, 600, 650) != 50;
+  xor_bits_inplace(cn, b2);
+  xor_bits_inplace(b, b2);
+  ans |= count_bits(cn) != count_bits(b) ||
+         count_bit_range(cn, 4608, 5000) !=
+           count_bit_range(b, 4608, 5000) ||
+         !equal_bits(cn, b);
+  // (the counts follow the new size)
+  append_bit_range(b2, cn, 900, 4100);
+  append_bit_range(b2, b, 900, 4100);
+  ans |= count_bits(cn) != count_bits(b) ||
+         count_bit_range(cn, 4608, 8000) != count_bit_range(b, 4608, 8000);
+  total_tests++;
+  if (ans) printf("Test %d (counts) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(cn);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // hashing ignores the padding bits and depends on the size and seed
+  ARRAY_TYPE garbage[3] = {12345, 678, ARRAY_TYPE_MAX};
+  bitarray view = {150, 3, garbage, true, NULL};
+  b = copy_bitarray(&view);
+  b2 = create_bitarray(151);
+  for (size_t i = 0; i < 150; i++) {
+    if (get_bit(b, i)) set_bit(b2, i);
+  }
+  ans = hash_bits(&view, 0) != hash_bits(b, 0) || !equal_bits(&view, b) ||
+        hash_bits(b, 0) == hash_bits(b, 1) ||
+        hash_bits(b, 0) == hash_bits(b2, 0);
+  uint64_t h1[2], h2[2];
+  hash_bits128(&view, 7, h1);
+  hash_bits128(b, 7, h2);
+  ans |= h1[0] != h2[0] || h1[1] != h2[1];
+  total_tests++;
+  if (ans) printf("Test %d (hash_bits) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // bitarray map: deduplicate 1000 signatures with 100 distinct values
+  bitarray_map *bm = create_bitarray_map(0);
+  size_t inserted = 0;
+  b = create_bitarray(200);
+  for (size_t i = 0; i < 1000; i++) {
+    clear_all_bits(b);
+    set_bit(b, i % 100);
+    set_bit(b, 199 - i % 7);
+    inserted += bitarray_map_add(bm, b, i);
+  }
+  uint64_t value = 0;
+  clear_all_bits(b);
+  set_bit(b, 5);
+  set_bit(b, 194);
+  ans = inserted != 700 || bm->size != 700 ||
+        !bitarray_map_get(bm, b, &value) || value != 5;
+  ans |= bitarray_map_put(bm, b, 1) || !bitarray_map_get(bm, b, &value) ||
+         value != 1;
+  size_t removed = 0;
+  for (size_t i = 0; i < 300; i++) {
+    clear_all_bits(b);
+    set_bit(b, i % 100);
+    set_bit(b, 199 - i % 7);
+    removed += bitarray_map_remove(bm, b);
+  }
+  size_t visited = 0;
+  for (size_t i = bitarray_map_next(bm, 0); i < bm->capacity;
+       i = bitarray_map_next(bm, i + 1)) {
+    visited++;
+    bitarray key = bitarray_map_key(bm, i);
+    ans |= !bitarray_map_get(bm, &key, &value) ||
+           value != bm->slots[i].value;
+  }
+  clear_all_bits(b);
+  set_bit(b, 5);
+  set_bit(b, 194);
+  b2 = create_bitarray(201);
+  set_bit(b2, 0);
+  set_bit(b2, 198);
+  ans |= removed != 300 || bm->size != 400 || visited != 400 ||
+         bitarray_map_get(bm, b, NULL) || bitarray_map_get(bm, b2, NULL);
+  copy_bit_range(b2, b, 0, 200);
+  ans |= !bitarray_map_get(bm, b, &value) || value != 400;
+  // long keys (in the arena), removed ones compacted away when it grows
+  delete_bitarray(b2);
+  b2 = create_bitarray(1000);
+  for (size_t i = 0; i < 2000; i++) {
+    clear_all_bits(b2);
+    set_bit(b2, i % 500);
+    set_bit(b2, 500 + i / 500);
+    bitarray_map_add(bm, b2, i);
+    if (i % 3 == 0) bitarray_map_remove(bm, b2);
+  }
+  for (size_t i = 0; i < 2000; i++) {
+    clear_all_bits(b2);
+    set_bit(b2, i % 500);
+    set_bit(b2, 500 + i / 500);
+    ans |= bitarray_map_get(bm, b2, &value) != (i % 3 != 0) ||
+           (i % 3 != 0 && value != i);
+  }
+  ans |= bm->size != 400 + 1333 ||
+         bm->_arena_used - bm->_arena_free != 1333 * 16;
+  total_tests++;
+  if (ans) printf("Test %d (bitarray_map) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray_map(bm);
+  delete_bitarray(b);
+  delete_bitarray(b2);
+
+  // shared memory: named region attached read-only and writable, memfd
+  // region written by a forked child
+  char shm_name[64];
+  snprintf(shm_name, sizeof(shm_name), "/bitarray_test_%d", (int) getpid());
+  b = create_bitarray(1000);
+  set_bit_range(b, 10, 300);
+  shm_bitarray *sh = create_shm_bitarray_from_bitarray(shm_name, b);
+  shm_bitarray *sh_ro = attach_shm_bitarray(shm_name, false);
+  shm_bitarray *sh_rw = attach_shm_bitarray(shm_name, true);
+  ans = !sh || !sh_ro || !sh_rw || sh_ro->writable ||
+        create_shm_bitarray(shm_name, 10) ||
+        !equal_bits(&sh_ro->bits, b) || (size_t) sh_ro->bits.array % 64;
+  if (!ans) {
+    shm_set_bit(sh_rw, 999);
+    shm_clear_bit_range(sh_rw, 20, 290);
+    ans |= shm_test_and_set_bit(sh, 5) || !shm_test_and_set_bit(sh_rw, 5);
+    shm_flip_bit(sh_rw, 10);
+    shm_set_bit_range(sh, 500, 700);
+    ans |= !shm_get_bit(sh_ro, 999) || shm_get_bit(sh_ro, 10) ||
+           count_bits(&sh_ro->bits) != 1 + 1 + 19 + 200;
+  }
+  if (sh_rw) detach_shm_bitarray(sh_rw);
+  if (sh_ro) detach_shm_bitarray(sh_ro);
+  if (sh) detach_shm_bitarray(sh);
+  ans |= !unlink_shm_bitarray(shm_name) ||
+         attach_shm_bitarray(shm_name, false);
+
+  sh = create_shm_bitarray(NULL, 100000);
+  ans |= !sh;
+  if (sh) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      shm_bitarray *child = attach_shm_bitarray_fd(sh->fd, true);
+      for (size_t i = 0; i < 100000; i += 3) shm_set_bit(child, i);
+      _exit(0);
+    }
+    for (size_t i = 0; i < 100000; i += 5) shm_set_bit(sh, i);
+    int status;
+    ans |= waitpid(pid, &status, 0) != pid || status != 0 ||
+           count_bits(&sh->bits) != 33334 + 20000 - 6667;
+    detach_shm_bitarray(sh);
+  }
+  total_tests++;
+  if (ans) printf("Test %d (shm_bitarray) failed.\n", total_tests);
+  fail_c += ans;
+  delete_bitarray(b);
+
+  ans = false;
+  // ID allocator: all IDs once, then SIZE_MAX; freed IDs come back
+  id_allocator *ida = create_id_allocator(1000);
+  bitarray *ids = create_bitarray(1000);
+  for (size_t i = 0; i < 1000; i++) {
+    size_t id = alloc_id(ida);
+    ans |= id >= 1000 || get_bit(ids, id);
+    if (id < 1000) set_bit(ids, id);
+  }
+  ans |= alloc_id(ida) != SIZE_MAX || alloc_id_range(ida, 1) != SIZE_MAX;
+  free_id(ida, 10);
+  free_id(ida, 999);
+  ans |= alloc_id(ida) + alloc_id(ida) != 1009 || alloc_id(ida) != SIZE_MAX;
+  free_id_range(ida, 100, 300);
+  free_id(ida, 50);
+  size_t first = alloc_id_range(ida, 250);
+  ans |= first < 100 || first > 150 || alloc_id_range(ida, 51) != SIZE_MAX;
+  free_id_range(ida, first, 250);
+  id_allocator_flush(ida);
+  ans |= count_bits(ida->used) != 699 ||
+         alloc_id_range(ida, 300) != 100 || alloc_id(ida) != 50;
+  delete_bitarray(ids);
+  delete_id_allocator(ida);
+
+  // concurrent threads never get the same ID
+  ida = create_id_allocator(100000);
+  uint8_t *id_owned = (uint8_t*) calloc(100000, 1);
+  pthread_t threads[8];
+  ID_WORKER_ARGS args = {ida, id_owned, 20000};
+  for (int t = 0; t < 8; t++) {
+    pthread_create(&threads[t], NULL, ID_WORKER, &args);
+  }
+  for (int t = 0; t < 8; t++) {
+    void *res;
+    pthread_join(threads[t], &res);
+    ans |= res != NULL;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < 100000; i++) {
+    ans |= id_owned[i] > 1;
+    kept += id_owned[i];
+  }
+  id_allocator_flush(ida);
+  ans |= kept != 80000 || count_bits(ida->used) != 80000;
+  free(id_owned);
+  delete_id_allocator(ida);
+  total_tests++;
+  if (ans) printf("Test %d (id_allocator) failed.\n", total_tests);
+  fail_c += ans;
+
+  ans = false;
+  // sliding windows against the history of pushed bits
+  bool history[1000];
+  ring_bitarray *ring = create_ring_bitarray(100);
+  for (size_t i = 0; i < 1000; i++) {
+    history[i] = (i * 7) % 5 < 2 || (i / 50) % 4 == 1;
+    bool retired = ring_push_bit(ring, history[i]);
+    ans |= retired != (i >= 100 && history[i - 100]);
+    for (size_t m = 0; m <= 100 && i % 37 == 0; m += 3) {
+      size_t expected = 0;
+      for (size_t j = 0; j < m && j <= i; j++) expected += history[i - j];
+      ans |= ring_count_last(ring, m) != expected;
+    }
+    ans |= ring_count_last(ring, 100) != ring->count ||
+           ring_get_bit(ring, i % 100) != (i >= i % 100 &&
+                                           history[i - i % 100]);
+  }
+  delete_ring_bitarray(ring);
+
+  // 37 windows (vector and scalar part), window k gets bit i if
+  // (i + k) % (k % 5 + 2) == 0
+  ring_set *rs = create_ring_set(37, 70);
+  bitarray *events = create_bitarray(37);
+  for (size_t i = 0; i < 300; i++) {
+    clear_all_bits(events);
+    for (size_t k = 0; k < 37; k++) {
+      if ((i + k) % (k % 5 + 2) == 0) set_bit(events, k);
+    }
+    ring_set_push(rs, i % 50 == 49 ? NULL : events);
+  }
+  for (size_t k = 0; k < 37; k++) {
+    for (size_t m = 0; m <= 70; m++) {
+      size_t expected = 0;
+      for (size_t j = 0; j < m; j++) {
+        size_t i = 299 - j;
+        expected += i % 50 != 49 && (i + k) % (k % 5 + 2) == 0;
+      }
+      bool newest = (299 - m) % 50 != 49 &&
+                    (299 - m + k) % (k % 5 + 2) == 0;
+      ans |= ring_set_count_last(rs, k, m) != expected ||
+             (m < 70 && ring_set_get_bit(rs, k, m) != newest);
+      if (m == 70) ans |= rs->counts[k] != expected;
+    }
+  }
+  delete_bitarray(events);
+  delete_ring_set(rs);
+  total_tests++;
+  if (ans) printf("Test %d (ring_bitarray) failed.\n", total_tests);
+  fail_c += ans;
+
+  ans = false;
+  // Elias-Fano: access, next_geq, decode and intersection against the
+  // encoded values
+  uint64_t ef_values[600];
+  for (size_t i = 0; i < 600; i++) {
+    ef_values[i] = i < 8 ? i / 2 : (i * i) / 3 + (i % 7 == 0 ? 5 : 0);
+  }
+  elias_fano *ef = create_elias_fano(ef_values, 600, 0);
+  uint64_t ef_out[600];
+  for (size_t i = 0; i < 600; i++) {
+    uint64_t value = 0;
+    ans |= ef_access(ef, i) != ef_values[i] ||
+           (i && ef_values[i] != ef_values[i - 1] &&
+            (ef_next_geq(ef, ef_values[i - 1] + 1, &value) != i ||
+             value != ef_values[i]));
+  }
+  ans |= ef_next_geq(ef, 0, NULL) != 0 ||
+         ef_next_geq(ef, ef_values[599] + 1, NULL) != 600 ||
+         ef_decode(ef, 590, 50, ef_out) != 10 ||
+         memcmp(ef_out, ef_values + 590, 10 * sizeof(uint64_t)) ||
+         ef_decode(ef, 3, 520, ef_out) != 520 ||
+         memcmp(ef_out, ef_values + 3, 520 * sizeof(uint64_t)) ||
+         ef_bytes(ef) >= 600 * sizeof(uint64_t) / 3;
+  b = create_bitarray(50000);
+  for (size_t i = 0; i < 50000; i += 3) set_bit(b, i);
+  size_t n_common = 0;
+  for (size_t i = 0; i < 600; i++) {
+    n_common += ef_values[i] < 50000 && ef_values[i] % 3 == 0;
+  }
+  ans |= ef_intersect_bitarray(ef, b, ef_out) != n_common ||
+         ef_out[0] != 0 || ef_out[1] != 0 || ef_out[2] != 3 ||
+         ef_out[3] != 3;
+  delete_elias_fano(ef);
+  ef = create_elias_fano_from_bitarray(b);
+  ans |= ef->n != 16667 || ef_access(ef, 16666) != 49998 ||
+         ef_next_geq(ef, 301, NULL) != 101;
+  delete_elias_fano(ef);
+  // empty lists take a few bytes, whatever the universe
+  ef = create_elias_fano(NULL, 0, (uint64_t) 1 << 32);
+  ans |= ef_bytes(ef) > 4096 || ef_next_geq(ef, 12345, NULL) != 0 ||
+         ef_decode(ef, 0, 5, ef_out) != 0 ||
+         ef_intersect_bitarray(ef, b, NULL) != 0;
+  delete_elias_fano(ef);
+  clear_all_bits(b);
+  ef = create_elias_fano_from_bitarray(b);
+  ans |= ef->n != 0 || ef_bytes(ef) > 4096 || ef_next_geq(ef, 0, NULL) != 0;
+  delete_elias_fano(ef);
+  delete_bitarray(b);
+  total_tests++;
+  if (ans) printf("Test %d (elias_fano) failed.\n", total_tests);
+  fail_c += ans;
+
+#ifdef BITARRAY_STATS
+  // instrumentation (only outermost calls are recorded)
+  bitarray_stats *stats = (bitarray_stats*) malloc(sizeof(bitarray_stats));
+  bitarray_stats_reset();
+  b = create_bitarray(256);
+  set_bit_range(b, 3, 200);
+  ans = get_bit(b, 3);
+  delete_bitarray(b);
+  bitarray_stats_snapshot(stats);
+  ans = !(stats->fn[BITARRAY_STAT_set_bit_range].calls == 1 &&
+          stats->fn[BITARRAY_STAT_set_bit_range].bits == 197 &&
+          stats->fn[BITARRAY_STAT_count_bit_range].calls == 0 &&
+          stats->fn[BITARRAY_STAT_get_bit].calls == 1 &&
+          stats->fn[BITARRAY_STAT_create_bitarray].bytes_allocated ==
+            sizeof(bitarray) + __bitarray_size(256) * TYPE_SIZE &&
+          stats->fn[BITARRAY_STAT_delete_bitarray].bits == 256);
+  total_tests++;
+  if (ans) printf("Test %d (bitarray_stats_snapshot) failed.\n", total_tests);
+  fail_c += ans;
+
+  bitarray_stats_reset();
+  bitarray_stats_snapshot(stats);
+  ans = stats->fn[BITARRAY_STAT_set_bit_range].calls != 0;
+  total_tests++;
+  if (ans) printf("Test %d (bitarray_stats_reset) failed.\n", total_tests);
+  fail_c += ans;
+  free(stats);
+#endif
+
   printf("All tests have been executed. %d/%d tests failed, "
          "%d/%d tests passed.\n",
          fail_c, total_tests, total_tests - fail_c, total_tests);
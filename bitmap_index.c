@@ -0,0 +1,515 @@
+#include "bitmap_index.h"
+
+#include <ctype.h>
+
+// number of array elements a query evaluates at once
+// (32768 documents with 64 bit elements)
+#define __INDEX_BLOCK 512
+
+// slots are doubled once they are more than 3/4 full
+#define __INDEX_MIN_CAPACITY 16
+
+// FNV-1a
+static uint64_t __index_hash(const char *key) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (; *key; key++) {
+    h ^= (unsigned char) *key;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static char* __index_strdup(const char *str, size_t len) {
+  char *copy = (char*) malloc(len + 1);
+  assert(copy);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+// slot of key, or the empty slot it would be inserted at
+static size_t __index_slot(bitmap_index *index, const char *key) {
+  size_t mask = index->_capacity - 1;
+  size_t slot = __index_hash(key) & mask;
+  while (index->_keys[slot] && strcmp(index->_keys[slot], key)) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static void __index_grow(bitmap_index *index) {
+  size_t old_capacity = index->_capacity;
+  char **old_keys = index->_keys;
+  bitarray **old_bitmaps = index->_bitmaps;
+  size_t *old_cardinality = index->_cardinality;
+
+  index->_capacity = old_capacity * 2;
+  index->_keys = (char**) calloc(index->_capacity, sizeof(char*));
+  index->_bitmaps = (bitarray**) calloc(index->_capacity, sizeof(bitarray*));
+  index->_cardinality = (size_t*) calloc(index->_capacity, sizeof(size_t));
+  assert(index->_keys && index->_bitmaps && index->_cardinality);
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (!old_keys[i]) continue;
+    size_t slot = __index_slot(index, old_keys[i]);
+    index->_keys[slot] = old_keys[i];
+    index->_bitmaps[slot] = old_bitmaps[i];
+    index->_cardinality[slot] = old_cardinality[i];
+  }
+
+  free(old_keys);
+  free(old_bitmaps);
+  free(old_cardinality);
+}
+
+// slot of key, inserting key with an empty bitarray if necessary
+static size_t __index_insert(bitmap_index *index, const char *key) {
+  size_t slot = __index_slot(index, key);
+  if (index->_keys[slot]) return slot;
+
+  if (4 * (index->n_keys + 1) > 3 * index->_capacity) {
+    __index_grow(index);
+    slot = __index_slot(index, key);
+  }
+
+  index->_keys[slot] = __index_strdup(key, strlen(key));
+  index->_bitmaps[slot] = create_bitarray(index->n_docs);
+  index->_cardinality[slot] = 0;
+  index->n_keys++;
+  return slot;
+}
+
+bitmap_index* create_bitmap_index(size_t n_docs) {
+  assert(n_docs > 0);
+
+  bitmap_index *index = (bitmap_index*) malloc(sizeof(bitmap_index));
+  assert(index);
+  index->n_docs = n_docs;
+  index->n_keys = 0;
+  index->_capacity = __INDEX_MIN_CAPACITY;
+  index->_keys = (char**) calloc(index->_capacity, sizeof(char*));
+  index->_bitmaps = (bitarray**) calloc(index->_capacity, sizeof(bitarray*));
+  index->_cardinality = (size_t*) calloc(index->_capacity, sizeof(size_t));
+  assert(index->_keys && index->_bitmaps && index->_cardinality);
+
+  return index;
+}
+
+void delete_bitmap_index(bitmap_index *index) {
+  assert(index);
+
+  for (size_t i = 0; i < index->_capacity; i++) {
+    if (!index->_keys[i]) continue;
+    free(index->_keys[i]);
+    delete_bitarray(index->_bitmaps[i]);
+  }
+  free(index->_keys);
+  free(index->_bitmaps);
+  free(index->_cardinality);
+  free(index);
+}
+
+void bitmap_index_add(bitmap_index *index, const char *key, size_t doc) {
+  assert(index && key);
+  assert(doc < index->n_docs);
+
+  size_t slot = __index_insert(index, key);
+  if (!get_bit(index->_bitmaps[slot], doc)) {
+    set_bit(index->_bitmaps[slot], doc);
+    index->_cardinality[slot]++;
+  }
+}
+
+void bitmap_index_remove(bitmap_index *index, const char *key, size_t doc) {
+  assert(index && key);
+  assert(doc < index->n_docs);
+
+  size_t slot = __index_slot(index, key);
+  if (index->_keys[slot] && get_bit(index->_bitmaps[slot], doc)) {
+    clear_bit(index->_bitmaps[slot], doc);
+    index->_cardinality[slot]--;
+  }
+}
+
+void bitmap_index_put(bitmap_index *index, const char *key, bitarray *bits) {
+  assert(index && key && bits);
+  assert(bits->size == index->n_docs);
+
+  size_t slot = __index_insert(index, key);
+  bitarray *b = index->_bitmaps[slot];
+  size_t n = b->_array_size < bits->_array_size ? b->_array_size
+                                                : bits->_array_size;
+  memcpy(b->array, bits->array, n * TYPE_SIZE);
+  memset(b->array + n, 0, (b->_array_size - n) * TYPE_SIZE);
+  index->_cardinality[slot] = count_bits(b);
+}
+
+bitarray* bitmap_index_get(bitmap_index *index, const char *key) {
+  assert(index && key);
+
+  size_t slot = __index_slot(index, key);
+  return index->_keys[slot] ? index->_bitmaps[slot] : NULL;
+}
+
+size_t bitmap_index_cardinality(bitmap_index *index, const char *key) {
+  assert(index && key);
+
+  size_t slot = __index_slot(index, key);
+  return index->_keys[slot] ? index->_cardinality[slot] : 0;
+}
+
+// query parser (recursive descent):
+//   or  := and ("OR" and)*
+//   and := not ("AND" not)*
+//   not := "NOT" not | "(" or ")" | key
+
+typedef struct {
+  const char *pos;
+} __query_parser;
+
+static bool __query_is_key_char(char c) {
+  return isalnum((unsigned char) c) || c == '_' || c == '-' || c == '.' ||
+         c == ':';
+}
+
+static void __query_skip_space(__query_parser *p) {
+  while (isspace((unsigned char) *p->pos)) p->pos++;
+}
+
+// consume keyword (AND/OR/NOT) if it's the next token
+static bool __query_keyword(__query_parser *p, const char *word) {
+  __query_skip_space(p);
+  size_t len = strlen(word);
+  if (strncmp(p->pos, word, len) || __query_is_key_char(p->pos[len])) {
+    return false;
+  }
+  p->pos += len;
+  return true;
+}
+
+static bitmap_query* __query_node(enum bitmap_query_op op) {
+  bitmap_query *q = (bitmap_query*) calloc(1, sizeof(bitmap_query));
+  assert(q);
+  q->op = op;
+  return q;
+}
+
+static void __query_add_child(bitmap_query *q, bitmap_query *child) {
+  q->children = (bitmap_query**) realloc(
+    q->children, (q->n_children + 1) * sizeof(bitmap_query*));
+  assert(q->children);
+  q->children[q->n_children++] = child;
+}
+
+static bitmap_query* __query_parse_or(__query_parser *p);
+
+static bitmap_query* __query_parse_not(__query_parser *p) {
+  if (__query_keyword(p, "NOT")) {
+    bitmap_query *child = __query_parse_not(p);
+    if (!child) return NULL;
+    bitmap_query *q = __query_node(BITMAP_QUERY_NOT);
+    __query_add_child(q, child);
+    return q;
+  }
+
+  __query_skip_space(p);
+  if (*p->pos == '(') {
+    p->pos++;
+    bitmap_query *q = __query_parse_or(p);
+    __query_skip_space(p);
+    if (q && *p->pos != ')') {
+      delete_bitmap_query(q);
+      return NULL;
+    }
+    if (q) p->pos++;
+    return q;
+  }
+
+  const char *start = p->pos;
+  if (*p->pos == '"') {
+    start++;
+    const char *end = strchr(start, '"');
+    if (!end) return NULL;
+    p->pos = end + 1;
+    bitmap_query *q = __query_node(BITMAP_QUERY_KEY);
+    q->key = __index_strdup(start, end - start);
+    return q;
+  }
+
+  while (__query_is_key_char(*p->pos)) p->pos++;
+  if (p->pos == start) return NULL;
+  bitmap_query *q = __query_node(BITMAP_QUERY_KEY);
+  q->key = __index_strdup(start, p->pos - start);
+  if (!strcmp(q->key, "AND") || !strcmp(q->key, "OR")) {
+    delete_bitmap_query(q);
+    return NULL;
+  }
+  return q;
+}
+
+// parse operands separated by keyword, one operand is returned as is
+static bitmap_query* __query_parse_list(__query_parser *p,
+                                        enum bitmap_query_op op,
+                                        const char *keyword) {
+  bitmap_query *first = op == BITMAP_QUERY_OR ? __query_parse_list(
+                          p, BITMAP_QUERY_AND, "AND") : __query_parse_not(p);
+  if (!first || !__query_keyword(p, keyword)) return first;
+
+  bitmap_query *q = __query_node(op);
+  __query_add_child(q, first);
+  do {
+    bitmap_query *next = op == BITMAP_QUERY_OR ? __query_parse_list(
+                           p, BITMAP_QUERY_AND, "AND") : __query_parse_not(p);
+    if (!next) {
+      delete_bitmap_query(q);
+      return NULL;
+    }
+    __query_add_child(q, next);
+  } while (__query_keyword(p, keyword));
+
+  return q;
+}
+
+static bitmap_query* __query_parse_or(__query_parser *p) {
+  return __query_parse_list(p, BITMAP_QUERY_OR, "OR");
+}
+
+bitmap_query* parse_bitmap_query(const char *str) {
+  assert(str);
+
+  __query_parser p = {str};
+  bitmap_query *q = __query_parse_or(&p);
+  __query_skip_space(&p);
+  if (q && *p.pos) {
+    delete_bitmap_query(q);
+    return NULL;
+  }
+  return q;
+}
+
+void delete_bitmap_query(bitmap_query *query) {
+  if (!query) return;
+
+  for (size_t i = 0; i < query->n_children; i++) {
+    delete_bitmap_query(query->children[i]);
+  }
+  free(query->children);
+  free(query->key);
+  free(query);
+}
+
+// query plan: NOT is pushed down to the keys (De Morgan), nested ANDs
+// (ORs) are merged and every node knows bounds of its cardinality
+
+typedef struct __plan_node {
+  enum bitmap_query_op op;  // KEY, AND or OR
+  bool negate;              // KEY: complement of the bitarray
+  const ARRAY_TYPE *bits;   // KEY: array of the bitarray (NULL: no key)
+  size_t lo, hi;            // bounds of the number of matching documents
+  size_t n_children;
+  struct __plan_node **children;
+} __plan_node;
+
+static void __plan_delete(__plan_node *node) {
+  for (size_t i = 0; i < node->n_children; i++) {
+    __plan_delete(node->children[i]);
+  }
+  free(node->children);
+  free(node);
+}
+
+static int __plan_cmp_hi(const void *a, const void *b) {
+  size_t x = (*(__plan_node* const*) a)->hi;
+  size_t y = (*(__plan_node* const*) b)->hi;
+  return (x > y) - (x < y);
+}
+
+static int __plan_cmp_lo_desc(const void *a, const void *b) {
+  size_t x = (*(__plan_node* const*) a)->lo;
+  size_t y = (*(__plan_node* const*) b)->lo;
+  return (x < y) - (x > y);
+}
+
+static void __plan_add_child(__plan_node *node, __plan_node *child) {
+  // merge nested nodes of the same kind
+  if (child->op == node->op) {
+    for (size_t i = 0; i < child->n_children; i++) {
+      __plan_add_child(node, child->children[i]);
+    }
+    child->n_children = 0;
+    __plan_delete(child);
+    return;
+  }
+
+  node->children = (__plan_node**) realloc(
+    node->children, (node->n_children + 1) * sizeof(__plan_node*));
+  assert(node->children);
+  node->children[node->n_children++] = child;
+}
+
+static __plan_node* __plan(bitmap_index *index, bitmap_query *query,
+                           bool negate) {
+  assert(query);
+  size_t n_docs = index->n_docs;
+
+  if (query->op == BITMAP_QUERY_NOT) {
+    assert(query->n_children == 1);
+    return __plan(index, query->children[0], !negate);
+  }
+
+  __plan_node *node = (__plan_node*) calloc(1, sizeof(__plan_node));
+  assert(node);
+
+  if (query->op == BITMAP_QUERY_KEY) {
+    assert(query->key);
+    size_t slot = __index_slot(index, query->key);
+    size_t count = 0;
+    if (index->_keys[slot]) {
+      node->bits = index->_bitmaps[slot]->array;
+      count = index->_cardinality[slot];
+    }
+    node->op = BITMAP_QUERY_KEY;
+    node->negate = negate;
+    node->lo = node->hi = negate ? n_docs - count : count;
+    return node;
+  }
+
+  // NOT (a AND b) == NOT a OR NOT b and vice versa
+  assert(query->n_children > 0);
+  bool is_and = (query->op == BITMAP_QUERY_AND) != negate;
+  node->op = is_and ? BITMAP_QUERY_AND : BITMAP_QUERY_OR;
+  for (size_t i = 0; i < query->n_children; i++) {
+    __plan_add_child(node, __plan(index, query->children[i], negate));
+  }
+
+  if (is_and) {
+    // the smallest children first, they exclude the most documents
+    qsort(node->children, node->n_children, sizeof(__plan_node*),
+          __plan_cmp_hi);
+    node->hi = node->children[0]->hi;
+    // |a & b| >= |a| + |b| - n_docs
+    size_t lo = n_docs;
+    for (size_t i = 0; i < node->n_children; i++) {
+      size_t missing = n_docs - node->children[i]->lo;
+      lo = missing < lo ? lo - missing : 0;
+    }
+    node->lo = lo;
+  } else {
+    // the largest children first, they fill blocks the fastest
+    qsort(node->children, node->n_children, sizeof(__plan_node*),
+          __plan_cmp_lo_desc);
+    node->lo = node->children[0]->lo;
+    size_t hi = 0;
+    for (size_t i = 0; i < node->n_children && hi < n_docs; i++) {
+      hi += node->children[i]->hi;
+    }
+    node->hi = hi < n_docs ? hi : n_docs;
+  }
+
+  return node;
+}
+
+static bool __block_is(const ARRAY_TYPE *block, size_t n, ARRAY_TYPE value) {
+  for (size_t i = 0; i < n; i++) {
+    if (block[i] != value) return false;
+  }
+  return true;
+}
+
+// combine the elements [w, w + n) of child into out (first: out = child);
+// scratch provides a block for every level below child
+static void __plan_eval(const __plan_node *node, size_t n_docs, size_t w,
+                        size_t n, ARRAY_TYPE *out, ARRAY_TYPE *scratch);
+
+static void __plan_combine(const __plan_node *node,
+                           const __plan_node *child, size_t n_docs,
+                           size_t w, size_t n, ARRAY_TYPE *out,
+                           ARRAY_TYPE *scratch, bool first) {
+  bool is_and = node->op == BITMAP_QUERY_AND;
+
+  // keys (that aren't constant) are read directly from the index
+  const ARRAY_TYPE *src;
+  ARRAY_TYPE flip = 0;
+  if (child->op == BITMAP_QUERY_KEY && child->hi > 0 &&
+      child->lo < n_docs) {
+    src = child->bits + w;
+    flip = child->negate ? ARRAY_TYPE_MAX : 0;
+  } else {
+    __plan_eval(child, n_docs, w, n, scratch, scratch + n);
+    src = scratch;
+  }
+
+  if (first) {
+    for (size_t i = 0; i < n; i++) out[i] = src[i] ^ flip;
+  } else if (is_and) {
+    for (size_t i = 0; i < n; i++) out[i] &= src[i] ^ flip;
+  } else {
+    for (size_t i = 0; i < n; i++) out[i] |= src[i] ^ flip;
+  }
+}
+
+static void __plan_eval(const __plan_node *node, size_t n_docs, size_t w,
+                        size_t n, ARRAY_TYPE *out, ARRAY_TYPE *scratch) {
+  // constant nodes (also keys that aren't in the index)
+  if (node->hi == 0) {
+    memset(out, 0, n * TYPE_SIZE);
+    return;
+  }
+  if (node->lo == n_docs) {
+    memset(out, 0xff, n * TYPE_SIZE);
+    return;
+  }
+
+  if (node->op == BITMAP_QUERY_KEY) {
+    ARRAY_TYPE flip = node->negate ? ARRAY_TYPE_MAX : 0;
+    for (size_t i = 0; i < n; i++) out[i] = node->bits[w + i] ^ flip;
+    return;
+  }
+
+  // stop as soon as the block can't change anymore
+  ARRAY_TYPE done = node->op == BITMAP_QUERY_AND ? 0 : ARRAY_TYPE_MAX;
+  for (size_t i = 0; i < node->n_children; i++) {
+    __plan_combine(node, node->children[i], n_docs, w, n, out, scratch,
+                   i == 0);
+    if (__block_is(out, n, done)) return;
+  }
+}
+
+static size_t __plan_depth(const __plan_node *node) {
+  size_t depth = 0;
+  for (size_t i = 0; i < node->n_children; i++) {
+    size_t d = __plan_depth(node->children[i]);
+    depth = d > depth ? d : depth;
+  }
+  return depth + 1;
+}
+
+bitarray* bitmap_index_query(bitmap_index *index, bitmap_query *query) {
+  assert(index && query);
+
+  bitarray *res = create_bitarray(index->n_docs);
+  __plan_node *plan = __plan(index, query, false);
+
+  if (plan->hi > 0) {
+    ARRAY_TYPE *scratch = (ARRAY_TYPE*) malloc(
+      __plan_depth(plan) * __INDEX_BLOCK * TYPE_SIZE);
+    assert(scratch);
+
+    for (size_t w = 0; w < res->_array_size; w += __INDEX_BLOCK) {
+      size_t n = res->_array_size - w < __INDEX_BLOCK
+                 ? res->_array_size - w : __INDEX_BLOCK;
+      __plan_eval(plan, index->n_docs, w, n, res->array + w, scratch);
+    }
+    free(scratch);
+
+    // complements set the bits after n_docs
+    size_t used = index->n_docs / BITS_PER_EL;
+    res->array[used] &= (MASK_1 << (index->n_docs % BITS_PER_EL)) - 1;
+    for (size_t i = used + 1; i < res->_array_size; i++) {
+      res->array[i] = 0;
+    }
+  }
+
+  __plan_delete(plan);
+  return res;
+}
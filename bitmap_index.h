@@ -0,0 +1,85 @@
+#ifndef BITMAP_INDEX_H_
+#define BITMAP_INDEX_H_
+
+// bitmap inverted index: maps keys (terms, categories, ...) to bitarrays
+// of n_docs bits and evaluates boolean queries over them
+//
+// the cardinality of every bitarray is cached, so a query can be planned
+// before any bitarray is read: the children of AND nodes are evaluated in
+// order of increasing cardinality (OR nodes in decreasing order), NOT is
+// folded into its parent (a & ~b) and the result is computed one block
+// of array elements at a time, so no intermediate bitarray is created and
+// a block is finished as soon as an AND becomes empty (an OR full).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t n_docs;          // number of bits of every bitarray
+  size_t n_keys;          // number of keys in the index
+  size_t _capacity;       // number of slots (a power of two)
+  char **_keys;           // key of each slot (NULL: empty slot)
+  bitarray **_bitmaps;    // bitarray of each slot
+  size_t *_cardinality;   // number of set bits of each slot's bitarray
+} bitmap_index;
+
+enum bitmap_query_op {
+  BITMAP_QUERY_KEY,  // the bitarray of key
+  BITMAP_QUERY_AND,  // intersection of the children
+  BITMAP_QUERY_OR,   // union of the children
+  BITMAP_QUERY_NOT   // complement of the only child
+};
+
+typedef struct bitmap_query {
+  enum bitmap_query_op op;
+  char *key;                        // BITMAP_QUERY_KEY
+  size_t n_children;                // AND/OR: >= 1, NOT: 1
+  struct bitmap_query **children;
+} bitmap_query;
+
+// create empty index over n_docs documents
+bitmap_index* create_bitmap_index(size_t n_docs);
+
+// delete index (including its bitarrays) and free allocated memory
+void delete_bitmap_index(bitmap_index *index);
+
+// set bit doc of key's bitarray (created on first use)
+void bitmap_index_add(bitmap_index *index, const char *key, size_t doc);
+
+// clear bit doc of key's bitarray
+void bitmap_index_remove(bitmap_index *index, const char *key, size_t doc);
+
+// replace key's bitarray with a copy of bits (must hold n_docs bits)
+void bitmap_index_put(bitmap_index *index, const char *key, bitarray *bits);
+
+// bitarray of key (NULL if key isn't in the index); change it only
+// through bitmap_index_add/remove/put, the cardinality is cached
+bitarray* bitmap_index_get(bitmap_index *index, const char *key);
+
+// number of set bits of key's bitarray (0 if key isn't in the index)
+size_t bitmap_index_cardinality(bitmap_index *index, const char *key);
+
+// parse query string like "a AND (b OR NOT c)"
+// (NOT binds stronger than AND, AND stronger than OR; keys consist of
+// letters, digits and _-.: or are quoted with "); NULL on syntax errors
+bitmap_query* parse_bitmap_query(const char *str);
+
+// delete query and free allocated memory
+void delete_bitmap_query(bitmap_query *query);
+
+// documents matching query (new bitarray of n_docs bits);
+// keys that aren't in the index match no document
+bitarray* bitmap_index_query(bitmap_index *index, bitmap_query *query);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // BITMAP_INDEX_H_
@@ -0,0 +1,611 @@
+#include "bitmatrix.h"
+
+#include <pthread.h>
+
+#if ARRAY_TYPE_MAX != UINT64_MAX
+#error "bitmatrix needs 64 bit array elements"
+#endif
+
+// rows are padded to multiples of 64 bytes
+#define __BITMATRIX_ALIGN 64
+#define __BITMATRIX_ALIGN_WORDS (__BITMATRIX_ALIGN / TYPE_SIZE)
+
+// products: columns of the result are computed one stripe of elements
+// (one cache line) at a time, with one table per 8 rows of b for every
+// element of a's rows (__BITMATRIX_TABLES tables of 256 combinations,
+// 128 KB)
+#define __BITMATRIX_STRIPE __BITMATRIX_ALIGN_WORDS
+#define __BITMATRIX_TABLES (BITS_PER_EL / 8)
+
+static inline size_t __bitmatrix_words(size_t n_bits) {
+  return (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+}
+
+bitmatrix* create_bitmatrix(size_t n_rows, size_t n_cols) {
+  assert(n_rows > 0 && n_cols > 0);
+
+  bitmatrix *m = (bitmatrix*) malloc(sizeof(bitmatrix));
+  assert(m);
+  m->n_rows = n_rows;
+  m->n_cols = n_cols;
+  m->_row_words = (__bitmatrix_words(n_cols) + __BITMATRIX_ALIGN_WORDS - 1) /
+                  __BITMATRIX_ALIGN_WORDS * __BITMATRIX_ALIGN_WORDS;
+
+  size_t bytes = n_rows * m->_row_words * TYPE_SIZE;
+  m->array = (ARRAY_TYPE*) aligned_alloc(__BITMATRIX_ALIGN, bytes);
+  assert(m->array);
+  memset(m->array, 0, bytes);
+
+  return m;
+}
+
+bitmatrix* create_bitmatrix_from_rows(bitarray **rows, size_t n_rows) {
+  assert(rows && n_rows > 0);
+
+  bitmatrix *m = create_bitmatrix(n_rows, rows[0]->size);
+  size_t words = __bitmatrix_words(m->n_cols);
+  for (size_t i = 0; i < n_rows; i++) {
+    assert(rows[i] && rows[i]->size == m->n_cols);
+    memcpy(m->array + i * m->_row_words, rows[i]->array, words * TYPE_SIZE);
+  }
+
+  return m;
+}
+
+bitmatrix* copy_bitmatrix(bitmatrix *m) {
+  assert(m);
+
+  bitmatrix *copy = create_bitmatrix(m->n_rows, m->n_cols);
+  memcpy(copy->array, m->array, m->n_rows * m->_row_words * TYPE_SIZE);
+  return copy;
+}
+
+void delete_bitmatrix(bitmatrix *m) {
+  assert(m);
+
+  free(m->array);
+  free(m);
+}
+
+bool bitmatrix_get(bitmatrix *m, size_t i, size_t j) {
+  assert(m);
+  assert(i < m->n_rows && j < m->n_cols);
+
+  ARRAY_TYPE el = m->array[i * m->_row_words + j / BITS_PER_EL];
+  return (el >> (j % BITS_PER_EL)) & MASK_1;
+}
+
+void bitmatrix_set(bitmatrix *m, size_t i, size_t j) {
+  assert(m);
+  assert(i < m->n_rows && j < m->n_cols);
+
+  m->array[i * m->_row_words + j / BITS_PER_EL] |= MASK_1 << (j % BITS_PER_EL);
+}
+
+void bitmatrix_clear(bitmatrix *m, size_t i, size_t j) {
+  assert(m);
+  assert(i < m->n_rows && j < m->n_cols);
+
+  m->array[i * m->_row_words + j / BITS_PER_EL] &=
+    ~(MASK_1 << (j % BITS_PER_EL));
+}
+
+bitarray bitmatrix_row(bitmatrix *m, size_t i) {
+  assert(m);
+  assert(i < m->n_rows);
+
+  bitarray row = {m->n_cols, m->_row_words, m->array + i * m->_row_words,
+                  true, NULL};
+  return row;
+}
+
+// transposes
+
+// one round swaps the bits of row k (k & s == 0) whose column has bit s
+// set with the bits of row k + s whose column has bit s cleared; after
+// the rounds s = 32, 16, ..., 1 bit j of row i has moved to bit i of row j
+void bitmatrix_transpose_block(uint64_t block[64]) {
+  assert(block);
+
+#ifdef __BITARRAY_AVX512
+  // vector q holds rows 8q to 8q + 7: for s >= 8 the rows of a pair are in
+  // different vectors (same lane), for s < 8 in different lanes
+  __m512i v[8];
+  for (int q = 0; q < 8; q++) {
+    v[q] = _mm512_loadu_si512((const void*) (block + 8 * q));
+  }
+
+  uint64_t mask = 0x00000000FFFFFFFFULL;
+  for (int s = 32; s >= 8; s >>= 1, mask ^= mask << s) {
+    const __m512i m = _mm512_set1_epi64(mask);
+    const int d = s / 8;
+    for (int q = 0; q < 8; q++) {
+      if (q & d) continue;
+      __m512i t = _mm512_and_si512(
+        _mm512_xor_si512(_mm512_srli_epi64(v[q], s), v[q + d]), m);
+      v[q + d] = _mm512_xor_si512(v[q + d], t);
+      v[q] = _mm512_xor_si512(v[q], _mm512_slli_epi64(t, s));
+    }
+  }
+
+  for (int s = 4; s >= 1; s >>= 1, mask ^= mask << s) {
+    const __m512i m = _mm512_set1_epi64(mask);
+    // lane l is paired with lane l ^ s, the high lanes have bit s set
+    const __m512i partner = _mm512_xor_si512(
+      _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_epi64(s));
+    const __mmask8 high = s == 4 ? 0xf0 : s == 2 ? 0xcc : 0xaa;
+    for (int q = 0; q < 8; q++) {
+      __m512i p = _mm512_permutexvar_epi64(partner, v[q]);
+      // t of the pair, computed in both lanes
+      __m512i lo = _mm512_mask_blend_epi64(high, v[q], p);
+      __m512i hi = _mm512_mask_blend_epi64(high, p, v[q]);
+      __m512i t = _mm512_and_si512(
+        _mm512_xor_si512(_mm512_srli_epi64(lo, s), hi), m);
+      v[q] = _mm512_xor_si512(
+        v[q], _mm512_mask_blend_epi64(high, _mm512_slli_epi64(t, s), t));
+    }
+  }
+
+  for (int q = 0; q < 8; q++) {
+    _mm512_storeu_si512((void*) (block + 8 * q), v[q]);
+  }
+#else
+  uint64_t mask = 0x00000000FFFFFFFFULL;
+  for (int s = 32; s; s >>= 1, mask ^= mask << s) {
+    for (int k = 0; k < 64; k = (k + s + 1) & ~s) {
+      uint64_t t = ((block[k] >> s) ^ block[k + s]) & mask;
+      block[k + s] ^= t;
+      block[k] ^= t << s;
+    }
+  }
+#endif
+}
+
+// three rounds swap the 1x1, 2x2 and 4x4 blocks off the diagonal of the
+// 2x2, 4x4 and 8x8 blocks (bit j of byte i is bit 8i + j and moves by
+// 7 * (i - j))
+static inline uint64_t __bitmatrix_transpose_8x8(uint64_t x) {
+  uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  return x ^ t ^ (t << 28);
+}
+
+void bitmatrix_transpose_8x8(uint64_t *blocks, size_t n) {
+  assert(blocks || !n);
+
+  size_t i = 0;
+#if defined(__BITARRAY_AVX512) && defined(__GFNI__)
+  // bit j of byte i of the affine transform of x by a is the parity of
+  // x's byte i AND byte 7 - j of a: with byte i of x = 1 << i it's bit i
+  // of byte 7 - j of a, so a is the block with its bytes reversed
+  const __m512i units = _mm512_set1_epi64(0x8040201008040201LL);
+  const __m512i reverse = _mm512_broadcast_i32x4(_mm_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+  for (; i + 8 <= n; i += 8) {
+    __m512i a = _mm512_shuffle_epi8(
+        _mm512_loadu_si512((const void*) (blocks + i)), reverse);
+    _mm512_storeu_si512((void*) (blocks + i),
+                        _mm512_gf2p8affine_epi64_epi8(units, a, 0));
+  }
+#endif
+  for (; i < n; i++) blocks[i] = __bitmatrix_transpose_8x8(blocks[i]);
+}
+
+// load the 64x64 block of m at rows [64 * r, 64 * r + 64), element c
+// (rows after n_rows are 0)
+static inline void __bitmatrix_load_block(bitmatrix *m, size_t r, size_t c,
+                                          uint64_t block[64]) {
+  size_t n = m->n_rows - 64 * r < 64 ? m->n_rows - 64 * r : 64;
+  const ARRAY_TYPE *src = m->array + 64 * r * m->_row_words + c;
+  for (size_t i = 0; i < n; i++) block[i] = src[i * m->_row_words];
+  for (size_t i = n; i < 64; i++) block[i] = 0;
+}
+
+bitmatrix* bitmatrix_transpose(bitmatrix *m) {
+  assert(m);
+
+  bitmatrix *t = create_bitmatrix(m->n_cols, m->n_rows);
+  uint64_t block[64];
+
+  for (size_t r = 0; r < __bitmatrix_words(m->n_rows); r++) {
+    for (size_t c = 0; c < __bitmatrix_words(m->n_cols); c++) {
+      __bitmatrix_load_block(m, r, c, block);
+      bitmatrix_transpose_block(block);
+
+      // row j of the block is row 64 * c + j of the transpose
+      size_t n = m->n_cols - 64 * c < 64 ? m->n_cols - 64 * c : 64;
+      ARRAY_TYPE *dest = t->array + 64 * c * t->_row_words + r;
+      for (size_t j = 0; j < n; j++) dest[j * t->_row_words] = block[j];
+    }
+  }
+
+  return t;
+}
+
+// products (Method of Four Russians)
+
+// tables[t][x] = combination (XOR if gf2, else OR) of the stripe of the
+// rows 8t + i of b for all bits i set in x, for the 64 rows after first
+static void __bitmatrix_build_tables(bitmatrix *b, size_t first, size_t stripe,
+                                     bool gf2, ARRAY_TYPE *tables) {
+  for (size_t t = 0; t < __BITMATRIX_TABLES; t++) {
+    ARRAY_TYPE *table = tables + t * 256 * __BITMATRIX_STRIPE;
+    memset(table, 0, __BITMATRIX_STRIPE * TYPE_SIZE);
+
+    // entries [2^i, 2^(i+1)) are entries [0, 2^i) combined with row i
+    for (size_t i = 0; i < 8; i++) {
+      size_t row = first + 8 * t + i;
+      const ARRAY_TYPE *src = b->array + row * b->_row_words + stripe;
+      ARRAY_TYPE *lo = table;
+      ARRAY_TYPE *hi = table + ((size_t) 1 << i) * __BITMATRIX_STRIPE;
+      size_t n = ((size_t) 1 << i) * __BITMATRIX_STRIPE;
+
+      if (row >= b->n_rows) {
+        // (never selected, a's bits after n_cols are 0)
+        memcpy(hi, lo, n * TYPE_SIZE);
+        continue;
+      }
+      for (size_t x = 0; x < n; x += __BITMATRIX_STRIPE) {
+        for (size_t w = 0; w < __BITMATRIX_STRIPE; w++) {
+          hi[x + w] = gf2 ? lo[x + w] ^ src[w] : lo[x + w] | src[w];
+        }
+      }
+    }
+  }
+}
+
+static bitmatrix* __bitmatrix_mul(bitmatrix *a, bitmatrix *b, bool gf2) {
+  assert(a && b);
+  assert(a->n_cols == b->n_rows);
+
+  bitmatrix *c = create_bitmatrix(a->n_rows, b->n_cols);
+  size_t table_bytes = __BITMATRIX_TABLES * 256 * __BITMATRIX_STRIPE *
+                       TYPE_SIZE;
+  ARRAY_TYPE *tables = (ARRAY_TYPE*) aligned_alloc(__BITMATRIX_ALIGN,
+                                                   table_bytes);
+  assert(tables);
+
+  for (size_t s = 0; s < c->_row_words; s += __BITMATRIX_STRIPE) {
+    // element g of a's rows selects rows [64 * g, 64 * g + 64) of b
+    for (size_t g = 0; g < __bitmatrix_words(a->n_cols); g++) {
+      __bitmatrix_build_tables(b, 64 * g, s, gf2, tables);
+
+      for (size_t i = 0; i < a->n_rows; i++) {
+        uint64_t x = a->array[i * a->_row_words + g];
+        if (!x) continue;
+
+        ARRAY_TYPE acc[__BITMATRIX_STRIPE] = {0};
+        for (size_t t = 0; t < __BITMATRIX_TABLES; t++, x >>= 8) {
+          const ARRAY_TYPE *entry = tables +
+            (t * 256 + (x & 0xff)) * __BITMATRIX_STRIPE;
+          for (size_t w = 0; w < __BITMATRIX_STRIPE; w++) {
+            acc[w] = gf2 ? acc[w] ^ entry[w] : acc[w] | entry[w];
+          }
+        }
+
+        ARRAY_TYPE *dest = c->array + i * c->_row_words + s;
+        for (size_t w = 0; w < __BITMATRIX_STRIPE; w++) {
+          dest[w] = gf2 ? dest[w] ^ acc[w] : dest[w] | acc[w];
+        }
+      }
+    }
+  }
+
+  free(tables);
+  return c;
+}
+
+bitmatrix* bitmatrix_mul_gf2(bitmatrix *a, bitmatrix *b) {
+  return __bitmatrix_mul(a, b, true);
+}
+
+bitmatrix* bitmatrix_mul_bool(bitmatrix *a, bitmatrix *b) {
+  return __bitmatrix_mul(a, b, false);
+}
+
+// counts
+
+void bitmatrix_row_counts(bitmatrix *m, size_t *counts) {
+  assert(m && counts);
+
+  for (size_t i = 0; i < m->n_rows; i++) {
+    bitarray row = bitmatrix_row(m, i);
+    counts[i] = count_bits(&row);
+  }
+}
+
+// columns of a 64x64 block are counted as rows of its transpose
+void bitmatrix_col_counts(bitmatrix *m, size_t *counts) {
+  assert(m && counts);
+
+  memset(counts, 0, m->n_cols * sizeof(size_t));
+  uint64_t block[64];
+
+  for (size_t c = 0; c < __bitmatrix_words(m->n_cols); c++) {
+    size_t n = m->n_cols - 64 * c < 64 ? m->n_cols - 64 * c : 64;
+    for (size_t r = 0; r < __bitmatrix_words(m->n_rows); r++) {
+      __bitmatrix_load_block(m, r, c, block);
+      bitmatrix_transpose_block(block);
+      for (size_t j = 0; j < n; j++) {
+        counts[64 * c + j] += __builtin_popcountll(block[j]);
+      }
+    }
+  }
+}
+
+// linear algebra over GF(2)
+
+// columns per elimination step (the window: 8 bits of every row) and
+// array elements per stripe of the table lookups (256 combinations of one
+// stripe are 128 KB)
+#define __BITMATRIX_STEP 8
+#define __BITMATRIX_ELIM_STRIPE 64
+
+// threads are only started for steps that update at least this many
+// array elements
+#define __BITMATRIX_THREAD_MIN ((size_t) 1 << 18)
+
+// columns [c, c + 8) of row i (c is a multiple of 8)
+static inline uint8_t __bitmatrix_window(bitmatrix *m, size_t i, size_t c) {
+  return m->array[i * m->_row_words + c / BITS_PER_EL] >> (c % BITS_PER_EL);
+}
+
+// row dest ^= row src (elements [from, to))
+static inline void __bitmatrix_xor_row(bitmatrix *m, size_t dest, size_t src,
+                                       size_t from, size_t to) {
+  ARRAY_TYPE *d = m->array + dest * m->_row_words;
+  const ARRAY_TYPE *s = m->array + src * m->_row_words;
+  for (size_t w = from; w < to; w++) d[w] ^= s[w];
+}
+
+static inline void __bitmatrix_swap_rows(bitmatrix *m, size_t a, size_t b,
+                                         size_t from, size_t to) {
+  ARRAY_TYPE *x = m->array + a * m->_row_words;
+  ARRAY_TYPE *y = m->array + b * m->_row_words;
+  for (size_t w = from; w < to; w++) {
+    ARRAY_TYPE tmp = x[w];
+    x[w] = y[w];
+    y[w] = tmp;
+  }
+}
+
+// one step of the elimination: every row i gets the pivot rows of the bits
+// set in sel[i] added (elements [from, to)); the thread handles every
+// n_threads-th stripe, starting with stripe thread
+typedef struct {
+  bitmatrix *m;
+  const uint8_t *sel;
+  const size_t *pivot_rows;  // pivot row of each bit of the window
+  uint8_t mask;              // bits of the window that have a pivot row
+  size_t from, to;
+  unsigned thread, n_threads;
+  ARRAY_TYPE *table;         // 256 * __BITMATRIX_ELIM_STRIPE elements
+} __bitmatrix_step;
+
+static void* __bitmatrix_eliminate(void *arg) {
+  __bitmatrix_step *step = (__bitmatrix_step*) arg;
+  bitmatrix *m = step->m;
+  ARRAY_TYPE *table = step->table;
+  const size_t stride = __BITMATRIX_ELIM_STRIPE;
+
+  for (size_t s = step->from + step->thread * stride; s < step->to;
+       s += step->n_threads * stride) {
+    size_t width = step->to - s < stride ? step->to - s : stride;
+
+    // combinations of the pivot rows (only the subsets of mask are used,
+    // they are enumerated in increasing order)
+    memset(table, 0, width * TYPE_SIZE);
+    for (unsigned x = -step->mask & step->mask; x;
+         x = (x - step->mask) & step->mask) {
+      const ARRAY_TYPE *prev = table + (x & (x - 1)) * stride;
+      const ARRAY_TYPE *row = m->array +
+        step->pivot_rows[__builtin_ctz(x)] * m->_row_words + s;
+      ARRAY_TYPE *entry = table + x * stride;
+      for (size_t w = 0; w < width; w++) entry[w] = prev[w] ^ row[w];
+    }
+
+    for (size_t i = 0; i < m->n_rows; i++) {
+      if (!step->sel[i]) continue;
+      const ARRAY_TYPE *entry = table + step->sel[i] * stride;
+      ARRAY_TYPE *row = m->array + i * m->_row_words + s;
+      for (size_t w = 0; w < width; w++) row[w] ^= entry[w];
+    }
+  }
+
+  return NULL;
+}
+
+size_t bitmatrix_rref(bitmatrix *m, size_t *pivots, unsigned n_threads) {
+  assert(m);
+
+  size_t words = __bitmatrix_words(m->n_cols);
+  if (n_threads < 1) n_threads = 1;
+
+  uint8_t *sel = (uint8_t*) malloc(m->n_rows);
+  ARRAY_TYPE *tables = (ARRAY_TYPE*) aligned_alloc(
+    __BITMATRIX_ALIGN, n_threads * 256 * __BITMATRIX_ELIM_STRIPE * TYPE_SIZE);
+  pthread_t *threads = (pthread_t*) malloc(n_threads * sizeof(pthread_t));
+  __bitmatrix_step *steps = (__bitmatrix_step*) malloc(
+    n_threads * sizeof(__bitmatrix_step));
+  assert(sel && tables && threads && steps);
+
+  size_t r = 0;
+  for (size_t c = 0; c < m->n_cols && r < m->n_rows; c += __BITMATRIX_STEP) {
+    size_t word = c / BITS_PER_EL;
+    uint8_t valid = m->n_cols - c >= __BITMATRIX_STEP
+                    ? 0xff : (1U << (m->n_cols - c)) - 1;
+
+    // find the pivots of the window: every row is reduced by the pivots
+    // found so far (their windows are reduced against each other, so the
+    // pivots to add are the pivot bits set in the row's window) and the
+    // lowest bit left becomes the pivot of the next pivot row
+    size_t pivot_rows[__BITMATRIX_STEP];
+    uint8_t pivot_windows[__BITMATRIX_STEP];
+    uint8_t mask = 0;
+    size_t f = 0;
+    for (size_t i = r; i < m->n_rows && mask != valid; i++) {
+      uint8_t w = __bitmatrix_window(m, i, c);
+      uint8_t comb = w & mask;
+      for (uint8_t x = comb; x; x &= x - 1) {
+        w ^= pivot_windows[__builtin_ctz(x)];
+      }
+      if (!w) continue;
+
+      for (uint8_t x = comb; x; x &= x - 1) {
+        __bitmatrix_xor_row(m, i, pivot_rows[__builtin_ctz(x)], word, words);
+      }
+      // rows [r + f, i) are no pivot rows
+      if (i != r + f) __bitmatrix_swap_rows(m, i, r + f, word, words);
+
+      unsigned b = __builtin_ctz(w);
+      for (uint8_t x = mask; x; x &= x - 1) {
+        unsigned a = __builtin_ctz(x);
+        if ((pivot_windows[a] >> b) & 1) {
+          __bitmatrix_xor_row(m, pivot_rows[a], r + f, word, words);
+          pivot_windows[a] ^= w;
+        }
+      }
+      pivot_rows[b] = r + f;
+      pivot_windows[b] = w;
+      mask |= 1U << b;
+      f++;
+    }
+    if (!f) continue;
+
+    // order the pivot rows by column
+    size_t k = r;
+    for (uint8_t x = mask; x; x &= x - 1, k++) {
+      unsigned b = __builtin_ctz(x);
+      if (pivot_rows[b] != k) {
+        __bitmatrix_swap_rows(m, pivot_rows[b], k, word, words);
+        for (uint8_t y = x & (x - 1); y; y &= y - 1) {
+          if (pivot_rows[__builtin_ctz(y)] == k) {
+            pivot_rows[__builtin_ctz(y)] = pivot_rows[b];
+          }
+        }
+        pivot_rows[b] = k;
+      }
+      if (pivots) pivots[k] = c + b;
+    }
+
+    // clear the pivot columns of all other rows
+    for (size_t i = 0; i < m->n_rows; i++) {
+      sel[i] = i >= r && i < r + f ? 0 : __bitmatrix_window(m, i, c) & mask;
+    }
+    unsigned n = (m->n_rows * (words - word) >= __BITMATRIX_THREAD_MIN)
+                 ? n_threads : 1;
+    for (unsigned t = 0; t < n; t++) {
+      __bitmatrix_step step = {m, sel, pivot_rows, mask, word, words, t, n,
+                               tables + t * 256 * __BITMATRIX_ELIM_STRIPE};
+      steps[t] = step;
+    }
+    // (a step whose thread can't be started runs in this thread)
+    bool *started = (bool*) calloc(n, sizeof(bool));
+    assert(started);
+    for (unsigned t = 1; t < n; t++) {
+      started[t] = !pthread_create(&threads[t], NULL, __bitmatrix_eliminate,
+                                   &steps[t]);
+    }
+    __bitmatrix_eliminate(&steps[0]);
+    for (unsigned t = 1; t < n; t++) {
+      if (started[t]) {
+        pthread_join(threads[t], NULL);
+      } else {
+        __bitmatrix_eliminate(&steps[t]);
+      }
+    }
+    free(started);
+
+    r += f;
+  }
+
+  free(sel);
+  free(tables);
+  free(threads);
+  free(steps);
+  return r;
+}
+
+size_t bitmatrix_rank(bitmatrix *m, unsigned n_threads) {
+  assert(m);
+
+  bitmatrix *copy = copy_bitmatrix(m);
+  size_t rank = bitmatrix_rref(copy, NULL, n_threads);
+  delete_bitmatrix(copy);
+  return rank;
+}
+
+bitarray* bitmatrix_solve(bitmatrix *a, bitarray *b, unsigned n_threads) {
+  assert(a && b);
+  assert(b->size == a->n_rows);
+
+  // [a | b]
+  bitmatrix *aug = create_bitmatrix(a->n_rows, a->n_cols + 1);
+  size_t words = __bitmatrix_words(a->n_cols);
+  for (size_t i = 0; i < a->n_rows; i++) {
+    memcpy(aug->array + i * aug->_row_words, a->array + i * a->_row_words,
+           words * TYPE_SIZE);
+    if (get_bit(b, i)) bitmatrix_set(aug, i, a->n_cols);
+  }
+
+  size_t *pivots = (size_t*) malloc((a->n_cols + 1) * sizeof(size_t));
+  assert(pivots);
+  size_t rank = bitmatrix_rref(aug, pivots, n_threads);
+
+  // no solution if b is (also) a pivot column
+  bitarray *x = NULL;
+  if (!rank || pivots[rank - 1] != a->n_cols) {
+    x = create_bitarray(a->n_cols);
+    for (size_t k = 0; k < rank; k++) {
+      if (bitmatrix_get(aug, k, a->n_cols)) set_bit(x, pivots[k]);
+    }
+  }
+
+  free(pivots);
+  delete_bitmatrix(aug);
+  return x;
+}
+
+// basis vector of free column j: bit j and, for every pivot row k, bit
+// pivots[k] if row k has bit j set (column j of the reduced matrix, taken
+// from its transpose)
+bitmatrix* bitmatrix_nullspace(bitmatrix *a, unsigned n_threads) {
+  assert(a);
+
+  bitmatrix *reduced = copy_bitmatrix(a);
+  size_t *pivots = (size_t*) malloc(a->n_cols * sizeof(size_t));
+  assert(pivots);
+  size_t rank = bitmatrix_rref(reduced, pivots, n_threads);
+
+  bitmatrix *basis = NULL;
+  if (rank < a->n_cols) {
+    bitmatrix *t = bitmatrix_transpose(reduced);
+    basis = create_bitmatrix(a->n_cols - rank, a->n_cols);
+
+    size_t k = 0;
+    size_t row = 0;
+    for (size_t j = 0; j < a->n_cols; j++) {
+      if (k < rank && pivots[k] == j) {
+        k++;
+        continue;
+      }
+      bitmatrix_set(basis, row, j);
+      // (the rows after rank are 0)
+      const ARRAY_TYPE *col = t->array + j * t->_row_words;
+      for (size_t w = 0; w < __bitmatrix_words(rank); w++) {
+        for (ARRAY_TYPE x = col[w]; x; x &= x - 1) {
+          bitmatrix_set(basis, row, pivots[w * BITS_PER_EL + __builtin_ctzll(x)]);
+        }
+      }
+      row++;
+    }
+    delete_bitmatrix(t);
+  }
+
+  free(pivots);
+  delete_bitmatrix(reduced);
+  return basis;
+}
@@ -0,0 +1,109 @@
+#ifndef BITMATRIX_H_
+#define BITMATRIX_H_
+
+// dense bit matrix (boolean relation) with contiguous row storage
+//
+// every row uses the layout of a bitarray (bit j of row i is bit j % 64 of
+// element j / 64 of the row) and is padded to a multiple of 64 bytes, so
+// rows are cache line aligned and can be used as bitarrays through
+// bitmatrix_row. transposes work on 64x64 blocks (rows 8 at a time with
+// AVX-512) or 8x8 blocks in a uint64_t (8 blocks per gf2p8affine),
+// products use the Method of Four Russians (tables of the XORs/ORs of all
+// combinations of 8 rows), and so does the Gaussian elimination over
+// GF(2) (rank, solve, nullspace).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t n_rows;
+  size_t n_cols;
+  size_t _row_words;   // array elements per row (a multiple of 8)
+  ARRAY_TYPE *array;   // row i starts at array + i * _row_words
+} bitmatrix;
+
+// create n_rows x n_cols matrix (all bits unset/false)
+bitmatrix* create_bitmatrix(size_t n_rows, size_t n_cols);
+
+// create matrix whose row i is a copy of rows[i] (all of the same size)
+bitmatrix* create_bitmatrix_from_rows(bitarray **rows, size_t n_rows);
+
+// copy matrix
+bitmatrix* copy_bitmatrix(bitmatrix *m);
+
+// delete matrix and free allocated memory
+void delete_bitmatrix(bitmatrix *m);
+
+// get bit at row i, column j
+bool bitmatrix_get(bitmatrix *m, size_t i, size_t j);
+
+// set bit at row i, column j
+void bitmatrix_set(bitmatrix *m, size_t i, size_t j);
+
+// clear bit at row i, column j
+void bitmatrix_clear(bitmatrix *m, size_t i, size_t j);
+
+// row i as a bitarray of n_cols bits that shares the matrix' memory
+// (use it with the bitarray functions that don't resize or free it)
+bitarray bitmatrix_row(bitmatrix *m, size_t i);
+
+// transpose 64x64 block in-place (bit j of block[i] <-> bit i of block[j])
+void bitmatrix_transpose_block(uint64_t block[64]);
+
+// transpose the 8x8 blocks[0, n) in-place (bit j of byte i <-> bit i of
+// byte j of every block)
+void bitmatrix_transpose_8x8(uint64_t *blocks, size_t n);
+
+// transposed copy of m (n_cols x n_rows)
+bitmatrix* bitmatrix_transpose(bitmatrix *m);
+
+// product over GF(2) (AND, XOR) of a (n x k) and b (k x m), n x m
+bitmatrix* bitmatrix_mul_gf2(bitmatrix *a, bitmatrix *b);
+
+// boolean product (AND, OR) of a (n x k) and b (k x m), n x m
+// (composition of relations)
+bitmatrix* bitmatrix_mul_bool(bitmatrix *a, bitmatrix *b);
+
+// number of set bits of every row (counts must hold n_rows values)
+void bitmatrix_row_counts(bitmatrix *m, size_t *counts);
+
+// number of set bits of every column (counts must hold n_cols values)
+void bitmatrix_col_counts(bitmatrix *m, size_t *counts);
+
+// linear algebra over GF(2)
+//
+// the elimination handles 8 columns at a time: their pivots are searched
+// with ctz on the 8 bits of each row and the pivot rows are combined into
+// a table of all 256 combinations, which clears the 8 columns of every
+// other row with one lookup (M4RI). the rows are updated one stripe of
+// columns at a time, so the table stays in cache; n_threads > 1 updates
+// the stripes in parallel (0 and 1: no threads).
+
+// reduce m in-place to reduced row echelon form and return its rank;
+// pivots (NULL or room for min(n_rows, n_cols) values) receives the pivot
+// column of each of the first rank rows
+size_t bitmatrix_rref(bitmatrix *m, size_t *pivots, unsigned n_threads);
+
+// rank of m (m is unchanged)
+size_t bitmatrix_rank(bitmatrix *m, unsigned n_threads);
+
+// solution x of a * x = b (new bitarray of n_cols bits, the free
+// variables are 0); NULL if there is no solution (b must have n_rows bits)
+bitarray* bitmatrix_solve(bitmatrix *a, bitarray *b, unsigned n_threads);
+
+// basis of the nullspace of a (x with a * x = 0) as the rows of a new
+// (n_cols - rank) x n_cols matrix; NULL if a has full column rank
+bitmatrix* bitmatrix_nullspace(bitmatrix *a, unsigned n_threads);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // BITMATRIX_H_
@@ -0,0 +1,319 @@
+#include "bloom.h"
+
+#include <math.h>
+
+// bytes/array elements per block of the blocked layout (one cache line)
+#define __BLOOM_BLOCK_BYTES 64
+#define __BLOOM_BLOCK_WORDS (__BLOOM_BLOCK_BYTES / TYPE_SIZE)
+
+// the top bits of a 32 bit product select the bit within an element
+#define __BLOOM_BIT_SHIFT (32 - __builtin_ctz(BITS_PER_EL))
+
+// keys hashed (and prefetched) per step of the batch functions; the
+// memory of the next batch is prefetched while the current one is probed
+// (must divide BITS_PER_EL)
+#define __BLOOM_BATCH 16
+
+// probe j of the blocked layout sets a bit in element (j + r) % 8 of the
+// block, chosen by the top bits of (hash * salt[j]) (like Parquet's split
+// block Bloom filter); the rotation r (bits 32 to 34 of the hash) spreads
+// the probes of k < 8 over all elements
+static const uint32_t __bloom_salts[BLOOM_MAX_K] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+  0x9e3779b1U, 0x85ebca77U, 0xc2b2ae3dU, 0x27d4eb2fU,
+  0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U
+};
+
+// 64 bit finalizer of MurmurHash3
+static inline uint64_t __bloom_hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// hash n keys into out
+static inline void __bloom_hash_many(const uint64_t *keys, size_t n,
+                                     uint64_t *out) {
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512) && defined(__AVX512DQ__)
+  const __m512i c1 = _mm512_set1_epi64((long long) 0xff51afd7ed558ccdULL);
+  const __m512i c2 = _mm512_set1_epi64((long long) 0xc4ceb9fe1a85ec53ULL);
+  for (; i + 8 <= n; i += 8) {
+    __m512i k = _mm512_loadu_si512((const void*) (keys + i));
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, c1);
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, c2);
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    _mm512_storeu_si512((void*) (out + i), k);
+  }
+#endif
+
+  for (; i < n; i++) {
+    out[i] = __bloom_hash(keys[i]);
+  }
+}
+
+// (x * n) >> 64, maps x uniformly to [0, n)
+static inline size_t __bloom_reduce(uint64_t x, size_t n) {
+  return (size_t) (((unsigned __int128) x * n) >> 64);
+}
+
+// position of probe i of the plain layout (double hashing)
+static inline size_t __bloom_plain_pos(bloom_filter *filter, uint64_t hash,
+                                       uint8_t i) {
+  uint64_t step = ((hash >> 32) | (hash << 32)) | 1;
+  return __bloom_reduce(hash + i * step, filter->bits->size);
+}
+
+// first element of the block of the blocked layout
+static inline ARRAY_TYPE* __bloom_block(bloom_filter *filter, uint64_t hash) {
+  size_t n_blocks = filter->bits->_array_size / __BLOOM_BLOCK_WORDS;
+  return filter->bits->array + __bloom_reduce(hash, n_blocks) *
+                               __BLOOM_BLOCK_WORDS;
+}
+
+#if defined(__BITARRAY_AVX512)
+// the bits of the first min(k, 8) probes (first == 0) or of the probes
+// 8 to k - 1 (first == 8) of the blocked layout, one element per probe
+static inline __m512i __bloom_block_mask_vec(uint64_t hash, uint8_t k,
+                                             int first) {
+  __m512i salts = _mm512_cvtepu32_epi64(
+    _mm256_loadu_si256((const __m256i*) (__bloom_salts + first)));
+  __m512i prod = _mm512_mul_epu32(_mm512_set1_epi64((long long) hash), salts);
+  __m512i idx = _mm512_and_si512(_mm512_srli_epi64(prod, __BLOOM_BIT_SHIFT),
+                                 _mm512_set1_epi64(BITS_PER_EL - 1));
+  int n = k - first < 8 ? k - first : 8;
+  return _mm512_maskz_sllv_epi64((__mmask8) ((1U << n) - 1),
+                                 _mm512_set1_epi64(1), idx);
+}
+
+// the bits of the blocked layout as one vector (element i of the block)
+static inline __m512i __bloom_block_mask(uint64_t hash, uint8_t k) {
+  __m512i mask = __bloom_block_mask_vec(hash, k, 0);
+  if (k > 8) {
+    mask = _mm512_or_si512(mask, __bloom_block_mask_vec(hash, k, 8));
+  }
+
+  // rotate probe j to element (j + r) % 8
+  __m512i r = _mm512_set1_epi64((long long) (hash >> 32));
+  __m512i idx = _mm512_and_si512(
+    _mm512_sub_epi64(_mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7), r),
+    _mm512_set1_epi64(7));
+  return _mm512_permutexvar_epi64(idx, mask);
+}
+#endif
+
+static inline void __bloom_insert_hash(bloom_filter *filter, uint64_t hash) {
+  if (!filter->blocked) {
+    for (uint8_t i = 0; i < filter->k; i++) {
+      size_t pos = __bloom_plain_pos(filter, hash, i);
+      filter->bits->array[pos / BITS_PER_EL] |= MASK_1 << (pos % BITS_PER_EL);
+    }
+    return;
+  }
+
+  ARRAY_TYPE *block = __bloom_block(filter, hash);
+#if defined(__BITARRAY_AVX512)
+  __m512i mask = __bloom_block_mask(hash, filter->k);
+  _mm512_store_si512((void*) block,
+                     _mm512_or_si512(_mm512_load_si512((void*) block), mask));
+#else
+  uint32_t h = (uint32_t) hash;
+  size_t r = hash >> 32;
+  for (uint8_t j = 0; j < filter->k; j++) {
+    uint32_t bit = (h * __bloom_salts[j]) >> __BLOOM_BIT_SHIFT;
+    block[(j + r) % __BLOOM_BLOCK_WORDS] |= MASK_1 << bit;
+  }
+#endif
+}
+
+static inline bool __bloom_contains_hash(bloom_filter *filter,
+                                         uint64_t hash) {
+  if (!filter->blocked) {
+    for (uint8_t i = 0; i < filter->k; i++) {
+      size_t pos = __bloom_plain_pos(filter, hash, i);
+      if (!((filter->bits->array[pos / BITS_PER_EL] >> (pos % BITS_PER_EL))
+            & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const ARRAY_TYPE *block = __bloom_block(filter, hash);
+#if defined(__BITARRAY_AVX512)
+  __m512i mask = __bloom_block_mask(hash, filter->k);
+  __m512i v = _mm512_and_si512(_mm512_load_si512((const void*) block), mask);
+  return _mm512_cmpneq_epi64_mask(v, mask) == 0;
+#else
+  // the block is in cache after the first probe, so all probes are
+  // checked without branches
+  uint32_t h = (uint32_t) hash;
+  size_t r = hash >> 32;
+  ARRAY_TYPE found = 1;
+  for (uint8_t j = 0; j < filter->k; j++) {
+    uint32_t bit = (h * __bloom_salts[j]) >> __BLOOM_BIT_SHIFT;
+    found &= block[(j + r) % __BLOOM_BLOCK_WORDS] >> bit;
+  }
+  return found & 1;
+#endif
+}
+
+// prefetch the memory n hashes map to; lookups of keys that weren't
+// inserted usually stop at the first probes of the plain layout, so
+// reads only prefetch the first one
+static inline void __bloom_prefetch(bloom_filter *filter,
+                                    const uint64_t *hashes, size_t n,
+                                    bool write) {
+  for (size_t i = 0; i < n; i++) {
+    if (filter->blocked) {
+      if (write) {
+        __builtin_prefetch(__bloom_block(filter, hashes[i]), 1, 3);
+      } else {
+        __builtin_prefetch(__bloom_block(filter, hashes[i]), 0, 3);
+      }
+      continue;
+    }
+    uint8_t n_probes = write ? filter->k : 1;
+    for (uint8_t j = 0; j < n_probes; j++) {
+      size_t pos = __bloom_plain_pos(filter, hashes[i], j);
+      if (write) {
+        __builtin_prefetch(filter->bits->array + pos / BITS_PER_EL, 1, 3);
+      } else {
+        __builtin_prefetch(filter->bits->array + pos / BITS_PER_EL, 0, 3);
+      }
+    }
+  }
+}
+
+bloom_filter* create_bloom_filter(size_t n_bits, uint8_t k, bool blocked) {
+  assert(n_bits > 0);
+  assert(k > 0 && k <= BLOOM_MAX_K);
+
+  bloom_filter *filter = (bloom_filter*) malloc(sizeof(bloom_filter));
+  assert(filter);
+  filter->k = k;
+  filter->blocked = blocked;
+
+  if (!blocked) {
+    filter->bits = create_bitarray(n_bits);
+    return filter;
+  }
+
+  // the blocks must be aligned to cache lines, so the array is allocated
+  // here instead of by create_bitarray
+  size_t n_blocks = (n_bits + __BLOOM_BLOCK_BYTES * 8 - 1) /
+                    (__BLOOM_BLOCK_BYTES * 8);
+  bitarray *bits = (bitarray*) malloc(sizeof(bitarray));
+  assert(bits);
+  bits->array = (ARRAY_TYPE*) aligned_alloc(__BLOOM_BLOCK_BYTES,
+                                            n_blocks * __BLOOM_BLOCK_BYTES);
+  assert(bits->array);
+  memset(bits->array, 0, n_blocks * __BLOOM_BLOCK_BYTES);
+  bits->size = n_blocks * __BLOOM_BLOCK_BYTES * 8;
+  bits->_array_size = n_blocks * __BLOOM_BLOCK_WORDS;
+  bits->_borrowed = false;
+  bits->_aux = NULL;
+  filter->bits = bits;
+
+  return filter;
+}
+
+bloom_filter* create_bloom_filter_for(size_t n_keys, double fp_rate,
+                                      bool blocked) {
+  assert(n_keys > 0);
+  assert(fp_rate > 0 && fp_rate < 1);
+
+  // m = -n ln(p) / ln(2)^2, k = m / n ln(2)
+  double n_bits = -(double) n_keys * log(fp_rate) / (M_LN2 * M_LN2);
+  double k = round(n_bits / n_keys * M_LN2);
+  if (k < 1) k = 1;
+  if (k > BLOOM_MAX_K) k = BLOOM_MAX_K;
+
+  return create_bloom_filter((size_t) ceil(n_bits), (uint8_t) k, blocked);
+}
+
+void delete_bloom_filter(bloom_filter *filter) {
+  assert(filter);
+
+  delete_bitarray(filter->bits);
+  free(filter);
+}
+
+void bloom_insert(bloom_filter *filter, uint64_t key) {
+  assert(filter);
+  __bloom_insert_hash(filter, __bloom_hash(key));
+}
+
+bool bloom_contains(bloom_filter *filter, uint64_t key) {
+  assert(filter);
+  return __bloom_contains_hash(filter, __bloom_hash(key));
+}
+
+void bloom_insert_many(bloom_filter *filter, const uint64_t *keys,
+                       size_t n) {
+  assert(filter);
+  assert(keys || !n);
+
+  uint64_t hashes[2][__BLOOM_BATCH];
+  size_t n_next = n < __BLOOM_BATCH ? n : __BLOOM_BATCH;
+  __bloom_hash_many(keys, n_next, hashes[0]);
+  __bloom_prefetch(filter, hashes[0], n_next, true);
+
+  for (size_t i = 0, cur = 0; i < n; i += __BLOOM_BATCH, cur ^= 1) {
+    size_t n_cur = n_next;
+
+    // hash the next batch and prefetch its memory
+    if (i + __BLOOM_BATCH < n) {
+      size_t left = n - i - __BLOOM_BATCH;
+      n_next = left < __BLOOM_BATCH ? left : __BLOOM_BATCH;
+      __bloom_hash_many(keys + i + __BLOOM_BATCH, n_next, hashes[cur ^ 1]);
+      __bloom_prefetch(filter, hashes[cur ^ 1], n_next, true);
+    }
+
+    for (size_t j = 0; j < n_cur; j++) {
+      __bloom_insert_hash(filter, hashes[cur][j]);
+    }
+  }
+}
+
+void bloom_contains_many(bloom_filter *filter, const uint64_t *keys,
+                         size_t n, bitarray *out) {
+  assert(filter && out);
+  assert(keys || !n);
+  assert(out->size >= n);
+
+  uint64_t hashes[2][__BLOOM_BATCH];
+  size_t n_next = n < __BLOOM_BATCH ? n : __BLOOM_BATCH;
+  __bloom_hash_many(keys, n_next, hashes[0]);
+  __bloom_prefetch(filter, hashes[0], n_next, false);
+
+  for (size_t i = 0, cur = 0; i < n; i += __BLOOM_BATCH, cur ^= 1) {
+    size_t n_cur = n_next;
+
+    // hash the next batch and prefetch its memory
+    if (i + __BLOOM_BATCH < n) {
+      size_t left = n - i - __BLOOM_BATCH;
+      n_next = left < __BLOOM_BATCH ? left : __BLOOM_BATCH;
+      __bloom_hash_many(keys + i + __BLOOM_BATCH, n_next, hashes[cur ^ 1]);
+      __bloom_prefetch(filter, hashes[cur ^ 1], n_next, false);
+    }
+
+    // a batch lies within one element of out
+    ARRAY_TYPE found = 0;
+    for (size_t j = 0; j < n_cur; j++) {
+      found |= (ARRAY_TYPE) __bloom_contains_hash(filter, hashes[cur][j]) << j;
+    }
+    ARRAY_TYPE mask = n_cur == BITS_PER_EL ? ARRAY_TYPE_MAX
+                                           : (MASK_1 << n_cur) - 1;
+    uint8_t shift = i % BITS_PER_EL;
+    ARRAY_TYPE *word = out->array + i / BITS_PER_EL;
+    *word = (*word & ~(mask << shift)) | (found << shift);
+  }
+}
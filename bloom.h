@@ -0,0 +1,61 @@
+#ifndef BLOOM_H_
+#define BLOOM_H_
+
+// Bloom filter over 64 bit keys (hash longer keys to 64 bits first)
+//
+// the filter is a bitarray; a key sets k of its bits. in the plain layout
+// these are k independent positions (k cache misses per key), in the
+// blocked layout all k bits lie in one 64 byte block (one cache miss per
+// key, at the cost of a somewhat higher false-positive rate).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// max number of bits set per key
+#define BLOOM_MAX_K 16
+
+typedef struct {
+  bitarray *bits;  // the filter (a multiple of 512 bits if blocked)
+  uint8_t k;       // number of bits set per key
+  bool blocked;    // all bits of a key lie in one 64 byte block
+} bloom_filter;
+
+// create empty bloom filter with n_bits bits (rounded up to a multiple of
+// 512 if blocked) and k (1 to BLOOM_MAX_K) bits per key
+bloom_filter* create_bloom_filter(size_t n_bits, uint8_t k, bool blocked);
+
+// create empty bloom filter sized for n_keys keys and a false-positive
+// rate of fp_rate (of the plain layout, the blocked one is a bit higher)
+bloom_filter* create_bloom_filter_for(size_t n_keys, double fp_rate,
+                                      bool blocked);
+
+// delete bloom filter and free allocated memory
+void delete_bloom_filter(bloom_filter *filter);
+
+// insert key
+void bloom_insert(bloom_filter *filter, uint64_t key);
+
+// check if key may have been inserted (false: it definitely wasn't)
+bool bloom_contains(bloom_filter *filter, uint64_t key);
+
+// insert n keys; keys are hashed several at a time and the memory they
+// map to is prefetched ahead of the inserts
+void bloom_insert_many(bloom_filter *filter, const uint64_t *keys, size_t n);
+
+// check n keys like bloom_contains, bit i of out is set to the result of
+// keys[i] (out must hold at least n bits)
+void bloom_contains_many(bloom_filter *filter, const uint64_t *keys,
+                         size_t n, bitarray *out);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // BLOOM_H_
@@ -0,0 +1,369 @@
+#include "bsi.h"
+
+// the comparison kernel processes __BSI_LANES array elements at once
+#if defined(__BITARRAY_AVX512)
+#define __BSI_LANES 8
+typedef __m512i __bsi_vec;
+#define __bsi_load(p) _mm512_loadu_si512((const void*) (p))
+#define __bsi_store(p, v) _mm512_storeu_si512((void*) (p), v)
+#define __bsi_and(a, b) _mm512_and_si512(a, b)
+#define __bsi_or(a, b) _mm512_or_si512(a, b)
+#define __bsi_andnot(a, b) _mm512_andnot_si512(a, b)  // ~a & b
+#define __bsi_ones() _mm512_set1_epi64(-1)
+#define __bsi_is_zero(v) (_mm512_test_epi64_mask(v, v) == 0)
+#elif defined(__BITARRAY_AVX2)
+#define __BSI_LANES 4
+typedef __m256i __bsi_vec;
+#define __bsi_load(p) _mm256_loadu_si256((const __m256i*) (p))
+#define __bsi_store(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define __bsi_and(a, b) _mm256_and_si256(a, b)
+#define __bsi_or(a, b) _mm256_or_si256(a, b)
+#define __bsi_andnot(a, b) _mm256_andnot_si256(a, b)  // ~a & b
+#define __bsi_ones() _mm256_set1_epi64x(-1)
+#define __bsi_is_zero(v) _mm256_testz_si256(v, v)
+#endif
+
+// number of array elements summed per slice before moving on to the next
+// slice (keeps the block of the filter in L1)
+#define __BSI_SUM_BLOCK 1024
+
+static uint64_t __bsi_max_value(bsi *index) {
+  return index->n_slices == 64 ? UINT64_MAX
+                               : (((uint64_t) 1) << index->n_slices) - 1;
+}
+
+// clear the bits after n_rows so only rows < n_rows can be set
+static void __bsi_clear_tail(bitarray *b) {
+  size_t used = b->size / BITS_PER_EL;
+  if (used >= b->_array_size) return;
+  b->array[used] &= (MASK_1 << (b->size % BITS_PER_EL)) - 1;
+  for (size_t i = used + 1; i < b->_array_size; i++) {
+    b->array[i] = 0;
+  }
+}
+
+// number of set bits in a[i] & b[i] for i in [0, n)
+static inline size_t __bsi_and_count(const ARRAY_TYPE *a,
+                                     const ARRAY_TYPE *b, size_t n) {
+  size_t count = 0;
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512) && defined(__AVX512VPOPCNTDQ__)
+  __m512i acc = _mm512_setzero_si512();
+  for (; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_and_si512(_mm512_loadu_si512((const void*) (a + i)),
+                                 _mm512_loadu_si512((const void*) (b + i)));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+  }
+  count = _mm512_reduce_add_epi64(acc);
+#endif
+
+  for (; i < n; i++) {
+    count += pop_count(a[i] & b[i]);
+  }
+  return count;
+}
+
+/*
+   the comparison walks the slices from the most significant bit down and
+   keeps two masks per bound: rows that are already known to be
+   greater (less) than the bound and rows that are equal to it so far.
+   a bound that can't exclude any row (lo == 0, hi >= max value) is
+   skipped, and the walk stops as soon as no row is equal to a checked
+   bound anymore.
+*/
+
+// rows of element w with lo <= value <= hi
+static inline ARRAY_TYPE __bsi_between_word(const ARRAY_TYPE **slices,
+                                            int n_slices, size_t w,
+                                            uint64_t lo, uint64_t hi,
+                                            bool check_lo, bool check_hi) {
+  ARRAY_TYPE gt_lo = 0, eq_lo = check_lo ? ARRAY_TYPE_MAX : 0;
+  ARRAY_TYPE lt_hi = 0, eq_hi = check_hi ? ARRAY_TYPE_MAX : 0;
+
+  for (int i = n_slices - 1; i >= 0 && (eq_lo | eq_hi); i--) {
+    ARRAY_TYPE s = slices[i][w];
+    if ((lo >> i) & 1) {
+      eq_lo &= s;
+    } else {
+      gt_lo |= eq_lo & s;
+      eq_lo &= ~s;
+    }
+    if ((hi >> i) & 1) {
+      lt_hi |= eq_hi & ~s;
+      eq_hi &= s;
+    } else {
+      eq_hi &= ~s;
+    }
+  }
+
+  ARRAY_TYPE ge_lo = check_lo ? gt_lo | eq_lo : ARRAY_TYPE_MAX;
+  ARRAY_TYPE le_hi = check_hi ? lt_hi | eq_hi : ARRAY_TYPE_MAX;
+  return ge_lo & le_hi;
+}
+
+#ifdef __BSI_LANES
+// rows of elements [w, w + __BSI_LANES) with lo <= value <= hi
+static inline void __bsi_between_vec(const ARRAY_TYPE **slices,
+                                     int n_slices, size_t w,
+                                     uint64_t lo, uint64_t hi,
+                                     bool check_lo, bool check_hi,
+                                     ARRAY_TYPE *out) {
+  const __bsi_vec ones = __bsi_ones();
+  __bsi_vec gt_lo = __bsi_andnot(ones, ones);
+  __bsi_vec lt_hi = gt_lo;
+  __bsi_vec eq_lo = check_lo ? ones : gt_lo;
+  __bsi_vec eq_hi = check_hi ? ones : gt_lo;
+
+  for (int i = n_slices - 1; i >= 0; i--) {
+    __bsi_vec live = __bsi_or(eq_lo, eq_hi);
+    if (__bsi_is_zero(live)) break;
+
+    __bsi_vec s = __bsi_load(slices[i] + w);
+    if ((lo >> i) & 1) {
+      eq_lo = __bsi_and(eq_lo, s);
+    } else {
+      gt_lo = __bsi_or(gt_lo, __bsi_and(eq_lo, s));
+      eq_lo = __bsi_andnot(s, eq_lo);
+    }
+    if ((hi >> i) & 1) {
+      lt_hi = __bsi_or(lt_hi, __bsi_andnot(s, eq_hi));
+      eq_hi = __bsi_and(eq_hi, s);
+    } else {
+      eq_hi = __bsi_andnot(s, eq_hi);
+    }
+  }
+
+  __bsi_vec ge_lo = check_lo ? __bsi_or(gt_lo, eq_lo) : ones;
+  __bsi_vec le_hi = check_hi ? __bsi_or(lt_hi, eq_hi) : ones;
+  __bsi_store(out + w, __bsi_and(ge_lo, le_hi));
+}
+#endif
+
+bsi* create_bsi(const uint64_t *values, size_t n_rows) {
+  assert(values && n_rows > 0);
+
+  // the largest value has the same bit width as the or of all values
+  uint64_t all = 0;
+  for (size_t r = 0; r < n_rows; r++) {
+    all |= values[r];
+  }
+
+  bsi *index = (bsi*) malloc(sizeof(bsi));
+  assert(index);
+  index->n_rows = n_rows;
+  index->n_slices = all ? 64 - __builtin_clzll(all) : 1;
+  index->slices = (bitarray**) malloc(index->n_slices * sizeof(bitarray*));
+  assert(index->slices);
+
+  for (uint8_t i = 0; i < index->n_slices; i++) {
+    index->slices[i] = create_bitarray(n_rows);
+  }
+
+  // only the set bits of each value have to be written
+  for (size_t r = 0; r < n_rows; r++) {
+    uint64_t v = values[r];
+    size_t w = r / BITS_PER_EL;
+    ARRAY_TYPE bit = MASK_1 << (r % BITS_PER_EL);
+    while (v) {
+      index->slices[__builtin_ctzll(v)]->array[w] |= bit;
+      v &= v - 1;
+    }
+  }
+
+  return index;
+}
+
+void delete_bsi(bsi *index) {
+  assert(index);
+
+  for (uint8_t i = 0; i < index->n_slices; i++) {
+    delete_bitarray(index->slices[i]);
+  }
+  free(index->slices);
+  free(index);
+}
+
+uint64_t bsi_get_value(bsi *index, size_t row) {
+  assert(index);
+  assert(row < index->n_rows);
+
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < index->n_slices; i++) {
+    value |= (uint64_t) get_bit(index->slices[i], row) << i;
+  }
+
+  return value;
+}
+
+void bsi_set_value(bsi *index, size_t row, uint64_t value) {
+  assert(index);
+  assert(row < index->n_rows);
+
+  uint8_t n_slices = value ? 64 - __builtin_clzll(value) : 1;
+  if (n_slices > index->n_slices) {
+    index->slices = (bitarray**) realloc(index->slices,
+                                         n_slices * sizeof(bitarray*));
+    assert(index->slices);
+    for (uint8_t i = index->n_slices; i < n_slices; i++) {
+      index->slices[i] = create_bitarray(index->n_rows);
+    }
+    index->n_slices = n_slices;
+  }
+
+  for (uint8_t i = 0; i < index->n_slices; i++) {
+    if ((value >> i) & 1) {
+      set_bit(index->slices[i], row);
+    } else {
+      clear_bit(index->slices[i], row);
+    }
+  }
+}
+
+bitarray* bsi_between(bsi *index, uint64_t lo, uint64_t hi) {
+  assert(index);
+
+  bitarray *res = create_bitarray(index->n_rows);
+  uint64_t max = __bsi_max_value(index);
+  if (lo > hi || lo > max) return res;
+
+  bool check_lo = lo > 0;
+  bool check_hi = hi < max;
+  int n_slices = index->n_slices;
+  const ARRAY_TYPE *slices[64];
+  for (int i = 0; i < n_slices; i++) {
+    assert(index->slices[i]->_array_size >= res->_array_size);
+    slices[i] = index->slices[i]->array;
+  }
+
+  size_t w = 0;
+#ifdef __BSI_LANES
+  for (; w + __BSI_LANES <= res->_array_size; w += __BSI_LANES) {
+    __bsi_between_vec(slices, n_slices, w, lo, hi, check_lo, check_hi,
+                      res->array);
+  }
+#endif
+  for (; w < res->_array_size; w++) {
+    res->array[w] = __bsi_between_word(slices, n_slices, w, lo, hi,
+                                       check_lo, check_hi);
+  }
+
+  __bsi_clear_tail(res);
+  return res;
+}
+
+bitarray* bsi_lt(bsi *index, uint64_t x) {
+  if (!x) return create_bitarray(index->n_rows);
+  return bsi_between(index, 0, x - 1);
+}
+
+bitarray* bsi_le(bsi *index, uint64_t x) {
+  return bsi_between(index, 0, x);
+}
+
+bitarray* bsi_eq(bsi *index, uint64_t x) {
+  return bsi_between(index, x, x);
+}
+
+bitarray* bsi_gt(bsi *index, uint64_t x) {
+  if (x == UINT64_MAX) return create_bitarray(index->n_rows);
+  return bsi_between(index, x + 1, UINT64_MAX);
+}
+
+bitarray* bsi_ge(bsi *index, uint64_t x) {
+  return bsi_between(index, x, UINT64_MAX);
+}
+
+uint64_t bsi_sum(bsi *index, bitarray *filter) {
+  assert(index);
+
+  // sum of values == sum over slices of 2^i * (rows with bit i set)
+  uint64_t sum = 0;
+  if (!filter) {
+    for (uint8_t i = 0; i < index->n_slices; i++) {
+      sum += (uint64_t) count_bits(index->slices[i]) << i;
+    }
+    return sum;
+  }
+
+  assert(filter->size == index->n_rows);
+  size_t n_words = filter->_array_size;
+  if (index->slices[0]->_array_size < n_words) {
+    n_words = index->slices[0]->_array_size;
+  }
+
+  uint64_t counts[64] = {0};
+  for (size_t w = 0; w < n_words; w += __BSI_SUM_BLOCK) {
+    size_t n = n_words - w < __BSI_SUM_BLOCK ? n_words - w : __BSI_SUM_BLOCK;
+    for (uint8_t i = 0; i < index->n_slices; i++) {
+      counts[i] += __bsi_and_count(index->slices[i]->array + w,
+                                   filter->array + w, n);
+    }
+  }
+
+  for (uint8_t i = 0; i < index->n_slices; i++) {
+    sum += counts[i] << i;
+  }
+  return sum;
+}
+
+bitarray* bsi_top_k(bsi *index, bitarray *filter, size_t k) {
+  assert(index);
+  assert(!filter || filter->size == index->n_rows);
+
+  // top: rows that are among the k largest for sure
+  // candidates: rows that may still be (all equal in the slices seen so far)
+  bitarray *top = create_bitarray(index->n_rows);
+  bitarray *candidates;
+  if (filter) {
+    candidates = create_bitarray(index->n_rows);
+    size_t n = filter->_array_size < candidates->_array_size
+               ? filter->_array_size : candidates->_array_size;
+    memcpy(candidates->array, filter->array, n * TYPE_SIZE);
+  } else {
+    candidates = create_set_bitarray(index->n_rows);
+  }
+
+  size_t n_words = top->_array_size;
+  ARRAY_TYPE *t = top->array;
+  ARRAY_TYPE *c = candidates->array;
+  size_t n_top = 0;
+
+  for (int i = index->n_slices - 1; i >= 0 && n_top < k; i--) {
+    const ARRAY_TYPE *s = index->slices[i]->array;
+    size_t n_set = __bsi_and_count(c, s, n_words);
+
+    if (n_top + n_set > k) {
+      // the remaining top rows all have bit i set
+      for (size_t w = 0; w < n_words; w++) {
+        c[w] &= s[w];
+      }
+    } else {
+      // all candidates with bit i set are in the top k
+      for (size_t w = 0; w < n_words; w++) {
+        t[w] |= c[w] & s[w];
+        c[w] &= ~s[w];
+      }
+      n_top += n_set;
+    }
+  }
+
+  // the remaining candidates have equal values, take the lowest rows
+  for (size_t w = 0; w < n_words && n_top < k; w++) {
+    ARRAY_TYPE bits = c[w];
+    if ((size_t) pop_count(bits) <= k - n_top) {
+      t[w] |= bits;
+      n_top += pop_count(bits);
+      continue;
+    }
+    while (n_top < k) {
+      ARRAY_TYPE lowest = bits & (~bits + 1);
+      t[w] |= lowest;
+      bits ^= lowest;
+      n_top++;
+    }
+  }
+
+  delete_bitarray(candidates);
+  return top;
+}
@@ -0,0 +1,62 @@
+#ifndef BSI_H_
+#define BSI_H_
+
+// bit-sliced index (BSI) over a column of unsigned integers
+//
+// slice i is a bitarray that holds bit i of every value, so predicates
+// like "value <= x" and aggregates like SUM are evaluated with bitwise
+// operations on whole array elements instead of a scan over the values.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t n_rows;       // number of values
+  uint8_t n_slices;    // number of bits per value (1 to 64)
+  bitarray **slices;   // slices[i] holds bit i of every value
+} bsi;
+
+// create bsi from n_rows values (n_slices is the bit width of the largest)
+bsi* create_bsi(const uint64_t *values, size_t n_rows);
+
+// delete bsi and free allocated memory
+void delete_bsi(bsi *index);
+
+// get value of row
+uint64_t bsi_get_value(bsi *index, size_t row);
+
+// set value of row (adds slices if value doesn't fit)
+void bsi_set_value(bsi *index, size_t row, uint64_t value);
+
+// rows with values < x, <= x, == x, > x and >= x
+// (new bitarray of n_rows bits)
+bitarray* bsi_lt(bsi *index, uint64_t x);
+bitarray* bsi_le(bsi *index, uint64_t x);
+bitarray* bsi_eq(bsi *index, uint64_t x);
+bitarray* bsi_gt(bsi *index, uint64_t x);
+bitarray* bsi_ge(bsi *index, uint64_t x);
+
+// rows with lo <= value <= hi (new bitarray of n_rows bits)
+bitarray* bsi_between(bsi *index, uint64_t lo, uint64_t hi);
+
+// sum of the values of the rows set in filter (NULL: all rows);
+// wraps around modulo 2^64
+uint64_t bsi_sum(bsi *index, bitarray *filter);
+
+// rows with the k largest values among the rows set in filter
+// (NULL: all rows); ties are broken in favor of lower rows, so exactly
+// min(k, rows in filter) bits are set (new bitarray of n_rows bits)
+bitarray* bsi_top_k(bsi *index, bitarray *filter, size_t k);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // BSI_H_
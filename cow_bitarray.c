@@ -0,0 +1,298 @@
+#include "cow_bitarray.h"
+
+// the block header takes a cache line, so the bits are cache line aligned
+#define __COW_HEADER 64
+
+struct __cow_block {
+  size_t refs;  // arrays that use the block (updated atomically)
+  char _pad[__COW_HEADER - sizeof(size_t)];
+  ARRAY_TYPE data[];
+};
+
+static inline size_t __cow_block_bits(cow_bitarray *c) {
+  return c->block_bytes * 8;
+}
+
+// new block with one reference (bits not initialized)
+static inline __cow_block* __cow_alloc(size_t block_bytes) {
+  __cow_block *b = (__cow_block*) aligned_alloc(64, __COW_HEADER +
+                                                block_bytes);
+  assert(b);
+  b->refs = 1;
+  return b;
+}
+
+static inline void __cow_ref(__cow_block *b) {
+  __atomic_fetch_add(&b->refs, 1, __ATOMIC_RELAXED);
+}
+
+// (the last array to let go of a block frees it, on whichever thread)
+static inline void __cow_unref(__cow_block *b) {
+  if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) free(b);
+}
+
+// bits of block i for writing: the block itself if no other array uses
+// it, else a clone (with the bits copied if copy is true, the caller
+// overwrites all bits otherwise)
+static inline ARRAY_TYPE* __cow_writable(cow_bitarray *c, size_t i,
+                                         bool copy) {
+  __cow_block *b = c->_blocks[i];
+  if (__atomic_load_n(&b->refs, __ATOMIC_ACQUIRE) == 1) return b->data;
+
+  __cow_block *clone = __cow_alloc(c->block_bytes);
+  if (copy) memcpy(clone->data, b->data, c->block_bytes);
+  c->_blocks[i] = clone;
+  __cow_unref(b);
+  return clone->data;
+}
+
+// block i as a bitarray of the bits it holds
+static inline bitarray __cow_view(cow_bitarray *c, size_t i,
+                                  ARRAY_TYPE *data) {
+  size_t from = i * __cow_block_bits(c);
+  size_t n_bits = c->size - from;
+  if (n_bits > __cow_block_bits(c)) n_bits = __cow_block_bits(c);
+  bitarray view = {n_bits, c->block_bytes / TYPE_SIZE, data, true, NULL};
+  return view;
+}
+
+static cow_bitarray* __cow_create(size_t n_bits, size_t block_bytes) {
+  assert(n_bits > 0);
+  assert(block_bytes > 0 && block_bytes % 64 == 0);
+
+  cow_bitarray *c = (cow_bitarray*) malloc(sizeof(cow_bitarray));
+  assert(c);
+  c->size = n_bits;
+  c->block_bytes = block_bytes;
+  c->n_blocks = (n_bits + block_bytes * 8 - 1) / (block_bytes * 8);
+  c->_blocks = (__cow_block**) malloc(c->n_blocks * sizeof(__cow_block*));
+  assert(c->_blocks);
+  return c;
+}
+
+cow_bitarray* create_cow_bitarray(size_t n_bits, size_t block_bytes) {
+  cow_bitarray *c = __cow_create(n_bits, block_bytes);
+
+  __cow_block *zero = __cow_alloc(block_bytes);
+  memset(zero->data, 0, block_bytes);
+  zero->refs = c->n_blocks;
+  for (size_t i = 0; i < c->n_blocks; i++) c->_blocks[i] = zero;
+  return c;
+}
+
+cow_bitarray* create_cow_bitarray_from_bitarray(bitarray *bit_array,
+                                                size_t block_bytes) {
+  assert(bit_array);
+
+  cow_bitarray *c = __cow_create(bit_array->size, block_bytes);
+  size_t words = (bit_array->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t block_words = block_bytes / TYPE_SIZE;
+  for (size_t i = 0; i < c->n_blocks; i++) {
+    __cow_block *b = __cow_alloc(block_bytes);
+    size_t n = words - i * block_words;
+    if (n > block_words) n = block_words;
+    memcpy(b->data, bit_array->array + i * block_words, n * TYPE_SIZE);
+    memset(b->data + n, 0, (block_words - n) * TYPE_SIZE);
+    c->_blocks[i] = b;
+  }
+  return c;
+}
+
+cow_bitarray* cow_snapshot(cow_bitarray *c) {
+  assert(c);
+
+  cow_bitarray *s = __cow_create(c->size, c->block_bytes);
+  memcpy(s->_blocks, c->_blocks, c->n_blocks * sizeof(__cow_block*));
+  for (size_t i = 0; i < c->n_blocks; i++) __cow_ref(c->_blocks[i]);
+  return s;
+}
+
+void delete_cow_bitarray(cow_bitarray *c) {
+  assert(c);
+
+  for (size_t i = 0; i < c->n_blocks; i++) __cow_unref(c->_blocks[i]);
+  free(c->_blocks);
+  free(c);
+}
+
+bool cow_get_bit(cow_bitarray *c, size_t idx) {
+  assert(c);
+  assert(idx < c->size);
+
+  size_t block_bits = __cow_block_bits(c);
+  const ARRAY_TYPE *data = c->_blocks[idx / block_bits]->data;
+  idx %= block_bits;
+  return (data[idx / BITS_PER_EL] >> (idx % BITS_PER_EL)) & 1;
+}
+
+void cow_set_bit(cow_bitarray *c, size_t idx) {
+  assert(c);
+  assert(idx < c->size);
+
+  size_t block_bits = __cow_block_bits(c);
+  ARRAY_TYPE *data = __cow_writable(c, idx / block_bits, true);
+  idx %= block_bits;
+  data[idx / BITS_PER_EL] |= (ARRAY_TYPE) 1 << (idx % BITS_PER_EL);
+}
+
+void cow_clear_bit(cow_bitarray *c, size_t idx) {
+  assert(c);
+  assert(idx < c->size);
+
+  size_t block_bits = __cow_block_bits(c);
+  ARRAY_TYPE *data = __cow_writable(c, idx / block_bits, true);
+  idx %= block_bits;
+  data[idx / BITS_PER_EL] &= ~((ARRAY_TYPE) 1 << (idx % BITS_PER_EL));
+}
+
+void cow_flip_bit(cow_bitarray *c, size_t idx) {
+  assert(c);
+  assert(idx < c->size);
+
+  size_t block_bits = __cow_block_bits(c);
+  ARRAY_TYPE *data = __cow_writable(c, idx / block_bits, true);
+  idx %= block_bits;
+  data[idx / BITS_PER_EL] ^= (ARRAY_TYPE) 1 << (idx % BITS_PER_EL);
+}
+
+enum __cow_range_op {
+  __COW_SET,
+  __COW_CLEAR,
+  __COW_FLIP
+};
+
+// apply op to [from, to) block by block; shared blocks that are set or
+// cleared as a whole are replaced without copying them
+static void __cow_range(cow_bitarray *c, size_t from, size_t to,
+                        enum __cow_range_op op) {
+  assert(c);
+  assert(from <= to && to <= c->size);
+  if (from == to) return;
+
+  size_t block_bits = __cow_block_bits(c);
+  for (size_t i = from / block_bits; i <= (to - 1) / block_bits; i++) {
+    size_t start = i * block_bits;
+    size_t block_size = c->size - start;
+    if (block_size > block_bits) block_size = block_bits;
+    size_t lo = from > start ? from - start : 0;
+    size_t hi = to - start < block_size ? to - start : block_size;
+    bool whole = lo == 0 && hi == block_size;
+
+    ARRAY_TYPE *data = __cow_writable(c, i, !whole || op == __COW_FLIP);
+    bitarray view = __cow_view(c, i, data);
+    if (whole && op != __COW_FLIP) {
+      memset(data, 0, c->block_bytes);
+      if (op == __COW_SET) set_all_bits(&view);
+    } else if (op == __COW_SET) {
+      set_bit_range(&view, lo, hi);
+    } else if (op == __COW_CLEAR) {
+      clear_bit_range(&view, lo, hi);
+    } else {
+      flip_bit_range(&view, lo, hi);
+    }
+  }
+}
+
+void cow_set_bit_range(cow_bitarray *c, size_t from, size_t to) {
+  __cow_range(c, from, to, __COW_SET);
+}
+
+void cow_clear_bit_range(cow_bitarray *c, size_t from, size_t to) {
+  __cow_range(c, from, to, __COW_CLEAR);
+}
+
+void cow_flip_bit_range(cow_bitarray *c, size_t from, size_t to) {
+  __cow_range(c, from, to, __COW_FLIP);
+}
+
+size_t cow_count_bits(cow_bitarray *c) {
+  assert(c);
+
+  return cow_count_bit_range(c, 0, c->size);
+}
+
+size_t cow_count_bit_range(cow_bitarray *c, size_t from, size_t to) {
+  assert(c);
+  assert(from <= to && to <= c->size);
+  if (from == to) return 0;
+
+  size_t block_bits = __cow_block_bits(c);
+  size_t count = 0;
+  for (size_t i = from / block_bits; i <= (to - 1) / block_bits; i++) {
+    size_t start = i * block_bits;
+    bitarray view = __cow_view(c, i, c->_blocks[i]->data);
+    size_t lo = from > start ? from - start : 0;
+    size_t hi = to - start < view.size ? to - start : view.size;
+    if (lo == 0 && hi == view.size) {
+      count += count_bits(&view);
+    } else {
+      count += count_bit_range(&view, lo, hi);
+    }
+  }
+  return count;
+}
+
+bool cow_equal_bits(cow_bitarray *left, cow_bitarray *right) {
+  assert(left && right);
+  assert(left->block_bytes == right->block_bytes);
+
+  if (left->size != right->size) return false;
+  for (size_t i = 0; i < left->n_blocks; i++) {
+    if (left->_blocks[i] != right->_blocks[i] &&
+        memcmp(left->_blocks[i]->data, right->_blocks[i]->data,
+               left->block_bytes)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+typedef void (*__cow_binary_op)(bitarray*, bitarray*);
+
+// left = left (op) right, block by block; a block shared by both is kept
+// (and, or) or cleared (xor)
+static void __cow_binary(cow_bitarray *left, cow_bitarray *right,
+                         __cow_binary_op op, bool is_xor) {
+  assert(left && right);
+  assert(left->size == right->size &&
+         left->block_bytes == right->block_bytes);
+
+  for (size_t i = 0; i < left->n_blocks; i++) {
+    __cow_block *r = right->_blocks[i];
+    if (left->_blocks[i] == r) {
+      if (is_xor) {
+        memset(__cow_writable(left, i, false), 0, left->block_bytes);
+      }
+      continue;
+    }
+    bitarray l_view = __cow_view(left, i, __cow_writable(left, i, true));
+    bitarray r_view = __cow_view(right, i, r->data);
+    op(&l_view, &r_view);
+  }
+}
+
+void cow_and_bits_inplace(cow_bitarray *left, cow_bitarray *right) {
+  __cow_binary(left, right, and_bits_inplace, false);
+}
+
+void cow_or_bits_inplace(cow_bitarray *left, cow_bitarray *right) {
+  __cow_binary(left, right, or_bits_inplace, false);
+}
+
+void cow_xor_bits_inplace(cow_bitarray *left, cow_bitarray *right) {
+  __cow_binary(left, right, xor_bits_inplace, true);
+}
+
+void cow_copy_to_bitarray(cow_bitarray *c, bitarray *dest) {
+  assert(c && dest);
+  assert(dest->size == c->size);
+
+  size_t words = (c->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t block_words = c->block_bytes / TYPE_SIZE;
+  for (size_t i = 0; i < c->n_blocks; i++) {
+    size_t n = words - i * block_words;
+    if (n > block_words) n = block_words;
+    memcpy(dest->array + i * block_words, c->_blocks[i]->data,
+           n * TYPE_SIZE);
+  }
+}
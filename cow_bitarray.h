@@ -0,0 +1,93 @@
+#ifndef COW_BITARRAY_H_
+#define COW_BITARRAY_H_
+
+// copy-on-write bitarray made of reference-counted blocks
+//
+// the bits are split into blocks of block_bytes bytes (bitarray layout
+// within a block) that can be shared by several arrays: a snapshot copies
+// only the block pointers (and increments the blocks' reference counts),
+// and a modification clones just the block it touches if that block is
+// shared. a snapshot can be read on another thread while the array it was
+// taken from keeps being modified; each array (snapshots included) must
+// only be used by one thread at a time. plain bitarrays don't share
+// blocks: callers of copy_bitarray and set_bit have to switch to
+// cow_snapshot and the cow_* functions (each access pays for the block
+// lookup, e.g. 5.0 instead of 2.9 ns per random get on 2^24 bits).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct __cow_block __cow_block;
+
+typedef struct {
+  size_t size;            // number of bits
+  size_t block_bytes;     // bytes per block (a multiple of 64)
+  size_t n_blocks;
+  __cow_block **_blocks;
+} cow_bitarray;
+
+// create copy-on-write bitarray that holds n_bits bits (all unset/false)
+// in blocks of block_bytes bytes (initially all one shared block)
+cow_bitarray* create_cow_bitarray(size_t n_bits, size_t block_bytes);
+
+// create copy-on-write bitarray from the bits of bit_array
+cow_bitarray* create_cow_bitarray_from_bitarray(bitarray *bit_array,
+                                                size_t block_bytes);
+
+// snapshot: new array that shares all blocks of c (O(n_blocks))
+cow_bitarray* cow_snapshot(cow_bitarray *c);
+
+// delete array (blocks are freed once no array uses them anymore)
+void delete_cow_bitarray(cow_bitarray *c);
+
+// get bit at position idx
+bool cow_get_bit(cow_bitarray *c, size_t idx);
+
+// set bit at position idx
+void cow_set_bit(cow_bitarray *c, size_t idx);
+
+// clear bit at position idx
+void cow_clear_bit(cow_bitarray *c, size_t idx);
+
+// flip bit at position idx
+void cow_flip_bit(cow_bitarray *c, size_t idx);
+
+// set bits in range [from, to)
+void cow_set_bit_range(cow_bitarray *c, size_t from, size_t to);
+
+// clear bits in range [from, to)
+void cow_clear_bit_range(cow_bitarray *c, size_t from, size_t to);
+
+// flip bits in range [from, to)
+void cow_flip_bit_range(cow_bitarray *c, size_t from, size_t to);
+
+// count set bits
+size_t cow_count_bits(cow_bitarray *c);
+
+// count set bits in range [from, to)
+size_t cow_count_bit_range(cow_bitarray *c, size_t from, size_t to);
+
+// compare bits (blocks shared by both are equal without comparing them)
+bool cow_equal_bits(cow_bitarray *left, cow_bitarray *right);
+
+// left = left (op) right (same size and block size); blocks shared by
+// both are handled without reading them
+void cow_and_bits_inplace(cow_bitarray *left, cow_bitarray *right);
+void cow_or_bits_inplace(cow_bitarray *left, cow_bitarray *right);
+void cow_xor_bits_inplace(cow_bitarray *left, cow_bitarray *right);
+
+// copy all bits into dest (a bitarray of the same size)
+void cow_copy_to_bitarray(cow_bitarray *c, bitarray *dest);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // COW_BITARRAY_H_
@@ -0,0 +1,360 @@
+#include "elias_fano.h"
+
+// position of set bit k (counted from 0) of x (k < pop_count(x))
+static inline unsigned __ef_select_word(ARRAY_TYPE x, unsigned k) {
+#if defined(__BITARRAY_BMI2) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_ctzll(_pdep_u64(MASK_1 << k, x));
+#else
+  for (; k; k--) x &= x - 1;
+  return __builtin_ctzll(x);
+#endif
+}
+
+// position of set (unset if zeros) bit k (counted from 0) of upper at or
+// after position pos (the bit must exist)
+static size_t __ef_select_from(const bitarray *upper, size_t pos, size_t k,
+                               bool zeros) {
+  const ARRAY_TYPE *a = upper->array;
+  size_t w = pos / BITS_PER_EL;
+  ARRAY_TYPE x = (zeros ? ~a[w] : a[w]) &
+                 (ARRAY_TYPE_MAX << (pos % BITS_PER_EL));
+  for (;;) {
+    size_t c = pop_count(x);
+    if (k < c) return w * BITS_PER_EL + __ef_select_word(x, k);
+    k -= c;
+    w++;
+    x = zeros ? ~a[w] : a[w];
+  }
+}
+
+// position of the set bit of value i in upper
+static inline size_t __ef_select1(const elias_fano *ef, size_t i) {
+  return __ef_select_from(ef->upper, ef->_ones[i / __EF_SAMPLE],
+                          i % __EF_SAMPLE, false);
+}
+
+// position of the unset bit that ends bucket h in upper
+static inline size_t __ef_select0(const elias_fano *ef, size_t h) {
+  return __ef_select_from(ef->upper, ef->_zeros[h / __EF_SAMPLE],
+                          h % __EF_SAMPLE, true);
+}
+
+// low bits of value i (a field may span two elements)
+static inline uint64_t __ef_low(const elias_fano *ef, size_t i) {
+  unsigned l = ef->lower_bits;
+  if (!l) return 0;
+
+  size_t bit = i * l;
+  const ARRAY_TYPE *a = ef->lower->array;
+  size_t w = bit / BITS_PER_EL;
+  unsigned s = bit % BITS_PER_EL;
+  uint64_t v = a[w] >> s;
+  if (s + l > BITS_PER_EL) v |= (uint64_t) a[w + 1] << (BITS_PER_EL - s);
+  return v & ((MASK_1 << l) - 1);
+}
+
+// the positions of set (unset if zeros) bits 0, __EF_SAMPLE, ... of upper
+static void __ef_sample(const bitarray *upper, bool zeros, size_t *samples) {
+  size_t n_words = (upper->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t seen = 0, next = 0;
+  for (size_t w = 0; w < n_words; w++) {
+    ARRAY_TYPE x = zeros ? ~upper->array[w] : upper->array[w];
+    if (w == n_words - 1 && upper->size % BITS_PER_EL) {
+      x &= (MASK_1 << (upper->size % BITS_PER_EL)) - 1;
+    }
+    size_t c = pop_count(x);
+    for (; next < seen + c; next += __EF_SAMPLE) {
+      samples[next / __EF_SAMPLE] = w * BITS_PER_EL +
+                                    __ef_select_word(x, next - seen);
+    }
+    seen += c;
+  }
+}
+
+// encoding of n values < universe with upper and lower cleared
+static elias_fano* __ef_alloc(size_t n, uint64_t universe) {
+  assert(universe > 0);
+
+  elias_fano *ef = (elias_fano*) malloc(sizeof(elias_fano));
+  assert(ef);
+  ef->n = n;
+  ef->universe = universe;
+
+  // (l = floor(log2(universe / n)) minimizes the size; fields must fit in
+  // two elements. without values all of them go into the low bits, so
+  // upper has a single bucket instead of one per value below universe)
+  unsigned l = 0;
+  if (n && universe / n > 1) l = 63 - __builtin_clzll(universe / n);
+  if (!n && universe > 1) l = 64 - __builtin_clzll(universe - 1);
+  if (l > BITS_PER_EL - 1) l = BITS_PER_EL - 1;
+  ef->lower_bits = l;
+
+  size_t n_buckets = (size_t) ((universe - 1) >> l) + 1;
+  ef->upper = create_bitarray(n + n_buckets);
+  // (16 more elements, so the fields can be read as two elements, 16
+  // elements at a time with AVX-512)
+  ef->lower = create_bitarray(n * l + 16 * BITS_PER_EL);
+  ef->_ones = (size_t*) malloc((n / __EF_SAMPLE + 1) * sizeof(size_t));
+  ef->_zeros = (size_t*) malloc((n_buckets / __EF_SAMPLE + 1) *
+                                sizeof(size_t));
+  assert(ef->_ones && ef->_zeros);
+  return ef;
+}
+
+// store value i (values must be stored in order)
+static inline void __ef_put(elias_fano *ef, size_t i, uint64_t v) {
+  assert(v < ef->universe);
+
+  unsigned l = ef->lower_bits;
+  size_t pos = (size_t) (v >> l) + i;
+  ef->upper->array[pos / BITS_PER_EL] |= MASK_1 << (pos % BITS_PER_EL);
+  if (!l) return;
+
+  ARRAY_TYPE low = (ARRAY_TYPE) (v & ((MASK_1 << l) - 1));
+  size_t bit = i * l;
+  ARRAY_TYPE *a = ef->lower->array;
+  unsigned s = bit % BITS_PER_EL;
+  a[bit / BITS_PER_EL] |= low << s;
+  if (s + l > BITS_PER_EL) a[bit / BITS_PER_EL + 1] |= low >> (BITS_PER_EL - s);
+}
+
+elias_fano* create_elias_fano(const uint64_t *values, size_t n,
+                              uint64_t universe) {
+  assert(values || !n);
+  if (!universe) universe = n ? values[n - 1] + 1 : 1;
+
+  elias_fano *ef = __ef_alloc(n, universe);
+  for (size_t i = 0; i < n; i++) {
+    assert(!i || values[i - 1] <= values[i]);
+    __ef_put(ef, i, values[i]);
+  }
+  __ef_sample(ef->upper, false, ef->_ones);
+  __ef_sample(ef->upper, true, ef->_zeros);
+  return ef;
+}
+
+elias_fano* create_elias_fano_from_bitarray(bitarray *bit_array) {
+  assert(bit_array);
+
+  elias_fano *ef = __ef_alloc(count_bits(bit_array),
+                              bit_array->size ? bit_array->size : 1);
+  size_t n_words = (bit_array->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t i = 0;
+  for (size_t w = 0; w < n_words; w++) {
+    ARRAY_TYPE x = bit_array->array[w];
+    if (w == n_words - 1 && bit_array->size % BITS_PER_EL) {
+      x &= (MASK_1 << (bit_array->size % BITS_PER_EL)) - 1;
+    }
+    for (; x; x &= x - 1) {
+      __ef_put(ef, i++, w * BITS_PER_EL + __builtin_ctzll(x));
+    }
+  }
+  __ef_sample(ef->upper, false, ef->_ones);
+  __ef_sample(ef->upper, true, ef->_zeros);
+  return ef;
+}
+
+void delete_elias_fano(elias_fano *ef) {
+  assert(ef);
+
+  delete_bitarray(ef->upper);
+  delete_bitarray(ef->lower);
+  free(ef->_ones);
+  free(ef->_zeros);
+  free(ef);
+}
+
+size_t ef_bytes(elias_fano *ef) {
+  assert(ef);
+
+  size_t n_zeros = ef->upper->size - ef->n;
+  return sizeof(elias_fano) + 2 * sizeof(bitarray) +
+         (ef->upper->_array_size + ef->lower->_array_size) * TYPE_SIZE +
+         (ef->n / __EF_SAMPLE + n_zeros / __EF_SAMPLE + 2) * sizeof(size_t);
+}
+
+uint64_t ef_access(elias_fano *ef, size_t i) {
+  assert(ef);
+  assert(i < ef->n);
+
+  size_t pos = __ef_select1(ef, i);
+  return ((uint64_t) (pos - i) << ef->lower_bits) | __ef_low(ef, i);
+}
+
+size_t ef_next_geq(elias_fano *ef, uint64_t x, uint64_t *value) {
+  assert(ef);
+  if (x >= ef->universe) return ef->n;
+
+  // the values of bucket h start after the unset bit that ends bucket
+  // h - 1 (h unset bits before them)
+  unsigned l = ef->lower_bits;
+  size_t h = (size_t) (x >> l);
+  size_t pos = h ? __ef_select0(ef, h - 1) + 1 : 0;
+  size_t i = pos - h;
+
+  // (values of bucket h compare their low bits, the first value of a
+  // later bucket is > x)
+  const ARRAY_TYPE *a = ef->upper->array;
+  size_t w = pos / BITS_PER_EL;
+  ARRAY_TYPE bits = a[w] & (ARRAY_TYPE_MAX << (pos % BITS_PER_EL));
+  for (; i < ef->n; i++) {
+    while (!bits) bits = a[++w];
+    size_t q = w * BITS_PER_EL + __builtin_ctzll(bits);
+    bits &= bits - 1;
+    uint64_t v = ((uint64_t) (q - i) << l) | __ef_low(ef, i);
+    if (v >= x) {
+      if (value) *value = v;
+      return i;
+    }
+  }
+  return ef->n;
+}
+
+// shift the high parts of the values [from, from + count) in out into
+// place and add the low bits; with AVX-512 8 fields at once: they lie
+// within 16 elements from the one of the first field on, and every field
+// is shifted together from the element it starts in and the next one
+// (picked by permutes)
+static void __ef_add_low(const elias_fano *ef, size_t from, size_t count,
+                         uint64_t *out) {
+  unsigned l = ef->lower_bits;
+  if (!l) return;
+  size_t j = 0;
+
+#if defined(__BITARRAY_AVX512)
+  const ARRAY_TYPE *a = ef->lower->array;
+  __m512i offsets = _mm512_set_epi64(7 * l, 6 * l, 5 * l, 4 * l, 3 * l,
+                                     2 * l, l, 0);
+  __m512i mask = _mm512_set1_epi64((long long) ((MASK_1 << l) - 1));
+  __m512i one = _mm512_set1_epi64(1);
+  __m512i sixty_three = _mm512_set1_epi64(63);
+  __m512i sixty_four = _mm512_set1_epi64(64);
+  __m128i shift = _mm_cvtsi32_si128((int) l);
+  for (; j + 8 <= count; j += 8) {
+    size_t bit = (from + j) * l;
+    const ARRAY_TYPE *block = a + bit / BITS_PER_EL;
+    __m512i b0 = _mm512_loadu_si512((const void*) block);
+    __m512i b1 = _mm512_loadu_si512((const void*) (block + 8));
+    __m512i pos = _mm512_add_epi64(
+      _mm512_set1_epi64((long long) (bit % BITS_PER_EL)), offsets);
+    __m512i w = _mm512_srli_epi64(pos, 6);
+    __m512i s = _mm512_and_si512(pos, sixty_three);
+    __m512i lo = _mm512_permutex2var_epi64(b0, w, b1);
+    __m512i hi = _mm512_permutex2var_epi64(b0, _mm512_add_epi64(w, one),
+                                           b1);
+    // (a shift by 64 gives 0, so hi adds nothing to fields at s == 0)
+    __m512i v = _mm512_or_si512(
+      _mm512_srlv_epi64(lo, s),
+      _mm512_sllv_epi64(hi, _mm512_sub_epi64(sixty_four, s)));
+    v = _mm512_and_si512(v, mask);
+    __m512i o = _mm512_sll_epi64(_mm512_loadu_si512((const void*) (out + j)),
+                                 shift);
+    _mm512_storeu_si512((void*) (out + j), _mm512_or_si512(o, v));
+  }
+#endif
+
+  for (; j < count; j++) out[j] = (out[j] << l) | __ef_low(ef, from + j);
+}
+
+// write the high parts of the values [from, from + count) to out; while
+// a whole element of upper fits into the rest of out, its set bits are
+// written without a branch per bit (the writes beyond its last set bit
+// are overwritten by the next element): with AVX-512 VBMI2 the positions
+// of the set bits are compressed into bytes and widened 8 at a time,
+// otherwise 4 positions are written per step
+static void __ef_high(const elias_fano *ef, size_t from, size_t count,
+                      uint64_t *out) {
+  const ARRAY_TYPE *a = ef->upper->array;
+  size_t pos = __ef_select1(ef, from);
+  size_t w = pos / BITS_PER_EL;
+  ARRAY_TYPE x = a[w] & (ARRAY_TYPE_MAX << (pos % BITS_PER_EL));
+  size_t j = 0;
+
+#if defined(__BITARRAY_AVX512) && defined(__AVX512VBMI2__)
+  __m512i iota = _mm512_set_epi8(63, 62, 61, 60, 59, 58, 57, 56, 55, 54,
+                                 53, 52, 51, 50, 49, 48, 47, 46, 45, 44,
+                                 43, 42, 41, 40, 39, 38, 37, 36, 35, 34,
+                                 33, 32, 31, 30, 29, 28, 27, 26, 25, 24,
+                                 23, 22, 21, 20, 19, 18, 17, 16, 15, 14,
+                                 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+                                 1, 0);
+  __m512i ramp = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+  uint8_t positions[64];
+  for (; j + BITS_PER_EL <= count; x = a[++w]) {
+    size_t c = pop_count(x);
+    _mm512_storeu_si512((void*) positions,
+                        _mm512_maskz_compress_epi8(x, iota));
+    // (bit p of element w at index from + j + k: high part
+    // w * 64 + p - from - j - k)
+    __m512i base = _mm512_sub_epi64(
+      _mm512_set1_epi64((long long) (w * BITS_PER_EL - from - j)), ramp);
+    for (size_t k = 0; k < c; k += 8) {
+      __m512i p = _mm512_cvtepu8_epi64(
+        _mm_loadl_epi64((const __m128i*) (positions + k)));
+      _mm512_storeu_si512((void*) (out + j + k),
+                          _mm512_add_epi64(p, base));
+      base = _mm512_sub_epi64(base, _mm512_set1_epi64(8));
+    }
+    j += c;
+  }
+#else
+  // (x | MASK_1 << 63 keeps the count of trailing zeros defined once all
+  // set bits are written)
+  const ARRAY_TYPE top = MASK_1 << (BITS_PER_EL - 1);
+  for (; j + BITS_PER_EL <= count; x = a[++w]) {
+    size_t c = pop_count(x);
+    size_t base = w * BITS_PER_EL - from - j;
+    for (size_t k = 0; k < c; k += 4) {
+      out[j + k] = base - k + __builtin_ctzll(x | top);
+      x &= x - 1;
+      out[j + k + 1] = base - k - 1 + __builtin_ctzll(x | top);
+      x &= x - 1;
+      out[j + k + 2] = base - k - 2 + __builtin_ctzll(x | top);
+      x &= x - 1;
+      out[j + k + 3] = base - k - 3 + __builtin_ctzll(x | top);
+      x &= x - 1;
+    }
+    j += c;
+  }
+#endif
+
+  for (; j < count; j++) {
+    while (!x) x = a[++w];
+    out[j] = w * BITS_PER_EL + __builtin_ctzll(x) - from - j;
+    x &= x - 1;
+  }
+}
+
+size_t ef_decode(elias_fano *ef, size_t from, size_t count, uint64_t *out) {
+  assert(ef);
+  if (from >= ef->n) return 0;
+  if (count > ef->n - from) count = ef->n - from;
+  if (!count) return 0;
+  assert(out);
+
+  __ef_high(ef, from, count, out);
+  __ef_add_low(ef, from, count, out);
+  return count;
+}
+
+size_t ef_intersect_bitarray(elias_fano *ef, bitarray *bit_array,
+                             uint64_t *out) {
+  assert(ef && bit_array);
+
+  // decode blocks of values and test their bits (out is written
+  // unconditionally, the count only advances on a hit)
+  uint64_t block[__EF_SAMPLE];
+  size_t found = 0;
+  for (size_t from = 0; from < ef->n; from += __EF_SAMPLE) {
+    size_t k = ef_decode(ef, from, __EF_SAMPLE, block);
+    for (size_t j = 0; j < k; j++) {
+      uint64_t v = block[j];
+      if (v >= bit_array->size) return found;
+      bool hit = (bit_array->array[v / BITS_PER_EL] >> (v % BITS_PER_EL)) &
+                 1;
+      if (out) out[found] = v;
+      found += hit;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,76 @@
+#ifndef ELIAS_FANO_H_
+#define ELIAS_FANO_H_
+
+// Elias-Fano encoding of a non-decreasing sequence of n integers below
+// universe (posting lists, sorted ID lists) in about 2 + log2(universe / n)
+// bits per value
+//
+// every value is split into its lower_bits low bits, stored as packed
+// fields in lower, and its high part h, stored in unary in upper: value i
+// sets bit h + i, so bucket h (the values with high part h) is the run of
+// set bits before the (h + 1)th unset bit. the positions of every
+// __EF_SAMPLE-th set and unset bit of upper are sampled: access(i) starts
+// at the sample of set bit i, next_geq(x) at the sample of the unset bit
+// that ends the bucket before x's one (skip pointers), and both scan at
+// most a few elements of upper from there.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// set/unset bits of upper per sample
+#define __EF_SAMPLE 256
+
+typedef struct {
+  size_t n;              // number of values
+  uint64_t universe;     // all values are < universe
+  unsigned lower_bits;   // low bits of every value stored in lower
+  bitarray *upper;       // bit (value_i >> lower_bits) + i set for every i
+  bitarray *lower;       // low bits of value i at bits [i * lower_bits,
+                         // (i + 1) * lower_bits)
+  size_t *_ones;         // position of set bit j * __EF_SAMPLE of upper
+  size_t *_zeros;        // position of unset bit j * __EF_SAMPLE of upper
+} elias_fano;
+
+// encode values[0, n) (non-decreasing, all < universe; universe 0: the
+// last value + 1)
+elias_fano* create_elias_fano(const uint64_t *values, size_t n,
+                              uint64_t universe);
+
+// encode the positions of the set bits of bit_array (universe: its size)
+elias_fano* create_elias_fano_from_bitarray(bitarray *bit_array);
+
+// delete encoding and free allocated memory
+void delete_elias_fano(elias_fano *ef);
+
+// memory used by the encoding in bytes (upper, lower and the samples)
+size_t ef_bytes(elias_fano *ef);
+
+// value i (i < n)
+uint64_t ef_access(elias_fano *ef, size_t i);
+
+// index of the first value >= x and that value in *value (if value isn't
+// NULL); n if all values are < x
+size_t ef_next_geq(elias_fano *ef, uint64_t x, uint64_t *value);
+
+// decode the values [from, from + count) (up to the last one) into out
+// and return their number
+size_t ef_decode(elias_fano *ef, size_t from, size_t count, uint64_t *out);
+
+// write the values whose bit is set in bit_array (values >= its size
+// are skipped) to out (if it isn't NULL, room for n values) and return
+// their number
+size_t ef_intersect_bitarray(elias_fano *ef, bitarray *bit_array,
+                             uint64_t *out);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // ELIAS_FANO_H_
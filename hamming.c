@@ -0,0 +1,396 @@
+#include "hamming.h"
+
+#include <pthread.h>
+
+#if ARRAY_TYPE_MAX != UINT64_MAX
+#error "hamming_index needs 64 bit array elements"
+#endif
+
+// codes are padded to multiples of 64 bytes
+#define __HAMMING_ALIGN 64
+#define __HAMMING_ALIGN_WORDS (__HAMMING_ALIGN / TYPE_SIZE)
+
+// heap entries are (distance << __HAMMING_ID_BITS) | id, so comparing
+// entries orders by distance and then by id
+#define __HAMMING_ID_BITS 40
+
+// multi-index hashing: chunk width, the largest chunk distance probed and
+// the share of the cost of a scan (1 / __HAMMING_MIH_MAX_SHARE) that
+// probing may take before the search falls back to the scan
+#define __HAMMING_CHUNK_BITS 16
+#define __HAMMING_CHUNK_VALUES (1U << __HAMMING_CHUNK_BITS)
+#define __HAMMING_MIH_MAX_RADIUS 4
+#define __HAMMING_MIH_MAX_SHARE 2
+
+// scans only start threads for at least this many codes per thread
+#define __HAMMING_THREAD_MIN 4096
+
+static inline size_t __hamming_words(size_t n_bits) {
+  return (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+}
+
+// number of differing bits of a[0, n) and b[0, n)
+static inline uint32_t __hamming_distance(const ARRAY_TYPE *a,
+                                          const ARRAY_TYPE *b, size_t n) {
+  uint32_t dist = 0;
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512) && defined(__AVX512VPOPCNTDQ__)
+  __m512i acc = _mm512_setzero_si512();
+  for (; i + 8 <= n; i += 8) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*) (a + i)),
+                                 _mm512_loadu_si512((const void*) (b + i)));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+  }
+  dist = _mm512_reduce_add_epi64(acc);
+#elif defined(__BITARRAY_AVX2)
+  // nibble lookup table popcount (Mula et al.)
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_xor_si256(
+      _mm256_loadu_si256((const __m256i*) (a + i)),
+      _mm256_loadu_si256((const __m256i*) (b + i)));
+    __m256i lo = _mm256_and_si256(x, low_nibbles);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibbles);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                  _mm256_shuffle_epi8(lut, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt,
+                                                _mm256_setzero_si256()));
+  }
+  dist = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+         _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+#endif
+
+  for (; i < n; i++) dist += __builtin_popcountll(a[i] ^ b[i]);
+  return dist;
+}
+
+// max-heap of the (up to) k smallest entries
+static inline void __hamming_heap_push(uint64_t *heap, size_t *n, size_t k,
+                                       uint64_t entry) {
+  size_t i;
+  if (*n < k) {
+    // sift up from the end
+    i = (*n)++;
+    while (i && heap[(i - 1) / 2] < entry) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = entry;
+    return;
+  }
+  if (entry >= heap[0]) return;
+
+  // replace the largest and sift down
+  i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= k) break;
+    if (child + 1 < k && heap[child + 1] > heap[child]) child++;
+    if (heap[child] <= entry) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = entry;
+}
+
+static int __hamming_cmp(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+// sort the heap and split its entries into ids and dists
+static size_t __hamming_heap_output(uint64_t *heap, size_t n, size_t *ids,
+                                    uint32_t *dists) {
+  qsort(heap, n, sizeof(uint64_t), __hamming_cmp);
+  for (size_t i = 0; i < n; i++) {
+    ids[i] = heap[i] & (((uint64_t) 1 << __HAMMING_ID_BITS) - 1);
+    dists[i] = heap[i] >> __HAMMING_ID_BITS;
+  }
+  return n;
+}
+
+hamming_index* create_hamming_index(size_t n_bits) {
+  assert(n_bits > 0);
+
+  hamming_index *index = (hamming_index*) calloc(1, sizeof(hamming_index));
+  assert(index);
+  index->n_bits = n_bits;
+  index->_code_words = (__hamming_words(n_bits) + __HAMMING_ALIGN_WORDS - 1) /
+                       __HAMMING_ALIGN_WORDS * __HAMMING_ALIGN_WORDS;
+  return index;
+}
+
+static void __hamming_drop_mih(hamming_index *index) {
+  free(index->_mih_offsets);
+  free(index->_mih_ids);
+  index->_mih_offsets = NULL;
+  index->_mih_ids = NULL;
+  index->_n_chunks = 0;
+}
+
+void delete_hamming_index(hamming_index *index) {
+  assert(index);
+
+  __hamming_drop_mih(index);
+  free(index->array);
+  free(index);
+}
+
+size_t hamming_index_add(hamming_index *index, bitarray *code) {
+  assert(index && code);
+  assert(code->size == index->n_bits);
+  assert(index->n_codes < (size_t) 1 << __HAMMING_ID_BITS);
+
+  if (index->n_codes == index->_capacity) {
+    // (there is no aligned realloc)
+    size_t capacity = index->_capacity ? 2 * index->_capacity : 64;
+    size_t bytes = capacity * index->_code_words * TYPE_SIZE;
+    ARRAY_TYPE *array = (ARRAY_TYPE*) aligned_alloc(__HAMMING_ALIGN, bytes);
+    assert(array);
+    if (index->array) {
+      memcpy(array, index->array,
+             index->n_codes * index->_code_words * TYPE_SIZE);
+      free(index->array);
+    }
+    index->array = array;
+    index->_capacity = capacity;
+  }
+
+  ARRAY_TYPE *dest = index->array + index->n_codes * index->_code_words;
+  size_t words = __hamming_words(index->n_bits);
+  memcpy(dest, code->array, words * TYPE_SIZE);
+  memset(dest + words, 0, (index->_code_words - words) * TYPE_SIZE);
+
+  __hamming_drop_mih(index);
+  return index->n_codes++;
+}
+
+bitarray hamming_index_code(hamming_index *index, size_t id) {
+  assert(index);
+  assert(id < index->n_codes);
+
+  bitarray code = {index->n_bits, index->_code_words,
+                   index->array + id * index->_code_words, true, NULL};
+  return code;
+}
+
+void hamming_index_distances(hamming_index *index, bitarray *query,
+                             uint32_t *out) {
+  assert(index && query && out);
+  assert(query->size == index->n_bits);
+
+  size_t words = __hamming_words(index->n_bits);
+  for (size_t i = 0; i < index->n_codes; i++) {
+    out[i] = __hamming_distance(query->array,
+                                index->array + i * index->_code_words, words);
+  }
+}
+
+// scan of the codes [from, to) into heap
+typedef struct {
+  hamming_index *index;
+  const ARRAY_TYPE *query;
+  size_t from, to, k;
+  uint64_t *heap;
+  size_t n;
+} __hamming_scan;
+
+static void* __hamming_scan_range(void *arg) {
+  __hamming_scan *scan = (__hamming_scan*) arg;
+  hamming_index *index = scan->index;
+  size_t words = __hamming_words(index->n_bits);
+
+  for (size_t i = scan->from; i < scan->to; i++) {
+    uint64_t dist = __hamming_distance(
+      scan->query, index->array + i * index->_code_words, words);
+    __hamming_heap_push(scan->heap, &scan->n, scan->k,
+                        (dist << __HAMMING_ID_BITS) | i);
+  }
+  return NULL;
+}
+
+size_t hamming_index_knn(hamming_index *index, bitarray *query, size_t k,
+                         size_t *ids, uint32_t *dists, unsigned n_threads) {
+  assert(index && query);
+  assert(query->size == index->n_bits);
+  assert((ids && dists) || !k);
+
+  if (k > index->n_codes) k = index->n_codes;
+  if (!k) return 0;
+
+  size_t max_threads = index->n_codes / __HAMMING_THREAD_MIN;
+  if (n_threads > max_threads) n_threads = max_threads;
+  if (n_threads < 1) n_threads = 1;
+
+  uint64_t *heaps = (uint64_t*) malloc(n_threads * k * sizeof(uint64_t));
+  __hamming_scan *scans = (__hamming_scan*) malloc(
+    n_threads * sizeof(__hamming_scan));
+  pthread_t *threads = (pthread_t*) malloc(n_threads * sizeof(pthread_t));
+  bool *started = (bool*) calloc(n_threads, sizeof(bool));
+  assert(heaps && scans && threads && started);
+
+  // thread t scans the t-th share of the codes into its own heap
+  for (unsigned t = 0; t < n_threads; t++) {
+    __hamming_scan scan = {index, query->array,
+                           index->n_codes * t / n_threads,
+                           index->n_codes * (t + 1) / n_threads,
+                           k, heaps + t * k, 0};
+    scans[t] = scan;
+  }
+  for (unsigned t = 1; t < n_threads; t++) {
+    started[t] = !pthread_create(&threads[t], NULL, __hamming_scan_range,
+                                 &scans[t]);
+  }
+  __hamming_scan_range(&scans[0]);
+  for (unsigned t = 1; t < n_threads; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
+    } else {
+      __hamming_scan_range(&scans[t]);
+    }
+    for (size_t i = 0; i < scans[t].n; i++) {
+      __hamming_heap_push(scans[0].heap, &scans[0].n, k, scans[t].heap[i]);
+    }
+  }
+
+  size_t n = __hamming_heap_output(scans[0].heap, scans[0].n, ids, dists);
+  free(heaps);
+  free(scans);
+  free(threads);
+  free(started);
+  return n;
+}
+
+// multi-index hashing
+
+static inline uint32_t __hamming_chunk(const ARRAY_TYPE *code, size_t c) {
+  size_t bit = c * __HAMMING_CHUNK_BITS;
+  return (code[bit / BITS_PER_EL] >> (bit % BITS_PER_EL)) &
+         (__HAMMING_CHUNK_VALUES - 1);
+}
+
+void hamming_index_build_mih(hamming_index *index) {
+  assert(index);
+  assert(index->n_codes < UINT32_MAX);
+
+  __hamming_drop_mih(index);
+  size_t n_chunks = (index->n_bits + __HAMMING_CHUNK_BITS - 1) /
+                    __HAMMING_CHUNK_BITS;
+  size_t n_offsets = __HAMMING_CHUNK_VALUES + 1;
+  uint32_t *offsets = (uint32_t*) calloc(n_chunks * n_offsets,
+                                         sizeof(uint32_t));
+  uint32_t *ids = (uint32_t*) malloc(
+    (n_chunks * index->n_codes + 1) * sizeof(uint32_t));
+  uint32_t *next = (uint32_t*) malloc(__HAMMING_CHUNK_VALUES *
+                                      sizeof(uint32_t));
+  assert(offsets && ids && next);
+
+  // counting sort of the ids by chunk value, for every chunk
+  for (size_t c = 0; c < n_chunks; c++) {
+    uint32_t *off = offsets + c * n_offsets;
+    for (size_t i = 0; i < index->n_codes; i++) {
+      off[__hamming_chunk(index->array + i * index->_code_words, c) + 1]++;
+    }
+    for (size_t v = 0; v < __HAMMING_CHUNK_VALUES; v++) {
+      off[v + 1] += off[v];
+      next[v] = off[v];
+    }
+    uint32_t *chunk_ids = ids + c * index->n_codes;
+    for (size_t i = 0; i < index->n_codes; i++) {
+      chunk_ids[next[__hamming_chunk(index->array + i * index->_code_words,
+                                     c)]++] = i;
+    }
+  }
+
+  free(next);
+  index->_n_chunks = n_chunks;
+  index->_mih_offsets = offsets;
+  index->_mih_ids = ids;
+}
+
+// next larger 16 bit mask with the same number of set bits (Gosper's
+// hack); masks past the chunk width end the enumeration
+static inline uint32_t __hamming_next_mask(uint32_t mask) {
+  uint32_t low = mask & -mask;
+  uint32_t r = mask + low;
+  return (((r ^ mask) >> 2) / low) | r;
+}
+
+// a code at distance d has a chunk within distance d / n_chunks of the
+// query's chunk, so once all chunks were probed up to distance s, every
+// code with d < n_chunks * (s + 1) was seen
+size_t hamming_index_knn_mih(hamming_index *index, bitarray *query,
+                             size_t k, size_t *ids, uint32_t *dists) {
+  assert(index && query);
+  assert(query->size == index->n_bits);
+  assert((ids && dists) || !k);
+
+  if (k > index->n_codes) k = index->n_codes;
+  if (!k) return 0;
+  if (!index->_n_chunks) hamming_index_build_mih(index);
+
+  size_t words = __hamming_words(index->n_bits);
+  size_t n_chunks = index->_n_chunks;
+  uint64_t *heap = (uint64_t*) malloc(k * sizeof(uint64_t));
+  bitarray *seen = create_bitarray(index->n_codes);
+  assert(heap);
+  size_t n = 0;
+  size_t n_seen = 0;
+  bool done = false;
+
+  // cost in buckets probed and codes checked, counted against the codes
+  // a scan checks
+  size_t cost = 0;
+  size_t budget = index->n_codes / __HAMMING_MIH_MAX_SHARE;
+  size_t n_values = 1;  // values at distance s of a chunk value
+
+  for (size_t s = 0; s <= __HAMMING_MIH_MAX_RADIUS && !done; s++) {
+    if (s) n_values = n_values * (__HAMMING_CHUNK_BITS - s + 1) / s;
+    if (cost + n_chunks * n_values > budget) break;
+    cost += n_chunks * n_values;
+
+    for (size_t c = 0; c < n_chunks; c++) {
+      const uint32_t *off = index->_mih_offsets +
+                            c * (__HAMMING_CHUNK_VALUES + 1);
+      const uint32_t *chunk_ids = index->_mih_ids + c * index->n_codes;
+      uint32_t value = __hamming_chunk(query->array, c);
+
+      // all values at distance s of the query's chunk
+      for (uint32_t mask = (1U << s) - 1; mask < __HAMMING_CHUNK_VALUES;
+           mask = __hamming_next_mask(mask)) {
+        uint32_t v = value ^ mask;
+        for (uint32_t j = off[v]; j < off[v + 1]; j++) {
+          uint32_t id = chunk_ids[j];
+          if (get_bit(seen, id)) continue;
+          set_bit(seen, id);
+          n_seen++;
+          cost++;
+          uint64_t dist = __hamming_distance(
+            query->array, index->array + id * index->_code_words, words);
+          __hamming_heap_push(heap, &n, k, (dist << __HAMMING_ID_BITS) | id);
+        }
+        if (!mask) break;
+      }
+    }
+
+    done = n_seen == index->n_codes ||
+           (n == k && (heap[0] >> __HAMMING_ID_BITS) < n_chunks * (s + 1));
+  }
+
+  delete_bitarray(seen);
+  if (!done) {
+    free(heap);
+    return hamming_index_knn(index, query, k, ids, dists, 1);
+  }
+
+  n = __hamming_heap_output(heap, n, ids, dists);
+  free(heap);
+  return n;
+}
@@ -0,0 +1,77 @@
+#ifndef HAMMING_H_
+#define HAMMING_H_
+
+// nearest-neighbor search over a collection of binary codes (e.g. 256 to
+// 1024 bit embeddings) by Hamming distance
+//
+// the codes are stored back to back in one array, each padded to a
+// multiple of 64 bytes, and a query is scored against all of them with a
+// SIMD popcount kernel (AVX-512/AVX2) without allocating. the k nearest
+// codes are kept in a max-heap; scans can be split over several threads.
+// multi-index hashing (Norouzi et al.) splits the codes into 16 bit
+// chunks with one table each: a code within distance d of the query
+// matches it within d / n_chunks in at least one chunk, so near
+// neighbors are found by probing the chunks' neighborhoods instead of
+// scanning everything.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t n_bits;            // bits per code
+  size_t n_codes;           // number of codes in the collection
+  size_t _code_words;       // array elements per code (a multiple of 8)
+  size_t _capacity;         // number of codes the array has room for
+  ARRAY_TYPE *array;        // code i starts at array + i * _code_words
+  size_t _n_chunks;         // 16 bit chunks (0: no hashing tables)
+  uint32_t *_mih_offsets;   // per chunk: 2^16 + 1 offsets into its ids
+  uint32_t *_mih_ids;       // per chunk: all ids, grouped by chunk value
+} hamming_index;
+
+// create empty collection of codes of n_bits bits
+hamming_index* create_hamming_index(size_t n_bits);
+
+// delete collection and free allocated memory
+void delete_hamming_index(hamming_index *index);
+
+// append a copy of code (n_bits bits) and return its id (ids are given
+// out in order, starting at 0); drops the multi-index hashing tables
+size_t hamming_index_add(hamming_index *index, bitarray *code);
+
+// code of id as a bitarray that shares the collection's memory
+// (don't resize or free it)
+bitarray hamming_index_code(hamming_index *index, size_t id);
+
+// Hamming distance of query (n_bits bits) to every code
+// (out must hold n_codes values)
+void hamming_index_distances(hamming_index *index, bitarray *query,
+                             uint32_t *out);
+
+// the min(k, n_codes) codes nearest to query by scanning all codes with
+// n_threads threads (0 and 1: no threads); ids and dists (room for k
+// values each) receive them in order of distance (ties: smaller id
+// first); returns their number
+size_t hamming_index_knn(hamming_index *index, bitarray *query, size_t k,
+                         size_t *ids, uint32_t *dists, unsigned n_threads);
+
+// build the multi-index hashing tables over the current codes
+void hamming_index_build_mih(hamming_index *index);
+
+// same as hamming_index_knn (same result), but through the multi-index
+// hashing tables (built if necessary); falls back to a scan if the
+// neighbors are too far away for the tables to help
+size_t hamming_index_knn_mih(hamming_index *index, bitarray *query,
+                             size_t k, size_t *ids, uint32_t *dists);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // HAMMING_H_
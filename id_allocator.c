@@ -0,0 +1,366 @@
+#include "id_allocator.h"
+
+// (one cache line per slot, so threads don't write to shared lines)
+struct __ids_cache {
+  bool lock;        // spin lock (only contended if threads share the slot)
+  size_t word;      // element of used the cached IDs belong to
+  ARRAY_TYPE ids;   // cached IDs (bits of element word, set in used)
+  size_t hint;      // element to search from
+} __attribute__((aligned(64)));
+
+static unsigned __ids_threads = 0;
+static _Thread_local unsigned __ids_thread = 0;  // (0: not assigned yet)
+
+static inline __ids_cache* __ids_slot(id_allocator *a) {
+  if (!__ids_thread) {
+    __ids_thread = 1 + __atomic_fetch_add(&__ids_threads, 1,
+                                          __ATOMIC_RELAXED);
+  }
+  return &a->_caches[(__ids_thread - 1) % __IDS_SLOTS];
+}
+
+static inline void __ids_lock(__ids_cache *c) {
+  while (__atomic_test_and_set(&c->lock, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&c->lock, __ATOMIC_RELAXED)) {}
+  }
+}
+
+static inline void __ids_unlock(__ids_cache *c) {
+  __atomic_clear(&c->lock, __ATOMIC_RELEASE);
+}
+
+// free IDs of element w if its value is x
+static inline ARRAY_TYPE __ids_free_bits(id_allocator *a, size_t w,
+                                         ARRAY_TYPE x) {
+  if (w == a->_n_words - 1 && a->capacity % BITS_PER_EL) {
+    return ~x & ((MASK_1 << (a->capacity % BITS_PER_EL)) - 1);
+  }
+  return ~x;
+}
+
+// the lowest n set bits of x
+static inline ARRAY_TYPE __ids_lowest(ARRAY_TYPE x, unsigned n) {
+  ARRAY_TYPE r = 0;
+  for (unsigned i = 0; i < n && x; i++) {
+    r |= x & -x;
+    x &= x - 1;
+  }
+  return r;
+}
+
+// summary
+
+static void __ids_mark_nonfull(id_allocator *a, size_t w) {
+  size_t j = w / BITS_PER_EL;
+  ARRAY_TYPE old = __atomic_fetch_or(&a->_nonfull[j],
+                                     MASK_1 << (w % BITS_PER_EL),
+                                     __ATOMIC_SEQ_CST);
+  if (!old) {
+    __atomic_fetch_or(&a->_nonzero[j / BITS_PER_EL],
+                      MASK_1 << (j % BITS_PER_EL), __ATOMIC_SEQ_CST);
+  }
+}
+
+// clear the summary bit of element w, which was found full; a free_id
+// that ran concurrently may have freed an ID of it (and set the bit before
+// it was cleared), so the element is checked again afterwards
+static void __ids_mark_full(id_allocator *a, size_t w) {
+  size_t j = w / BITS_PER_EL;
+  ARRAY_TYPE now = __atomic_and_fetch(&a->_nonfull[j],
+                                      ~(MASK_1 << (w % BITS_PER_EL)),
+                                      __ATOMIC_SEQ_CST);
+  if (!now) {
+    __atomic_fetch_and(&a->_nonzero[j / BITS_PER_EL],
+                       ~(MASK_1 << (j % BITS_PER_EL)), __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&a->_nonfull[j], __ATOMIC_SEQ_CST)) {
+      __atomic_fetch_or(&a->_nonzero[j / BITS_PER_EL],
+                        MASK_1 << (j % BITS_PER_EL), __ATOMIC_SEQ_CST);
+    }
+  }
+  ARRAY_TYPE x = __atomic_load_n(&a->used->array[w], __ATOMIC_SEQ_CST);
+  if (__ids_free_bits(a, w, x)) __ids_mark_nonfull(a, w);
+}
+
+// first element >= w with its summary bit set (SIZE_MAX if there is none);
+// the second level skips 64 summary elements per zero bit
+static size_t __ids_find_from(id_allocator *a, size_t w) {
+  size_t n_summary = (a->_n_words + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t j = w / BITS_PER_EL;
+  ARRAY_TYPE x = __atomic_load_n(&a->_nonfull[j], __ATOMIC_RELAXED) &
+                 (ARRAY_TYPE_MAX << (w % BITS_PER_EL));
+  if (x) return j * BITS_PER_EL + __builtin_ctzll(x);
+
+  for (j++; j < n_summary;) {
+    size_t t = j / BITS_PER_EL;
+    ARRAY_TYPE y = __atomic_load_n(&a->_nonzero[t], __ATOMIC_RELAXED) &
+                   (ARRAY_TYPE_MAX << (j % BITS_PER_EL));
+    if (!y) {
+      j = (t + 1) * BITS_PER_EL;
+      continue;
+    }
+    j = t * BITS_PER_EL + __builtin_ctzll(y);
+    if (j >= n_summary) break;
+    x = __atomic_load_n(&a->_nonfull[j], __ATOMIC_RELAXED);
+    if (x) return j * BITS_PER_EL + __builtin_ctzll(x);
+    j++;  // (stale second-level bit)
+  }
+  return SIZE_MAX;
+}
+
+// element that may have a free ID, searched from start on and then from
+// the beginning; the summary is a hint, so before giving up all elements
+// are scanned
+static size_t __ids_find(id_allocator *a, size_t start) {
+  size_t w = __ids_find_from(a, start);
+  if (w == SIZE_MAX && start) w = __ids_find_from(a, 0);
+  if (w != SIZE_MAX) return w;
+
+  for (w = 0; w < a->_n_words; w++) {
+    ARRAY_TYPE x = __atomic_load_n(&a->used->array[w], __ATOMIC_RELAXED);
+    if (__ids_free_bits(a, w, x)) {
+      __ids_mark_nonfull(a, w);
+      return w;
+    }
+  }
+  return SIZE_MAX;
+}
+
+// claim up to n free IDs of element w (the lowest ones) with a
+// compare-and-swap; returns them as bits of the element (0 if it's full)
+static ARRAY_TYPE __ids_claim(id_allocator *a, size_t w, unsigned n) {
+  ARRAY_TYPE *word = &a->used->array[w];
+  ARRAY_TYPE old = __atomic_load_n(word, __ATOMIC_RELAXED);
+  for (;;) {
+    ARRAY_TYPE free_bits = __ids_free_bits(a, w, old);
+    if (!free_bits) {
+      __ids_mark_full(a, w);
+      return 0;
+    }
+    ARRAY_TYPE take = __ids_lowest(free_bits, n);
+    if (__atomic_compare_exchange_n(word, &old, old | take, true,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      if (take == free_bits) __ids_mark_full(a, w);
+      return take;
+    }
+  }
+}
+
+// free the IDs ids of element w in used
+static void __ids_release(id_allocator *a, size_t w, ARRAY_TYPE ids) {
+  ARRAY_TYPE old = __atomic_fetch_and(&a->used->array[w], ~ids,
+                                      __ATOMIC_SEQ_CST);
+  assert((old & ids) == ids);
+  if (!__ids_free_bits(a, w, old)) __ids_mark_nonfull(a, w);
+}
+
+// fill cache c (locked) with IDs of the next element that has free ones
+static bool __ids_refill(id_allocator *a, __ids_cache *c) {
+  for (;;) {
+    size_t w = __ids_find(a, c->hint);
+    if (w == SIZE_MAX) return false;
+    ARRAY_TYPE ids = __ids_claim(a, w, __IDS_BATCH);
+    if (ids) {
+      c->word = w;
+      c->ids = ids;
+      c->hint = w;
+      return true;
+    }
+  }
+}
+
+id_allocator* create_id_allocator(size_t capacity) {
+  assert(capacity > 0);
+
+  id_allocator *a = (id_allocator*) malloc(sizeof(id_allocator));
+  assert(a);
+  a->capacity = capacity;
+  a->used = create_bitarray(capacity);
+  a->_n_words = (capacity + BITS_PER_EL - 1) / BITS_PER_EL;
+
+  size_t n_summary = (a->_n_words + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t n_top = (n_summary + BITS_PER_EL - 1) / BITS_PER_EL;
+  a->_nonfull = (ARRAY_TYPE*) calloc(n_summary, TYPE_SIZE);
+  a->_nonzero = (ARRAY_TYPE*) calloc(n_top, TYPE_SIZE);
+  assert(a->_nonfull && a->_nonzero);
+  for (size_t w = 0; w < a->_n_words; w++) {
+    a->_nonfull[w / BITS_PER_EL] |= MASK_1 << (w % BITS_PER_EL);
+  }
+  for (size_t j = 0; j < n_summary; j++) {
+    a->_nonzero[j / BITS_PER_EL] |= MASK_1 << (j % BITS_PER_EL);
+  }
+
+  a->_caches = (__ids_cache*) aligned_alloc(64, __IDS_SLOTS *
+                                                sizeof(__ids_cache));
+  assert(a->_caches);
+  for (size_t s = 0; s < __IDS_SLOTS; s++) {
+    a->_caches[s].lock = false;
+    a->_caches[s].word = 0;
+    a->_caches[s].ids = 0;
+    a->_caches[s].hint = s * a->_n_words / __IDS_SLOTS;
+  }
+  return a;
+}
+
+void delete_id_allocator(id_allocator *a) {
+  assert(a);
+
+  delete_bitarray(a->used);
+  free(a->_nonfull);
+  free(a->_nonzero);
+  free(a->_caches);
+  free(a);
+}
+
+size_t alloc_id(id_allocator *a) {
+  assert(a);
+
+  __ids_cache *c = __ids_slot(a);
+  for (bool flushed = false; ; flushed = true) {
+    __ids_lock(c);
+    if (c->ids || __ids_refill(a, c)) {
+      size_t id = c->word * BITS_PER_EL + __builtin_ctzll(c->ids);
+      c->ids &= c->ids - 1;
+      __ids_unlock(c);
+      return id;
+    }
+    __ids_unlock(c);
+
+    // (the remaining free IDs may sit in other threads' caches)
+    if (flushed) return SIZE_MAX;
+    id_allocator_flush(a);
+  }
+}
+
+void free_id(id_allocator *a, size_t id) {
+  assert(a);
+  assert(id < a->capacity);
+
+  size_t w = id / BITS_PER_EL;
+  ARRAY_TYPE bit = MASK_1 << (id % BITS_PER_EL);
+  __ids_cache *c = __ids_slot(a);
+  __ids_lock(c);
+  if (c->word == w) {
+    assert(!(c->ids & bit));
+    c->ids |= bit;
+    __ids_unlock(c);
+    return;
+  }
+  __ids_unlock(c);
+  __ids_release(a, w, bit);
+}
+
+// claim [from, to) element by element with compare-and-swap; if an ID is
+// taken, the elements claimed so far are released again
+static bool __ids_claim_range(id_allocator *a, size_t from, size_t to) {
+  size_t first = from / BITS_PER_EL, last = (to - 1) / BITS_PER_EL;
+  for (size_t w = first; w <= last; w++) {
+    ARRAY_TYPE mask = ARRAY_TYPE_MAX;
+    if (w == first) mask &= ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+    if (w == last) {
+      mask &= ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL);
+    }
+
+    ARRAY_TYPE *word = &a->used->array[w];
+    ARRAY_TYPE old = __atomic_load_n(word, __ATOMIC_RELAXED);
+    do {
+      if (old & mask) {
+        if (w > first) free_id_range(a, from, w * BITS_PER_EL - from);
+        return false;
+      }
+    } while (!__atomic_compare_exchange_n(word, &old, old | mask, true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    if (!__ids_free_bits(a, w, old | mask)) __ids_mark_full(a, w);
+  }
+  return true;
+}
+
+// first position p >= pos with IDs [p, p + k) all free in a snapshot of
+// used (SIZE_MAX if there is none); the elements are read with relaxed
+// atomic loads into a scratch window of __IDS_SCAN elements (more for
+// long runs) that find_clear_run searches, and consecutive windows
+// overlap by k - 1 bits so runs across their border are found
+static size_t __ids_find_run(id_allocator *a, size_t k, size_t pos) {
+  size_t span = __IDS_SCAN + (k + BITS_PER_EL - 1) / BITS_PER_EL;
+  ARRAY_TYPE local[2 * __IDS_SCAN];
+  ARRAY_TYPE *scratch = local;
+  if (span > 2 * __IDS_SCAN) {
+    scratch = (ARRAY_TYPE*) malloc(span * TYPE_SIZE);
+    assert(scratch);
+  }
+
+  size_t found = SIZE_MAX;
+  while (pos + k <= a->capacity) {
+    size_t w = pos / BITS_PER_EL;
+    size_t n_els = a->_n_words - w < span ? a->_n_words - w : span;
+    for (size_t i = 0; i < n_els; i++) {
+      scratch[i] = __atomic_load_n(&a->used->array[w + i], __ATOMIC_RELAXED);
+    }
+    size_t base = w * BITS_PER_EL;
+    size_t n_bits = a->capacity - base < n_els * BITS_PER_EL
+                    ? a->capacity - base : n_els * BITS_PER_EL;
+    bitarray window = {n_bits, n_els, scratch, true, NULL};
+    size_t p = find_clear_run(&window, k, pos - base);
+    if (p != SIZE_MAX) {
+      found = base + p;
+      break;
+    }
+    if (w + n_els == a->_n_words) break;
+    pos = base + n_bits - (k - 1);
+  }
+
+  if (scratch != local) free(scratch);
+  return found;
+}
+
+size_t alloc_id_range(id_allocator *a, size_t k) {
+  assert(a && k > 0);
+  if (k > a->capacity) return SIZE_MAX;
+
+  __ids_cache *c = __ids_slot(a);
+  __ids_lock(c);
+  size_t start = c->hint * BITS_PER_EL;
+  __ids_unlock(c);
+
+  // (the search reads a snapshot of used that other threads may have
+  // changed since; the claim only succeeds if the IDs are still free)
+  for (int pass = 0; pass < 3; pass++) {
+    if (pass == 2) id_allocator_flush(a);
+    size_t pos = pass ? 0 : start;
+    size_t first;
+    while ((first = __ids_find_run(a, k, pos)) != SIZE_MAX) {
+      if (__ids_claim_range(a, first, first + k)) return first;
+      pos = first + 1;
+    }
+  }
+  return SIZE_MAX;
+}
+
+void free_id_range(id_allocator *a, size_t first, size_t k) {
+  assert(a);
+  assert(first <= a->capacity && k <= a->capacity - first);
+  if (!k) return;
+
+  size_t to = first + k;
+  size_t w_first = first / BITS_PER_EL, w_last = (to - 1) / BITS_PER_EL;
+  for (size_t w = w_first; w <= w_last; w++) {
+    ARRAY_TYPE mask = ARRAY_TYPE_MAX;
+    if (w == w_first) mask &= ARRAY_TYPE_MAX << (first % BITS_PER_EL);
+    if (w == w_last) {
+      mask &= ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL);
+    }
+    __ids_release(a, w, mask);
+  }
+}
+
+void id_allocator_flush(id_allocator *a) {
+  assert(a);
+
+  for (size_t s = 0; s < __IDS_SLOTS; s++) {
+    __ids_cache *c = &a->_caches[s];
+    __ids_lock(c);
+    if (c->ids) __ids_release(a, c->word, c->ids);
+    c->ids = 0;
+    __ids_unlock(c);
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef ID_ALLOCATOR_H_
+#define ID_ALLOCATOR_H_
+
+// allocator of integer IDs [0, capacity) (connection IDs, slots, ...) that
+// many threads can use concurrently without a lock
+//
+// a bitarray holds the allocated IDs; IDs are claimed by compare-and-swap
+// on its elements. a two-level summary (bit w: element w may have a free
+// ID, bit j of the second level: summary element j isn't zero) leads
+// searches to free IDs without scanning full elements. every thread takes
+// IDs from a cache of up to __IDS_BATCH IDs claimed from one element at
+// once and returns freed IDs of that element to it, so most alloc_id and
+// free_id calls don't touch shared memory. threads start searching at
+// different positions, which spreads them over the elements.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// IDs claimed per cache refill
+#define __IDS_BATCH 16
+
+// cache slots (threads beyond this share slots)
+#define __IDS_SLOTS 64
+
+// elements of used copied per step of a range search
+#define __IDS_SCAN 64
+
+typedef struct __ids_cache __ids_cache;
+
+typedef struct {
+  size_t capacity;       // number of IDs
+  bitarray *used;        // bit i set: ID i is allocated or in a cache
+                         // (modified atomically, read it only while no
+                         // thread allocates or frees)
+  size_t _n_words;       // elements of used
+  ARRAY_TYPE *_nonfull;  // summary: bit w set if element w may have a
+                         // free ID
+  ARRAY_TYPE *_nonzero;  // bit j set if _nonfull[j] may be non-zero
+  __ids_cache *_caches;  // __IDS_SLOTS per-thread caches
+} id_allocator;
+
+// create allocator of the IDs [0, capacity) (all free)
+id_allocator* create_id_allocator(size_t capacity);
+
+// delete allocator and free allocated memory (no thread may use it
+// anymore)
+void delete_id_allocator(id_allocator *a);
+
+// allocate an ID; SIZE_MAX if all IDs are allocated
+size_t alloc_id(id_allocator *a);
+
+// free ID id (allocated by alloc_id or alloc_id_range)
+void free_id(id_allocator *a, size_t id);
+
+// allocate k consecutive IDs [first, first + k) and return first;
+// SIZE_MAX if there is no such range
+size_t alloc_id_range(id_allocator *a, size_t k);
+
+// free the IDs [first, first + k)
+void free_id_range(id_allocator *a, size_t first, size_t k);
+
+// return the IDs in the caches of all threads (e.g. before reading used);
+// alloc_id does this itself before it gives up
+void id_allocator_flush(id_allocator *a);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // ID_ALLOCATOR_H_
@@ -12,8 +12,1494 @@ inline size_t __bitarray_size(size_t n_bits) {
   return n_bits / (TYPE_SIZE * 8) + 1;
 }
 
+// hot-path instrumentation
+
+#ifdef BITARRAY_STATS
+
+typedef struct __bitarray_thread_stats {
+  bitarray_stats stats;
+  struct __bitarray_thread_stats *next;
+} __bitarray_thread_stats;
+
+// the counters of every thread stay in this list (even after the thread
+// exited), so snapshots always contain all recorded calls
+static __bitarray_thread_stats *__stats_threads = NULL;
+static pthread_mutex_t __stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread __bitarray_thread_stats *__stats_local = NULL;
+static __thread unsigned __stats_depth = 0;
+static __thread uint64_t __stats_pending_bytes = 0;
+
+static inline uint64_t __stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// counters are only written by the thread they belong to,
+// but snapshots/resets access them from other threads
+static inline void __stats_add(uint64_t *counter, uint64_t n) {
+  uint64_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  __atomic_store_n(counter, old + n, __ATOMIC_RELAXED);
+}
+
+static __bitarray_thread_stats* __stats_register_thread(void) {
+  __bitarray_thread_stats *t =
+    (__bitarray_thread_stats*) calloc(1, sizeof(__bitarray_thread_stats));
+  assert(t);
+
+  pthread_mutex_lock(&__stats_lock);
+  t->next = __stats_threads;
+  __stats_threads = t;
+  pthread_mutex_unlock(&__stats_lock);
+
+  __stats_local = t;
+  return t;
+}
+
+static inline uint64_t __stats_begin(void) {
+  // nested call (e.g. set_bit inside of set_bit_range)
+  if (__stats_depth++) return 0;
+
+  __stats_pending_bytes = 0;
+  return __stats_ticks();
+}
+
+static inline void __stats_end(enum bitarray_stat_fn fn,
+                               uint64_t start, uint64_t bits) {
+  if (--__stats_depth) return;
+
+  uint64_t ticks = __stats_ticks() - start;
+  __bitarray_thread_stats *t = __stats_local;
+  if (!t) t = __stats_register_thread();
+
+  bitarray_fn_stats *s = &(t->stats.fn[fn]);
+  __stats_add(&(s->calls), 1);
+  __stats_add(&(s->bits), bits);
+  __stats_add(&(s->bytes_allocated), __stats_pending_bytes);
+  __stats_add(&(s->ticks), ticks);
+
+  // bucket i holds latencies in [2^i, 2^(i+1))
+  unsigned bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+  if (bucket >= BITARRAY_STAT_BUCKETS) bucket = BITARRAY_STAT_BUCKETS - 1;
+  __stats_add(&(s->latency_hist[bucket]), 1);
+}
+
+#define STAT_BEGIN() uint64_t __stat_start = __stats_begin()
+#define STAT_END(fn, bits) \
+  __stats_end(BITARRAY_STAT_##fn, __stat_start, (bits))
+#define STAT_ALLOC(bytes) (__stats_pending_bytes += (bytes))
+
+#else
+
+#define STAT_BEGIN() ((void) 0)
+#define STAT_END(fn, bits) ((void) (bits))
+#define STAT_ALLOC(bytes) ((void) 0)
+
+#endif  // BITARRAY_STATS
+
+const char* bitarray_stat_name(enum bitarray_stat_fn fn) {
+#define BITARRAY_STAT_NAME(fn) #fn,
+  static const char *names[] = {
+    BITARRAY_STAT_FUNCTIONS(BITARRAY_STAT_NAME)
+  };
+#undef BITARRAY_STAT_NAME
+
+  assert(fn < BITARRAY_STAT_FN_COUNT);
+  return names[fn];
+}
+
+void bitarray_stats_snapshot(bitarray_stats *out) {
+  assert(out);
+  memset(out, 0, sizeof(bitarray_stats));
+
+#ifdef BITARRAY_STATS
+  // bitarray_stats only consists of uint64_t counters
+  uint64_t *sum = (uint64_t*) out;
+  size_t n_counters = sizeof(bitarray_stats) / sizeof(uint64_t);
+
+  pthread_mutex_lock(&__stats_lock);
+  for (__bitarray_thread_stats *t = __stats_threads; t; t = t->next) {
+    uint64_t *counters = (uint64_t*) &(t->stats);
+    for (size_t i = 0; i < n_counters; i++) {
+      sum[i] += __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&__stats_lock);
+#endif
+}
+
+void bitarray_stats_reset(void) {
+#ifdef BITARRAY_STATS
+  size_t n_counters = sizeof(bitarray_stats) / sizeof(uint64_t);
+
+  pthread_mutex_lock(&__stats_lock);
+  for (__bitarray_thread_stats *t = __stats_threads; t; t = t->next) {
+    uint64_t *counters = (uint64_t*) &(t->stats);
+    for (size_t i = 0; i < n_counters; i++) {
+      __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&__stats_lock);
+#endif
+}
+
+void bitarray_stats_dump_json(FILE *out) {
+  assert(out);
+
+#ifdef BITARRAY_STATS
+  bitarray_stats *stats = (bitarray_stats*) malloc(sizeof(bitarray_stats));
+  assert(stats);
+  bitarray_stats_snapshot(stats);
+
+  fprintf(out, "{\"enabled\": true, \"clock\": \"%s\", \"functions\": {",
+#if defined(__x86_64__) || defined(__i386__)
+          "rdtsc"
+#else
+          "ns"
+#endif
+          );
+
+  for (int fn = 0; fn < BITARRAY_STAT_FN_COUNT; fn++) {
+    bitarray_fn_stats *s = &(stats->fn[fn]);
+    fprintf(out, "%s\n  \"%s\": {\"calls\": %lu, \"bits\": %lu, "
+                 "\"bytes_allocated\": %lu, \"ticks\": %lu, "
+                 "\"latency_hist\": [",
+            fn ? "," : "", bitarray_stat_name((enum bitarray_stat_fn) fn),
+            s->calls, s->bits, s->bytes_allocated, s->ticks);
+    for (int i = 0; i < BITARRAY_STAT_BUCKETS; i++) {
+      fprintf(out, "%s%lu", i ? ", " : "", s->latency_hist[i]);
+    }
+    fprintf(out, "]}");
+  }
+  fprintf(out, "\n}}\n");
+
+  free(stats);
+#else
+  fprintf(out, "{\"enabled\": false, \"functions\": {}}\n");
+#endif
+}
+
+// range engine
+//
+// every range function runs through __range_apply: the (partial) first
+// and last element of [from, to) are handled with one masked operation
+// each and the elements in between with a (SIMD) loop over whole
+// elements. op is a compile-time constant at every call site, so each
+// caller gets its own specialized copy of the engine.
+
+enum __range_op {
+  __RANGE_SET,
+  __RANGE_CLEAR,
+  __RANGE_FLIP,
+  __RANGE_COUNT,
+  __RANGE_TEST_ANY,
+  __RANGE_TEST_ALL,
+  __RANGE_COPY
+};
+
+#define __ALWAYS_INLINE static inline __attribute__((always_inline))
+// (paths only taken for bitarrays with attached structures, kept out of
+// the functions so their plain paths stay as short as they were)
+#define __NOINLINE static __attribute__((noinline))
+
+// number of set bits in words[0, n)
+__ALWAYS_INLINE size_t __popcount_words(const ARRAY_TYPE *words, size_t n) {
+  size_t count = 0;
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512) && defined(__AVX512VPOPCNTDQ__)
+  __m512i acc = _mm512_setzero_si512();
+  for (; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_loadu_si512((const void*) (words + i));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+  }
+  count = _mm512_reduce_add_epi64(acc);
+#elif defined(__BITARRAY_AVX2)
+  // nibble lookup table popcount (Mula et al.)
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) (words + i));
+    __m256i lo = _mm256_and_si256(v, low_nibbles);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                    _mm256_shuffle_epi8(lut, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes,
+                                                _mm256_setzero_si256()));
+  }
+  count = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+          _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+#endif
+
+  for (; i < n; i++) {
+    count += pop_count(words[i]);
+  }
+  return count;
+}
+
+// check if any of words[0, n) is non-zero
+// (ones == true: check if any of them isn't all ones)
+__ALWAYS_INLINE bool __any_words(const ARRAY_TYPE *words, size_t n,
+                                 bool ones) {
+  const ARRAY_TYPE flip = ones ? ARRAY_TYPE_MAX : 0;
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512)
+  const __m512i vflip = _mm512_set1_epi64((long long) flip);
+  for (; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_loadu_si512((const void*) (words + i));
+    if (_mm512_test_epi64_mask(_mm512_xor_si512(v, vflip),
+                               _mm512_set1_epi64(-1))) {
+      return true;
+    }
+  }
+#elif defined(__BITARRAY_AVX2)
+  const __m256i vflip = _mm256_set1_epi64x((long long) flip);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_xor_si256(
+      _mm256_loadu_si256((const __m256i*) (words + i)), vflip);
+    if (!_mm256_testz_si256(v, v)) return true;
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (words[i] ^ flip) return true;
+  }
+  return false;
+}
+
+// first element of words[i, n) that isn't value (n if there is none, i if
+// i >= n)
+__ALWAYS_INLINE size_t __skip_words(const ARRAY_TYPE *words, size_t i,
+                                   size_t n, ARRAY_TYPE value) {
+#if defined(__BITARRAY_AVX512)
+  const __m512i vvalue = _mm512_set1_epi64((long long) value);
+  for (; i + 8 <= n; i += 8) {
+    __mmask8 ne = _mm512_cmpneq_epu64_mask(
+      _mm512_loadu_si512((const void*) (words + i)), vvalue);
+    if (ne) return i + __builtin_ctz(ne);
+  }
+#elif defined(__BITARRAY_AVX2)
+  const __m256i vvalue = _mm256_set1_epi64x((long long) value);
+  for (; i + 4 <= n; i += 4) {
+    __m256i eq = _mm256_cmpeq_epi64(
+      _mm256_loadu_si256((const __m256i*) (words + i)), vvalue);
+    unsigned ne = ~_mm256_movemask_pd(_mm256_castsi256_pd(eq)) & 0xf;
+    if (ne) return i + __builtin_ctz(ne);
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (words[i] != value) return i;
+  }
+  return i;
+}
+
+// bits p of x where x has k (1 <= k <= BITS_PER_EL) consecutive set bits
+// starting at p (log2(k) shift-and steps)
+__ALWAYS_INLINE ARRAY_TYPE __run_starts(ARRAY_TYPE x, size_t k) {
+  size_t s = 1;
+  for (; 2 * s <= k; s *= 2) x &= x >> s;
+  if (k > s) x &= x >> (k - s);
+  return x;
+}
+
+// element i of the bit range [from, to) with the bits that belong to a run
+// (set bits, or unset bits if flip is ARRAY_TYPE_MAX) set; bits outside the
+// range never belong to one
+__ALWAYS_INLINE ARRAY_TYPE __run_bits(const ARRAY_TYPE *words, size_t i,
+                                      size_t from, size_t to,
+                                      ARRAY_TYPE flip) {
+  ARRAY_TYPE x = words[i] ^ flip;
+  if (i == from / BITS_PER_EL) x &= ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+  if (i == (to - 1) / BITS_PER_EL) {
+    x &= ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL);
+  }
+  return x;
+}
+
+// first position p >= start with bits [p, p + k) in a run (see
+// __run_bits); runs are carried across elements by their length, elements
+// entirely inside or outside a run are skipped with __skip_words and runs
+// within an element are found with __run_starts
+__ALWAYS_INLINE size_t __find_run(const ARRAY_TYPE *words, size_t n_bits,
+                                  size_t k, size_t start, ARRAY_TYPE flip) {
+  if (k == 0) return start <= n_bits ? start : SIZE_MAX;
+  if (start >= n_bits || k > n_bits - start) return SIZE_MAX;
+
+  // (elements before full lie entirely in the bitarray)
+  size_t full = n_bits / BITS_PER_EL;
+  size_t last = (n_bits - 1) / BITS_PER_EL;
+  size_t run = 0, run_start = 0;
+  for (size_t i = start / BITS_PER_EL; i <= last;) {
+    ARRAY_TYPE x = __run_bits(words, i, start, n_bits, flip);
+    if (!run) run_start = i * BITS_PER_EL;
+
+    if (x == ARRAY_TYPE_MAX) {
+      size_t j = __skip_words(words, i + 1, full, ~flip);
+      run += (j - i) * BITS_PER_EL;
+      if (run >= k) return run_start;
+      i = j;
+      continue;
+    }
+    if (run + __builtin_ctzll(~x) >= k) return run_start;
+    if (k <= BITS_PER_EL) {
+      ARRAY_TYPE starts = __run_starts(x, k);
+      if (starts) return i * BITS_PER_EL + __builtin_ctzll(starts);
+    }
+    if (!x) {
+      run = 0;
+      i = __skip_words(words, i + 1, full, flip);
+      continue;
+    }
+    run = __builtin_clzll(~x);
+    run_start = (i + 1) * BITS_PER_EL - run;
+    i++;
+  }
+  return SIZE_MAX;
+}
+
+// longest run in [from, to) (see __find_run); runs within an element are
+// only walked if one of them is longer than the longest run so far
+__ALWAYS_INLINE size_t __longest_run(const ARRAY_TYPE *words, size_t from,
+                                     size_t to, ARRAY_TYPE flip,
+                                     size_t *pos) {
+  size_t best = 0, best_start = SIZE_MAX;
+  size_t run = 0, run_start = 0;
+  size_t full = to / BITS_PER_EL;
+  size_t last = to > from ? (to - 1) / BITS_PER_EL : 0;
+  for (size_t i = from / BITS_PER_EL; to > from && i <= last;) {
+    ARRAY_TYPE x = __run_bits(words, i, from, to, flip);
+    if (!run) run_start = i * BITS_PER_EL;
+
+    if (x == ARRAY_TYPE_MAX) {
+      size_t j = __skip_words(words, i + 1, full, ~flip);
+      run += (j - i) * BITS_PER_EL;
+      i = j;
+      continue;
+    }
+    size_t lead = __builtin_ctzll(~x);
+    if (run + lead > best) {
+      best = run + lead;
+      best_start = run_start;
+    }
+    size_t tail = __builtin_clzll(~x);
+    if (best < BITS_PER_EL - 1 && __run_starts(x, best + 1)) {
+      // (the lead and tail runs are counted above and below)
+      ARRAY_TYPE inner = x & (ARRAY_TYPE_MAX << lead) &
+                         (ARRAY_TYPE_MAX >> tail);
+      while (inner) {
+        size_t p = __builtin_ctzll(inner);
+        size_t len = __builtin_ctzll(~(inner >> p));
+        if (len > best) {
+          best = len;
+          best_start = i * BITS_PER_EL + p;
+        }
+        inner &= ~(((MASK_1 << len) - 1) << p);
+      }
+    }
+    if (!x) {
+      run = 0;
+      i = __skip_words(words, i + 1, full, flip);
+      continue;
+    }
+    run = tail;
+    run_start = (i + 1) * BITS_PER_EL - run;
+    i++;
+  }
+  if (run > best) {
+    best = run;
+    best_start = run_start;
+  }
+
+  if (pos) *pos = best_start;
+  return best;
+}
+
+// first position >= pos whose bit is set (unset if flip is
+// ARRAY_TYPE_MAX), n_bits if there is none; ctz of the element (or its
+// complement) jumps to the next transition, __skip_words skips elements
+// without one
+__ALWAYS_INLINE size_t __next_bit(const ARRAY_TYPE *words, size_t n_bits,
+                                  size_t pos, ARRAY_TYPE flip) {
+  if (pos >= n_bits) return n_bits;
+
+  size_t i = pos / BITS_PER_EL;
+  size_t last = (n_bits - 1) / BITS_PER_EL;
+  ARRAY_TYPE x = (words[i] ^ flip) & (ARRAY_TYPE_MAX << (pos % BITS_PER_EL));
+  while (!x) {
+    if (++i > last) return n_bits;
+    i = __skip_words(words, i, last, flip);
+    x = words[i] ^ flip;
+  }
+  // (set padding bits and the unset ones of flip count as past the end)
+  size_t p = i * BITS_PER_EL + __builtin_ctzll(x);
+  return p < n_bits ? p : n_bits;
+}
+
+// number of runs of set bits that start in [pos, n_bits), given that bit
+// pos - 1 is unset or not counted: set bits whose predecessor is unset
+__ALWAYS_INLINE size_t __count_run_starts(const ARRAY_TYPE *words,
+                                          size_t n_bits, size_t pos) {
+  if (pos >= n_bits) return 0;
+
+  size_t first = pos / BITS_PER_EL;
+  size_t last = (n_bits - 1) / BITS_PER_EL;
+  size_t count = 0;
+  ARRAY_TYPE carry = 0;
+  for (size_t i = first; i <= last; i++) {
+    ARRAY_TYPE x = words[i];
+    if (i == first) x &= ARRAY_TYPE_MAX << (pos % BITS_PER_EL);
+    if (i == last) {
+      x &= ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (n_bits - 1) % BITS_PER_EL);
+    }
+    count += pop_count(x & ~((x << 1) | carry));
+    carry = x >> (BITS_PER_EL - 1);
+  }
+  return count;
+}
+
+// store the runs of set bits of words[0, n_bits) in intervals[0, max) and
+// return their number (see convert_bitarray_to_intervals). the
+// transitions of an element (bits that differ from the bit before them)
+// are run starts and ends in turn and are taken off with t & (t - 1), so
+// the runs within an element don't wait for each other's ctz; elements
+// without a transition are skipped with __skip_words
+__ALWAYS_INLINE size_t __collect_runs(const ARRAY_TYPE *words,
+                                      size_t n_bits,
+                                      bitarray_interval *intervals,
+                                      size_t max) {
+  size_t full = n_bits / BITS_PER_EL;
+  size_t last = (n_bits - 1) / BITS_PER_EL;
+  size_t n = 0, start = 0;
+  bool in_run = false;
+  ARRAY_TYPE carry = 0;  // the bit before the element (as bit 0)
+  for (size_t i = 0; i <= last;) {
+    ARRAY_TYPE x = words[i];
+    if (i == full) x &= (MASK_1 << (n_bits % BITS_PER_EL)) - 1;
+    ARRAY_TYPE t = x ^ ((x << 1) | carry);
+    carry = x >> (BITS_PER_EL - 1);
+
+    for (; t; t &= t - 1) {
+      size_t p = i * BITS_PER_EL + __builtin_ctzll(t);
+      in_run = !in_run;
+      if (in_run) {
+        start = p;
+        continue;
+      }
+      if (n == max) return n + 1 + __count_run_starts(words, n_bits, p);
+      intervals[n].start = start;
+      intervals[n].end = p;
+      n++;
+    }
+    i = __skip_words(words, i + 1, full, carry ? ARRAY_TYPE_MAX : 0);
+  }
+
+  // (a run that ends with the last element)
+  if (in_run) {
+    if (n < max) {
+      intervals[n].start = start;
+      intervals[n].end = n_bits;
+    }
+    n++;
+  }
+  return n;
+}
+
+// BITS_PER_EL bits of src starting at (signed) bit position pos;
+// bits before position 0 and after src_words elements read as 0
+__ALWAYS_INLINE ARRAY_TYPE __load_bits(const ARRAY_TYPE *src,
+                                       size_t src_words, ptrdiff_t pos) {
+  if (pos < 0) return src[0] << (-pos);
+
+  size_t idx = pos / BITS_PER_EL;
+  uint8_t shift = pos % BITS_PER_EL;
+  ARRAY_TYPE v = idx < src_words ? src[idx] >> shift : 0;
+  if (shift && idx + 1 < src_words) {
+    v |= src[idx + 1] << (BITS_PER_EL - shift);
+  }
+  return v;
+}
+
+// apply op to the bits of *word selected by mask;
+// returns the partial result of count/test ops
+__ALWAYS_INLINE size_t __range_word(enum __range_op op, ARRAY_TYPE *word,
+                                    ARRAY_TYPE mask, ARRAY_TYPE value) {
+  switch (op) {
+    case __RANGE_SET: *word |= mask; return 0;
+    case __RANGE_CLEAR: *word &= ~mask; return 0;
+    case __RANGE_FLIP: *word ^= mask; return 0;
+    case __RANGE_COUNT: return pop_count(*word & mask);
+    case __RANGE_TEST_ANY: return (*word & mask) != 0;
+    case __RANGE_TEST_ALL: return (*word & mask) == mask;
+    case __RANGE_COPY: *word = (*word & ~mask) | (value & mask); return 0;
+  }
+  return 0;
+}
+
+// fill whole elements words[first, last) from src, element i receives
+// the bits of src starting at bit i * BITS_PER_EL + delta
+__ALWAYS_INLINE void __copy_words(ARRAY_TYPE *words, size_t first,
+                                  size_t last, const ARRAY_TYPE *src,
+                                  size_t src_words, ptrdiff_t delta,
+                                  bool backwards) {
+  if (delta % (ptrdiff_t) BITS_PER_EL == 0) {
+    // source and destination elements line up
+    const ARRAY_TYPE *start = src + (ptrdiff_t) first +
+                              delta / (ptrdiff_t) BITS_PER_EL;
+    memmove(words + first, start, (last - first) * TYPE_SIZE);
+    return;
+  }
+
+  // element i is a funnel shift of src[i + off] and src[i + off + 1];
+  // only the first and last element may need the bounds checks
+  const ptrdiff_t bits = BITS_PER_EL;
+  ptrdiff_t off = delta >= 0 ? delta / bits : -((-delta + bits - 1) / bits);
+  uint8_t shift = delta - off * bits;
+  size_t lo = first, hi = last;
+  if (lo < last && (ptrdiff_t) lo + off < 0) lo++;
+  while (hi > lo && (ptrdiff_t) hi + off >= (ptrdiff_t) src_words) hi--;
+
+  if (backwards) {
+    for (size_t i = last; i-- > hi;) {
+      words[i] = __load_bits(src, src_words,
+                             (ptrdiff_t) (i * BITS_PER_EL) + delta);
+    }
+    for (size_t i = hi; i-- > lo;) {
+      const ARRAY_TYPE *s = src + (ptrdiff_t) i + off;
+      words[i] = (s[0] >> shift) | (s[1] << (BITS_PER_EL - shift));
+    }
+    if (lo > first) {
+      words[first] = __load_bits(src, src_words,
+                                 (ptrdiff_t) (first * BITS_PER_EL) + delta);
+    }
+  } else {
+    if (lo > first) {
+      words[first] = __load_bits(src, src_words,
+                                 (ptrdiff_t) (first * BITS_PER_EL) + delta);
+    }
+    for (size_t i = lo; i < hi; i++) {
+      const ARRAY_TYPE *s = src + (ptrdiff_t) i + off;
+      words[i] = (s[0] >> shift) | (s[1] << (BITS_PER_EL - shift));
+    }
+    for (size_t i = hi; i < last; i++) {
+      words[i] = __load_bits(src, src_words,
+                             (ptrdiff_t) (i * BITS_PER_EL) + delta);
+    }
+  }
+}
+
+// apply op to the bits in [from, to) of words;
+// for __RANGE_COPY, bit from + i receives bit src_from + i of src
+// (src has src_words elements and may be words itself)
+// returns the count for __RANGE_COUNT and 0/1 for the test ops;
+// no element after the one holding bit to - 1 is accessed
+__ALWAYS_INLINE size_t __range_apply(enum __range_op op, ARRAY_TYPE *words,
+                                     size_t from, size_t to,
+                                     const ARRAY_TYPE *src,
+                                     size_t src_words, size_t src_from) {
+  if (from >= to) return op == __RANGE_TEST_ALL;
+
+  size_t first = from / BITS_PER_EL;
+  size_t last = (to - 1) / BITS_PER_EL;
+  ARRAY_TYPE head_mask = ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+  ARRAY_TYPE tail_mask = ARRAY_TYPE_MAX >>
+                         (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL);
+
+  ptrdiff_t delta = (ptrdiff_t) src_from - (ptrdiff_t) from;
+  ARRAY_TYPE head_value = 0, tail_value = 0;
+  if (op == __RANGE_COPY) {
+    // load the edge values first, the copy may overlap with them
+    head_value = __load_bits(src, src_words,
+                             (ptrdiff_t) (first * BITS_PER_EL) + delta);
+    tail_value = __load_bits(src, src_words,
+                             (ptrdiff_t) (last * BITS_PER_EL) + delta);
+  }
+
+  // range within a single element
+  if (first == last) {
+    return __range_word(op, words + first, head_mask & tail_mask,
+                        head_value);
+  }
+
+  size_t n_body = last - first - 1;
+  ARRAY_TYPE *body = words + first + 1;
+  size_t result = 0;
+
+  switch (op) {
+    case __RANGE_SET:
+      memset(body, 0xff, n_body * TYPE_SIZE);
+      break;
+    case __RANGE_CLEAR:
+      memset(body, 0, n_body * TYPE_SIZE);
+      break;
+    case __RANGE_FLIP:
+      for (size_t i = 0; i < n_body; i++) {
+        body[i] = ~body[i];
+      }
+      break;
+    case __RANGE_COUNT:
+      result = __popcount_words(body, n_body);
+      break;
+    case __RANGE_TEST_ANY:
+      if (__range_word(op, words + first, head_mask, 0)) return 1;
+      if (__any_words(body, n_body, false)) return 1;
+      return __range_word(op, words + last, tail_mask, 0);
+    case __RANGE_TEST_ALL:
+      if (!__range_word(op, words + first, head_mask, 0)) return 0;
+      if (__any_words(body, n_body, true)) return 0;
+      return __range_word(op, words + last, tail_mask, 0);
+    case __RANGE_COPY: {
+      // copy back to front if the destination overlaps the source
+      // from behind (like memmove)
+      bool backwards = src == words && delta < 0;
+      if (backwards) {
+        __range_word(op, words + last, tail_mask, tail_value);
+        __copy_words(words, first + 1, last, src, src_words, delta, true);
+        __range_word(op, words + first, head_mask, head_value);
+      } else {
+        __range_word(op, words + first, head_mask, head_value);
+        __copy_words(words, first + 1, last, src, src_words, delta, false);
+        __range_word(op, words + last, tail_mask, tail_value);
+      }
+      return 0;
+    }
+  }
+
+  result += __range_word(op, words + first, head_mask, 0);
+  result += __range_word(op, words + last, tail_mask, 0);
+  return result;
+}
+
+// reverse the bits within each byte of x
+__ALWAYS_INLINE ARRAY_TYPE __reverse_byte_bits(ARRAY_TYPE x) {
+  const ARRAY_TYPE m1 = (ARRAY_TYPE) 0x5555555555555555ULL;
+  const ARRAY_TYPE m2 = (ARRAY_TYPE) 0x3333333333333333ULL;
+  const ARRAY_TYPE m4 = (ARRAY_TYPE) 0x0f0f0f0f0f0f0f0fULL;
+  x = ((x >> 1) & m1) | ((x & m1) << 1);
+  x = ((x >> 2) & m2) | ((x & m2) << 2);
+  return ((x >> 4) & m4) | ((x & m4) << 4);
+}
+
+__ALWAYS_INLINE ARRAY_TYPE __byte_swap(ARRAY_TYPE x) {
+#if ARRAY_TYPE_MAX == UINT64_MAX
+  return __builtin_bswap64(x);
+#else
+  return __builtin_bswap32(x);
+#endif
+}
+
+// reverse the bits of one element
+__ALWAYS_INLINE ARRAY_TYPE __reverse_word(ARRAY_TYPE x) {
+  return __byte_swap(__reverse_byte_bits(x));
+}
+
+#ifdef __BITARRAY_AVX512
+// reverse the bits within each byte
+__ALWAYS_INLINE __m512i __reverse_byte_bits_vec512(__m512i x) {
+#ifdef __GFNI__
+  // affine transform with the anti-diagonal matrix reverses each byte
+  return _mm512_gf2p8affine_epi64_epi8(
+      x, _mm512_set1_epi64(0x8040201008040201LL), 0);
+#else
+  const __m512i rev = _mm512_broadcast_i32x4(_mm_setr_epi8(
+      0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15));
+  const __m512i low_nibbles = _mm512_set1_epi8(0x0f);
+  __m512i lo = _mm512_shuffle_epi8(rev, _mm512_and_si512(x, low_nibbles));
+  __m512i hi = _mm512_shuffle_epi8(
+      rev, _mm512_and_si512(_mm512_srli_epi16(x, 4), low_nibbles));
+  return _mm512_or_si512(_mm512_slli_epi16(lo, 4), hi);
+#endif
+}
+
+// reverse the bits of 8 elements and their order
+__ALWAYS_INLINE __m512i __reverse_vec512(__m512i x) {
+  const __m512i bswap = _mm512_broadcast_i32x4(_mm_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+  x = _mm512_shuffle_epi8(__reverse_byte_bits_vec512(x), bswap);
+  return _mm512_permutexvar_epi64(
+      _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0), x);
+}
+#endif
+
+#ifdef __BITARRAY_AVX2
+// reverse the bits within each byte (nibble lookup table)
+__ALWAYS_INLINE __m256i __reverse_byte_bits_vec256(__m256i x) {
+  const __m256i rev = _mm256_setr_epi8(0, 8, 4, 12, 2, 10, 6, 14,
+                                       1, 9, 5, 13, 3, 11, 7, 15,
+                                       0, 8, 4, 12, 2, 10, 6, 14,
+                                       1, 9, 5, 13, 3, 11, 7, 15);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(rev, _mm256_and_si256(x, low_nibbles));
+  __m256i hi = _mm256_shuffle_epi8(
+      rev, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibbles));
+  return _mm256_or_si256(_mm256_slli_epi16(lo, 4), hi);
+}
+
+// reverse the bits of 4 elements and their order
+// (byte reversal, byte swap, element permutation)
+__ALWAYS_INLINE __m256i __reverse_vec256(__m256i x) {
+  const __m256i bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8);
+  x = _mm256_shuffle_epi8(__reverse_byte_bits_vec256(x), bswap);
+  return _mm256_permute4x64_epi64(x, 0x1b);
+}
+#endif
+
+// reverse words[0, n): the order of the elements and the bits of each
+// (vectors are swapped from both ends towards the middle)
+__ALWAYS_INLINE void __reverse_words(ARRAY_TYPE *words, size_t n) {
+  size_t lo = 0, hi = n;
+
+#if defined(__BITARRAY_AVX512)
+  for (; hi - lo >= 16; lo += 8, hi -= 8) {
+    __m512i a = _mm512_loadu_si512((const void*) (words + lo));
+    __m512i b = _mm512_loadu_si512((const void*) (words + hi - 8));
+    _mm512_storeu_si512((void*) (words + lo), __reverse_vec512(b));
+    _mm512_storeu_si512((void*) (words + hi - 8), __reverse_vec512(a));
+  }
+#elif defined(__BITARRAY_AVX2)
+  for (; hi - lo >= 8; lo += 4, hi -= 4) {
+    __m256i a = _mm256_loadu_si256((const __m256i*) (words + lo));
+    __m256i b = _mm256_loadu_si256((const __m256i*) (words + hi - 4));
+    _mm256_storeu_si256((__m256i*) (words + lo), __reverse_vec256(b));
+    _mm256_storeu_si256((__m256i*) (words + hi - 4), __reverse_vec256(a));
+  }
+#endif
+
+  for (; hi - lo >= 2; lo++, hi--) {
+    ARRAY_TYPE a = words[lo];
+    words[lo] = __reverse_word(words[hi - 1]);
+    words[hi - 1] = __reverse_word(a);
+  }
+  if (hi > lo) words[lo] = __reverse_word(words[lo]);
+}
+
+// byte order
+//
+// bitarray elements are native integers, so bit i of a buffer in
+// BITARRAY_LSB_FIRST order is where the library expects it on
+// little-endian CPUs; BITARRAY_MSB_FIRST needs the bits of every byte
+// reversed (and big-endian CPUs need the bytes of every element swapped).
+
+// convert n elements from src to dst (may be the same, neither needs to
+// be aligned) between the native layout and order (the conversion is its
+// own inverse)
+__ALWAYS_INLINE void __convert_bit_order(uint8_t *dst, const uint8_t *src,
+                                         size_t n,
+                                         enum bitarray_bit_order order) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  const bool swap = true;
+#else
+  const bool swap = false;
+  if (order == BITARRAY_LSB_FIRST) {
+    if (dst != src) memmove(dst, src, n * TYPE_SIZE);
+    return;
+  }
+#endif
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512)
+  if (!swap) {
+    for (; i + 8 <= n; i += 8) {
+      __m512i v = _mm512_loadu_si512((const void*) (src + i * TYPE_SIZE));
+      _mm512_storeu_si512((void*) (dst + i * TYPE_SIZE),
+                          __reverse_byte_bits_vec512(v));
+    }
+  }
+#elif defined(__BITARRAY_AVX2)
+  if (!swap) {
+    for (; i + 4 <= n; i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*) (src + i * TYPE_SIZE));
+      _mm256_storeu_si256((__m256i*) (dst + i * TYPE_SIZE),
+                          __reverse_byte_bits_vec256(v));
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    ARRAY_TYPE w;
+    memcpy(&w, src + i * TYPE_SIZE, TYPE_SIZE);
+    if (swap) w = __byte_swap(w);
+    if (order == BITARRAY_MSB_FIRST) w = __reverse_byte_bits(w);
+    memcpy(dst + i * TYPE_SIZE, &w, TYPE_SIZE);
+  }
+}
+
+// free the array of bit_array (unless the caller owns it), before it gets
+// a new (owned) one
+__ALWAYS_INLINE void __release_array(bitarray *bit_array) {
+  if (!bit_array->_borrowed) free(bit_array->array);
+  bit_array->_borrowed = false;
+}
+
+// comparison and hashing
+
+// check if a[0, n) and b[0, n) are equal (several vectors per check, so
+// the loop does one branch per 256/512 bytes)
+__ALWAYS_INLINE bool __equal_words(const ARRAY_TYPE *a, const ARRAY_TYPE *b,
+                                   size_t n) {
+  size_t i = 0;
+
+#if defined(__BITARRAY_AVX512)
+  for (; i + 32 <= n; i += 32) {
+    __m512i x = _mm512_setzero_si512();
+    for (size_t j = 0; j < 32; j += 8) {
+      x = _mm512_or_si512(x, _mm512_xor_si512(
+          _mm512_loadu_si512((const void*) (a + i + j)),
+          _mm512_loadu_si512((const void*) (b + i + j))));
+    }
+    if (_mm512_test_epi64_mask(x, x)) return false;
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*) (a + i)),
+                                 _mm512_loadu_si512((const void*) (b + i)));
+    if (_mm512_test_epi64_mask(x, x)) return false;
+  }
+#elif defined(__BITARRAY_AVX2)
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_setzero_si256();
+    for (size_t j = 0; j < 16; j += 4) {
+      x = _mm256_or_si256(x, _mm256_xor_si256(
+          _mm256_loadu_si256((const __m256i*) (a + i + j)),
+          _mm256_loadu_si256((const __m256i*) (b + i + j))));
+    }
+    if (!_mm256_testz_si256(x, x)) return false;
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i*) (a + i)),
+        _mm256_loadu_si256((const __m256i*) (b + i)));
+    if (!_mm256_testz_si256(x, x)) return false;
+  }
+#endif
+
+  return memcmp(a + i, b + i, (n - i) * TYPE_SIZE) == 0;
+}
+
+// mask of the bits of the last element of an n_bits bitarray
+__ALWAYS_INLINE ARRAY_TYPE __last_mask(size_t n_bits) {
+  return ARRAY_TYPE_MAX >> ((BITS_PER_EL - n_bits % BITS_PER_EL) %
+                            BITS_PER_EL);
+}
+
+#ifndef __BITARRAY_AES
+// 64x64 -> 128 bit multiply, folded (wyhash/mum)
+__ALWAYS_INLINE uint64_t __hash_mum(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+#endif
+
+// 128 bit hash of n_bits and the n_bits bits in words (the bits after
+// n_bits in the last element are masked off)
+__ALWAYS_INLINE void __hash_words(const ARRAY_TYPE *words, size_t n_bits,
+                                  uint64_t seed, uint64_t out[2]) {
+  size_t n = (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+  // whole pairs of elements before the last element, then the last one
+  // or two elements (masked) as a tail pair
+  size_t body = n ? (n - 1) & ~(size_t) 1 : 0;
+  uint64_t tail[2] = {0, 0};
+  for (size_t j = body; j < n; j++) tail[j - body] = words[j];
+  if (n) tail[n - 1 - body] &= __last_mask(n_bits);
+
+#ifdef __BITARRAY_AES
+  // two lanes of one AES round per 16 bytes (the data is the round key),
+  // finished with a few rounds with the seed as key
+  const __m128i k0 = _mm_set_epi64x(seed ^ 0x243f6a8885a308d3ULL,
+                                    n_bits ^ 0x13198a2e03707344ULL);
+  const __m128i k1 = _mm_set_epi64x(seed ^ 0xa4093822299f31d0ULL,
+                                    n_bits ^ 0x082efa98ec4e6c89ULL);
+  __m128i s0 = k0, s1 = k1;
+  size_t i = 0;
+  for (; i + 4 <= body; i += 4) {
+    s0 = _mm_aesenc_si128(s0, _mm_loadu_si128((const __m128i*) (words + i)));
+    s1 = _mm_aesenc_si128(s1,
+                          _mm_loadu_si128((const __m128i*) (words + i + 2)));
+  }
+  if (i < body) {
+    s0 = _mm_aesenc_si128(s0, _mm_loadu_si128((const __m128i*) (words + i)));
+  }
+  s1 = _mm_aesenc_si128(s1, _mm_loadu_si128((const __m128i*) tail));
+
+  __m128i h = _mm_aesenc_si128(s0, s1);
+  h = _mm_aesenc_si128(h, k0);
+  h = _mm_aesenc_si128(h, k1);
+  h = _mm_aesenc_si128(h, k0);
+  out[0] = (uint64_t) _mm_cvtsi128_si64(h);
+  out[1] = (uint64_t) _mm_extract_epi64(h, 1);
+#else
+  uint64_t h0 = seed ^ 0x243f6a8885a308d3ULL;
+  uint64_t h1 = n_bits ^ 0x13198a2e03707344ULL;
+  for (size_t i = 0; i < body; i += 2) {
+    uint64_t a = words[i], b = words[i + 1];
+    h0 = __hash_mum(a ^ 0xa4093822299f31d0ULL, b ^ h0);
+    h1 = __hash_mum(a ^ h1, b ^ 0x082efa98ec4e6c89ULL);
+  }
+  h0 = __hash_mum(tail[0] ^ 0xa4093822299f31d0ULL, tail[1] ^ h0);
+  h1 = __hash_mum(tail[0] ^ h1, tail[1] ^ 0x082efa98ec4e6c89ULL);
+  out[0] = __hash_mum(h0 ^ 0x452821e638d01377ULL, h1 ^ seed);
+  out[1] = __hash_mum(h1 ^ 0xbe5466cf34e90c6cULL, out[0] ^ n_bits);
+#endif
+}
+
+// extract/deposit
+//
+// one pext/pdep per element, with the extracted bits carried across
+// element boundaries. pext/pdep are microcoded on AMD Zen 1/2 (hundreds
+// of cycles); there, and without BMI2, the loops use __pext_word and
+// __pdep_word instead, which take one step per run of set mask bits.
+
+// bits of x at the positions set in m, packed into the low bits
+__ALWAYS_INLINE ARRAY_TYPE __pext_word(ARRAY_TYPE x, ARRAY_TYPE m) {
+  ARRAY_TYPE result = 0;
+  unsigned k = 0;
+  while (m) {
+    unsigned start = __builtin_ctzll(m);
+    ARRAY_TYPE run = ((m + (m & -m)) ^ m) & m;  // lowest run of set bits
+    result |= ((x & run) >> start) << k;
+    k += pop_count(run);
+    m ^= run;
+  }
+  return result;
+}
+
+// low bits of x, in order, at the positions set in m
+__ALWAYS_INLINE ARRAY_TYPE __pdep_word(ARRAY_TYPE x, ARRAY_TYPE m) {
+  ARRAY_TYPE result = 0;
+  unsigned k = 0;
+  while (m) {
+    unsigned start = __builtin_ctzll(m);
+    ARRAY_TYPE run = ((m + (m & -m)) ^ m) & m;
+    result |= ((x >> k) << start) & run;
+    k += pop_count(run);
+    m ^= run;
+  }
+  return result;
+}
+
+// whether pext/pdep should be used (checked once per process)
+static inline bool __fast_pdep(void) {
+#if defined(__BITARRAY_BMI2) && (defined(__x86_64__) || defined(__i386__))
+  static int fast = -1;
+  if (fast < 0) {
+    __builtin_cpu_init();
+    fast = !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+  }
+  return fast;
+#else
+  return false;
+#endif
+}
+
+__ALWAYS_INLINE ARRAY_TYPE __pext(ARRAY_TYPE x, ARRAY_TYPE m, bool hw) {
+#ifdef __BITARRAY_BMI2
+  if (hw) return _pext_u64(x, m);
+#endif
+  (void) hw;
+  return __pext_word(x, m);
+}
+
+__ALWAYS_INLINE ARRAY_TYPE __pdep(ARRAY_TYPE x, ARRAY_TYPE m, bool hw) {
+#ifdef __BITARRAY_BMI2
+  if (hw) return _pdep_u64(x, m);
+#endif
+  (void) hw;
+  return __pdep_word(x, m);
+}
+
+// pack the bits of src[0, n) selected by mask[0, n) into out
+// (hw is a constant at each call site, so each gets its own loop)
+__ALWAYS_INLINE void __extract_words(ARRAY_TYPE *out, const ARRAY_TYPE *src,
+                                     const ARRAY_TYPE *mask, size_t n,
+                                     bool hw) {
+  ARRAY_TYPE acc = 0;
+  unsigned acc_bits = 0;
+  for (size_t i = 0; i < n; i++) {
+    // (no branch on empty mask elements, they are unpredictable for
+    // sparse masks)
+    ARRAY_TYPE m = mask[i];
+    ARRAY_TYPE v = __pext(src[i], m, hw);
+    unsigned k = pop_count(m);
+    acc |= v << acc_bits;
+    if (acc_bits + k >= BITS_PER_EL) {
+      *out++ = acc;
+      acc = acc_bits ? v >> (BITS_PER_EL - acc_bits) : 0;
+      acc_bits = acc_bits + k - BITS_PER_EL;
+    } else {
+      acc_bits += k;
+    }
+  }
+  if (acc_bits) *out = acc;
+}
+
+// out[i] receives the next pop_count(mask[i]) bits of src at the
+// positions set in mask[i]
+__ALWAYS_INLINE void __deposit_words(ARRAY_TYPE *out, const ARRAY_TYPE *src,
+                                     size_t src_words,
+                                     const ARRAY_TYPE *mask, size_t n,
+                                     bool hw) {
+  size_t pos = 0;
+  for (size_t i = 0; i < n; i++) {
+    ARRAY_TYPE m = mask[i];
+    size_t idx = pos / BITS_PER_EL;
+    unsigned shift = pos % BITS_PER_EL;
+    // (funnel shift without a branch on shift == 0)
+    ARRAY_TYPE v = idx + 1 < src_words
+                   ? (src[idx] >> shift) |
+                     ((src[idx + 1] << 1) << (BITS_PER_EL - 1 - shift))
+                   : __load_bits(src, src_words, (ptrdiff_t) pos);
+    out[i] = __pdep(v, m, hw);
+    pos += pop_count(m);
+  }
+}
+
+// summary and counts (see attach_summary and attach_count)
+//
+// modifying functions report the elements they changed: single bits and
+// elements visited through the summary with __aux_word (old and new value
+// of one element), ranges with __aux_bits/__aux_all, which recompute the
+// summary bits of the elements from the bottom level up and recount their
+// blocks. the checks for an attached structure are inlined, the updates
+// aren't
+
+// summary levels of the largest arrays (2^58 elements)
+#define __SUMMARY_MAX_LEVELS 10
+
+// (the fields read by every update of a single element first)
+struct bitarray_aux {
+  uint32_t *block_counts;   // set bits per block (NULL: no counts)
+  size_t count;             // set bits (if block_counts isn't NULL)
+  unsigned block_shift;     // log2 of the elements per counted block
+  size_t n_levels;          // summary levels (0: no summary)
+  size_t n_blocks;
+  // bit w of levels[0] set if element w of the array isn't 0, bit w of
+  // levels[l] if element w of levels[l - 1] isn't 0
+  bitarray *levels[__SUMMARY_MAX_LEVELS];
+};
+
+// bit k set if words[k] isn't 0 (n <= BITS_PER_EL)
+__ALWAYS_INLINE ARRAY_TYPE __summary_nonzero(const ARRAY_TYPE *words,
+                                             size_t n) {
+  ARRAY_TYPE mask = 0;
+  size_t k = 0;
+
+#ifdef __BITARRAY_AVX512
+  for (; k + 8 <= n; k += 8) {
+    __m512i v = _mm512_loadu_si512((const void*) (words + k));
+    mask |= (ARRAY_TYPE) _mm512_test_epi64_mask(v, v) << k;
+  }
+#endif
+
+  for (; k < n; k++) {
+    mask |= (ARRAY_TYPE) (words[k] != 0) << k;
+  }
+  return mask;
+}
+
+// recompute the summary bits of the elements lo to hi (inclusive)
+static void __summary_update(bitarray *bit_array, size_t lo, size_t hi) {
+  bitarray_aux *aux = bit_array->_aux;
+  const ARRAY_TYPE *src = bit_array->array;
+  for (size_t l = 0; l < aux->n_levels; l++) {
+    bitarray *dst = aux->levels[l];
+    for (size_t j = lo / BITS_PER_EL; j <= hi / BITS_PER_EL; j++) {
+      size_t n = dst->size - j * BITS_PER_EL;
+      if (n > BITS_PER_EL) n = BITS_PER_EL;
+      dst->array[j] = __summary_nonzero(src + j * BITS_PER_EL, n);
+    }
+    lo /= BITS_PER_EL;
+    hi /= BITS_PER_EL;
+    src = dst->array;
+  }
+}
+
+// element w became non-zero
+static inline void __summary_mark(bitarray_aux *aux, size_t w) {
+  for (size_t l = 0; l < aux->n_levels; l++) {
+    ARRAY_TYPE *el = &aux->levels[l]->array[w / BITS_PER_EL];
+    bool was_set = *el != 0;
+    *el |= MASK_1 << (w % BITS_PER_EL);
+    if (was_set) return;
+    w /= BITS_PER_EL;
+  }
+}
+
+// element w became 0
+static inline void __summary_unmark(bitarray_aux *aux, size_t w) {
+  for (size_t l = 0; l < aux->n_levels; l++) {
+    ARRAY_TYPE *el = &aux->levels[l]->array[w / BITS_PER_EL];
+    *el &= ~(MASK_1 << (w % BITS_PER_EL));
+    if (*el) return;
+    w /= BITS_PER_EL;
+  }
+}
+
+// first set bit at or after i of level l (its size if there is none);
+// looks for the next non-zero element one level up if the element of i
+// has none
+static size_t __summary_next(bitarray_aux *aux, size_t l, size_t i) {
+  bitarray *level = aux->levels[l];
+  if (i >= level->size) return level->size;
+
+  ARRAY_TYPE el = level->array[i / BITS_PER_EL] &
+                  (ARRAY_TYPE_MAX << (i % BITS_PER_EL));
+  if (el) return i / BITS_PER_EL * BITS_PER_EL + __builtin_ctzll(el);
+  if (l + 1 == aux->n_levels) return level->size;
+
+  size_t e = __summary_next(aux, l + 1, i / BITS_PER_EL + 1);
+  if (e == aux->levels[l + 1]->size) return level->size;
+  return e * BITS_PER_EL + __builtin_ctzll(level->array[e]);
+}
+
+// first non-zero element at or after w (_array_size if there is none);
+// the common case (same element of level 0) is inlined
+__ALWAYS_INLINE size_t __summary_next_word(bitarray_aux *aux, size_t w) {
+  bitarray *level = aux->levels[0];
+  if (w < level->size) {
+    ARRAY_TYPE el = level->array[w / BITS_PER_EL] &
+                    (ARRAY_TYPE_MAX << (w % BITS_PER_EL));
+    if (el) return w / BITS_PER_EL * BITS_PER_EL + __builtin_ctzll(el);
+  }
+  return __summary_next(aux, 0, w);
+}
+
+// summary of bit_array (NULL if it has none)
+__ALWAYS_INLINE bitarray_aux* __summary_of(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  return __builtin_expect(aux != NULL, 0) && aux->n_levels ? aux : NULL;
+}
+
+// first set bit at or after pos (size if there is none), following the
+// summary over zero elements
+__ALWAYS_INLINE size_t __summary_next_bit(bitarray *bit_array,
+                                          bitarray_aux *aux, size_t pos) {
+  if (pos >= bit_array->size) return bit_array->size;
+
+  size_t w = pos / BITS_PER_EL;
+  ARRAY_TYPE x = bit_array->array[w] & (ARRAY_TYPE_MAX << (pos % BITS_PER_EL));
+  if (!x) {
+    w = __summary_next_word(aux, w + 1);
+    if (w >= bit_array->_array_size) return bit_array->size;
+    x = bit_array->array[w];
+  }
+  size_t p = w * BITS_PER_EL + __builtin_ctzll(x);
+  return p < bit_array->size ? p : bit_array->size;
+}
+
+// count (__RANGE_COUNT) or test (__RANGE_TEST_ANY) the bits [from, to)
+// within the blocks of BITS_PER_EL elements that have a non-zero one
+static size_t __summary_range(enum __range_op op, bitarray *bit_array,
+                              bitarray_aux *aux, size_t from, size_t to) {
+  if (from >= to) return 0;
+
+  const size_t block = BITS_PER_EL * BITS_PER_EL;
+  const ARRAY_TYPE *blocks = aux->levels[0]->array;
+  size_t last = (to - 1) / block;
+  size_t result = 0;
+  for (size_t j = __skip_words(blocks, from / block, last + 1, 0);
+       j <= last; j = __skip_words(blocks, j + 1, last + 1, 0)) {
+    size_t lo = j * block > from ? j * block : from;
+    size_t hi = (j + 1) * block < to ? (j + 1) * block : to;
+    result += __range_apply(op, bit_array->array, lo, hi, NULL, 0, 0);
+    if (op == __RANGE_TEST_ANY && result) return 1;
+  }
+  return result;
+}
+
+// create the summary levels of bit_array's elements (until one has at
+// most one element) and fill them
+static void __summary_build(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  size_t n = bit_array->_array_size;
+  aux->n_levels = 1;
+  for (size_t m = n; m > BITS_PER_EL; m = (m + BITS_PER_EL - 1) / BITS_PER_EL) {
+    aux->n_levels++;
+  }
+  assert(aux->n_levels <= __SUMMARY_MAX_LEVELS);
+  for (size_t l = 0; l < aux->n_levels; l++) {
+    aux->levels[l] = create_bitarray(n);
+    n = (n + BITS_PER_EL - 1) / BITS_PER_EL;
+  }
+  __summary_update(bit_array, 0, bit_array->_array_size - 1);
+}
+
+static void __summary_free(bitarray_aux *aux) {
+  for (size_t l = 0; l < aux->n_levels; l++) delete_bitarray(aux->levels[l]);
+  aux->n_levels = 0;
+}
+
+// cached counts of bit_array (NULL if it has none)
+__ALWAYS_INLINE bitarray_aux* __count_of(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  return __builtin_expect(aux != NULL, 0) && aux->block_counts ? aux : NULL;
+}
+
+// recount the blocks [lo, hi] and adjust the total
+static void __count_update(bitarray *bit_array, size_t lo, size_t hi) {
+  bitarray_aux *aux = bit_array->_aux;
+  for (size_t i = lo; i <= hi; i++) {
+    size_t w = i << aux->block_shift;
+    size_t n = bit_array->_array_size - w;
+    if (n > (size_t) 1 << aux->block_shift) n = (size_t) 1 << aux->block_shift;
+    size_t count = __popcount_words(bit_array->array + w, n);
+    aux->count += count - aux->block_counts[i];
+    aux->block_counts[i] = count;
+  }
+}
+
+// create the block counts of bit_array's elements (block_shift set) and
+// fill them
+static void __count_build(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  aux->n_blocks = ((bit_array->_array_size - 1) >> aux->block_shift) + 1;
+  aux->block_counts = (uint32_t*) calloc(aux->n_blocks, sizeof(uint32_t));
+  assert(aux->block_counts);
+  STAT_ALLOC(aux->n_blocks * sizeof(uint32_t));
+  aux->count = 0;
+  __count_update(bit_array, 0, aux->n_blocks - 1);
+}
+
+static void __count_free(bitarray_aux *aux) {
+  free(aux->block_counts);
+  aux->block_counts = NULL;
+  aux->n_blocks = 0;
+  aux->count = 0;
+}
+
+// set bits in [from, to): the counts of the covered blocks, the bits of
+// the partially covered ones (or the block count minus the smaller
+// uncovered part)
+static size_t __count_range(bitarray *bit_array, bitarray_aux *aux,
+                            size_t from, size_t to) {
+  if (from >= to) return 0;
+
+  const size_t block = BITS_PER_EL << aux->block_shift;
+  size_t count = 0;
+  for (size_t i = from / block; i <= (to - 1) / block; i++) {
+    size_t start = i * block;
+    size_t end = start + block < bit_array->size ? start + block
+                                                 : bit_array->size;
+    size_t lo = from > start ? from : start;
+    size_t hi = to < end ? to : end;
+    if (lo == start && hi == end) {
+      count += aux->block_counts[i];
+    } else if (2 * (hi - lo) <= end - start) {
+      count += __range_apply(__RANGE_COUNT, bit_array->array, lo, hi,
+                             NULL, 0, 0);
+    } else {
+      count += aux->block_counts[i] -
+               __range_apply(__RANGE_COUNT, bit_array->array, start, lo,
+                             NULL, 0, 0) -
+               __range_apply(__RANGE_COUNT, bit_array->array, hi, end,
+                             NULL, 0, 0);
+    }
+  }
+  return count;
+}
+
+// free bit_array's attached structures once none is left
+static void __aux_release(bitarray *bit_array) {
+  if (!bit_array->_aux->n_levels && !bit_array->_aux->block_counts) {
+    free(bit_array->_aux);
+    bit_array->_aux = NULL;
+  }
+}
+
+// summary bits of element w, which changed from old to now
+__NOINLINE void __summary_word(bitarray_aux *aux, size_t w, ARRAY_TYPE old,
+                               ARRAY_TYPE now) {
+  if (!old && now) {
+    __summary_mark(aux, w);
+  } else if (old && !now) {
+    __summary_unmark(aux, w);
+  }
+}
+
+// element w of bit_array (which has attached structures) changed from old
+// to now; the counts are adjusted inline, as single bit updates of counted
+// bitarrays are common
+__ALWAYS_INLINE void __aux_word_changed(bitarray *bit_array, size_t w,
+                                        ARRAY_TYPE old, ARRAY_TYPE now) {
+  bitarray_aux *aux = bit_array->_aux;
+  if (aux->block_counts) {
+    // (+-difference modulo 2^n)
+    size_t diff = (size_t) pop_count(now) - (size_t) pop_count(old);
+    aux->block_counts[w >> aux->block_shift] += diff;
+    aux->count += diff;
+  }
+  if (aux->n_levels) __summary_word(aux, w, old, now);
+}
+
+// element w of bit_array changed from old
+__ALWAYS_INLINE void __aux_word(bitarray *bit_array, size_t w,
+                                ARRAY_TYPE old) {
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_word_changed(bit_array, w, old, bit_array->array[w]);
+  }
+}
+
+__NOINLINE void __aux_elements_changed(bitarray *bit_array, size_t lo,
+                                        size_t hi) {
+  bitarray_aux *aux = bit_array->_aux;
+  // (functions may write to the elements after size, up to _array_size)
+  if (hi >= bit_array->_array_size) hi = bit_array->_array_size - 1;
+  if (aux->n_levels) __summary_update(bit_array, lo, hi);
+  if (aux->block_counts) {
+    __count_update(bit_array, lo >> aux->block_shift,
+                   hi >> aux->block_shift);
+  }
+}
+
+// bits [from, to) of bit_array changed
+__ALWAYS_INLINE void __aux_bits(bitarray *bit_array, size_t from, size_t to) {
+  if (__builtin_expect(bit_array->_aux != NULL, 0) && from < to) {
+    __aux_elements_changed(bit_array, from / BITS_PER_EL,
+                           (to - 1) / BITS_PER_EL);
+  }
+}
+
+// all elements of bit_array changed
+__ALWAYS_INLINE void __aux_all(bitarray *bit_array) {
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_elements_changed(bit_array, 0, bit_array->_array_size - 1);
+  }
+}
+
+// bit_array's size or array (and maybe all elements) changed
+static void __aux_resized(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  if (!aux) return;
+  if (aux->n_levels) {
+    if (aux->levels[0]->size == bit_array->_array_size) {
+      __summary_update(bit_array, 0, bit_array->_array_size - 1);
+    } else {
+      __summary_free(aux);
+      __summary_build(bit_array);
+    }
+  }
+  if (aux->block_counts) {
+    if (aux->n_blocks ==
+        ((bit_array->_array_size - 1) >> aux->block_shift) + 1) {
+      __count_update(bit_array, 0, aux->n_blocks - 1);
+    } else {
+      __count_free(aux);
+      __count_build(bit_array);
+    }
+  }
+}
+
+// set, clear or flip the bits [from, to) of a bitarray with attached
+// structures (out of line, so the path without them stays as it was)
+__NOINLINE void __aux_range_apply(enum __range_op op,
+                                   bitarray *bit_array, size_t from,
+                                   size_t to) {
+  bitarray_aux *summary = __summary_of(bit_array);
+  if (op == __RANGE_CLEAR && summary && from < to) {
+    // only the non-zero elements
+    size_t first = from / BITS_PER_EL, last = (to - 1) / BITS_PER_EL;
+    for (size_t w = __summary_next_word(summary, first); w <= last;
+         w = __summary_next_word(summary, w + 1)) {
+      ARRAY_TYPE mask = ARRAY_TYPE_MAX;
+      if (w == first) mask &= ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+      if (w == last) {
+        mask &= ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL);
+      }
+      ARRAY_TYPE old = bit_array->array[w];
+      bit_array->array[w] &= ~mask;
+      __aux_word(bit_array, w, old);
+    }
+    return;
+  }
+
+  bitarray_aux *counts = __count_of(bit_array);
+  if (counts && from < to) {
+    // the new count of a block follows from its old one and the count of
+    // the covered bits before the modification
+    const size_t block = BITS_PER_EL << counts->block_shift;
+    for (size_t i = from / block; i <= (to - 1) / block; i++) {
+      size_t start = i * block;
+      size_t lo = from > start ? from : start;
+      size_t hi = to < start + block ? to : start + block;
+      size_t old = counts->block_counts[i];
+      size_t covered = lo == start && hi == start + block
+                       ? old : __range_apply(__RANGE_COUNT, bit_array->array,
+                                             lo, hi, NULL, 0, 0);
+      __range_apply(op, bit_array->array, lo, hi, NULL, 0, 0);
+      size_t now = old - covered;
+      if (op == __RANGE_SET) now += hi - lo;
+      if (op == __RANGE_FLIP) now += hi - lo - covered;
+      counts->block_counts[i] = now;
+      counts->count += now - old;
+    }
+    if (summary) {
+      __summary_update(bit_array, from / BITS_PER_EL, (to - 1) / BITS_PER_EL);
+    }
+    return;
+  }
+
+  __range_apply(op, bit_array->array, from, to, NULL, 0, 0);
+  __aux_bits(bit_array, from, to);
+}
+
+enum __aux_binary_op {
+  __AUX_AND,
+  __AUX_OR,
+  __AUX_XOR
+};
+
+// left's elements [0, n) (op)= right's for a bitarray with attached
+// structures, a counted block (or 512 elements) at a time: each one is
+// recounted and summarized right after it's written, while it's in L1
+__NOINLINE void __aux_binary(enum __aux_binary_op op, bitarray *left,
+                             const ARRAY_TYPE *right, size_t n) {
+  bitarray_aux *aux = left->_aux;
+  size_t chunk = aux->block_counts ? (size_t) 1 << aux->block_shift : 512;
+  ARRAY_TYPE *l = left->array;
+  for (size_t from = 0; from < n; from += chunk) {
+    size_t to = from + chunk < n ? from + chunk : n;
+    if (op == __AUX_AND) {
+      for (size_t i = from; i < to; i++) l[i] &= right[i];
+    } else if (op == __AUX_OR) {
+      for (size_t i = from; i < to; i++) l[i] |= right[i];
+    } else {
+      for (size_t i = from; i < to; i++) l[i] ^= right[i];
+    }
+    __aux_elements_changed(left, from, to - 1);
+  }
+}
+
+// count_bits of a bitarray with a summary: the set bits of the blocks of
+// BITS_PER_EL elements with a non-zero one
+__NOINLINE size_t __summary_count_bits(bitarray *bit_array) {
+  bitarray_aux *aux = bit_array->_aux;
+  const ARRAY_TYPE *blocks = aux->levels[0]->array;
+  size_t n = aux->levels[0]->_array_size;
+  size_t count = 0;
+  for (size_t j = __skip_words(blocks, 0, n, 0); j < n;
+       j = __skip_words(blocks, j + 1, n, 0)) {
+    size_t w = j * BITS_PER_EL;
+    size_t m = bit_array->_array_size - w;
+    count += __popcount_words(bit_array->array + w,
+                              m < BITS_PER_EL ? m : BITS_PER_EL);
+  }
+  return count;
+}
+
 // get bit at idx
 bool get_bit(bitarray *bit_array, size_t idx) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
   assert(idx < bit_array->size);
@@ -24,6 +1510,8 @@ bool get_bit(bitarray *bit_array, size_t idx) {
   // position of bit at array index/value
   uint8_t offset = idx % BITS_PER_EL;
 
+  STAT_END(get_bit, 1);
+
   // left-shift 1 by offset and AND it with array value
   // if the bit is set, this will result in a positive number (==true)
   // if not, this will result i 0 (==false)
@@ -33,6 +1521,7 @@ bool get_bit(bitarray *bit_array, size_t idx) {
 // set functions
 
 void set_bit(bitarray *bit_array, size_t idx) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
   assert(idx < bit_array->size);
@@ -43,57 +1532,33 @@ void set_bit(bitarray *bit_array, size_t idx) {
   // position of bit at array index/value
   uint8_t offset = idx % BITS_PER_EL;
 
+  ARRAY_TYPE old = bit_array->array[array_idx];
+
   // OR array value in-place with 1 leftshifted by offset (will set the bit)
   bit_array->array[array_idx] |= (MASK_1 << offset);
+  __aux_word(bit_array, array_idx, old);
   assert(get_bit(bit_array, idx));
+  STAT_END(set_bit, 1);
 }
 
 void set_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
   assert(bit_array);
-  assert(bit_array->array && bit_array->size > 0);
-  assert(to <= bit_array->size);
-
-  // if the size of the bitarray is <= BITS_PER_EL,
-  // there is no more efficient way than to iterate
-  // over evey bit position and to set it
-  if (bit_array->size <= BITS_PER_EL || (to - from) <= BITS_PER_EL) {
-    for (size_t i = from; i < to; i++) {
-      set_bit(bit_array, i);
-    }
-    return;
-  }
-
-  // array index where bit at "from" lives
-  size_t array_idx_from = from / BITS_PER_EL;
-
-  // array index where bit at "to" lives
-  size_t array_idx_to = to / BITS_PER_EL;
-
-  // position of "from" bit at array index/value
-  uint8_t offset_from = from % BITS_PER_EL;
-
-  // position of "to" bit at array index/value
-  uint8_t offset_to = to % BITS_PER_EL;
-
-  size_t end_idx_from = from + (BITS_PER_EL - offset_from);
-  for (size_t i = from; i < end_idx_from; i++) {
-    set_bit(bit_array, i);
-  }
-
-  // set entire array value (BITS_PER_EL bits) to "true"
-  // without iterating over every bit position
-  for (size_t i = array_idx_from + 1; i < array_idx_to; i++) {
-    bit_array->array[i] = ARRAY_TYPE_MAX;
-  }
+  assert(bit_array->array && bit_array->size > 0);
+  assert(from <= to && to <= bit_array->size);
 
-  for (size_t i = to - offset_to; i < to; i++) {
-    set_bit(bit_array, i);
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_range_apply(__RANGE_SET, bit_array, from, to);
+  } else {
+    __range_apply(__RANGE_SET, bit_array->array, from, to, NULL, 0, 0);
   }
 
   assert(count_bit_range(bit_array, from, to) == (to - from));
+  STAT_END(set_bit_range, to - from);
 }
 
 void set_all_bits(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
 
@@ -105,17 +1570,22 @@ void set_all_bits(bitarray *bit_array) {
   size_t capacity = bit_array->_array_size * BITS_PER_EL;
   size_t size = bit_array->size;
 
+  // (clear_bit_range may follow the summary)
+  __aux_all(bit_array);
+
   // temporarily increase size to capacity (this is safe here)
   bit_array->size = capacity;
   clear_bit_range(bit_array, size, capacity);
   bit_array->size = size;  // change it back
 
   assert(count_bits(bit_array) == bit_array->size);
+  STAT_END(set_all_bits, bit_array->size);
 }
 
 // flip/invert functions
 
 void flip_bit(bitarray *bit_array, size_t idx) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
   assert(idx < bit_array->size);
@@ -126,55 +1596,31 @@ void flip_bit(bitarray *bit_array, size_t idx) {
   // position of bit at array index/value
   uint8_t offset = idx % BITS_PER_EL;
 
+  ARRAY_TYPE old = bit_array->array[array_idx];
+
   // XOR array value in-place with 1 leftshifted by offset
   // (will flip the bit)
   bit_array->array[array_idx] ^= (MASK_1 << offset);
+  __aux_word(bit_array, array_idx, old);
+  STAT_END(flip_bit, 1);
 }
 
 void flip_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
-  assert(to <= bit_array->size);
-
-  // if the size of the bitarray is <= BITS_PER_EL,
-  // there is no more efficient way than to iterate
-  // over evey bit position and to flip it
-  if (bit_array->size <= BITS_PER_EL || (to - from) <= BITS_PER_EL) {
-    for (size_t i = from; i < to; i++) {
-      flip_bit(bit_array, i);
-    }
-    return;
-  }
-
-  // array index where bit at "from" lives
-  size_t array_idx_from = from / BITS_PER_EL;
-
-  // array index where bit at "to" lives
-  size_t array_idx_to = to / BITS_PER_EL;
-
-  // position of "from" bit at array index/value
-  uint8_t offset_from = from % BITS_PER_EL;
-
-  // position of "to" bit at array index/value
-  uint8_t offset_to = to % BITS_PER_EL;
-
-  size_t end_idx_from = from + (BITS_PER_EL - offset_from);
-  for (size_t i = from; i < end_idx_from; i++) {
-    flip_bit(bit_array, i);
-  }
-
-  // flip entire array value (BITS_PER_EL bits)
-  // without iterating over every bit position
-  for (size_t i = array_idx_from + 1; i < array_idx_to; i++) {
-    bit_array->array[i] = ~(bit_array->array[i]);
-  }
+  assert(from <= to && to <= bit_array->size);
 
-  for (size_t i = to - offset_to; i < to; i++) {
-    flip_bit(bit_array, i);
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_range_apply(__RANGE_FLIP, bit_array, from, to);
+  } else {
+    __range_apply(__RANGE_FLIP, bit_array->array, from, to, NULL, 0, 0);
   }
+  STAT_END(flip_bit_range, to - from);
 }
 
 void flip_all_bits(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
 
@@ -185,75 +1631,169 @@ void flip_all_bits(bitarray *bit_array) {
   // keep free bits cleared
   size_t capacity = bit_array->_array_size * BITS_PER_EL;
   size_t size = bit_array->size;
+  __aux_all(bit_array);
   bit_array->size = capacity;
   clear_bit_range(bit_array, size, capacity);
   bit_array->size = size;
+  STAT_END(flip_all_bits, bit_array->size);
 }
 
 // count functions
 
 size_t count_bits(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
 
-  size_t count = 0;
-  for (size_t i = 0; i < bit_array->_array_size; i++) {
+  size_t count;
+  bitarray_aux *aux = bit_array->_aux;
+  if (__builtin_expect(aux != NULL, 0)) {
+    count = aux->block_counts ? aux->count : __summary_count_bits(bit_array);
+  } else {
     // use machine-optimized popcount function for max speed
-    count += pop_count(bit_array->array[i]);
+    count = __popcount_words(bit_array->array, bit_array->_array_size);
   }
 
+  STAT_END(count_bits, bit_array->size);
   return count;
 }
 
 size_t count_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
-  assert(to <= bit_array->size);
+  assert(from <= to && to <= bit_array->size);
+
+  size_t count;
+  bitarray_aux *summary = __summary_of(bit_array);
+  bitarray_aux *counts = __count_of(bit_array);
+  if (counts) {
+    count = __count_range(bit_array, counts, from, to);
+  } else if (summary) {
+    count = __summary_range(__RANGE_COUNT, bit_array, summary, from, to);
+  } else {
+    count = __range_apply(__RANGE_COUNT, bit_array->array, from, to, NULL,
+                          0, 0);
+  }
 
-  size_t count = 0;
-  // if the size of the bitarray is <= BITS_PER_EL,
-  // there is no more efficient way than to iterate
-  // over evey bit position and to count it
-  if (bit_array->size <= BITS_PER_EL || (to - from) <= BITS_PER_EL) {
-    for (size_t i = from; i < to; i++) {
-      count += get_bit(bit_array, i);
+  STAT_END(count_bit_range, to - from);
+  return count;
+}
+
+bool test_any_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(from <= to && to <= bit_array->size);
+
+  bitarray_aux *summary = __summary_of(bit_array);
+  bool any = summary ? __summary_range(__RANGE_TEST_ANY, bit_array, summary,
+                                       from, to)
+                     : __range_apply(__RANGE_TEST_ANY, bit_array->array,
+                                     from, to, NULL, 0, 0);
+
+  STAT_END(test_any_bit_range, to - from);
+  return any;
+}
+
+bool test_all_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(from <= to && to <= bit_array->size);
+
+  bool all = __range_apply(__RANGE_TEST_ALL, bit_array->array, from, to,
+                           NULL, 0, 0);
+
+  STAT_END(test_all_bit_range, to - from);
+  return all;
+}
+
+size_t find_clear_run(bitarray *bit_array, size_t k, size_t start) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+
+  size_t pos = __find_run(bit_array->array, bit_array->size, k, start,
+                          ARRAY_TYPE_MAX);
+
+  size_t end = pos == SIZE_MAX ? bit_array->size : pos + k;
+  STAT_END(find_clear_run, end > start ? end - start : 0);
+  return pos;
+}
+
+size_t find_set_run(bitarray *bit_array, size_t k, size_t start) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+
+  size_t pos;
+  bitarray_aux *summary = __summary_of(bit_array);
+  if (summary && k) {
+    // the runs one by one, jumping over zero elements
+    size_t n_bits = bit_array->size;
+    pos = __summary_next_bit(bit_array, summary, start);
+    while (k > 1 && pos < n_bits) {
+      size_t end = __next_bit(bit_array->array, n_bits, pos, ARRAY_TYPE_MAX);
+      if (end - pos >= k) break;
+      pos = __summary_next_bit(bit_array, summary, end);
     }
-    return count;
+    if (pos >= n_bits) pos = SIZE_MAX;
+  } else {
+    pos = __find_run(bit_array->array, bit_array->size, k, start, 0);
   }
 
-  // array index where bit at "from" lives
-  size_t array_idx_from = from / BITS_PER_EL;
+  size_t end = pos == SIZE_MAX ? bit_array->size : pos + k;
+  STAT_END(find_set_run, end > start ? end - start : 0);
+  return pos;
+}
+
+size_t longest_clear_run(bitarray *bit_array, size_t from, size_t to,
+                         size_t *pos) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(from <= to && to <= bit_array->size);
+
+  size_t len = __longest_run(bit_array->array, from, to, ARRAY_TYPE_MAX,
+                             pos);
 
-  // array index where bit at "to" lives
-  size_t array_idx_to = to / BITS_PER_EL;
+  STAT_END(longest_clear_run, to - from);
+  return len;
+}
 
-  // position of "from" bit at array index/value
-  uint8_t offset_from = from % BITS_PER_EL;
+size_t longest_set_run(bitarray *bit_array, size_t from, size_t to,
+                       size_t *pos) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(from <= to && to <= bit_array->size);
 
-  // position of "to" bit at array index/value
-  uint8_t offset_to = to % BITS_PER_EL;
+  size_t len = __longest_run(bit_array->array, from, to, 0, pos);
 
-  size_t end_idx_from = from + (BITS_PER_EL - offset_from);
-  for (size_t i = from; i < end_idx_from; i++) {
-    count += get_bit(bit_array, i);
-  }
+  STAT_END(longest_set_run, to - from);
+  return len;
+}
 
-  // get popcount of entire array value
-  // without iterating over every bit position
-  for (size_t i = array_idx_from + 1; i < array_idx_to; i++) {
-    count += pop_count(bit_array->array[i]);
-  }
+size_t next_set_run(bitarray *bit_array, size_t pos, size_t *end) {
+  STAT_BEGIN();
+  assert(bit_array && end);
+  assert(bit_array->array && bit_array->size > 0);
 
-  for (size_t i = to - offset_to; i < to; i++) {
-    count += get_bit(bit_array, i);
-  }
+  size_t n_bits = bit_array->size;
+  bitarray_aux *summary = __summary_of(bit_array);
+  size_t start = summary ? __summary_next_bit(bit_array, summary, pos)
+                         : __next_bit(bit_array->array, n_bits, pos, 0);
+  *end = __next_bit(bit_array->array, n_bits, start, ARRAY_TYPE_MAX);
 
-  return count;
+  STAT_END(next_set_run, *end > pos ? *end - pos : 0);
+  return start;
 }
 
 // clear functions
 
 void clear_bit(bitarray *bit_array, size_t idx) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
   assert(idx < bit_array->size);
@@ -264,71 +1804,181 @@ void clear_bit(bitarray *bit_array, size_t idx) {
   // position of bit at array index/value
   uint8_t offset = idx % BITS_PER_EL;
 
+  ARRAY_TYPE old = bit_array->array[array_idx];
+
   // AND array value in-place with 1 leftshifted by offset FLIPPED
   // (the flip turns 100000 int 011111, which will clear the 0 bit after AND)
   bit_array->array[array_idx] &= ~(MASK_1 << offset);
+  __aux_word(bit_array, array_idx, old);
   assert(!get_bit(bit_array, idx));
+  STAT_END(clear_bit, 1);
 }
 
 void clear_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array && bit_array->size > 0);
-  assert(to <= bit_array->size);
+  assert(from <= to && to <= bit_array->size);
 
-  // if the size of the bitarray is <= BITS_PER_EL,
-  // there is no more efficient way than to iterate
-  // over evey bit position and to clear it
-  if (bit_array->size <= BITS_PER_EL || (to - from) <= BITS_PER_EL) {
-    for (size_t i = from; i < to; i++) {
-      clear_bit(bit_array, i);
-    }
-    return;
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_range_apply(__RANGE_CLEAR, bit_array, from, to);
+  } else {
+    __range_apply(__RANGE_CLEAR, bit_array->array, from, to, NULL, 0, 0);
   }
 
-  // array index where bit at "from" lives
-  size_t array_idx_from = from / BITS_PER_EL;
+  assert(count_bit_range(bit_array, from, to) == 0);
+  STAT_END(clear_bit_range, to - from);
+}
+
+void clear_all_bits(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->_array_size > 0);
 
-  // array index where bit at "to" lives
-  size_t array_idx_to = to / BITS_PER_EL;
+  for (size_t i = 0; i < bit_array->_array_size; i++) {
+    bit_array->array[i] = 0;
+  }
+  __aux_all(bit_array);
 
-  // position of "from" bit at array index/value
-  uint8_t offset_from = from % BITS_PER_EL;
+  assert(count_bits(bit_array) == 0);
+  STAT_END(clear_all_bits, bit_array->size);
+}
 
-  // position of "to" bit at array index/value
-  uint8_t offset_to = to % BITS_PER_EL;
+// batch engine
+//
+// set_bits/clear_bits/get_bits prefetch the element of idx[i +
+// __BATCH_PREFETCH] while processing idx[i], so many cache misses are in
+// flight at once instead of one per call (and there is no call per bit).
+// the positions are processed in the given order: bucketing them by
+// region first (or gathering 8 elements at once with AVX-512) was slower
+// than the plain prefetched loop for every size the benchmark covers.
+
+enum __batch_op {
+  __BATCH_SET,
+  __BATCH_CLEAR,
+  __BATCH_GET
+};
+
+// positions processed before their element is needed
+#define __BATCH_PREFETCH 32
+
+// bits at idx[0, m) (m <= BITS_PER_EL) as one element; prefetches the
+// elements of positions up to idx[left)
+__ALWAYS_INLINE ARRAY_TYPE __batch_get_word(const ARRAY_TYPE *words,
+                                            const size_t *idx, size_t m,
+                                            size_t left) {
+  ARRAY_TYPE res = 0;
+  for (size_t j = 0; j < m; j++) {
+    if (j + __BATCH_PREFETCH < left) {
+      __builtin_prefetch(words + idx[j + __BATCH_PREFETCH] / BITS_PER_EL, 0);
+    }
+    res |= ((words[idx[j] / BITS_PER_EL] >> (idx[j] % BITS_PER_EL)) &
+            MASK_1) << j;
+  }
+  return res;
+}
 
-  size_t end_idx_from = from + (BITS_PER_EL - offset_from);
-  for (size_t i = from; i < end_idx_from; i++) {
-    clear_bit(bit_array, i);
+__ALWAYS_INLINE void __batch_apply(enum __batch_op op, ARRAY_TYPE *words,
+                                   const size_t *idx, size_t n,
+                                   ARRAY_TYPE *out) {
+  if (op == __BATCH_GET) {
+    // results are collected and written one element (of out) at a time
+    size_t i = 0;
+    for (; i + BITS_PER_EL <= n; i += BITS_PER_EL) {
+      out[i / BITS_PER_EL] = __batch_get_word(words, idx + i, BITS_PER_EL,
+                                              n - i);
+    }
+    if (i < n) {
+      ARRAY_TYPE keep = ARRAY_TYPE_MAX << (n - i);
+      out[i / BITS_PER_EL] = (out[i / BITS_PER_EL] & keep) |
+                             __batch_get_word(words, idx + i, n - i, n - i);
+    }
+    return;
   }
 
-  // flip entire array value (BITS_PER_EL bits)
-  // without iterating over every bit position
-  for (size_t i = array_idx_from + 1; i < array_idx_to; i++) {
-    bit_array->array[i] = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i + __BATCH_PREFETCH < n) {
+      __builtin_prefetch(words + idx[i + __BATCH_PREFETCH] / BITS_PER_EL, 1);
+    }
+    ARRAY_TYPE mask = MASK_1 << (idx[i] % BITS_PER_EL);
+    if (op == __BATCH_SET) {
+      words[idx[i] / BITS_PER_EL] |= mask;
+    } else {
+      words[idx[i] / BITS_PER_EL] &= ~mask;
+    }
   }
+}
 
-  for (size_t i = to - offset_to; i < to; i++) {
-    clear_bit(bit_array, i);
+// set or clear the bits at idx[0, n) one by one, reporting every element
+static void __aux_batch(enum __batch_op op, bitarray *bit_array,
+                        const size_t *idx, size_t n) {
+  ARRAY_TYPE *words = bit_array->array;
+  for (size_t i = 0; i < n; i++) {
+    size_t w = idx[i] / BITS_PER_EL;
+    ARRAY_TYPE old = words[w];
+    ARRAY_TYPE mask = MASK_1 << (idx[i] % BITS_PER_EL);
+    words[w] = op == __BATCH_SET ? old | mask : old & ~mask;
+    if (words[w] != old) __aux_word_changed(bit_array, w, old, words[w]);
   }
+}
 
-  assert(count_bit_range(bit_array, from, to) == 0);
+#ifndef NDEBUG
+// check that idx[0, n) are positions of bit_array
+static bool __batch_valid(bitarray *bit_array, const size_t *idx, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (idx[i] >= bit_array->size) return false;
+  }
+  return true;
 }
+#endif
 
-void clear_all_bits(bitarray *bit_array) {
+void set_bits(bitarray *bit_array, const size_t *idx, size_t n) {
+  STAT_BEGIN();
   assert(bit_array);
-  assert(bit_array->array && bit_array->_array_size > 0);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(idx || !n);
+  assert(__batch_valid(bit_array, idx, n));
 
-  for (size_t i = 0; i < bit_array->_array_size; i++) {
-    bit_array->array[i] = 0;
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_batch(__BATCH_SET, bit_array, idx, n);
+  } else {
+    __batch_apply(__BATCH_SET, bit_array->array, idx, n, NULL);
   }
+  STAT_END(set_bits, n);
+}
 
-  assert(count_bits(bit_array) == 0);
+void clear_bits(bitarray *bit_array, const size_t *idx, size_t n) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(idx || !n);
+  assert(__batch_valid(bit_array, idx, n));
+
+  if (__builtin_expect(bit_array->_aux != NULL, 0)) {
+    __aux_batch(__BATCH_CLEAR, bit_array, idx, n);
+  } else {
+    __batch_apply(__BATCH_CLEAR, bit_array->array, idx, n, NULL);
+  }
+  STAT_END(clear_bits, n);
+}
+
+void get_bits(bitarray *bit_array, const size_t *idx, size_t n,
+              bitarray *out) {
+  STAT_BEGIN();
+  assert(bit_array && out);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(out->array && out->size >= n);
+  assert(idx || !n);
+  assert(__batch_valid(bit_array, idx, n));
+
+  __batch_apply(__BATCH_GET, bit_array->array, idx, n, out->array);
+  STAT_END(get_bits, n);
 }
 
 // bitwise operations (in-place)
 
 void and_bits_inplace(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size && right->size);
 
@@ -338,12 +1988,29 @@ void and_bits_inplace(bitarray *left, bitarray *right) {
     exit(1);
   }
 
-  for (size_t i = 0; i < left->_array_size; i++) {
-    left->array[i] &= right->array[i];
+  // only the elements that hold bits (right's array may be smaller)
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  bitarray_aux *summary = __summary_of(left);
+  if (summary) {
+    // (only left's non-zero elements can change)
+    for (size_t i = __summary_next_word(summary, 0); i < n;
+         i = __summary_next_word(summary, i + 1)) {
+      ARRAY_TYPE old = left->array[i];
+      left->array[i] &= right->array[i];
+      __aux_word(left, i, old);
+    }
+  } else if (__builtin_expect(left->_aux != NULL, 0)) {
+    __aux_binary(__AUX_AND, left, right->array, n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      left->array[i] &= right->array[i];
+    }
   }
+  STAT_END(and_bits_inplace, left->size);
 }
 
 void or_bits_inplace(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size == right->size);
 
@@ -353,12 +2020,29 @@ void or_bits_inplace(bitarray *left, bitarray *right) {
     exit(1);
   }
 
-  for (size_t i = 0; i < left->_array_size; i++) {
-    left->array[i] |= right->array[i];
+  // only the elements that hold bits (right's array may be smaller)
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  bitarray_aux *summary = left != right ? __summary_of(right) : NULL;
+  if (summary) {
+    // (only the elements where right is non-zero change)
+    for (size_t i = __summary_next_word(summary, 0); i < n;
+         i = __summary_next_word(summary, i + 1)) {
+      ARRAY_TYPE old = left->array[i];
+      left->array[i] |= right->array[i];
+      __aux_word(left, i, old);
+    }
+  } else if (__builtin_expect(left->_aux != NULL, 0)) {
+    __aux_binary(__AUX_OR, left, right->array, n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      left->array[i] |= right->array[i];
+    }
   }
+  STAT_END(or_bits_inplace, left->size);
 }
 
 void xor_bits_inplace(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size && right->size);
 
@@ -368,55 +2052,188 @@ void xor_bits_inplace(bitarray *left, bitarray *right) {
     exit(1);
   }
 
-  for (size_t i = 0; i < left->_array_size; i++) {
-    left->array[i] ^= right->array[i];
+  // only the elements that hold bits (right's array may be smaller)
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  bitarray_aux *summary = left != right ? __summary_of(right) : NULL;
+  if (summary) {
+    // (only the elements where right is non-zero change)
+    for (size_t i = __summary_next_word(summary, 0); i < n;
+         i = __summary_next_word(summary, i + 1)) {
+      ARRAY_TYPE old = left->array[i];
+      left->array[i] ^= right->array[i];
+      __aux_word(left, i, old);
+    }
+  } else if (__builtin_expect(left->_aux != NULL, 0)) {
+    __aux_binary(__AUX_XOR, left, right->array, n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      left->array[i] ^= right->array[i];
+    }
   }
+  STAT_END(xor_bits_inplace, left->size);
 }
 
 void not_bits_inplace(bitarray *bit_array) {
+  STAT_BEGIN();
   flip_all_bits(bit_array);
+  STAT_END(not_bits_inplace, bit_array->size);
 }
 
 void right_shift_bits_inplace(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size);
   assert(n <= bit_array->size);
-  if (!n) return;
-
-  // probably not the most efficient way of doing it,
-  // but simply append the bits after the shift to a new (cleared) bitarray
-  // and swap the array ptr of the input bitarray
-  bitarray *tmp = create_bitarray(bit_array->size);
-  tmp->size = 0;
-  append_bit_range(bit_array, tmp, n, bit_array->size);
-
-  ARRAY_TYPE *old = bit_array->array;
-  bit_array->array = tmp->array;
+  if (!n) {
+    STAT_END(right_shift_bits_inplace, 0);
+    return;
+  }
 
-  free(old);
-  free(tmp);
+  // move the bits down within the array and clear the vacated ones
+  size_t size = bit_array->size;
+  __range_apply(__RANGE_COPY, bit_array->array, 0, size - n,
+                bit_array->array, bit_array->_array_size, n);
+  __range_apply(__RANGE_CLEAR, bit_array->array, size - n, size, NULL, 0, 0);
+  __aux_all(bit_array);
+  STAT_END(right_shift_bits_inplace, bit_array->size);
 }
 
 void left_shift_bits_inplace(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size);
   assert(n <= bit_array->size);
-  if (!n) return;
+  if (!n) {
+    STAT_END(left_shift_bits_inplace, 0);
+    return;
+  }
+
+  // move the bits up within the array and clear the vacated ones
+  size_t size = bit_array->size;
+  __range_apply(__RANGE_COPY, bit_array->array, n, size,
+                bit_array->array, bit_array->_array_size, 0);
+  __range_apply(__RANGE_CLEAR, bit_array->array, 0, n, NULL, 0, 0);
+  __aux_all(bit_array);
+  STAT_END(left_shift_bits_inplace, bit_array->size);
+}
+
+// rotate [from, to) so that bit from + i receives bit
+// from + (i + k) % (to - from) (0 < k < to - from): the smaller of the
+// two parts is saved, the larger one moved (overlapping) with
+// __range_apply and the saved part copied behind/before it
+static void __rotate_range(bitarray *bit_array, size_t from, size_t to,
+                           size_t k) {
+  ARRAY_TYPE *words = bit_array->array;
+  size_t n_words = bit_array->_array_size;
+  size_t len = to - from;
+  bool head = k <= len - k;  // save [from, from + k) (else the rest)
+  size_t saved_bits = head ? k : len - k;
+
+  ARRAY_TYPE stack_tmp[64];
+  size_t tmp_words = (saved_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+  ARRAY_TYPE *tmp = stack_tmp;
+  if (tmp_words > 64) {
+    tmp = (ARRAY_TYPE*) malloc(tmp_words * TYPE_SIZE);
+    assert(tmp);
+    STAT_ALLOC(tmp_words * TYPE_SIZE);
+  }
+
+  if (head) {
+    __range_apply(__RANGE_COPY, tmp, 0, k, words, n_words, from);
+    __range_apply(__RANGE_COPY, words, from, to - k, words, n_words,
+                  from + k);
+    __range_apply(__RANGE_COPY, words, to - k, to, tmp, tmp_words, 0);
+  } else {
+    __range_apply(__RANGE_COPY, tmp, 0, len - k, words, n_words, from + k);
+    __range_apply(__RANGE_COPY, words, from + len - k, to, words, n_words,
+                  from);
+    __range_apply(__RANGE_COPY, words, from, from + len - k, tmp,
+                  tmp_words, 0);
+  }
+
+  if (tmp != stack_tmp) free(tmp);
+}
+
+void rotate_left(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
+  assert(bit_array);
+  rotate_left_bit_range(bit_array, 0, bit_array->size, n);
+  STAT_END(rotate_left, bit_array->size);
+}
+
+void rotate_right(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
+  assert(bit_array);
+  rotate_right_bit_range(bit_array, 0, bit_array->size, n);
+  STAT_END(rotate_right, bit_array->size);
+}
+
+void rotate_left_bit_range(bitarray *bit_array, size_t from, size_t to,
+                           size_t n) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(from <= to && to <= bit_array->size);
+
+  size_t len = to - from;
+  if (len && n % len) {
+    __rotate_range(bit_array, from, to, len - n % len);
+    __aux_bits(bit_array, from, to);
+  }
+  STAT_END(rotate_left_bit_range, len);
+}
+
+void rotate_right_bit_range(bitarray *bit_array, size_t from, size_t to,
+                            size_t n) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(from <= to && to <= bit_array->size);
+
+  size_t len = to - from;
+  if (len && n % len) {
+    __rotate_range(bit_array, from, to, n % len);
+    __aux_bits(bit_array, from, to);
+  }
+  STAT_END(rotate_right_bit_range, len);
+}
 
-  // probably not the most efficient way of doing it,
-  // but simply append the bits after the shift to a new (cleared) bitarray
-  // and swap the array ptr of the input bitarray
-  bitarray *tmp = create_bitarray(bit_array->size);
-  tmp->size = n;
-  append_bit_range(bit_array, tmp, 0, bit_array->size - n);
+void reverse_bits(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
+  reverse_bit_range(bit_array, 0, bit_array->size);
+  STAT_END(reverse_bits, bit_array->size);
+}
 
-  ARRAY_TYPE *old = bit_array->array;
-  bit_array->array = tmp->array;
+void reverse_bit_range(bitarray *bit_array, size_t from, size_t to) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(from <= to && to <= bit_array->size);
+  if (to - from < 2) {
+    STAT_END(reverse_bit_range, 0);
+    return;
+  }
 
-  free(old);
-  free(tmp);
+  ARRAY_TYPE *words = bit_array->array;
+  size_t first = from / BITS_PER_EL;
+  size_t last = (to - 1) / BITS_PER_EL;
+  ARRAY_TYPE first_word = words[first], last_word = words[last];
+
+  // after reversing the elements first to last, the bits of the last
+  // element after the range come first, then the reversed range
+  __reverse_words(words + first, last - first + 1);
+  size_t start = first * BITS_PER_EL + ((last + 1) * BITS_PER_EL - to);
+  __range_apply(__RANGE_COPY, words, from, to, words,
+                bit_array->_array_size, start);
+
+  // restore the bits outside the range that the reversal moved
+  ARRAY_TYPE head_mask = (MASK_1 << (from % BITS_PER_EL)) - 1;
+  ARRAY_TYPE tail_mask = ARRAY_TYPE_MAX << ((to - 1) % BITS_PER_EL) << 1;
+  words[first] = (words[first] & ~head_mask) | (first_word & head_mask);
+  words[last] = (words[last] & ~tail_mask) | (last_word & tail_mask);
+  __aux_bits(bit_array, from, to);
+  STAT_END(reverse_bit_range, to - from);
 }
 
 // bitwise operations
 bitarray* and_bits(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size && right->size);
 
@@ -428,14 +2245,17 @@ bitarray* and_bits(bitarray *left, bitarray *right) {
 
   bitarray *b = copy_bitarray(left);
 
-  for (size_t i = 0; i < left->_array_size; i++) {
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  for (size_t i = 0; i < n; i++) {
     b->array[i] &= right->array[i];
   }
 
+  STAT_END(and_bits, left->size);
   return b;
 }
 
 bitarray* or_bits(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size && right->size);
 
@@ -447,14 +2267,17 @@ bitarray* or_bits(bitarray *left, bitarray *right) {
 
   bitarray *b = copy_bitarray(left);
 
-  for (size_t i = 0; i < left->_array_size; i++) {
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  for (size_t i = 0; i < n; i++) {
     b->array[i] |= right->array[i];
   }
 
+  STAT_END(or_bits, left->size);
   return b;
 }
 
 bitarray* xor_bits(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size && right->size);
 
@@ -466,179 +2289,324 @@ bitarray* xor_bits(bitarray *left, bitarray *right) {
 
   bitarray *b = copy_bitarray(left);
 
-  for (size_t i = 0; i < left->_array_size; i++) {
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  for (size_t i = 0; i < n; i++) {
     b->array[i] ^= right->array[i];
   }
 
+  STAT_END(xor_bits, left->size);
   return b;
 }
 
 bitarray* not_bits(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size);
 
   bitarray *b = copy_bitarray(bit_array);
   flip_all_bits(b);
 
+  STAT_END(not_bits, bit_array->size);
   return b;
 }
 
 bitarray* right_shift_bits(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size);
   assert(n <= bit_array->size);
-  if (!n) return bit_array;
+  if (!n) {
+    STAT_END(right_shift_bits, 0);
+    return bit_array;
+  }
 
   bitarray *b = create_bitarray(bit_array->size);
   b->size = 0;
   append_bit_range(bit_array, b, n, bit_array->size);
   b->size += n;
 
+  STAT_END(right_shift_bits, bit_array->size);
   return b;
 }
 
 bitarray* left_shift_bits(bitarray *bit_array, size_t n) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size);
   assert(n <= bit_array->size);
-  if (!n) return bit_array;
+  if (!n) {
+    STAT_END(left_shift_bits, 0);
+    return bit_array;
+  }
 
   bitarray *b = create_bitarray(bit_array->size);
   b->size = n;
   append_bit_range(bit_array, b, 0, bit_array->size - n);
 
+  STAT_END(left_shift_bits, bit_array->size);
   return b;
 }
 
 // copy functions
 
 void copy_all_bits(bitarray *src, bitarray *dest) {
+  STAT_BEGIN();
   assert(src && dest);
 
-  if (!(dest->array)) {
-    dest->array = (ARRAY_TYPE*) malloc(src->_array_size * TYPE_SIZE);
-  }
-
-  if (dest->_array_size < src->_array_size) {
-    free(dest->array);
+  if (!(dest->array) || dest->_array_size < src->_array_size) {
+    if (dest->array) __release_array(dest);
     dest->array = (ARRAY_TYPE*) malloc(src->_array_size * TYPE_SIZE);
+    assert(dest->array);
+    STAT_ALLOC(src->_array_size * TYPE_SIZE);
     dest->_array_size = src->_array_size;
   }
 
-  assert(src->_array_size == dest->_array_size);
-
   for (size_t i = 0; i < src->_array_size; i++) {
     dest->array[i] = src->array[i];
   }
 
+  // keep the elements after the copied ones cleared
+  // (dest's array may be larger, e.g. if src wraps a buffer)
+  for (size_t i = src->_array_size; i < dest->_array_size; i++) {
+    dest->array[i] = 0;
+  }
+
   dest->size = src->size;
+  __aux_resized(dest);
+  STAT_END(copy_all_bits, src->size);
 }
 
 void copy_bit_range(bitarray *src, bitarray *dest,
                     size_t from, size_t to) {
+  STAT_BEGIN();
   assert(src && dest);
-  assert(to <= src->size);
+  assert(from <= to && to <= src->size);
+
+  size_t n_bits = to - from;
+  size_t old_size = dest->array ? dest->size : 0;
 
-  if (!(dest->array) || dest->size < (to - from)) {
-    if (dest->array) free(dest->array);
-    size_t array_size = __bitarray_size(to - from);
+  if (!(dest->array) || dest->_array_size * BITS_PER_EL < n_bits) {
+    if (dest->array) __release_array(dest);
+    size_t array_size = __bitarray_size(n_bits);
     dest->array = (ARRAY_TYPE*) calloc(array_size, TYPE_SIZE);
+    STAT_ALLOC(array_size * TYPE_SIZE);
     dest->_array_size = array_size;
+    old_size = 0;
   }
 
-  dest->size = to - from;
+  dest->size = n_bits;
 
-  if (src->size <= BITS_PER_EL || (to - from) <= BITS_PER_EL) {
-    for (size_t i = from; i < to; i++) {
-      if (get_bit(src, i)) {
-        set_bit(dest, i - from);
-      } else {
-        clear_bit(dest, i - from);
-      }
-    }
+  __range_apply(__RANGE_COPY, dest->array, 0, n_bits,
+                src->array, src->_array_size, from);
+
+  // keep the bits after the copied range cleared
+  if (old_size > n_bits) {
+    __range_apply(__RANGE_CLEAR, dest->array, n_bits, old_size, NULL, 0, 0);
+  }
+  __aux_resized(dest);
+  STAT_END(copy_bit_range, to - from);
+}
+
+void append_all_bits(bitarray *src, bitarray *dest) {
+  STAT_BEGIN();
+  assert(src && dest);
+
+  if (!(src->size)) {
+    STAT_END(append_all_bits, 0);
     return;
   }
 
-  // array index where bit at "from" lives
-  size_t array_idx_from = from / BITS_PER_EL;
+  append_bit_range(src, dest, 0, src->size);
+  STAT_END(append_all_bits, src->size);
+}
 
-  // array index where bit at "to" lives
-  size_t array_idx_to = to / BITS_PER_EL;
+void append_bit_range(bitarray *src, bitarray *dest,
+                      size_t from, size_t to) {
+  STAT_BEGIN();
+  assert(src && dest);
+  assert(from <= to && to <= src->size);
 
-  // position of "from" bit at array index/value
-  uint8_t offset_from = from % BITS_PER_EL;
+  if (!(src->size) || from == to) {
+    STAT_END(append_bit_range, 0);
+    return;
+  }
 
-  // position of "to" bit at array index/value
-  uint8_t offset_to = to % BITS_PER_EL;
+  size_t capacity = dest->_array_size * BITS_PER_EL;
+  size_t old_size = dest->size;
+  size_t new_size = old_size + (to - from);
 
-  size_t end_idx_from = from + (BITS_PER_EL - offset_from);
+  if (new_size > capacity) {
+    // grow geometrically so repeated appends stay cheap
+    size_t new_array_size = __bitarray_size(new_size);
+    if (new_array_size < 2 * dest->_array_size) {
+      new_array_size = 2 * dest->_array_size;
+    }
 
-  for (size_t i = from; i < end_idx_from; i++) {
-    if (get_bit(src, i)) {
-      set_bit(dest, i);
+    if (dest->_borrowed) {
+      // (the caller owns the array, the bits move to an owned one)
+      ARRAY_TYPE *array = (ARRAY_TYPE*) malloc(new_array_size * TYPE_SIZE);
+      assert(array);
+      memcpy(array, dest->array, dest->_array_size * TYPE_SIZE);
+      dest->array = array;
+      dest->_borrowed = false;
     } else {
-      clear_bit(dest, i);
+      dest->array = (ARRAY_TYPE*) realloc(dest->array,
+                                          new_array_size * TYPE_SIZE);
+      assert(dest->array);
     }
+    STAT_ALLOC((new_array_size - dest->_array_size) * TYPE_SIZE);
+    memset(dest->array + dest->_array_size, 0,
+           (new_array_size - dest->_array_size) * TYPE_SIZE);
+    dest->_array_size = new_array_size;
   }
 
-  // copy entire array value (BITS_PER_EL bits)
-  // without iterating over every bit position
-  for (size_t i = array_idx_from + 1; i < array_idx_to; i++) {
-    dest->array[i] = src->array[i];
+  // (src may be dest, so its array pointer is read after the realloc)
+  __range_apply(__RANGE_COPY, dest->array, old_size, new_size,
+                src->array, src->_array_size, from);
+  dest->size = new_size;
+  if (new_size > capacity) {
+    __aux_resized(dest);
+  } else {
+    __aux_bits(dest, old_size, new_size);
   }
+  STAT_END(append_bit_range, to - from);
+}
 
-  for (size_t i = to - offset_to; i < to; i++) {
-    if (get_bit(src, i)) {
-      set_bit(dest, i);
-    } else {
-      clear_bit(dest, i);
-    }
+void extract_bits(bitarray *dest, bitarray *src, bitarray *mask) {
+  STAT_BEGIN();
+  assert(dest && src && mask);
+  assert(src->size == mask->size);
+
+  size_t n_words = (mask->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t n_bits = __popcount_words(mask->array, n_words);
+  size_t old_size = dest->array ? dest->size : 0;
+
+  if (!(dest->array) || dest->_array_size * BITS_PER_EL < n_bits) {
+    if (dest->array) __release_array(dest);
+    size_t array_size = __bitarray_size(n_bits);
+    dest->array = (ARRAY_TYPE*) calloc(array_size, TYPE_SIZE);
+    STAT_ALLOC(array_size * TYPE_SIZE);
+    dest->_array_size = array_size;
+    old_size = 0;
+  }
+
+  // (dest may be src or mask: element i of dest is written after
+  // element i of both was read)
+  if (__fast_pdep()) {
+    __extract_words(dest->array, src->array, mask->array, n_words, true);
+  } else {
+    __extract_words(dest->array, src->array, mask->array, n_words, false);
+  }
+  dest->size = n_bits;
+
+  // keep the bits after the extracted ones cleared
+  if (old_size > n_bits) {
+    __range_apply(__RANGE_CLEAR, dest->array, n_bits, old_size, NULL, 0, 0);
   }
+  __aux_resized(dest);
+  STAT_END(extract_bits, mask->size);
 }
 
-void append_all_bits(bitarray *src, bitarray *dest) {
-  assert(src && dest);
+void deposit_bits(bitarray *dest, bitarray *src, bitarray *mask) {
+  STAT_BEGIN();
+  assert(dest && src && mask);
+  assert(dest->size == mask->size);
+  assert(dest != src);
+
+  size_t n_words = (mask->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  if (__fast_pdep()) {
+    __deposit_words(dest->array, src->array, src->_array_size, mask->array,
+                    n_words, true);
+  } else {
+    __deposit_words(dest->array, src->array, src->_array_size, mask->array,
+                    n_words, false);
+  }
+  __aux_all(dest);
+  STAT_END(deposit_bits, mask->size);
+}
 
-  if (!(src->size)) return;
+// summary
 
-  append_bit_range(src, dest, 0, src->size);
+void attach_summary(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+
+  if (!bit_array->_aux) {
+    bit_array->_aux = (bitarray_aux*) calloc(1, sizeof(bitarray_aux));
+    assert(bit_array->_aux);
+    STAT_ALLOC(sizeof(bitarray_aux));
+  }
+  if (!bit_array->_aux->n_levels) __summary_build(bit_array);
+  STAT_END(attach_summary, bit_array->size);
 }
 
-void append_bit_range(bitarray *src, bitarray *dest,
-                      size_t from, size_t to) {
-  assert(src && dest);
-  assert(to <= src->size);
+void detach_summary(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
 
-  if (!(src->size)) return;
+  if (bit_array->_aux) {
+    __summary_free(bit_array->_aux);
+    __aux_release(bit_array);
+  }
+  STAT_END(detach_summary, bit_array->size);
+}
 
-  size_t capacity = dest->_array_size * BITS_PER_EL;
-  size_t free_bits = capacity - dest->size;
-  size_t old_size = dest->size;
-  dest->size += (to - from);
+// count caching
 
-  if (src->size > free_bits) {
-    size_t new_array_size = dest->_array_size +
-                            (src->size / BITS_PER_EL + 1);
+void attach_count(bitarray *bit_array, size_t block_bytes) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(block_bytes >= TYPE_SIZE && !(block_bytes & (block_bytes - 1)));
+  assert(block_bytes * 8 <= UINT32_MAX);
 
-    dest->array = (ARRAY_TYPE*) realloc(dest->array, new_array_size);
-    dest->_array_size = new_array_size;
-    clear_bit_range(dest, old_size, dest->size);
+  if (!bit_array->_aux) {
+    bit_array->_aux = (bitarray_aux*) calloc(1, sizeof(bitarray_aux));
+    assert(bit_array->_aux);
+    STAT_ALLOC(sizeof(bitarray_aux));
+  }
+  bitarray_aux *aux = bit_array->_aux;
+  unsigned shift = __builtin_ctzll(block_bytes / TYPE_SIZE);
+  if (aux->block_counts && aux->block_shift != shift) __count_free(aux);
+  if (!aux->block_counts) {
+    aux->block_shift = shift;
+    __count_build(bit_array);
   }
+  STAT_END(attach_count, bit_array->size);
+}
+
+void detach_count(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
 
-  for (size_t i = from, j = old_size; i < to; i++, j++) {
-    if (get_bit(src, i)) set_bit(dest, j);
+  if (bit_array->_aux) {
+    __count_free(bit_array->_aux);
+    __aux_release(bit_array);
   }
+  STAT_END(detach_count, bit_array->size);
+}
+
+void refresh_bitarray(bitarray *bit_array) {
+  STAT_BEGIN();
+  assert(bit_array);
+
+  __aux_resized(bit_array);
+  STAT_END(refresh_bitarray, bit_array->size);
 }
 
 bitarray* copy_bitarray(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array && bit_array->size > 0);
 
   bitarray *b = create_bitarray(bit_array->size);
   copy_all_bits(bit_array, b);
 
+  STAT_END(copy_bitarray, bit_array->size);
   return b;
 }
 
 // "constructor" functions
 
 bitarray* create_bitarray(size_t n_bits) {
+  STAT_BEGIN();
   size_t array_size = __bitarray_size(n_bits);
   assert(array_size > 0);
   bitarray *b = (bitarray*) malloc(sizeof(bitarray));
@@ -647,16 +2615,21 @@ bitarray* create_bitarray(size_t n_bits) {
   // zero-initialize the memory so every bit is set to 0
   b->array = (ARRAY_TYPE*) calloc(array_size, TYPE_SIZE);
   assert(b->array);
+  STAT_ALLOC(sizeof(bitarray) + array_size * TYPE_SIZE);
 
   b->size = n_bits;
   b->_array_size = array_size;
+  b->_borrowed = false;
+  b->_aux = NULL;
 
   assert(count_bits(b) == 0);
 
+  STAT_END(create_bitarray, n_bits);
   return b;
 }
 
 bitarray* create_set_bitarray(size_t n_bits) {
+  STAT_BEGIN();
   size_t array_size = __bitarray_size(n_bits);
   assert(array_size > 0);
   bitarray *b = (bitarray*) malloc(sizeof(bitarray));
@@ -664,6 +2637,7 @@ bitarray* create_set_bitarray(size_t n_bits) {
 
   b->array = (ARRAY_TYPE*) malloc(array_size * TYPE_SIZE);
   assert(b->array);
+  STAT_ALLOC(sizeof(bitarray) + array_size * TYPE_SIZE);
 
   // set all bits
   for (size_t i = 0; i < array_size; i++) {
@@ -672,6 +2646,8 @@ bitarray* create_set_bitarray(size_t n_bits) {
 
   b->size = n_bits;
   b->_array_size = array_size;
+  b->_borrowed = false;
+  b->_aux = NULL;
 
   // clear the bits after n_bits so only bits < n_bits are set
   size_t capacity = b->_array_size * BITS_PER_EL;
@@ -683,10 +2659,12 @@ bitarray* create_set_bitarray(size_t n_bits) {
 
   assert(count_bits(b) == b->size);
 
+  STAT_END(create_set_bitarray, n_bits);
   return b;
 }
 
 bitarray* create_bitarray_from_str(const char *str, size_t str_len) {
+  STAT_BEGIN();
   size_t array_size = __bitarray_size(str_len);
   assert(array_size > 0);
   bitarray *b = (bitarray*) malloc(sizeof(bitarray));
@@ -694,9 +2672,12 @@ bitarray* create_bitarray_from_str(const char *str, size_t str_len) {
 
   b->array = (ARRAY_TYPE*) calloc(array_size, TYPE_SIZE);
   assert(b->array);
+  STAT_ALLOC(sizeof(bitarray) + array_size * TYPE_SIZE);
 
   b->size = str_len;
   b->_array_size = array_size;
+  b->_borrowed = false;
+  b->_aux = NULL;
 
   // add 1s and 0s in reverse order so the rightmost bit
   // lives at idx 0 and so on...
@@ -707,39 +2688,167 @@ bitarray* create_bitarray_from_str(const char *str, size_t str_len) {
     }
   }
 
+  STAT_END(create_bitarray_from_str, str_len);
   return b;
 }
 
 bitarray* create_bitarray_from_num(ARRAY_TYPE num) {
+  STAT_BEGIN();
   bitarray *b = (bitarray*) malloc(sizeof(bitarray));
   assert(b);
 
   b->array = (ARRAY_TYPE*) malloc(TYPE_SIZE);
   assert(b->array);
+  STAT_ALLOC(sizeof(bitarray) + TYPE_SIZE);
 
   b->array[0] = num;
 
   b->size = BITS_PER_EL;
   b->_array_size = 1;
+  b->_borrowed = false;
+  b->_aux = NULL;
 
+  STAT_END(create_bitarray_from_num, BITS_PER_EL);
   return b;
 }
 
 ARRAY_TYPE convert_bitarray_to_num(bitarray* bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->size > 0 && bit_array->size <= BITS_PER_EL);
+  STAT_END(convert_bitarray_to_num, bit_array->size);
   return bit_array->array[0];
 }
 
+bitarray* create_bitarray_from_intervals(size_t n_bits,
+                                         const bitarray_interval *intervals,
+                                         size_t n_intervals) {
+  STAT_BEGIN();
+  assert(intervals || !n_intervals);
+  bitarray *b = create_bitarray(n_bits);
+
+  for (size_t i = 0; i < n_intervals; i++) {
+    size_t from = intervals[i].start, to = intervals[i].end;
+    assert(from <= to && to <= n_bits);
+    if (from == to) continue;
+
+    // (short intervals are mostly within one element)
+    if (from / BITS_PER_EL == (to - 1) / BITS_PER_EL) {
+      b->array[from / BITS_PER_EL] |=
+        (ARRAY_TYPE_MAX << (from % BITS_PER_EL)) &
+        (ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 - (to - 1) % BITS_PER_EL));
+    } else {
+      __range_apply(__RANGE_SET, b->array, from, to, NULL, 0, 0);
+    }
+  }
+
+  STAT_END(create_bitarray_from_intervals, n_bits);
+  return b;
+}
+
+size_t convert_bitarray_to_intervals(bitarray *bit_array,
+                                     bitarray_interval *intervals,
+                                     size_t max_intervals) {
+  STAT_BEGIN();
+  assert(bit_array);
+  assert(bit_array->array && bit_array->size > 0);
+  assert(intervals || !max_intervals);
+
+  size_t n = __collect_runs(bit_array->array, bit_array->size, intervals,
+                            max_intervals);
+
+  STAT_END(convert_bitarray_to_intervals, bit_array->size);
+  return n;
+}
+
+bitarray* wrap_bitarray(ARRAY_TYPE *array, size_t n_bits, bool owned) {
+  STAT_BEGIN();
+  assert(array && n_bits > 0);
+  bitarray *b = (bitarray*) malloc(sizeof(bitarray));
+  assert(b);
+  STAT_ALLOC(sizeof(bitarray));
+
+  b->array = array;
+  b->size = n_bits;
+  b->_array_size = (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+  b->_borrowed = !owned;
+  b->_aux = NULL;
+
+  // clear the bits after n_bits
+  if (n_bits % BITS_PER_EL) {
+    b->array[b->_array_size - 1] &= ARRAY_TYPE_MAX >>
+                                    (BITS_PER_EL - n_bits % BITS_PER_EL);
+  }
+
+  STAT_END(wrap_bitarray, n_bits);
+  return b;
+}
+
+bitarray* wrap_bitarray_bytes(uint8_t *bytes, size_t n_bytes, size_t n_bits,
+                              enum bitarray_bit_order order, bool owned) {
+  STAT_BEGIN();
+  assert(bytes && n_bits > 0);
+  assert(n_bits <= n_bytes * 8);
+
+  size_t n_words = (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+  bitarray *b;
+  if ((uintptr_t) bytes % TYPE_SIZE == 0 && n_bytes >= n_words * TYPE_SIZE) {
+    __convert_bit_order(bytes, bytes, n_words, order);
+    b = wrap_bitarray((ARRAY_TYPE*) bytes, n_bits, owned);
+  } else {
+    ARRAY_TYPE *array = (ARRAY_TYPE*) calloc(n_words, TYPE_SIZE);
+    assert(array);
+    STAT_ALLOC(n_words * TYPE_SIZE);
+    memcpy(array, bytes, (n_bits + 7) / 8);
+    __convert_bit_order((uint8_t*) array, (const uint8_t*) array, n_words,
+                        order);
+    if (owned) free(bytes);
+    b = wrap_bitarray(array, n_bits, true);
+  }
+
+  STAT_END(wrap_bitarray_bytes, n_bits);
+  return b;
+}
+
+void copy_bitarray_to_bytes(bitarray *bit_array, uint8_t *bytes,
+                            enum bitarray_bit_order order) {
+  STAT_BEGIN();
+  assert(bit_array && bytes);
+
+  size_t n_bytes = (bit_array->size + 7) / 8;
+  size_t n_words = n_bytes / TYPE_SIZE;
+  __convert_bit_order(bytes, (const uint8_t*) bit_array->array, n_words,
+                      order);
+
+  // last partial element
+  if (n_bytes % TYPE_SIZE) {
+    ARRAY_TYPE w;
+    __convert_bit_order((uint8_t*) &w,
+                        (const uint8_t*) (bit_array->array + n_words), 1,
+                        order);
+    memcpy(bytes + n_words * TYPE_SIZE, &w, n_bytes % TYPE_SIZE);
+  }
+  STAT_END(copy_bitarray_to_bytes, bit_array->size);
+}
+
 // "destructor" functions
 void delete_bitarray(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array);
-  free(bit_array->array);
+  size_t n_bits = bit_array->size;
+  if (bit_array->_aux) {
+    __summary_free(bit_array->_aux);
+    __count_free(bit_array->_aux);
+    free(bit_array->_aux);
+  }
+  if (!bit_array->_borrowed) free(bit_array->array);
   free(bit_array);
+  STAT_END(delete_bitarray, n_bits);
 }
 
 void print_bitarray(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array);
 
@@ -747,14 +2856,17 @@ void print_bitarray(bitarray *bit_array) {
     printf("%d", get_bit(bit_array, i));
   }
   printf("\n");
+  STAT_END(print_bitarray, bit_array->size);
 }
 
 char* create_str_from_bitarray(bitarray *bit_array) {
+  STAT_BEGIN();
   assert(bit_array);
   assert(bit_array->array);
 
   size_t size = bit_array->size + 1;
   char* str = (char*) malloc(size * sizeof(char));
+  STAT_ALLOC(size * sizeof(char));
 
   size_t i, j;
   for (j = 0, i = bit_array->size; i-- > 0; j++) {
@@ -764,18 +2876,41 @@ char* create_str_from_bitarray(bitarray *bit_array) {
   str[j] = '\0';
   assert(strlen(str) == bit_array->size);
 
+  STAT_END(create_str_from_bitarray, bit_array->size);
   return str;
 }
 
 bool equal_bits(bitarray *left, bitarray *right) {
+  STAT_BEGIN();
   assert(left && right);
   assert(left->size == right->size);
 
-  for (size_t i = 0; i < left->_array_size; i++) {
-    if (left->array[i] != right->array[i]) {
-      return false;
-    }
-  }
+  // only the elements that hold bits (the arrays may differ in size,
+  // e.g. for the rows of a bitmatrix), the last one masked
+  size_t n = (left->size + BITS_PER_EL - 1) / BITS_PER_EL;
+  bool equal = n == 0 ||
+               (__equal_words(left->array, right->array, n - 1) &&
+                !((left->array[n - 1] ^ right->array[n - 1]) &
+                  __last_mask(left->size)));
 
-  return true;
+  STAT_END(equal_bits, left->size);
+  return equal;
+}
+
+uint64_t hash_bits(bitarray *bit_array, uint64_t seed) {
+  STAT_BEGIN();
+  assert(bit_array);
+
+  uint64_t h[2];
+  __hash_words(bit_array->array, bit_array->size, seed, h);
+  STAT_END(hash_bits, bit_array->size);
+  return h[0];
+}
+
+void hash_bits128(bitarray *bit_array, uint64_t seed, uint64_t out[2]) {
+  STAT_BEGIN();
+  assert(bit_array && out);
+
+  __hash_words(bit_array->array, bit_array->size, seed, out);
+  STAT_END(hash_bits128, bit_array->size);
 }
@@ -3,11 +3,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 
+#ifdef BITARRAY_STATS
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
 // 32 bit
 // #define ARRAY_TYPE uint32_t
 // #define ARRAY_TYPE_MAX UINT32_MAX
@@ -24,12 +34,55 @@
 #define MASK_1 1UL
 #define pop_count __builtin_popcountl
 
+// the SIMD kernels operate on 64 bit array elements and are used
+// if the compiler targets a CPU that supports them (e.g. -march=native)
+#if ARRAY_TYPE_MAX == UINT64_MAX && defined(__AVX2__)
+#define __BITARRAY_AVX2
+#include <immintrin.h>
+#endif
+#if ARRAY_TYPE_MAX == UINT64_MAX && defined(__AVX512F__) && \
+    defined(__AVX512BW__)
+#define __BITARRAY_AVX512
+#endif
+#if ARRAY_TYPE_MAX == UINT64_MAX && defined(__BMI2__)
+#define __BITARRAY_BMI2
+#include <immintrin.h>
+#endif
+#if ARRAY_TYPE_MAX == UINT64_MAX && defined(__AES__) && defined(__SSE4_1__)
+#define __BITARRAY_AES
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// structures attached to a bitarray that its functions keep up to date
+// (see attach_summary)
+typedef struct bitarray_aux bitarray_aux;
+
 typedef struct {
   size_t size;         // number of bits this bitarray contains
   size_t _array_size;  // number of elements the underlying array contains
   ARRAY_TYPE *array;   // pointer to the start of the array
+  bool _borrowed;      // array is owned by the caller (see wrap_bitarray)
+  bitarray_aux *_aux;  // attached structures (NULL if there are none)
 } bitarray;
 
+// layout of the bits in a byte buffer (see wrap_bitarray_bytes)
+enum bitarray_bit_order {
+  BITARRAY_LSB_FIRST,  // bit i is bit i % 8 of byte i / 8 (this library's
+                       // layout on little-endian CPUs)
+  BITARRAY_MSB_FIRST   // bit i is bit 7 - i % 8 of byte i / 8 (e.g. numpy
+                       // packbits, most network protocols)
+};
+
+// bits [start, end) (see convert_bitarray_to_intervals)
+typedef struct {
+  size_t start;
+  size_t end;
+} bitarray_interval;
+
 // figure out how many array elements are needed to store n_bits bits
 size_t __bitarray_size(size_t n_bits);
 
@@ -48,7 +101,7 @@ void set_all_bits(bitarray *bit_array);
 // flip/invert bit at idx
 void flip_bit(bitarray *bit_array, size_t idx);
 
-// flip/invert bits in range [from, to]
+// flip/invert bits in range [from, to)
 void flip_bit_range(bitarray *bit_array, size_t from, size_t to);
 
 // flip/invert all bits (~)
@@ -60,6 +113,37 @@ size_t count_bits(bitarray *bit_array);
 // count true bits in range [from, to)
 size_t count_bit_range(bitarray *bit_array, size_t from, size_t to);
 
+// check if any bit in range [from, to) is set
+bool test_any_bit_range(bitarray *bit_array, size_t from, size_t to);
+
+// check if all bits in range [from, to) are set
+bool test_all_bit_range(bitarray *bit_array, size_t from, size_t to);
+
+// first position p >= start with bits [p, p + k) all unset (SIZE_MAX if
+// there is none), e.g. k free blocks in an allocation map
+size_t find_clear_run(bitarray *bit_array, size_t k, size_t start);
+
+// first position p >= start with bits [p, p + k) all set (SIZE_MAX if
+// there is none)
+size_t find_set_run(bitarray *bit_array, size_t k, size_t start);
+
+// length of the longest run of unset bits in range [from, to); its (first)
+// start is stored in *pos if pos isn't NULL (SIZE_MAX if there is none)
+size_t longest_clear_run(bitarray *bit_array, size_t from, size_t to,
+                         size_t *pos);
+
+// length of the longest run of set bits in range [from, to) (see
+// longest_clear_run)
+size_t longest_set_run(bitarray *bit_array, size_t from, size_t to,
+                       size_t *pos);
+
+// run of set bits that contains pos or is the first one after it: returns
+// its start (pos if bit pos is set) and stores its end in *end; returns
+// bit_array->size if there is none. iterate over all runs with
+// for (size_t start = next_set_run(b, 0, &end); start < b->size;
+//      start = next_set_run(b, end, &end))
+size_t next_set_run(bitarray *bit_array, size_t pos, size_t *end);
+
 // clear bit at idx
 void clear_bit(bitarray *bit_array, size_t idx);
 
@@ -69,6 +153,21 @@ void clear_bit_range(bitarray *bit_array, size_t from, size_t to);
 // clear/reset all bits to "false"
 void clear_all_bits(bitarray *bit_array);
 
+// batch functions (bits at n arbitrary positions; memory is prefetched
+// ahead, which is faster than n single-bit calls on bitarrays that don't
+// fit in cache)
+
+// set bits at idx[0], ..., idx[n - 1]
+void set_bits(bitarray *bit_array, const size_t *idx, size_t n);
+
+// clear bits at idx[0], ..., idx[n - 1]
+void clear_bits(bitarray *bit_array, const size_t *idx, size_t n);
+
+// get bits at idx[0], ..., idx[n - 1]; bit i of out is set to the bit at
+// idx[i] (out must hold at least n bits, its other bits are unchanged)
+void get_bits(bitarray *bit_array, const size_t *idx, size_t n,
+              bitarray *out);
+
 // bitwise operations (in-place)
 
 // perform bitwise AND (&=) on left bitarray in-place
@@ -90,6 +189,25 @@ void right_shift_bits_inplace(bitarray *bit_array, size_t n);
 // perform left shift (<<=) in bitarray in-place
 void left_shift_bits_inplace(bitarray *bit_array, size_t n);
 
+// rotate bits in-place: bit i moves to position (i + n) % size
+// (rotate_left, the direction of left_shift_bits_inplace) or
+// (i - n) % size (rotate_right); n may exceed the size
+void rotate_left(bitarray *bit_array, size_t n);
+void rotate_right(bitarray *bit_array, size_t n);
+
+// rotate the bits in range [from, to) in-place (like rotate_left and
+// rotate_right within the range)
+void rotate_left_bit_range(bitarray *bit_array, size_t from, size_t to,
+                           size_t n);
+void rotate_right_bit_range(bitarray *bit_array, size_t from, size_t to,
+                            size_t n);
+
+// reverse the order of the bits in-place (bit i moves to size - 1 - i)
+void reverse_bits(bitarray *bit_array);
+
+// reverse the order of the bits in range [from, to) in-place
+void reverse_bit_range(bitarray *bit_array, size_t from, size_t to);
+
 // bitwise operations
 
 // perform bitwise AND (&) and write result to a new bitarray
@@ -114,16 +232,63 @@ bitarray* left_shift_bits(bitarray *bit_array, size_t n);
 // (comparable to what you would expect "dest = src" to do)
 void copy_all_bits(bitarray *src, bitarray *dest);
 
-// copy bits in range [from, to] from src to dest
+// copy bits in range [from, to) from src to dest
 // (comparable to what you would expect "dest = src[from:to]" to do)
 void copy_bit_range(bitarray *src, bitarray *dest, size_t from, size_t to);
 
 // appends all bits from src to dest
 void append_all_bits(bitarray *src, bitarray *dest);
 
-// appends bits in range [from, to] from src to dest
+// appends bits in range [from, to) from src to dest
 void append_bit_range(bitarray *src, bitarray *dest, size_t from, size_t to);
 
+// gather the bits of src at the positions set in mask (same size as src)
+// into dest, in order (comparable to pext; dest gets count_bits(mask) bits)
+void extract_bits(bitarray *dest, bitarray *src, bitarray *mask);
+
+// scatter the bits of src, in order, to the positions set in mask and
+// clear the other bits of dest (same size as mask; comparable to pdep;
+// bits past the end of src read as 0)
+void deposit_bits(bitarray *dest, bitarray *src, bitarray *mask);
+
+// summary
+//
+// a bitarray can carry a hierarchical summary of its non-zero elements
+// (level 0: one bit per element, level 1: one bit per element of level 0,
+// and so on up to a single element). every function in this file that
+// modifies the bits keeps it up to date, and next_set_run, find_set_run,
+// count_bits, count_bit_range, test_any_bit_range, clear_bit_range and
+// the in-place AND/OR/XOR follow it to the non-zero elements, skipping
+// empty regions instead of scanning them. bitarrays without a summary
+// pay one (well predicted) NULL check per modifying call
+
+// attach a summary to bit_array (nothing happens if it has one)
+void attach_summary(bitarray *bit_array);
+
+// remove the summary of bit_array (if it has one)
+void detach_summary(bitarray *bit_array);
+
+// count caching
+//
+// a bitarray can also carry the number of its set bits and of the set bits
+// of every block of block_bytes bytes. the modifying functions adjust the
+// counts (single bits by the popcount difference of their element, ranges
+// by the counts of the covered blocks, AND/OR/XOR by recounting each block
+// right after writing it), count_bits returns the total (O(1)) and
+// count_bit_range adds up the counts of the blocks it covers
+
+// cache the counts of bit_array per block_bytes bytes (a power of 2, at
+// least TYPE_SIZE, e.g. 4096; the counts are recomputed if bit_array
+// already has counts for another block size)
+void attach_count(bitarray *bit_array, size_t block_bytes);
+
+// remove the cached counts of bit_array (if it has them)
+void detach_count(bitarray *bit_array);
+
+// recompute the attached structures after bit_array->array was modified
+// without the functions of this file (e.g. by other code or a module)
+void refresh_bitarray(bitarray *bit_array);
+
 // "constructor" functions
 
 // copy bitarray
@@ -144,6 +309,40 @@ bitarray* create_bitarray_from_num(ARRAY_TYPE num);
 // convert bitarray (with max size of BITS_PER_EL bits) to number
 ARRAY_TYPE convert_bitarray_to_num(bitarray* bit_array);
 
+// create bitarray that holds n_bits bits with the bits of intervals[0,
+// n_intervals) set (in any order, overlapping intervals are fine)
+bitarray* create_bitarray_from_intervals(size_t n_bits,
+                                         const bitarray_interval *intervals,
+                                         size_t n_intervals);
+
+// store the runs of set bits in order in intervals[0, max_intervals);
+// returns the number of runs, which is larger than max_intervals if they
+// don't fit (the rest are only counted, so a call with max_intervals 0
+// sizes the buffer)
+size_t convert_bitarray_to_intervals(bitarray *bit_array,
+                                     bitarray_interval *intervals,
+                                     size_t max_intervals);
+
+// create bitarray that uses array (ceil(n_bits / BITS_PER_EL) elements)
+// without copying it; if owned, array must come from malloc and is freed
+// by delete_bitarray, else the caller frees it after delete_bitarray.
+// the bits after n_bits in the last element are cleared. functions that
+// need a larger array (e.g. append_bit_range) move the bits to a new
+// (owned) allocation
+bitarray* wrap_bitarray(ARRAY_TYPE *array, size_t n_bits, bool owned);
+
+// create bitarray from the n_bits bits stored in bytes (n_bytes bytes) in
+// the given order; bytes are used without copying (converted in place if
+// the order isn't the native one) if they are aligned to TYPE_SIZE and
+// cover whole elements, else they are copied (and freed if owned).
+// check b->array == (ARRAY_TYPE*) bytes to find out which happened
+bitarray* wrap_bitarray_bytes(uint8_t *bytes, size_t n_bytes, size_t n_bits,
+                              enum bitarray_bit_order order, bool owned);
+
+// write the bits to bytes (ceil(size / 8) bytes) in the given order
+void copy_bitarray_to_bytes(bitarray *bit_array, uint8_t *bytes,
+                            enum bitarray_bit_order order);
+
 // "destructor" function
 
 // delete bitarray and free allocated memory
@@ -158,6 +357,89 @@ void print_bitarray(bitarray *bit_array);
 char* create_str_from_bitarray(bitarray *bit_array);
 
 // check if bits of left and right are equal (must be same size)
+// (stops at the first difference; bits after size are ignored)
 bool equal_bits(bitarray *left, bitarray *right);
 
+// 64 bit hash of the size and bits (bits after size are ignored), e.g.
+// for hash tables of bitarrays; uses AES rounds with AES-NI and a
+// multiply mixer otherwise, so hashes differ between such builds.
+// not meant to withstand collisions crafted on purpose
+uint64_t hash_bits(bitarray *bit_array, uint64_t seed);
+
+// 128 bit hash (out[0] is the 64 bit hash)
+void hash_bits128(bitarray *bit_array, uint64_t seed, uint64_t out[2]);
+
+// hot-path instrumentation
+//
+// compile with -DBITARRAY_STATS (make stats/stats_shared) to count calls,
+// bits processed, bytes allocated and latencies (in rdtsc ticks) of every
+// function in thread-local counters; without it the counters compile to
+// nothing and the functions below only report zeros.
+// only the outermost call is recorded (e.g. the append_bit_range call
+// made by right_shift_bits is accounted to right_shift_bits)
+
+#define BITARRAY_STAT_FUNCTIONS(X) \
+  X(get_bit) X(set_bit) X(set_bit_range) X(set_all_bits) X(flip_bit) \
+  X(flip_bit_range) X(flip_all_bits) X(count_bits) X(count_bit_range) \
+  X(test_any_bit_range) X(test_all_bit_range) X(find_clear_run) \
+  X(find_set_run) X(longest_clear_run) X(longest_set_run) \
+  X(next_set_run) \
+  X(clear_bit) X(clear_bit_range) X(clear_all_bits) X(set_bits) \
+  X(clear_bits) X(get_bits) X(and_bits_inplace) \
+  X(or_bits_inplace) X(xor_bits_inplace) X(not_bits_inplace) \
+  X(right_shift_bits_inplace) X(left_shift_bits_inplace) X(and_bits) \
+  X(or_bits) X(xor_bits) X(not_bits) X(right_shift_bits) \
+  X(left_shift_bits) X(copy_all_bits) X(copy_bit_range) \
+  X(rotate_left) X(rotate_right) X(rotate_left_bit_range) \
+  X(rotate_right_bit_range) X(reverse_bits) X(reverse_bit_range) \
+  X(append_all_bits) X(append_bit_range) X(extract_bits) \
+  X(deposit_bits) X(copy_bitarray) \
+  X(create_bitarray) X(create_set_bitarray) X(create_bitarray_from_str) \
+  X(create_bitarray_from_num) X(convert_bitarray_to_num) \
+  X(create_bitarray_from_intervals) X(convert_bitarray_to_intervals) \
+  X(wrap_bitarray) X(wrap_bitarray_bytes) X(copy_bitarray_to_bytes) \
+  X(delete_bitarray) X(print_bitarray) X(create_str_from_bitarray) \
+  X(equal_bits) X(hash_bits) X(hash_bits128) \
+  X(attach_summary) X(detach_summary) X(attach_count) X(detach_count) \
+  X(refresh_bitarray)
+
+#define BITARRAY_STAT_ENUM(fn) BITARRAY_STAT_##fn,
+enum bitarray_stat_fn {
+  BITARRAY_STAT_FUNCTIONS(BITARRAY_STAT_ENUM)
+  BITARRAY_STAT_FN_COUNT
+};
+#undef BITARRAY_STAT_ENUM
+
+// latency histogram bucket i counts calls that took [2^i, 2^(i+1)) ticks
+#define BITARRAY_STAT_BUCKETS 40
+
+typedef struct {
+  uint64_t calls;            // number of (outermost) calls
+  uint64_t bits;             // number of bits processed by these calls
+  uint64_t bytes_allocated;  // bytes allocated by these calls
+  uint64_t ticks;            // total latency in rdtsc ticks
+  uint64_t latency_hist[BITARRAY_STAT_BUCKETS];
+} bitarray_fn_stats;
+
+typedef struct {
+  bitarray_fn_stats fn[BITARRAY_STAT_FN_COUNT];
+} bitarray_stats;
+
+// name of the function a bitarray_stat_fn value refers to
+const char* bitarray_stat_name(enum bitarray_stat_fn fn);
+
+// sum the counters of all threads (that ever called a function) into out
+void bitarray_stats_snapshot(bitarray_stats *out);
+
+// reset the counters of all threads
+// (updates of threads that are running concurrently may survive the reset)
+void bitarray_stats_reset(void);
+
+// write a snapshot as one JSON object to out
+void bitarray_stats_dump_json(FILE *out);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
 #endif  // LIBBITARRAY_H_
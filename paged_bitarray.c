@@ -0,0 +1,445 @@
+#include "paged_bitarray.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// pages announced to the kernel ahead of a sequential access
+#define __PAGED_READ_AHEAD 8
+
+#define __PAGED_NONE SIZE_MAX
+
+static inline size_t __paged_page_bits(paged_bitarray *p) {
+  return p->page_bytes * 8;
+}
+
+// a failed read or write of a page would lose data; there is no way to
+// continue
+static void __paged_io(ssize_t done, size_t bytes, const char *what) {
+  if (done != (ssize_t) bytes) {
+    perror(what);
+    abort();
+  }
+}
+
+// page -> frame map
+
+static inline size_t __paged_hash(paged_bitarray *p, size_t page) {
+  return (size_t) (((uint64_t) page * 0x9e3779b97f4a7c15ULL) >>
+                   (64 - p->_map_bits));
+}
+
+static inline size_t __paged_map_find(paged_bitarray *p, size_t page) {
+  size_t mask = ((size_t) 1 << p->_map_bits) - 1;
+  for (size_t i = __paged_hash(p, page); ; i = (i + 1) & mask) {
+    size_t frame = p->_map[i];
+    if (frame == __PAGED_NONE || p->_frames[frame].page == page) return i;
+  }
+}
+
+static inline void __paged_map_remove(paged_bitarray *p, size_t page) {
+  size_t mask = ((size_t) 1 << p->_map_bits) - 1;
+  size_t hole = __paged_map_find(p, page);
+  p->_map[hole] = __PAGED_NONE;
+
+  // move entries after the hole back that can't be found anymore
+  for (size_t i = (hole + 1) & mask; p->_map[i] != __PAGED_NONE;
+       i = (i + 1) & mask) {
+    size_t home = __paged_hash(p, p->_frames[p->_map[i]].page);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      p->_map[hole] = p->_map[i];
+      p->_map[i] = __PAGED_NONE;
+      hole = i;
+    }
+  }
+}
+
+// LRU list
+
+static inline void __paged_unlink(paged_bitarray *p, size_t f) {
+  __paged_frame *frame = &p->_frames[f];
+  if (frame->prev != __PAGED_NONE) {
+    p->_frames[frame->prev].next = frame->next;
+  } else {
+    p->_lru_head = frame->next;
+  }
+  if (frame->next != __PAGED_NONE) {
+    p->_frames[frame->next].prev = frame->prev;
+  } else {
+    p->_lru_tail = frame->prev;
+  }
+}
+
+static inline void __paged_push_front(paged_bitarray *p, size_t f) {
+  __paged_frame *frame = &p->_frames[f];
+  frame->prev = __PAGED_NONE;
+  frame->next = p->_lru_head;
+  if (p->_lru_head != __PAGED_NONE) p->_frames[p->_lru_head].prev = f;
+  p->_lru_head = f;
+  if (p->_lru_tail == __PAGED_NONE) p->_lru_tail = f;
+}
+
+static void __paged_write_back(paged_bitarray *p, __paged_frame *frame) {
+  __paged_io(pwrite(p->_fd, frame->data, p->page_bytes,
+                    (off_t) (frame->page * p->page_bytes)),
+             p->page_bytes, "paged_bitarray write");
+  frame->dirty = false;
+  p->n_writes++;
+}
+
+// tell the kernel to read the pages after page if the accesses are
+// sequential
+static inline void __paged_read_ahead(paged_bitarray *p, size_t page) {
+  if (page == p->_last_page + 1 && page + 1 >= p->_read_ahead &&
+      page + 1 < p->n_pages) {
+    size_t n = p->n_pages - page - 1;
+    if (n > __PAGED_READ_AHEAD) n = __PAGED_READ_AHEAD;
+    posix_fadvise(p->_fd, (off_t) ((page + 1) * p->page_bytes),
+                  (off_t) (n * p->page_bytes), POSIX_FADV_WILLNEED);
+    p->_read_ahead = page + 1 + n;
+  }
+  p->_last_page = page;
+}
+
+// memory of page, cached as the most recently used page; read from the
+// file unless read is false (the caller overwrites the whole page), and
+// marked as modified if write is true
+static ARRAY_TYPE* __paged_get(paged_bitarray *p, size_t page, bool read,
+                               bool write) {
+  assert(page < p->n_pages);
+
+  size_t f = p->_lru_head;
+  if (f == __PAGED_NONE || p->_frames[f].page != page) {
+    __paged_read_ahead(p, page);
+    size_t slot = __paged_map_find(p, page);
+    f = p->_map[slot];
+
+    if (f == __PAGED_NONE) {
+      // miss: use a free frame or evict the least recently used page
+      if (p->_n_used < p->_n_frames) {
+        f = p->_n_used++;
+        p->_frames[f].data = (ARRAY_TYPE*) aligned_alloc(64, p->page_bytes);
+        assert(p->_frames[f].data);
+      } else {
+        f = p->_lru_tail;
+        __paged_frame *old = &p->_frames[f];
+        if (old->dirty) __paged_write_back(p, old);
+        __paged_unlink(p, f);
+        __paged_map_remove(p, old->page);
+        slot = __paged_map_find(p, page);
+      }
+
+      __paged_frame *frame = &p->_frames[f];
+      frame->page = page;
+      frame->dirty = false;
+      if (read) {
+        __paged_io(pread(p->_fd, frame->data, p->page_bytes,
+                         (off_t) (page * p->page_bytes)),
+                   p->page_bytes, "paged_bitarray read");
+        p->n_reads++;
+        if (page == p->n_pages - 1) {
+          // bits past size are unset (the file may have been longer)
+          size_t used = p->size - page * __paged_page_bits(p);
+          bitarray view = {__paged_page_bits(p), p->page_bytes / TYPE_SIZE,
+                           frame->data, true, NULL};
+          clear_bit_range(&view, used, view.size);
+        }
+      }
+      p->_map[slot] = f;
+    } else {
+      __paged_unlink(p, f);
+    }
+    __paged_push_front(p, f);
+  }
+
+  if (write) p->_frames[f].dirty = true;
+  return p->_frames[f].data;
+}
+
+// page as a bitarray of the bits it holds
+static inline bitarray __paged_view(paged_bitarray *p, size_t page,
+                                    ARRAY_TYPE *data) {
+  size_t from = page * __paged_page_bits(p);
+  size_t n_bits = p->size - from;
+  if (n_bits > __paged_page_bits(p)) n_bits = __paged_page_bits(p);
+  bitarray view = {n_bits, p->page_bytes / TYPE_SIZE, data, true, NULL};
+  return view;
+}
+
+paged_bitarray* open_paged_bitarray(const char *path, size_t n_bits,
+                                    size_t page_bytes, size_t cache_bytes) {
+  assert(path);
+  assert(n_bits > 0);
+  assert(page_bytes > 0 && page_bytes % 64 == 0);
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return NULL;
+
+  size_t page_bits = page_bytes * 8;
+  size_t n_pages = (n_bits + page_bits - 1) / page_bits;
+  struct stat st;
+  if (fstat(fd, &st) ||
+      ((size_t) st.st_size < n_pages * page_bytes &&
+       ftruncate(fd, (off_t) (n_pages * page_bytes)))) {
+    close(fd);
+    return NULL;
+  }
+
+  paged_bitarray *p = (paged_bitarray*) calloc(1, sizeof(paged_bitarray));
+  assert(p);
+  p->size = n_bits;
+  p->page_bytes = page_bytes;
+  p->n_pages = n_pages;
+  p->_fd = fd;
+
+  p->_n_frames = cache_bytes / page_bytes;
+  if (p->_n_frames < 1) p->_n_frames = 1;
+  if (p->_n_frames > n_pages) p->_n_frames = n_pages;
+  p->_frames = (__paged_frame*) malloc(p->_n_frames * sizeof(__paged_frame));
+  assert(p->_frames);
+  for (size_t f = 0; f < p->_n_frames; f++) {
+    __paged_frame frame = {__PAGED_NONE, NULL, false, __PAGED_NONE,
+                           __PAGED_NONE};
+    p->_frames[f] = frame;
+  }
+  p->_lru_head = __PAGED_NONE;
+  p->_lru_tail = __PAGED_NONE;
+
+  // at most half full
+  p->_map_bits = 1;
+  while (((size_t) 1 << p->_map_bits) < 2 * p->_n_frames) p->_map_bits++;
+  p->_map = (size_t*) malloc(((size_t) 1 << p->_map_bits) * sizeof(size_t));
+  assert(p->_map);
+  memset(p->_map, 0xff, ((size_t) 1 << p->_map_bits) * sizeof(size_t));
+
+  p->_last_page = __PAGED_NONE;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  return p;
+}
+
+void close_paged_bitarray(paged_bitarray *p) {
+  assert(p);
+
+  paged_flush(p);
+  close(p->_fd);
+  for (size_t f = 0; f < p->_n_used; f++) free(p->_frames[f].data);
+  free(p->_frames);
+  free(p->_map);
+  free(p);
+}
+
+void paged_flush(paged_bitarray *p) {
+  assert(p);
+
+  for (size_t f = 0; f < p->_n_used; f++) {
+    if (p->_frames[f].dirty) __paged_write_back(p, &p->_frames[f]);
+  }
+}
+
+bool paged_get_bit(paged_bitarray *p, size_t idx) {
+  assert(p);
+  assert(idx < p->size);
+
+  size_t page_bits = __paged_page_bits(p);
+  ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, false);
+  idx %= page_bits;
+  return (data[idx / BITS_PER_EL] >> (idx % BITS_PER_EL)) & 1;
+}
+
+void paged_set_bit(paged_bitarray *p, size_t idx) {
+  assert(p);
+  assert(idx < p->size);
+
+  size_t page_bits = __paged_page_bits(p);
+  ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, true);
+  idx %= page_bits;
+  data[idx / BITS_PER_EL] |= (ARRAY_TYPE) 1 << (idx % BITS_PER_EL);
+}
+
+void paged_clear_bit(paged_bitarray *p, size_t idx) {
+  assert(p);
+  assert(idx < p->size);
+
+  size_t page_bits = __paged_page_bits(p);
+  ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, true);
+  idx %= page_bits;
+  data[idx / BITS_PER_EL] &= ~((ARRAY_TYPE) 1 << (idx % BITS_PER_EL));
+}
+
+void paged_flip_bit(paged_bitarray *p, size_t idx) {
+  assert(p);
+  assert(idx < p->size);
+
+  size_t page_bits = __paged_page_bits(p);
+  ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, true);
+  idx %= page_bits;
+  data[idx / BITS_PER_EL] ^= (ARRAY_TYPE) 1 << (idx % BITS_PER_EL);
+}
+
+enum __paged_range_op {
+  __PAGED_SET,
+  __PAGED_CLEAR,
+  __PAGED_FLIP
+};
+
+// apply op to [from, to) page by page; pages that are set or cleared as a
+// whole aren't read
+static void __paged_range(paged_bitarray *p, size_t from, size_t to,
+                          enum __paged_range_op op) {
+  assert(p);
+  assert(from <= to && to <= p->size);
+  if (from == to) return;
+
+  size_t page_bits = __paged_page_bits(p);
+  for (size_t page = from / page_bits; page <= (to - 1) / page_bits;
+       page++) {
+    size_t start = page * page_bits;
+    size_t lo = from > start ? from - start : 0;
+    size_t hi = to - start;
+    size_t page_size = p->size - start;
+    if (page_size > page_bits) page_size = page_bits;
+    if (hi > page_size) hi = page_size;
+    bool whole = lo == 0 && hi == page_size;
+
+    ARRAY_TYPE *data = __paged_get(p, page, !whole || op == __PAGED_FLIP,
+                                   true);
+    bitarray view = __paged_view(p, page, data);
+    if (whole && op != __PAGED_FLIP) {
+      // also initializes the padding of an unread page
+      memset(data, 0, p->page_bytes);
+      if (op == __PAGED_SET) set_all_bits(&view);
+    } else if (op == __PAGED_SET) {
+      set_bit_range(&view, lo, hi);
+    } else if (op == __PAGED_CLEAR) {
+      clear_bit_range(&view, lo, hi);
+    } else {
+      flip_bit_range(&view, lo, hi);
+    }
+  }
+}
+
+void paged_set_bit_range(paged_bitarray *p, size_t from, size_t to) {
+  __paged_range(p, from, to, __PAGED_SET);
+}
+
+void paged_clear_bit_range(paged_bitarray *p, size_t from, size_t to) {
+  __paged_range(p, from, to, __PAGED_CLEAR);
+}
+
+void paged_flip_bit_range(paged_bitarray *p, size_t from, size_t to) {
+  __paged_range(p, from, to, __PAGED_FLIP);
+}
+
+size_t paged_count_bits(paged_bitarray *p) {
+  assert(p);
+
+  return paged_count_bit_range(p, 0, p->size);
+}
+
+size_t paged_count_bit_range(paged_bitarray *p, size_t from, size_t to) {
+  assert(p);
+  assert(from <= to && to <= p->size);
+  if (from == to) return 0;
+
+  size_t page_bits = __paged_page_bits(p);
+  size_t count = 0;
+  for (size_t page = from / page_bits; page <= (to - 1) / page_bits;
+       page++) {
+    size_t start = page * page_bits;
+    bitarray view = __paged_view(p, page, __paged_get(p, page, true, false));
+    size_t lo = from > start ? from - start : 0;
+    size_t hi = to - start < view.size ? to - start : view.size;
+    if (lo == 0 && hi == view.size) {
+      count += count_bits(&view);
+    } else {
+      count += count_bit_range(&view, lo, hi);
+    }
+  }
+  return count;
+}
+
+typedef void (*__paged_binary_op)(bitarray*, bitarray*);
+
+// left = left (op) right, page by page
+static void __paged_binary(paged_bitarray *left, paged_bitarray *right,
+                           __paged_binary_op op) {
+  assert(left && right);
+  assert(left != right && left->_fd != right->_fd);
+  assert(left->size == right->size && left->page_bytes == right->page_bytes);
+
+  for (size_t page = 0; page < left->n_pages; page++) {
+    bitarray r = __paged_view(right, page,
+                              __paged_get(right, page, true, false));
+    bitarray l = __paged_view(left, page,
+                              __paged_get(left, page, true, true));
+    op(&l, &r);
+  }
+}
+
+void paged_and_bits_inplace(paged_bitarray *left, paged_bitarray *right) {
+  __paged_binary(left, right, and_bits_inplace);
+}
+
+void paged_or_bits_inplace(paged_bitarray *left, paged_bitarray *right) {
+  __paged_binary(left, right, or_bits_inplace);
+}
+
+void paged_xor_bits_inplace(paged_bitarray *left, paged_bitarray *right) {
+  __paged_binary(left, right, xor_bits_inplace);
+}
+
+// copy n bits from bit s of src to bit d of dst (other bits of dst are
+// kept)
+static void __paged_copy_bits(ARRAY_TYPE *dst, size_t d,
+                              const ARRAY_TYPE *src, size_t s, size_t n) {
+  while (n) {
+    size_t d_off = d % BITS_PER_EL;
+    size_t s_off = s % BITS_PER_EL;
+    size_t chunk = BITS_PER_EL - d_off;
+    if (chunk > n) chunk = n;
+
+    ARRAY_TYPE v = src[s / BITS_PER_EL] >> s_off;
+    if (s_off + chunk > BITS_PER_EL) {
+      v |= src[s / BITS_PER_EL + 1] << (BITS_PER_EL - s_off);
+    }
+    ARRAY_TYPE mask = chunk == BITS_PER_EL ? ARRAY_TYPE_MAX
+                                           : ((ARRAY_TYPE) 1 << chunk) - 1;
+    dst[d / BITS_PER_EL] = (dst[d / BITS_PER_EL] & ~(mask << d_off)) |
+                           ((v & mask) << d_off);
+    d += chunk;
+    s += chunk;
+    n -= chunk;
+  }
+}
+
+void paged_copy_to_bitarray(paged_bitarray *p, size_t from, bitarray *dest) {
+  assert(p && dest);
+  assert(from <= p->size && dest->size <= p->size - from);
+
+  size_t page_bits = __paged_page_bits(p);
+  for (size_t done = 0; done < dest->size; ) {
+    size_t idx = from + done;
+    size_t n = page_bits - idx % page_bits;
+    if (n > dest->size - done) n = dest->size - done;
+    ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, false);
+    __paged_copy_bits(dest->array, done, data, idx % page_bits, n);
+    done += n;
+  }
+}
+
+void paged_copy_from_bitarray(paged_bitarray *p, size_t from,
+                              bitarray *src) {
+  assert(p && src);
+  assert(from <= p->size && src->size <= p->size - from);
+
+  size_t page_bits = __paged_page_bits(p);
+  for (size_t done = 0; done < src->size; ) {
+    size_t idx = from + done;
+    size_t n = page_bits - idx % page_bits;
+    if (n > src->size - done) n = src->size - done;
+    ARRAY_TYPE *data = __paged_get(p, idx / page_bits, true, true);
+    __paged_copy_bits(data, idx % page_bits, src->array, done, n);
+    done += n;
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef PAGED_BITARRAY_H_
+#define PAGED_BITARRAY_H_
+
+// bitarray backed by a file, for arrays larger than memory
+//
+// the file holds the bits in the bitarray layout (bit i is bit i % 64 of
+// element i / 64), padded to whole pages of page_bytes bytes. at most
+// cache_bytes of pages are kept in memory: pages are read on first access,
+// the least recently used page is evicted when the cache is full and
+// written back if it was modified. the range, count and boolean functions
+// work page by page with the bitarray functions, and sequential access
+// (page after page) makes the kernel read the following pages ahead.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t page;       // page held (SIZE_MAX: none)
+  ARRAY_TYPE *data;  // page_bytes bytes
+  bool dirty;        // modified since it was read
+  size_t prev;       // neighbors in the LRU list (SIZE_MAX: none)
+  size_t next;
+} __paged_frame;
+
+typedef struct {
+  size_t size;              // number of bits
+  size_t page_bytes;        // bytes per page (a multiple of 64)
+  size_t n_pages;           // pages of the file
+  size_t n_reads;           // pages read from the file so far
+  size_t n_writes;          // pages written back so far
+  int _fd;
+  size_t _n_frames;         // pages the cache has room for
+  size_t _n_used;           // frames that hold a page
+  __paged_frame *_frames;
+  size_t _lru_head;         // most recently used frame
+  size_t _lru_tail;         // least recently used frame
+  size_t *_map;             // page -> frame (SIZE_MAX: empty slot)
+  unsigned _map_bits;       // log2 of the map's capacity
+  size_t _last_page;        // page of the previous access
+  size_t _read_ahead;       // pages announced to the kernel up to here
+} paged_bitarray;
+
+// open the file at path (created if it doesn't exist) as a bitarray of
+// n_bits bits that caches at most cache_bytes (at least one page) of pages
+// of page_bytes bytes; the file is extended to whole pages with unset
+// bits if it is shorter; NULL if the file can't be opened or extended
+paged_bitarray* open_paged_bitarray(const char *path, size_t n_bits,
+                                    size_t page_bytes, size_t cache_bytes);
+
+// write back modified pages and close the file and free allocated memory
+void close_paged_bitarray(paged_bitarray *p);
+
+// write back modified pages (they stay cached)
+void paged_flush(paged_bitarray *p);
+
+// get bit at position idx
+bool paged_get_bit(paged_bitarray *p, size_t idx);
+
+// set bit at position idx
+void paged_set_bit(paged_bitarray *p, size_t idx);
+
+// clear bit at position idx
+void paged_clear_bit(paged_bitarray *p, size_t idx);
+
+// flip bit at position idx
+void paged_flip_bit(paged_bitarray *p, size_t idx);
+
+// set bits in range [from, to)
+void paged_set_bit_range(paged_bitarray *p, size_t from, size_t to);
+
+// clear bits in range [from, to)
+void paged_clear_bit_range(paged_bitarray *p, size_t from, size_t to);
+
+// flip bits in range [from, to)
+void paged_flip_bit_range(paged_bitarray *p, size_t from, size_t to);
+
+// count set bits
+size_t paged_count_bits(paged_bitarray *p);
+
+// count set bits in range [from, to)
+size_t paged_count_bit_range(paged_bitarray *p, size_t from, size_t to);
+
+// left = left (op) right (same size and page size, different files)
+void paged_and_bits_inplace(paged_bitarray *left, paged_bitarray *right);
+void paged_or_bits_inplace(paged_bitarray *left, paged_bitarray *right);
+void paged_xor_bits_inplace(paged_bitarray *left, paged_bitarray *right);
+
+// copy bits [from, from + dest->size) into bitarray dest
+void paged_copy_to_bitarray(paged_bitarray *p, size_t from, bitarray *dest);
+
+// copy all bits of bitarray src to [from, from + src->size)
+void paged_copy_from_bitarray(paged_bitarray *p, size_t from, bitarray *src);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // PAGED_BITARRAY_H_
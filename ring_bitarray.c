@@ -0,0 +1,189 @@
+#include "ring_bitarray.h"
+
+// number of set bits at positions [from, to) of a window whose element e
+// is words[e * stride]
+static size_t __ring_count(const ARRAY_TYPE *words, size_t stride,
+                           size_t from, size_t to) {
+  if (from >= to) return 0;
+
+  size_t first = from / BITS_PER_EL;
+  size_t last = (to - 1) / BITS_PER_EL;
+  ARRAY_TYPE first_mask = ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+  ARRAY_TYPE last_mask = ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 -
+                                            (to - 1) % BITS_PER_EL);
+  if (first == last) {
+    return pop_count(words[first * stride] & first_mask & last_mask);
+  }
+
+  size_t count = pop_count(words[first * stride] & first_mask) +
+                 pop_count(words[last * stride] & last_mask);
+  for (size_t e = first + 1; e < last; e++) {
+    count += pop_count(words[e * stride]);
+  }
+  return count;
+}
+
+// number of set bits among the len bits from position from on, wrapping
+// around at window
+static size_t __ring_count_wrapped(const ARRAY_TYPE *words, size_t stride,
+                                   size_t window, size_t from, size_t len) {
+  if (from + len <= window) {
+    return __ring_count(words, stride, from, from + len);
+  }
+  return __ring_count(words, stride, from, window) +
+         __ring_count(words, stride, 0, from + len - window);
+}
+
+// number of set bits among the last m bits of a window with the given
+// head and count; the shorter one of the last m and the oldest
+// window - m bits is counted
+static size_t __ring_count_last(const ARRAY_TYPE *words, size_t stride,
+                                size_t window, size_t head, size_t count,
+                                size_t m) {
+  assert(m <= window);
+
+  if (2 * m <= window) {
+    return __ring_count_wrapped(words, stride, window,
+                                (head + window - m) % window, m);
+  }
+  return count - __ring_count_wrapped(words, stride, window, head,
+                                      window - m);
+}
+
+ring_bitarray* create_ring_bitarray(size_t window) {
+  assert(window > 0);
+
+  ring_bitarray *r = (ring_bitarray*) malloc(sizeof(ring_bitarray));
+  assert(r);
+  r->window = window;
+  r->head = 0;
+  r->count = 0;
+  r->bits = create_bitarray(window);
+  return r;
+}
+
+void delete_ring_bitarray(ring_bitarray *r) {
+  assert(r);
+
+  delete_bitarray(r->bits);
+  free(r);
+}
+
+bool ring_push_bit(ring_bitarray *r, bool bit) {
+  assert(r);
+
+  ARRAY_TYPE *el = &r->bits->array[r->head / BITS_PER_EL];
+  unsigned shift = r->head % BITS_PER_EL;
+  bool old = (*el >> shift) & 1;
+  *el ^= (ARRAY_TYPE) (old ^ bit) << shift;
+  r->count += bit;
+  r->count -= old;
+  if (++r->head == r->window) r->head = 0;
+  return old;
+}
+
+bool ring_get_bit(ring_bitarray *r, size_t age) {
+  assert(r);
+  assert(age < r->window);
+
+  size_t pos = (r->head + r->window - 1 - age) % r->window;
+  return (r->bits->array[pos / BITS_PER_EL] >> (pos % BITS_PER_EL)) & 1;
+}
+
+size_t ring_count_last(ring_bitarray *r, size_t m) {
+  assert(r);
+
+  return __ring_count_last(r->bits->array, 1, r->window, r->head, r->count,
+                           m);
+}
+
+ring_set* create_ring_set(size_t n_windows, size_t window) {
+  assert(n_windows > 0);
+  assert(window > 0 && window <= UINT32_MAX);
+
+  ring_set *rs = (ring_set*) malloc(sizeof(ring_set));
+  assert(rs);
+  rs->n_windows = n_windows;
+  rs->window = window;
+  rs->head = 0;
+  rs->_n_els = (window + BITS_PER_EL - 1) / BITS_PER_EL;
+  rs->counts = (uint32_t*) calloc(n_windows, sizeof(uint32_t));
+  rs->_words = (ARRAY_TYPE*) calloc(rs->_n_els * n_windows, TYPE_SIZE);
+  assert(rs->counts && rs->_words);
+  return rs;
+}
+
+void delete_ring_set(ring_set *rs) {
+  assert(rs);
+
+  free(rs->counts);
+  free(rs->_words);
+  free(rs);
+}
+
+// the row of the elements at head: the new bits are xored in where they
+// differ from the oldest ones, and the counts go up (down) by one where a
+// set (unset) bit replaces an unset (set) one
+void ring_set_push(ring_set *rs, bitarray *events) {
+  assert(rs);
+  assert(!events || events->size == rs->n_windows);
+
+  size_t n = rs->n_windows;
+  ARRAY_TYPE *row = rs->_words + (rs->head / BITS_PER_EL) * n;
+  unsigned shift = rs->head % BITS_PER_EL;
+  uint32_t *counts = rs->counts;
+  size_t k = 0;
+
+#if defined(__BITARRAY_AVX512)
+  __m512i bit = _mm512_set1_epi64((long long) (MASK_1 << shift));
+  __m512i one = _mm512_set1_epi32(1);
+  for (; k + 16 <= n; k += 16) {
+    __mmask16 now = events ? (__mmask16) (events->array[k / BITS_PER_EL] >>
+                                          (k % BITS_PER_EL))
+                           : 0;
+    __m512i lo = _mm512_loadu_si512((const void*) (row + k));
+    __m512i hi = _mm512_loadu_si512((const void*) (row + k + 8));
+    __mmask16 old = (__mmask16) (_mm512_test_epi64_mask(lo, bit) |
+                                 (_mm512_test_epi64_mask(hi, bit) << 8));
+    __mmask16 flip = old ^ now;
+    if (!flip) continue;
+
+    lo = _mm512_mask_xor_epi64(lo, (__mmask8) flip, lo, bit);
+    hi = _mm512_mask_xor_epi64(hi, (__mmask8) (flip >> 8), hi, bit);
+    _mm512_storeu_si512((void*) (row + k), lo);
+    _mm512_storeu_si512((void*) (row + k + 8), hi);
+    __m512i c = _mm512_loadu_si512((const void*) (counts + k));
+    c = _mm512_mask_add_epi32(c, now & flip, c, one);
+    c = _mm512_mask_sub_epi32(c, old & flip, c, one);
+    _mm512_storeu_si512((void*) (counts + k), c);
+  }
+#endif
+
+  for (; k < n; k++) {
+    ARRAY_TYPE now = events ? (events->array[k / BITS_PER_EL] >>
+                               (k % BITS_PER_EL)) & 1
+                            : 0;
+    ARRAY_TYPE old = (row[k] >> shift) & 1;
+    row[k] ^= (old ^ now) << shift;
+    counts[k] += (uint32_t) now - (uint32_t) old;
+  }
+
+  if (++rs->head == rs->window) rs->head = 0;
+}
+
+bool ring_set_get_bit(ring_set *rs, size_t k, size_t age) {
+  assert(rs);
+  assert(k < rs->n_windows && age < rs->window);
+
+  size_t pos = (rs->head + rs->window - 1 - age) % rs->window;
+  ARRAY_TYPE el = rs->_words[(pos / BITS_PER_EL) * rs->n_windows + k];
+  return (el >> (pos % BITS_PER_EL)) & 1;
+}
+
+size_t ring_set_count_last(ring_set *rs, size_t k, size_t m) {
+  assert(rs);
+  assert(k < rs->n_windows);
+
+  return __ring_count_last(rs->_words + k, rs->n_windows, rs->window,
+                           rs->head, rs->counts[k], m);
+}
@@ -0,0 +1,81 @@
+#ifndef RING_BITARRAY_H_
+#define RING_BITARRAY_H_
+
+// sliding windows of the last `window` pushed bits (e.g. "event seen in
+// each of the last N ticks" for rate limiting)
+//
+// a ring_bitarray is a circular bitarray: a push overwrites the oldest bit
+// in place and adjusts a running popcount, so it's O(1), and the number of
+// set bits among the last m pushes is counted over at most two ranges of
+// whole elements with masks at the ends. a ring_set holds n_windows such
+// windows that advance together (one push per tick for every key): element
+// e of all windows is stored contiguously, so a tick updates one
+// contiguous row of n_windows elements and the counts (16 windows per
+// step with AVX-512).
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t window;     // number of bits kept
+  size_t head;       // position the next bit is written to (the newest
+                     // bit is at head - 1, wrapping around)
+  size_t count;      // number of set bits in the window
+  bitarray *bits;    // the window (window bits)
+} ring_bitarray;
+
+typedef struct {
+  size_t n_windows;
+  size_t window;         // number of bits kept per window
+  size_t head;           // position the next bits are written to
+  uint32_t *counts;      // number of set bits in each window
+  ARRAY_TYPE *_words;    // element e of window k at _words[e * n_windows
+                         // + k]
+  size_t _n_els;         // elements per window
+} ring_set;
+
+// create window of the last window bits (all unset/false at first)
+ring_bitarray* create_ring_bitarray(size_t window);
+
+// delete ring bitarray and free allocated memory
+void delete_ring_bitarray(ring_bitarray *r);
+
+// push bit as the newest bit and return the oldest one it replaces
+bool ring_push_bit(ring_bitarray *r, bool bit);
+
+// get the bit pushed age pushes ago (0: the newest bit)
+bool ring_get_bit(ring_bitarray *r, size_t age);
+
+// number of set bits among the last m pushed bits (m <= window)
+size_t ring_count_last(ring_bitarray *r, size_t m);
+
+// create n_windows windows of the last window bits (all unset/false at
+// first, window < 2^32)
+ring_set* create_ring_set(size_t n_windows, size_t window);
+
+// delete ring set and free allocated memory
+void delete_ring_set(ring_set *rs);
+
+// push bit k of events (n_windows bits) into window k for every k, or an
+// unset bit into every window if events is NULL
+void ring_set_push(ring_set *rs, bitarray *events);
+
+// get the bit pushed into window k age pushes ago (0: the newest bit)
+bool ring_set_get_bit(ring_set *rs, size_t k, size_t age);
+
+// number of set bits among the last m bits pushed into window k
+// (m <= window)
+size_t ring_set_count_last(ring_set *rs, size_t k, size_t m);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RING_BITARRAY_H_
@@ -0,0 +1,226 @@
+// (memfd_create)
+#define _GNU_SOURCE
+#include "shm_bitarray.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// "BITARSHM"; written last by the creator, so attaching processes never
+// see a half initialized header
+#define __SHM_MAGIC 0x4d48535241544942ULL
+
+// bytes before the elements (a cache line)
+#define __SHM_HEADER 64
+
+typedef struct {
+  uint64_t magic;
+  uint64_t size;        // number of bits
+  uint64_t array_size;  // number of elements
+} __shm_header;
+
+static inline size_t __shm_region_bytes(size_t array_size) {
+  return __SHM_HEADER + array_size * TYPE_SIZE;
+}
+
+// map the region behind fd (closed on failure) and check its header
+static shm_bitarray* __shm_map(int fd, bool writable) {
+  struct stat st;
+  if (fstat(fd, &st) || (size_t) st.st_size < __SHM_HEADER) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t bytes = st.st_size;
+  void *region = mmap(NULL, bytes, writable ? PROT_READ | PROT_WRITE
+                                            : PROT_READ,
+                      MAP_SHARED, fd, 0);
+  if (region == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  __shm_header *h = (__shm_header*) region;
+  if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != __SHM_MAGIC ||
+      h->array_size != (h->size + BITS_PER_EL - 1) / BITS_PER_EL ||
+      __shm_region_bytes(h->array_size) > bytes) {
+    munmap(region, bytes);
+    close(fd);
+    return NULL;
+  }
+
+  shm_bitarray *s = (shm_bitarray*) malloc(sizeof(shm_bitarray));
+  assert(s);
+  bitarray bits = {h->size, h->array_size,
+                   (ARRAY_TYPE*) ((char*) region + __SHM_HEADER), true, NULL};
+  s->bits = bits;
+  s->writable = writable;
+  s->fd = fd;
+  s->_region = region;
+  s->_region_bytes = bytes;
+  return s;
+}
+
+// create a region of n_bits bits; the header is published (magic stored)
+// only after src's bits (if any) are copied
+static shm_bitarray* __shm_create(const char *name, size_t n_bits,
+                                  bitarray *src) {
+  assert(n_bits > 0);
+
+  int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)
+                : memfd_create("bitarray", MFD_CLOEXEC);
+  if (fd < 0) return NULL;
+
+  size_t array_size = (n_bits + BITS_PER_EL - 1) / BITS_PER_EL;
+  size_t bytes = __shm_region_bytes(array_size);
+  void *region = MAP_FAILED;
+  if (!ftruncate(fd, (off_t) bytes)) {
+    region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (region == MAP_FAILED) {
+    close(fd);
+    if (name) shm_unlink(name);
+    return NULL;
+  }
+
+  // (the region starts zeroed)
+  __shm_header *h = (__shm_header*) region;
+  h->size = n_bits;
+  h->array_size = array_size;
+  ARRAY_TYPE *array = (ARRAY_TYPE*) ((char*) region + __SHM_HEADER);
+  if (src) {
+    memcpy(array, src->array, array_size * TYPE_SIZE);
+    if (n_bits % BITS_PER_EL) {
+      array[array_size - 1] &= (MASK_1 << (n_bits % BITS_PER_EL)) - 1;
+    }
+  }
+  __atomic_store_n(&h->magic, __SHM_MAGIC, __ATOMIC_RELEASE);
+
+  shm_bitarray *s = (shm_bitarray*) malloc(sizeof(shm_bitarray));
+  assert(s);
+  bitarray bits = {n_bits, array_size, array, true, NULL};
+  s->bits = bits;
+  s->writable = true;
+  s->fd = fd;
+  s->_region = region;
+  s->_region_bytes = bytes;
+  return s;
+}
+
+shm_bitarray* create_shm_bitarray(const char *name, size_t n_bits) {
+  return __shm_create(name, n_bits, NULL);
+}
+
+shm_bitarray* create_shm_bitarray_from_bitarray(const char *name,
+                                                bitarray *bit_array) {
+  assert(bit_array);
+
+  return __shm_create(name, bit_array->size, bit_array);
+}
+
+shm_bitarray* attach_shm_bitarray(const char *name, bool writable) {
+  assert(name);
+
+  int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  return __shm_map(fd, writable);
+}
+
+shm_bitarray* attach_shm_bitarray_fd(int fd, bool writable) {
+  int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd < 0) return NULL;
+  return __shm_map(dup_fd, writable);
+}
+
+void detach_shm_bitarray(shm_bitarray *s) {
+  assert(s);
+
+  munmap(s->_region, s->_region_bytes);
+  close(s->fd);
+  free(s);
+}
+
+bool unlink_shm_bitarray(const char *name) {
+  assert(name);
+
+  return shm_unlink(name) == 0;
+}
+
+static inline ARRAY_TYPE* __shm_el(shm_bitarray *s, size_t idx) {
+  assert(s);
+  assert(idx < s->bits.size);
+
+  return &s->bits.array[idx / BITS_PER_EL];
+}
+
+static inline ARRAY_TYPE __shm_bit(size_t idx) {
+  return MASK_1 << (idx % BITS_PER_EL);
+}
+
+bool shm_get_bit(shm_bitarray *s, size_t idx) {
+  return (__atomic_load_n(__shm_el(s, idx), __ATOMIC_RELAXED) >>
+          (idx % BITS_PER_EL)) & 1;
+}
+
+void shm_set_bit(shm_bitarray *s, size_t idx) {
+  assert(s && s->writable);
+
+  __atomic_fetch_or(__shm_el(s, idx), __shm_bit(idx), __ATOMIC_RELAXED);
+}
+
+void shm_clear_bit(shm_bitarray *s, size_t idx) {
+  assert(s && s->writable);
+
+  __atomic_fetch_and(__shm_el(s, idx), ~__shm_bit(idx), __ATOMIC_RELAXED);
+}
+
+void shm_flip_bit(shm_bitarray *s, size_t idx) {
+  assert(s && s->writable);
+
+  __atomic_fetch_xor(__shm_el(s, idx), __shm_bit(idx), __ATOMIC_RELAXED);
+}
+
+bool shm_test_and_set_bit(shm_bitarray *s, size_t idx) {
+  assert(s && s->writable);
+
+  ARRAY_TYPE old = __atomic_fetch_or(__shm_el(s, idx), __shm_bit(idx),
+                                     __ATOMIC_RELAXED);
+  return (old >> (idx % BITS_PER_EL)) & 1;
+}
+
+// set (or clear) [from, to): partially covered elements with an atomic
+// or (and), fully covered ones with atomic stores
+static void __shm_range(shm_bitarray *s, size_t from, size_t to, bool set) {
+  assert(s && s->writable);
+  assert(from <= to && to <= s->bits.size);
+  if (from == to) return;
+
+  ARRAY_TYPE *array = s->bits.array;
+  size_t first = from / BITS_PER_EL;
+  size_t last = (to - 1) / BITS_PER_EL;
+  ARRAY_TYPE first_mask = ARRAY_TYPE_MAX << (from % BITS_PER_EL);
+  ARRAY_TYPE last_mask = ARRAY_TYPE_MAX >> (BITS_PER_EL - 1 -
+                                            (to - 1) % BITS_PER_EL);
+  if (first == last) first_mask &= last_mask;
+
+  ARRAY_TYPE fill = set ? ARRAY_TYPE_MAX : 0;
+  for (size_t i = first; i <= last; i++) {
+    ARRAY_TYPE mask = i == first ? first_mask
+                      : i == last ? last_mask : ARRAY_TYPE_MAX;
+    if (mask == ARRAY_TYPE_MAX) {
+      __atomic_store_n(&array[i], fill, __ATOMIC_RELAXED);
+    } else if (set) {
+      __atomic_fetch_or(&array[i], mask, __ATOMIC_RELAXED);
+    } else {
+      __atomic_fetch_and(&array[i], ~mask, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void shm_set_bit_range(shm_bitarray *s, size_t from, size_t to) {
+  __shm_range(s, from, to, true);
+}
+
+void shm_clear_bit_range(shm_bitarray *s, size_t from, size_t to) {
+  __shm_range(s, from, to, false);
+}
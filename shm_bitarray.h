@@ -0,0 +1,88 @@
+#ifndef SHM_BITARRAY_H_
+#define SHM_BITARRAY_H_
+
+// bitarray in POSIX shared memory, shared between processes without
+// copying (e.g. one read-mostly array for all workers of a pre-fork server)
+//
+// the region (a named shm_open object or an anonymous memfd) starts with a
+// 64 byte header (magic, number of bits, number of elements) and holds the
+// elements from byte 64 on, so every process that maps it finds the bits
+// at the same offset. each process gets its own shm_bitarray whose bits
+// point into its mapping: readers use the bitarray functions on &s->bits,
+// writers that run concurrently with other processes use the shm_*
+// functions, which update whole elements atomically.
+// (include bitarray.h before this header if you use the header-only
+// version of the library)
+
+#ifndef BITARRAY_H_
+#include "libbitarray.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  bitarray bits;          // the shared bits (the array is the mapping's)
+  bool writable;          // mapped writable (else writes fault)
+  int fd;                 // shm_open/memfd file descriptor
+  void *_region;          // the mapping
+  size_t _region_bytes;
+} shm_bitarray;
+
+// create shared region name (for shm_open, e.g. "/workers_filter"; fails
+// if it exists) holding n_bits bits (all unset/false), or an anonymous
+// memfd region if name is NULL (shared with processes forked afterwards
+// and with processes s->fd is passed to); mapped writable; NULL if the
+// region can't be created
+shm_bitarray* create_shm_bitarray(const char *name, size_t n_bits);
+
+// create shared region name (see create_shm_bitarray) holding a copy of
+// bit_array
+shm_bitarray* create_shm_bitarray_from_bitarray(const char *name,
+                                                bitarray *bit_array);
+
+// map the existing region name read-only or writable; NULL if it doesn't
+// exist, isn't a bitarray region or isn't initialized yet
+shm_bitarray* attach_shm_bitarray(const char *name, bool writable);
+
+// map the region behind file descriptor fd (which is duplicated, the
+// caller keeps fd); NULL as for attach_shm_bitarray
+shm_bitarray* attach_shm_bitarray_fd(int fd, bool writable);
+
+// unmap the region and free allocated memory (the region itself stays
+// until it is unlinked (named) or its last descriptor is closed (memfd))
+void detach_shm_bitarray(shm_bitarray *s);
+
+// remove the name of shared region name (processes that have it mapped
+// keep using it); false if there is no such region
+bool unlink_shm_bitarray(const char *name);
+
+// get bit at position idx (atomic load of its element)
+bool shm_get_bit(shm_bitarray *s, size_t idx);
+
+// set bit at position idx (atomic)
+void shm_set_bit(shm_bitarray *s, size_t idx);
+
+// clear bit at position idx (atomic)
+void shm_clear_bit(shm_bitarray *s, size_t idx);
+
+// flip bit at position idx (atomic)
+void shm_flip_bit(shm_bitarray *s, size_t idx);
+
+// set bit at position idx and return its previous value (atomic, so only
+// one of several processes setting the same bit gets false)
+bool shm_test_and_set_bit(shm_bitarray *s, size_t idx);
+
+// set bits in range [from, to) (every element is updated atomically, the
+// range as a whole isn't)
+void shm_set_bit_range(shm_bitarray *s, size_t from, size_t to);
+
+// clear bits in range [from, to) (see shm_set_bit_range)
+void shm_clear_bit_range(shm_bitarray *s, size_t from, size_t to);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // SHM_BITARRAY_H_